@@ -0,0 +1,541 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+// Compiler throughput benchmark.
+//
+// Generates synthetic Tron sources of a given shape and scale, then runs the
+// lexer, the parser, the LLVM IR builder and the object emitter over them
+// separately, reporting latency percentiles, throughput and the heap growth
+// of each phase. The parser pulls tokens from its own lexer, so the parse
+// phase includes lexing. Results can be stored as a baseline and later
+// checked against it with a regression threshold.
+//
+// Usage:
+//   compile_bench [-n reps] [-t threshold] [-s max_scale] [--save file | --check file]
+//   compile_bench --emit <shape> <scale>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include "../src/parser.h"
+#include "../src/simplify.h"
+#include "../src/specialize.h"
+#include "../src/llvm.h"
+
+#define MAX_SAMPLES 1024
+#define MAX_BASELINES 256
+
+typedef enum Shape
+{
+    SHAPE_FUNCTIONS,
+    SHAPE_IF_CHAIN,
+    SHAPE_EXPRESSION,
+    SHAPE_STATEMENTS,
+    SHAPE_GLOBALS
+} Shape;
+
+static char *SHAPE_NAMES[] = {"functions", "if_chain", "expression", "statements", "globals"};
+
+typedef enum Phase
+{
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_CODEGEN,
+    PHASE_EMIT
+} Phase;
+
+static char *PHASE_NAMES[] = {"lex", "parse", "codegen", "emit"};
+
+#define NUM_SHAPES (sizeof(SHAPE_NAMES) / sizeof(SHAPE_NAMES[0]))
+#define NUM_PHASES (sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]))
+
+static int SCALES[] = {100, 1000, 5000};
+
+#define NUM_SCALES (sizeof(SCALES) / sizeof(SCALES[0]))
+
+typedef struct Source
+{
+    char *buffer;
+    size_t size;
+    int lines;
+} Source;
+
+typedef struct PhaseResult
+{
+    double samples[MAX_SAMPLES];
+    int count;
+    long memory;
+} PhaseResult;
+
+typedef struct Baseline
+{
+    char shape[32];
+    int scale;
+    char phase[32];
+    double p50;
+} Baseline;
+
+void generate_functions(FILE *out, int scale)
+{
+    for (int i = 0; i < scale; i++)
+    {
+        fprintf(out, "func fn%d(a: int, b: int): int {\n", i);
+        fprintf(out, "    var c = a * %d + b;\n", i + 1);
+        fprintf(out, "    if (c > %d) {\n", i);
+        fprintf(out, "        return c - 1;\n");
+        fprintf(out, "    }\n");
+        fprintf(out, "    return c;\n");
+        fprintf(out, "}\n\n");
+    }
+    fprintf(out, "func main() {\n");
+    fprintf(out, "    var acc = 0;\n");
+    for (int i = 0; i < scale; i++)
+    {
+        fprintf(out, "    acc = acc + fn%d(acc, %d);\n", i, i);
+    }
+    fprintf(out, "    print_int(acc);\n");
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+}
+
+void generate_if_chain(FILE *out, int scale)
+{
+    fprintf(out, "func classify(n: int): int {\n");
+    fprintf(out, "    var r = 0;\n");
+    for (int i = 0; i < scale; i++)
+    {
+        fprintf(out, "    %sif (n == %d) {\n", i == 0 ? "" : "} else ", i);
+        fprintf(out, "        r = n * %d + %d;\n", i % 7 + 1, i);
+    }
+    fprintf(out, "    } else {\n");
+    fprintf(out, "        r = n;\n");
+    fprintf(out, "    }\n");
+    fprintf(out, "    return r;\n");
+    fprintf(out, "}\n\n");
+    fprintf(out, "func main() {\n");
+    fprintf(out, "    print_int(classify(%d));\n", scale / 2);
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+}
+
+void generate_expression(FILE *out, int scale)
+{
+    static char *ops[] = {"+", "*", "-", "&", "+", "|", "^", "-"};
+
+    fprintf(out, "func compute(a: int, b: int): int {\n");
+    fprintf(out, "    var x = a");
+    for (int i = 0; i < scale; i++)
+    {
+        fprintf(out, " %s %s", ops[i % 8], i % 3 == 0 ? "b" : (i % 3 == 1 ? "a" : "3"));
+        if (i % 16 == 15)
+        {
+            fprintf(out, "\n        ");
+        }
+    }
+    fprintf(out, ";\n");
+    fprintf(out, "    return x;\n");
+    fprintf(out, "}\n\n");
+    fprintf(out, "func main() {\n");
+    fprintf(out, "    print_int(compute(3, 4));\n");
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+}
+
+void generate_statements(FILE *out, int scale)
+{
+    fprintf(out, "func main() {\n");
+    fprintf(out, "    var x = 1;\n");
+    for (int i = 0; i < scale; i++)
+    {
+        if (i % 2 == 0)
+        {
+            fprintf(out, "    var v%d = x * %d;\n", i, i % 13 + 1);
+        }
+        else
+        {
+            fprintf(out, "    x = x + v%d;\n", i - 1);
+        }
+    }
+    fprintf(out, "    print_int(x);\n");
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+}
+
+void generate_globals(FILE *out, int scale)
+{
+    for (int i = 0; i < scale; i++)
+    {
+        if (i % 4 == 3)
+        {
+            fprintf(out, "var g%d: float = %d.5;\n", i, i);
+        }
+        else
+        {
+            fprintf(out, "var g%d = %d;\n", i, i);
+        }
+    }
+    int last = scale - 1;
+    if (last % 4 == 3)
+    {
+        last--;
+    }
+    fprintf(out, "\nfunc main() {\n");
+    fprintf(out, "    print_int(g0 + g%d);\n", last);
+    fprintf(out, "    return 0;\n");
+    fprintf(out, "}\n");
+}
+
+void generate(FILE *out, Shape shape, int scale)
+{
+    switch (shape)
+    {
+    case SHAPE_FUNCTIONS:
+        generate_functions(out, scale);
+        break;
+    case SHAPE_IF_CHAIN:
+        generate_if_chain(out, scale);
+        break;
+    case SHAPE_EXPRESSION:
+        generate_expression(out, scale);
+        break;
+    case SHAPE_STATEMENTS:
+        generate_statements(out, scale);
+        break;
+    case SHAPE_GLOBALS:
+        generate_globals(out, scale);
+        break;
+    }
+}
+
+Source *new_source(Shape shape, int scale)
+{
+    Source *source = malloc(sizeof(Source));
+    FILE *out = open_memstream(&source->buffer, &source->size);
+    generate(out, shape, scale);
+    fclose(out);
+
+    source->lines = 0;
+    for (size_t i = 0; i < source->size; i++)
+    {
+        if (source->buffer[i] == '\n')
+        {
+            source->lines++;
+        }
+    }
+    return source;
+}
+
+void dispose_source(Source *source)
+{
+    free(source->buffer);
+    free(source);
+}
+
+int find_shape(char *name)
+{
+    for (int i = 0; i < NUM_SHAPES; i++)
+    {
+        if (strcmp(SHAPE_NAMES[i], name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+double now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+long heap_in_use()
+{
+    struct mallinfo2 info = mallinfo2();
+    return (long)info.uordblks + (long)info.hblkhd;
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(double *)a;
+    double y = *(double *)b;
+    return (x > y) - (x < y);
+}
+
+double percentile(PhaseResult *result, double p)
+{
+    double sorted[MAX_SAMPLES];
+    memcpy(sorted, result->samples, result->count * sizeof(double));
+    qsort(sorted, result->count, sizeof(double), compare_doubles);
+    int index = (int)(p * (result->count - 1) + 0.5);
+    return sorted[index];
+}
+
+int lex_all(Source *source)
+{
+    FILE *file = fmemopen(source->buffer, source->size, "r");
+    Lexer *l = new_lexer(file);
+    int tokens = 0;
+    while (1)
+    {
+        Token *token = lex(l);
+        TokenType token_type = token->token_type;
+        dispose_token(token);
+        if (token_type == T_EOF)
+        {
+            break;
+        }
+        if (token_type != T_SPACE && token_type != T_COMMENT)
+        {
+            tokens++;
+        }
+    }
+    dispose_lexer(l);
+    fclose(file);
+    return tokens;
+}
+
+int run_once(Source *source, PhaseResult *results, Options *options, char *object_path)
+{
+    long heap = heap_in_use();
+    double start = now_us();
+    int tokens = lex_all(source);
+    results[PHASE_LEX].samples[results[PHASE_LEX].count++] = now_us() - start;
+    results[PHASE_LEX].memory = heap_in_use() - heap;
+
+    FILE *file = fmemopen(source->buffer, source->size, "r");
+    heap = heap_in_use();
+    start = now_us();
+    Parser *p = new_parser(file);
+    Node *ast = parse(p);
+    results[PHASE_PARSE].samples[results[PHASE_PARSE].count++] = now_us() - start;
+    results[PHASE_PARSE].memory = heap_in_use() - heap;
+
+    heap = heap_in_use();
+    start = now_us();
+    simplify(ast);
+    specialize(ast, options->opt_level > 0);
+    Llvm *llvm = new_llvm(options);
+    llvm_analyze(llvm, ast);
+    llvm_visit(llvm, ast);
+    llvm_finalize(llvm);
+    llvm_validate(llvm);
+    results[PHASE_CODEGEN].samples[results[PHASE_CODEGEN].count++] = now_us() - start;
+    results[PHASE_CODEGEN].memory = heap_in_use() - heap;
+
+    heap = heap_in_use();
+    start = now_us();
+    llvm_compile(llvm, object_path);
+    results[PHASE_EMIT].samples[results[PHASE_EMIT].count++] = now_us() - start;
+    results[PHASE_EMIT].memory = heap_in_use() - heap;
+
+    dispose_llvm(llvm);
+    dispose_node(ast);
+    dispose_parser(p);
+    fclose(file);
+
+    return tokens;
+}
+
+int load_baselines(char *path, Baseline *baselines)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not open baseline file: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    int count = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL && count < MAX_BASELINES)
+    {
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+        Baseline *baseline = &baselines[count];
+        if (sscanf(line, "%31s %d %31s %lf", baseline->shape, &baseline->scale, baseline->phase, &baseline->p50) == 4)
+        {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+Baseline *find_baseline(Baseline *baselines, int count, char *shape, int scale, char *phase)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(baselines[i].shape, shape) == 0 && baselines[i].scale == scale && strcmp(baselines[i].phase, phase) == 0)
+        {
+            return &baselines[i];
+        }
+    }
+    return NULL;
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: compile_bench [-n reps] [-t threshold] [-s max_scale] [--save file | --check file]\n");
+    fprintf(stderr, "       compile_bench --emit <shape> <scale>\n");
+    fprintf(stderr, "Shapes: functions, if_chain, expression, statements, globals\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    int reps = 5;
+    int max_scale = SCALES[NUM_SCALES - 1];
+    double threshold = 0.25;
+    char *save_path = NULL;
+    char *check_path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--emit") == 0 && i + 2 < argc)
+        {
+            int shape = find_shape(argv[i + 1]);
+            if (shape < 0)
+            {
+                usage();
+            }
+            generate(stdout, shape, atoi(argv[i + 2]));
+            return 0;
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            reps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            max_scale = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            threshold = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc)
+        {
+            save_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc)
+        {
+            check_path = argv[++i];
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    if (reps < 1 || reps > MAX_SAMPLES)
+    {
+        fprintf(stderr, "Repetitions must be between 1 and %d\n", MAX_SAMPLES);
+        exit(EXIT_FAILURE);
+    }
+
+    Baseline baselines[MAX_BASELINES];
+    int num_baselines = check_path != NULL ? load_baselines(check_path, baselines) : 0;
+
+    FILE *save = NULL;
+    if (save_path != NULL)
+    {
+        save = fopen(save_path, "w");
+        if (save == NULL)
+        {
+            fprintf(stderr, "Could not open baseline file: %s\n", save_path);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(save, "# shape scale phase p50_us\n");
+    }
+
+    Options *options = new_options();
+    options->opt_level = 2;
+    char object_path[] = "/tmp/tron_compile_bench.o";
+    int regressions = 0;
+
+    printf("%-10s %6s %7s %8s %-7s %10s %10s %10s %10s %12s %12s\n",
+           "shape", "scale", "lines", "tokens", "phase", "p50(us)", "p90(us)", "p99(us)", "heap(KiB)", "tokens/s", "lines/s");
+
+    for (int s = 0; s < NUM_SHAPES; s++)
+    {
+        for (int k = 0; k < NUM_SCALES && SCALES[k] <= max_scale; k++)
+        {
+            Source *source = new_source(s, SCALES[k]);
+            PhaseResult results[NUM_PHASES];
+            memset(results, 0, sizeof(results));
+
+            int tokens = 0;
+            for (int r = 0; r < reps; r++)
+            {
+                tokens = run_once(source, results, options, object_path);
+            }
+
+            for (int ph = 0; ph < NUM_PHASES; ph++)
+            {
+                double p50 = percentile(&results[ph], 0.50);
+                double p90 = percentile(&results[ph], 0.90);
+                double p99 = percentile(&results[ph], 0.99);
+                double seconds = p50 > 0 ? p50 / 1e6 : 1e-9;
+
+                printf("%-10s %6d %7d %8d %-7s %10.1f %10.1f %10.1f %10ld %12.0f %12.0f",
+                       SHAPE_NAMES[s], SCALES[k], source->lines, tokens, PHASE_NAMES[ph],
+                       p50, p90, p99, results[ph].memory / 1024, tokens / seconds, source->lines / seconds);
+
+                if (save != NULL)
+                {
+                    fprintf(save, "%s %d %s %.1f\n", SHAPE_NAMES[s], SCALES[k], PHASE_NAMES[ph], p50);
+                }
+
+                Baseline *baseline = find_baseline(baselines, num_baselines, SHAPE_NAMES[s], SCALES[k], PHASE_NAMES[ph]);
+                if (baseline != NULL && p50 > baseline->p50 * (1 + threshold))
+                {
+                    printf("  REGRESSION (baseline %.1f, +%.0f%%)", baseline->p50, (p50 / baseline->p50 - 1) * 100);
+                    regressions++;
+                }
+                printf("\n");
+            }
+
+            dispose_source(source);
+        }
+    }
+
+    remove(object_path);
+    dispose_options(options);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("\npeak rss: %ld KiB\n", usage.ru_maxrss);
+
+    if (save != NULL)
+    {
+        fclose(save);
+    }
+
+    if (regressions > 0)
+    {
+        printf("%d phase(s) regressed beyond %.0f%% of the baseline\n", regressions, threshold * 100);
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
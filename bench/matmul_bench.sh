@@ -0,0 +1,74 @@
+#!/bin/sh
+# ------------------------------------------------------------------------------
+# Copyright [2023] [Kadir PEKEL]
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# 	http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ------------------------------------------------------------------------------
+
+# Matrix multiply benchmark: builds example/matmul.tr for n x n matrices as
+# is, multiplying with the matmul builtin, and with the naive triple loop
+# next to it, then reports GFLOP/s of both for growing n. The builtin runs
+# once per instruction set in ISAS, each capping the corelib kernel through
+# TRON_MATMUL_ISA. Both builds repeat the product 1 + 2^28 / n^3 times.
+
+TRON=${TRON:-obj/tron}
+CC=${CC:-gcc}
+CORELIB=${CORELIB:-obj/corelib.o}
+TIMEIT=${TIMEIT:-obj/timeit}
+OUT_DIR=${OUT_DIR:-obj/matmul}
+SIZES=${SIZES:-"64 128 256 512"}
+ISAS=${ISAS:-"baseline avx2 avx512"}
+LEVEL=${LEVEL:-2}
+REPS=${REPS:-5}
+
+mkdir -p $OUT_DIR
+
+printf "%-5s %12s" "n" "naive GF/s"
+for isa in $ISAS; do
+    printf " %12s" "$isa GF/s"
+done
+printf "\n"
+
+for n in $SIZES; do
+    sed "s/var n = 64;/var n = $n;/" example/matmul.tr > $OUT_DIR/matmul.$n.tr
+    sed "s/blocked(a, b, c);/naive(a, b, c);/" $OUT_DIR/matmul.$n.tr > $OUT_DIR/naive.$n.tr
+
+    for variant in naive matmul; do
+        if ! $TRON -O$LEVEL $OUT_DIR/$variant.$n.tr $OUT_DIR/$variant.$n.o > /dev/null 2> $OUT_DIR/$variant.$n.log ||
+            ! $CC $OUT_DIR/$variant.$n.o $CORELIB -o $OUT_DIR/$variant.$n -lm -pthread 2>> $OUT_DIR/$variant.$n.log; then
+            echo "$variant build failed for n=$n, see $OUT_DIR/$variant.$n.log"
+            exit 1
+        fi
+    done
+
+    # Elements are small integers, so every order of the sums is exact
+    if [ "$($OUT_DIR/naive.$n)" != "$($OUT_DIR/matmul.$n)" ]; then
+        echo "output mismatch for n=$n"
+        exit 1
+    fi
+
+    times=$($TIMEIT $REPS $OUT_DIR/naive.$n | awk '{ print $2 }')
+    for isa in $ISAS; do
+        times="$times $(TRON_MATMUL_ISA=$isa $TIMEIT $REPS $OUT_DIR/matmul.$n | awk '{ print $2 }')"
+    done
+
+    echo "$n $times" | awk '{
+        n = $1
+        flops = 2 * n * n * n * (1 + int(268435456 / (n * n * n)))
+        printf "%-5s", n
+        for (i = 2; i <= NF; i++) {
+            printf " %12.2f", flops / (($i > 0.01 ? $i : 0.01) * 1e6)
+        }
+        printf "\n"
+    }'
+done
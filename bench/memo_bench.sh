@@ -0,0 +1,58 @@
+#!/bin/sh
+# ------------------------------------------------------------------------------
+# Copyright [2023] [Kadir PEKEL]
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# 	http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ------------------------------------------------------------------------------
+
+# Memoization benchmark: builds example/fib.tr as is and with `@memo` on
+# fib, then times both for growing n. The plain build grows exponentially
+# with n while the memoized one stays flat.
+
+TRON=${TRON:-obj/tron}
+CC=${CC:-gcc}
+CORELIB=${CORELIB:-obj/corelib.o}
+TIMEIT=${TIMEIT:-obj/timeit}
+OUT_DIR=${OUT_DIR:-obj/memo}
+SIZES=${SIZES:-"25 30 35 40"}
+LEVEL=${LEVEL:-2}
+REPS=${REPS:-5}
+
+mkdir -p $OUT_DIR
+
+printf "%-4s %14s %14s %10s\n" "n" "plain p50(ms)" "memo p50(ms)" "speedup"
+
+for n in $SIZES; do
+    sed "s/fib(10)/fib($n)/" example/fib.tr > $OUT_DIR/plain.$n.tr
+    sed "s/^func fib/@memo\nfunc fib/" $OUT_DIR/plain.$n.tr > $OUT_DIR/memo.$n.tr
+
+    for variant in plain memo; do
+        if ! $TRON -O$LEVEL $OUT_DIR/$variant.$n.tr $OUT_DIR/$variant.$n.o > /dev/null 2> $OUT_DIR/$variant.$n.log ||
+            ! $CC $OUT_DIR/$variant.$n.o $CORELIB -pthread -o $OUT_DIR/$variant.$n 2>> $OUT_DIR/$variant.$n.log; then
+            echo "$variant build failed for n=$n, see $OUT_DIR/$variant.$n.log"
+            exit 1
+        fi
+    done
+
+    if [ "$($OUT_DIR/plain.$n)" != "$($OUT_DIR/memo.$n)" ]; then
+        echo "output mismatch for n=$n"
+        exit 1
+    fi
+
+    plain_times=$($TIMEIT $REPS $OUT_DIR/plain.$n)
+    memo_times=$($TIMEIT $REPS $OUT_DIR/memo.$n)
+
+    echo "$n $plain_times $memo_times" | awk '{
+        printf "%-4s %14.2f %14.2f %9.0fx\n", $1, $3, $7, $3 / ($7 > 0.01 ? $7 : 0.01)
+    }'
+done
@@ -0,0 +1,65 @@
+#!/bin/sh
+# ------------------------------------------------------------------------------
+# Copyright [2023] [Kadir PEKEL]
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# 	http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ------------------------------------------------------------------------------
+
+# Runtime benchmark: builds every Tron kernel and its hand-written C
+# equivalent at each optimization level, checks that both print the same
+# result and reports median/p90 runtimes and the Tron/C ratio.
+
+TRON=${TRON:-obj/tron}
+TRON_FLAGS=${TRON_FLAGS:-}
+CC=${CC:-gcc}
+CORELIB=${CORELIB:-obj/corelib.o}
+TIMEIT=${TIMEIT:-obj/timeit}
+KERNEL_DIR=${KERNEL_DIR:-example/kernels}
+OUT_DIR=${OUT_DIR:-obj/kernels}
+LEVELS=${LEVELS:-"0 1 2 3"}
+REPS=${REPS:-10}
+KERNELS=${KERNELS:-$(ls $KERNEL_DIR/*.tr | xargs -n1 basename | sed 's/\.tr$//')}
+
+mkdir -p $OUT_DIR
+
+printf "%-12s %-5s %12s %12s %12s %12s %8s\n" "kernel" "level" "tron p50(ms)" "tron p90(ms)" "c p50(ms)" "c p90(ms)" "tron/c"
+
+for kernel in $KERNELS; do
+    for level in $LEVELS; do
+        tron_bin=$OUT_DIR/$kernel.O$level.tron
+        c_bin=$OUT_DIR/$kernel.O$level.c
+
+        if ! $TRON -O$level $TRON_FLAGS $KERNEL_DIR/$kernel.tr $tron_bin.o > /dev/null 2> $tron_bin.log ||
+            ! $CC $tron_bin.o $CORELIB -pthread -o $tron_bin 2>> $tron_bin.log; then
+            printf "%-12s %-5s %s\n" $kernel O$level "tron build failed, see $tron_bin.log"
+            continue
+        fi
+
+        if ! $CC -O$level $KERNEL_DIR/$kernel.c -o $c_bin; then
+            printf "%-12s %-5s %s\n" $kernel O$level "c build failed"
+            continue
+        fi
+
+        if [ "$($tron_bin)" != "$($c_bin)" ]; then
+            printf "%-12s %-5s %s\n" $kernel O$level "output mismatch between tron and c"
+            continue
+        fi
+
+        tron_times=$($TIMEIT $REPS $tron_bin)
+        c_times=$($TIMEIT $REPS $c_bin)
+
+        echo "$kernel O$level $tron_times $c_times" | awk '{
+            printf "%-12s %-5s %12.2f %12.2f %12.2f %12.2f %8.2f\n", $1, $2, $4, $5, $8, $9, $4 / $8
+        }'
+    done
+done
@@ -0,0 +1,104 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+// Runs a program repeatedly with its output discarded and prints the
+// min, median, p90 and max wall time of the runs in milliseconds.
+//
+// Usage:
+//   timeit <reps> <program> [args...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+    double x = *(double *)a;
+    double y = *(double *)b;
+    return (x > y) - (x < y);
+}
+
+double run(char **argv)
+{
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0)
+    {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        execvp(argv[0], argv);
+        perror("execvp");
+        _exit(127);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    double elapsed = now_ms() - start;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127)
+    {
+        fprintf(stderr, "%s did not run to completion\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    return elapsed;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: timeit <reps> <program> [args...]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int reps = atoi(argv[1]);
+    if (reps < 1)
+    {
+        fprintf(stderr, "Repetitions must be positive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double *samples = calloc(reps, sizeof(double));
+    for (int i = 0; i < reps; i++)
+    {
+        samples[i] = run(argv + 2);
+    }
+    qsort(samples, reps, sizeof(double), compare_doubles);
+
+    printf("%.2f %.2f %.2f %.2f\n",
+           samples[0],
+           samples[(reps - 1) / 2],
+           samples[(int)(0.9 * (reps - 1) + 0.5)],
+           samples[reps - 1]);
+
+    free(samples);
+    return 0;
+}
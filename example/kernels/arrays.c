@@ -0,0 +1,32 @@
+#include <stdio.h>
+
+int traverse(int rounds)
+{
+    int a[4096];
+    int i = 0;
+    while (i < 4096)
+    {
+        a[i] = (i * 7919) % 4096;
+        i = i + 1;
+    }
+
+    unsigned int total = 0;
+    int r = 0;
+    while (r < rounds)
+    {
+        i = 0;
+        while (i < 4096)
+        {
+            total = total + a[i] * (r % 3);
+            i = i + 1;
+        }
+        r = r + 1;
+    }
+    return (int)total;
+}
+
+int main()
+{
+    printf("%d\n", traverse(20000));
+    return 0;
+}
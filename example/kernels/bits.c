@@ -0,0 +1,35 @@
+#include <stdio.h>
+
+int popcount(unsigned int x)
+{
+    unsigned int v = x;
+    int count = 0;
+    while (v != 0)
+    {
+        v = v & (v - 1);
+        count = count + 1;
+    }
+    return count;
+}
+
+int shuffle(int n)
+{
+    unsigned int state = 2463534;
+    unsigned int total = 0;
+    int i = 0;
+    while (i < n)
+    {
+        state = state ^ (state << 13);
+        state = state ^ (state >> 17);
+        state = state ^ (state << 5);
+        total = total + popcount(state & 65535) + ((state >> 3) & ~240u);
+        i = i + 1;
+    }
+    return (int)total;
+}
+
+int main()
+{
+    printf("%d\n", shuffle(10000000));
+    return 0;
+}
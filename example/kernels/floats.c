@@ -0,0 +1,25 @@
+#include <stdio.h>
+
+float series(int n)
+{
+    float acc = 0.0f;
+    float x = 0.0f;
+    int i = 0;
+    while (i < n)
+    {
+        acc = acc + x * 0.5f - acc * 0.001f;
+        x = x + 0.25f;
+        if (x > 100.0f)
+        {
+            x = 0.0f;
+        }
+        i = i + 1;
+    }
+    return acc;
+}
+
+int main()
+{
+    printf("%f\n", series(20000000));
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include <stdio.h>
+
+int collatz(int limit)
+{
+    int longest = 0;
+    int n = 1;
+    while (n < limit)
+    {
+        int x = n;
+        int steps = 0;
+        while (x != 1)
+        {
+            if (x % 2 == 0)
+            {
+                x = x / 2;
+            }
+            else
+            {
+                x = 3 * x + 1;
+            }
+            steps = steps + 1;
+        }
+        if (steps > longest)
+        {
+            longest = steps;
+        }
+        n = n + 1;
+    }
+    return longest;
+}
+
+int triangle(int n)
+{
+    int total = 0;
+    int i = 0;
+    while (i < n)
+    {
+        int j = 0;
+        while (j < i)
+        {
+            total = total + (i ^ j) % 7;
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    return total;
+}
+
+int main()
+{
+    printf("%d\n", collatz(100000));
+    printf("%d\n", triangle(12000));
+    return 0;
+}
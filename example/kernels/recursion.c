@@ -0,0 +1,26 @@
+#include <stdio.h>
+
+int fib(int n)
+{
+    if (n < 2)
+    {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+int tak(int x, int y, int z)
+{
+    if (y < x)
+    {
+        return tak(tak(x - 1, y, z), tak(y - 1, z, x), tak(z - 1, x, y));
+    }
+    return z;
+}
+
+int main()
+{
+    printf("%d\n", fib(35));
+    printf("%d\n", tak(30, 20, 10));
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+float reduce(int n, int rounds)
+{
+    float *x = calloc(n, sizeof(float));
+    int *k = calloc(n, sizeof(int));
+    int i = 0;
+    while (i < n)
+    {
+        x[i] = (float)(i % 7);
+        k[i] = i * 7919 % 10007;
+        i = i + 1;
+    }
+
+    float total = 0.0f;
+    int r = 0;
+    while (r < rounds)
+    {
+        x[r % n] = x[r % n] + 1.0f;
+        k[r % n] = k[r % n] - 3;
+        float sum = 0.0f;
+        int max = k[0];
+        int argmax = 0;
+        for (int j = 0; j < n; j++)
+        {
+            sum += x[j];
+            if (k[j] > max)
+            {
+                max = k[j];
+                argmax = j;
+            }
+        }
+        total = total + sum + (float)(max - argmax);
+        r = r + 1;
+    }
+    free(x);
+    free(k);
+    return total;
+}
+
+int main()
+{
+    printf("%f\n", reduce(4096, 20000));
+    return 0;
+}
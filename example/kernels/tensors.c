@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+float relax(int n, int rounds)
+{
+    float *x = calloc(n, sizeof(float));
+    float *y = calloc(n, sizeof(float));
+    int i = 0;
+    while (i < n)
+    {
+        x[i] = (float)(i % 100);
+        y[i] = (float)(i % 7) * 0.5f;
+        i = i + 1;
+    }
+
+    float *z = calloc(n, sizeof(float));
+    int r = 0;
+    while (r < rounds)
+    {
+        for (int k = 0; k < n; k++)
+        {
+            z[k] = x[k] * 0.5f + y[k] - z[k] * 0.25f;
+        }
+        r = r + 1;
+    }
+    float result = z[0] + z[n - 1];
+    free(x);
+    free(y);
+    free(z);
+    return result;
+}
+
+int main()
+{
+    printf("%f\n", relax(4096, 20000));
+    return 0;
+}
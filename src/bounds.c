@@ -0,0 +1,831 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bounds.h"
+#include "constants.h"
+#include "hashtable.h"
+
+// Variables visible at a point of a function, globals included
+typedef struct BoundsName
+{
+    char *name;
+    TypeInfo *type_info;
+    bool local;
+    struct BoundsName *next;
+} BoundsName;
+
+// What is known while going through the body of an innermost loop. The
+// induction variable counts up by one from where the loop is entered, an
+// index read after the increment is one past the value the condition saw.
+typedef struct BoundsContext
+{
+    BoundsName *names;
+    HashTable *assigned;
+    HashTable *grown;
+    bool calls;
+    bool trapping;
+    BoundsLoop *loop;
+    char *induction;
+    bool induction_unsigned;
+    int64_t step;
+} BoundsContext;
+
+BoundsName *push_bounds_name(BoundsName *names, char *name, TypeInfo *type_info, bool local)
+{
+    BoundsName *bounds_name = malloc(sizeof(BoundsName));
+    bounds_name->name = name;
+    bounds_name->type_info = type_info;
+    bounds_name->local = local;
+    bounds_name->next = names;
+    return bounds_name;
+}
+
+void pop_bounds_names(BoundsName *names, BoundsName *until)
+{
+    while (names != until)
+    {
+        BoundsName *next = names->next;
+        free(names);
+        names = next;
+    }
+}
+
+BoundsName *find_bounds_name(BoundsName *names, char *name)
+{
+    for (; names != NULL; names = names->next)
+    {
+        if (strcmp(names->name, name) == 0)
+        {
+            return names;
+        }
+    }
+    return NULL;
+}
+
+bool is_bounds_name(Expression *expression)
+{
+    return expression != NULL && expression->node != NULL && expression->node->node_type == N_NAME;
+}
+
+char *name_of(Expression *expression)
+{
+    return ((Name *)expression->node->data)->value;
+}
+
+bool has_loops(Node *statements)
+{
+    for (Node *node = statements; node != NULL; node = node->next)
+    {
+        if (node->node_type == N_WHILE)
+        {
+            return true;
+        }
+        if (node->node_type == N_IF)
+        {
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                if (has_loops(if_->body->statements))
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Pushing to a slice or passing it to a function may change its length,
+// calling a function may change any global
+void scan_loop_expression(BoundsContext *context, Expression *expression);
+
+void scan_loop_call(BoundsContext *context, Call *call)
+{
+    if (strcmp(call->name, PUSH) != 0 && strcmp(call->name, LEN) != 0 && strcmp(call->name, MATMUL) != 0 &&
+        !is_cast(call->name) && !is_reduction(call->name))
+    {
+        context->calls = true;
+    }
+    for (Expression *arg = call->expression; arg != NULL; arg = arg->next)
+    {
+        if (arg->type_info->slice && is_bounds_name(arg) && strcmp(call->name, LEN) != 0 && !is_reduction(call->name))
+        {
+            insert_value(context->grown, name_of(arg), NULL);
+        }
+        scan_loop_expression(context, arg);
+    }
+}
+
+void scan_loop_expression(BoundsContext *context, Expression *expression)
+{
+    if (expression == NULL)
+    {
+        return;
+    }
+    scan_loop_expression(context, expression->left);
+    scan_loop_expression(context, expression->right);
+    if (expression->node == NULL)
+    {
+        return;
+    }
+    if (expression->node->node_type == N_CALL)
+    {
+        scan_loop_call(context, expression->node->data);
+    }
+    else if (expression->node->node_type == N_ARRAY)
+    {
+        for (Expression *element = expression->node->data; element != NULL; element = element->next)
+        {
+            scan_loop_expression(context, element);
+        }
+    }
+    else if (expression->node->node_type == N_SLICE)
+    {
+        Slice *slice = expression->node->data;
+        scan_loop_expression(context, slice->array);
+        scan_loop_expression(context, slice->low);
+        scan_loop_expression(context, slice->high);
+    }
+}
+
+void scan_loop_statements(BoundsContext *context, Node *statements)
+{
+    for (Node *node = statements; node != NULL; node = node->next)
+    {
+        switch (node->node_type)
+        {
+        case N_VARIABLE:
+        {
+            Variable *variable = node->data;
+            insert_value(context->assigned, variable->name, NULL);
+            if (variable->assignment != NULL)
+            {
+                scan_loop_expression(context, variable->assignment->expression);
+            }
+            break;
+        }
+        case N_ASSIGNMENT:
+        {
+            Assignment *assignment = node->data;
+            if (assignment->index == NULL)
+            {
+                insert_value(context->assigned, assignment->name, NULL);
+            }
+            for (Expression *index = assignment->index; index != NULL; index = index->next)
+            {
+                scan_loop_expression(context, index);
+            }
+            scan_loop_expression(context, assignment->expression);
+            break;
+        }
+        case N_CALL:
+            scan_loop_call(context, node->data);
+            break;
+        case N_IF:
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                scan_loop_expression(context, if_->condition);
+                scan_loop_statements(context, if_->body->statements);
+            }
+            break;
+        case N_RETURN:
+            scan_loop_expression(context, ((Return *)node->data)->expression);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool is_assigned(BoundsContext *context, char *name)
+{
+    return lookup_value(context->assigned, name) != NULL;
+}
+
+// The length of a fixed size array never changes, the one of a slice does
+// unless the loop neither pushes to it nor lets a function see it
+bool has_invariant_length(BoundsContext *context, char *name)
+{
+    BoundsName *bounds_name = find_bounds_name(context->names, name);
+    if (bounds_name == NULL || !bounds_name->type_info->slice)
+    {
+        return bounds_name != NULL;
+    }
+    return !is_assigned(context, name) && lookup_value(context->grown, name) == NULL &&
+           (bounds_name->local || !context->calls);
+}
+
+// Integer expressions the loop can not change and that can be evaluated
+// once before it without side effects. Arithmetic may trap on overflow
+// with --trap-on-overflow, where the loop might never have evaluated it.
+bool is_invariant(BoundsContext *context, Expression *expression)
+{
+    if (expression == NULL || !is_integer_type(expression->type_info->type) || expression->type_info->array_info != NULL ||
+        expression->type_info->slice)
+    {
+        return false;
+    }
+    if (expression->node != NULL)
+    {
+        if (expression->node->node_type == N_INTEGER)
+        {
+            return true;
+        }
+        if (expression->node->node_type == N_NAME)
+        {
+            BoundsName *bounds_name = find_bounds_name(context->names, name_of(expression));
+            return bounds_name != NULL && !is_assigned(context, bounds_name->name) && (bounds_name->local || !context->calls);
+        }
+        if (expression->node->node_type == N_CALL)
+        {
+            Call *call = expression->node->data;
+            if (is_cast(call->name))
+            {
+                return is_invariant(context, call->expression);
+            }
+            return strcmp(call->name, LEN) == 0 && is_bounds_name(call->expression) &&
+                   has_invariant_length(context, name_of(call->expression));
+        }
+        return false;
+    }
+    TokenType op = expression->token->token_type;
+    return (op == T_ADD || op == T_SUB || op == T_MUL) && !context->trapping && is_invariant(context, expression->left) &&
+           is_invariant(context, expression->right);
+}
+
+bool constant_value(BoundsContext *context, Expression *expression, int64_t *value)
+{
+    if (expression->node == NULL)
+    {
+        return false;
+    }
+    if (expression->node->node_type == N_INTEGER)
+    {
+        *value = ((Integer *)expression->node->data)->value;
+        return true;
+    }
+    if (expression->node->node_type == N_CALL && strcmp(((Call *)expression->node->data)->name, LEN) == 0)
+    {
+        // len(t, d) of a tensor is the size of dimension d
+        Expression *sequence = ((Call *)expression->node->data)->expression;
+        ArrayInfo *array_info = sequence->type_info->array_info;
+        if (sequence->next != NULL)
+        {
+            for (int64_t d = ((Integer *)sequence->next->node->data)->value; d > 0 && array_info != NULL; d--)
+            {
+                array_info = array_info->next;
+            }
+        }
+        if (array_info != NULL && array_info->size >= 0)
+        {
+            *value = array_info->size;
+            return true;
+        }
+    }
+    return false;
+}
+
+// i, i + c, c + i and i - c, offset is c
+bool induction_offset(BoundsContext *context, Expression *index, int64_t *offset)
+{
+    if (context->induction == NULL)
+    {
+        return false;
+    }
+    if (is_bounds_name(index))
+    {
+        *offset = 0;
+        return strcmp(name_of(index), context->induction) == 0;
+    }
+    if (index->node != NULL || (index->token->token_type != T_ADD && index->token->token_type != T_SUB))
+    {
+        return false;
+    }
+    Expression *variable = index->left;
+    Expression *constant = index->right;
+    if (index->token->token_type == T_ADD && is_bounds_name(constant))
+    {
+        variable = index->right;
+        constant = index->left;
+    }
+    if (!is_bounds_name(variable) || strcmp(name_of(variable), context->induction) != 0 || constant->node == NULL ||
+        constant->node->node_type != N_INTEGER)
+    {
+        return false;
+    }
+    *offset = ((Integer *)constant->node->data)->value;
+    if (index->token->token_type == T_SUB)
+    {
+        *offset = -*offset;
+    }
+    return *offset >= -BOUNDS_MAX_OFFSET && *offset <= BOUNDS_MAX_OFFSET;
+}
+
+BoundsFact *new_bounds_fact(BoundsFactKind kind, Expression *index, int64_t offset, char *array, int size)
+{
+    BoundsFact *fact = malloc(sizeof(BoundsFact));
+    fact->kind = kind;
+    fact->index = index;
+    fact->offset = offset;
+    fact->array = array;
+    fact->size = size;
+    fact->next = NULL;
+    return fact;
+}
+
+// One low fact with the smallest offset and one high fact per length with
+// the largest cover every induction access
+void add_bounds_fact(BoundsLoop *loop, BoundsFactKind kind, Expression *index, int64_t offset, char *array, int size)
+{
+    for (BoundsFact *fact = loop->facts; fact != NULL && kind != BOUNDS_INDEX; fact = fact->next)
+    {
+        if (fact->kind == BOUNDS_LOW && kind == BOUNDS_LOW)
+        {
+            fact->offset = offset < fact->offset ? offset : fact->offset;
+            return;
+        }
+        if (fact->kind == BOUNDS_HIGH && kind == BOUNDS_HIGH && fact->size == size &&
+            (array == NULL ? fact->array == NULL : fact->array != NULL && strcmp(fact->array, array) == 0))
+        {
+            fact->offset = offset > fact->offset ? offset : fact->offset;
+            return;
+        }
+    }
+    BoundsFact *fact = new_bounds_fact(kind, index, offset, array, size);
+    fact->next = loop->facts;
+    loop->facts = fact;
+}
+
+// Limits of the form len(array) bound an index into that same array, or
+// into the first dimension of that tensor
+bool is_length_of(BoundsContext *context, Expression *limit, char *array)
+{
+    if (array == NULL || is_assigned(context, array) || limit->node == NULL || limit->node->node_type != N_CALL)
+    {
+        return false;
+    }
+    Call *call = limit->node->data;
+    return strcmp(call->name, LEN) == 0 && is_bounds_name(call->expression) && call->expression->next == NULL &&
+           strcmp(name_of(call->expression), array) == 0;
+}
+
+// Proves index in bounds of a sequence, the slice named array or a fixed
+// size array of size elements, from facts that hold on entry to the loop.
+// A tensor dimension only known at runtime has a size of -1, indexes into
+// it are only proven by a len() limit.
+bool prove_index(BoundsContext *context, char *array, bool slice, int size, Expression *index)
+{
+    BoundsLoop *loop = context->loop;
+    if (slice && (array == NULL || !has_invariant_length(context, array)))
+    {
+        return false;
+    }
+    int64_t offset;
+    int64_t value;
+    if (induction_offset(context, index, &offset))
+    {
+        offset += context->step;
+        bool high_holds = false;
+        if (is_length_of(context, loop->limit, array))
+        {
+            // Past the end on the last iteration, the check reports it
+            if (offset > 0)
+            {
+                return false;
+            }
+            high_holds = true;
+        }
+        else if (!slice && size >= 0 && constant_value(context, loop->limit, &value))
+        {
+            if (value + offset > size)
+            {
+                return false;
+            }
+            high_holds = true;
+        }
+        if (!slice && size < 0 && !high_holds)
+        {
+            return false;
+        }
+        if (!(context->induction_unsigned && offset >= 0))
+        {
+            add_bounds_fact(loop, BOUNDS_LOW, NULL, offset, NULL, 0);
+        }
+        if (!high_holds)
+        {
+            add_bounds_fact(loop, BOUNDS_HIGH, NULL, offset, slice ? array : NULL, size);
+        }
+    }
+    else if (is_invariant(context, index))
+    {
+        if (!slice && size < 0)
+        {
+            return false;
+        }
+        if (!slice && constant_value(context, index, &value))
+        {
+            if (value < 0 || value >= size)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            add_bounds_fact(loop, BOUNDS_INDEX, index, 0, slice ? array : NULL, size);
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    BoundsIndex *proven = malloc(sizeof(BoundsIndex));
+    proven->index = index;
+    proven->next = loop->proven;
+    loop->proven = proven;
+    return true;
+}
+
+void prove_expression(BoundsContext *context, Expression *expression);
+
+void prove_call(BoundsContext *context, Call *call)
+{
+    for (Expression *arg = call->expression; arg != NULL; arg = arg->next)
+    {
+        prove_expression(context, arg);
+    }
+}
+
+void prove_expression(BoundsContext *context, Expression *expression)
+{
+    if (expression == NULL)
+    {
+        return;
+    }
+    prove_expression(context, expression->left);
+    prove_expression(context, expression->right);
+    if (expression->token != NULL && expression->token->token_type == T_LBRACKET)
+    {
+        Expression *sequence = expression->left;
+        prove_index(context, is_bounds_name(sequence) ? name_of(sequence) : NULL, sequence->type_info->slice,
+                    sequence->type_info->slice ? 0 : sequence->type_info->array_info->size, expression->right);
+    }
+    if (expression->node == NULL)
+    {
+        return;
+    }
+    if (expression->node->node_type == N_CALL)
+    {
+        prove_call(context, expression->node->data);
+    }
+    else if (expression->node->node_type == N_ARRAY)
+    {
+        for (Expression *element = expression->node->data; element != NULL; element = element->next)
+        {
+            prove_expression(context, element);
+        }
+    }
+    else if (expression->node->node_type == N_SLICE)
+    {
+        Slice *slice = expression->node->data;
+        prove_expression(context, slice->array);
+        prove_expression(context, slice->low);
+        prove_expression(context, slice->high);
+    }
+}
+
+void prove_assignment(BoundsContext *context, Assignment *assignment)
+{
+    for (Expression *index = assignment->index; index != NULL; index = index->next)
+    {
+        prove_expression(context, index);
+    }
+    prove_expression(context, assignment->expression);
+
+    BoundsName *target = find_bounds_name(context->names, assignment->name);
+    if (target == NULL || assignment->index == NULL)
+    {
+        return;
+    }
+    if (target->type_info->slice)
+    {
+        prove_index(context, target->name, true, 0, assignment->index);
+        return;
+    }
+    ArrayInfo *array_info = target->type_info->array_info;
+    for (Expression *index = assignment->index; index != NULL && array_info != NULL; index = index->next)
+    {
+        prove_index(context, index == assignment->index ? target->name : NULL, false, array_info->size, index);
+        array_info = array_info->next;
+    }
+}
+
+void prove_statements(BoundsContext *context, Node *statements, Node *increment)
+{
+    BoundsName *scope = context->names;
+    for (Node *node = statements; node != NULL; node = node->next)
+    {
+        if (node == increment)
+        {
+            context->step = 1;
+            continue;
+        }
+        switch (node->node_type)
+        {
+        case N_VARIABLE:
+        {
+            Variable *variable = node->data;
+            if (variable->assignment != NULL)
+            {
+                prove_expression(context, variable->assignment->expression);
+            }
+            context->names = push_bounds_name(context->names, variable->name, variable->type_info, true);
+            break;
+        }
+        case N_ASSIGNMENT:
+            prove_assignment(context, node->data);
+            break;
+        case N_CALL:
+            prove_call(context, node->data);
+            break;
+        case N_IF:
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                prove_expression(context, if_->condition);
+                prove_statements(context, if_->body->statements, NULL);
+            }
+            break;
+        case N_RETURN:
+            prove_expression(context, ((Return *)node->data)->expression);
+            break;
+        default:
+            break;
+        }
+    }
+    pop_bounds_names(context->names, scope);
+    context->names = scope;
+}
+
+int count_assignments(Node *statements, char *name)
+{
+    int count = 0;
+    for (Node *node = statements; node != NULL; node = node->next)
+    {
+        if (node->node_type == N_ASSIGNMENT && ((Assignment *)node->data)->index == NULL &&
+            strcmp(((Assignment *)node->data)->name, name) == 0)
+        {
+            count++;
+        }
+        else if (node->node_type == N_VARIABLE && strcmp(((Variable *)node->data)->name, name) == 0)
+        {
+            count += 2;
+        }
+        else if (node->node_type == N_IF)
+        {
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                count += count_assignments(if_->body->statements, name);
+            }
+        }
+    }
+    return count;
+}
+
+// The single `i = i + 1` at the top level of the body, NULL if i changes
+// any other way
+Node *find_increment(Node *statements, char *name)
+{
+    if (count_assignments(statements, name) != 1)
+    {
+        return NULL;
+    }
+    for (Node *node = statements; node != NULL; node = node->next)
+    {
+        if (node->node_type != N_ASSIGNMENT || strcmp(((Assignment *)node->data)->name, name) != 0)
+        {
+            continue;
+        }
+        Expression *value = ((Assignment *)node->data)->expression;
+        if (value->node != NULL || value->token->token_type != T_ADD)
+        {
+            return NULL;
+        }
+        Expression *variable = is_bounds_name(value->left) ? value->left : value->right;
+        Expression *one = variable == value->left ? value->right : value->left;
+        if (is_bounds_name(variable) && strcmp(name_of(variable), name) == 0 && one->node != NULL &&
+            one->node->node_type == N_INTEGER && ((Integer *)one->node->data)->value == 1)
+        {
+            return node;
+        }
+        return NULL;
+    }
+    return NULL;
+}
+
+// `while (i < limit)` counting a local integer up by one to a limit the
+// loop does not change. Unsigned 64 bit counters do not fit the signed
+// 64 bit facts.
+Node *find_induction(BoundsContext *context, While *while_)
+{
+    Expression *condition = while_->condition;
+    if (condition->node != NULL || (condition->token->token_type != T_LT && condition->token->token_type != T_GT))
+    {
+        return NULL;
+    }
+    Expression *variable = condition->token->token_type == T_LT ? condition->left : condition->right;
+    Expression *limit = condition->token->token_type == T_LT ? condition->right : condition->left;
+    if (!is_bounds_name(variable) || variable->type_info->type != limit->type_info->type ||
+        variable->type_info->type == TYPE_U64 || !is_invariant(context, limit))
+    {
+        return NULL;
+    }
+    BoundsName *bounds_name = find_bounds_name(context->names, name_of(variable));
+    if (bounds_name == NULL || !bounds_name->local || bounds_name->type_info->array_info != NULL ||
+        bounds_name->type_info->slice || !is_integer_type(bounds_name->type_info->type))
+    {
+        return NULL;
+    }
+    Node *increment = find_increment(while_->body->statements, bounds_name->name);
+    if (increment != NULL)
+    {
+        context->induction = bounds_name->name;
+        context->induction_unsigned = !is_signed_type(bounds_name->type_info->type);
+        context->loop->induction = variable;
+        context->loop->limit = limit;
+    }
+    return increment;
+}
+
+BoundsLoop *new_bounds_loop(While *loop)
+{
+    BoundsLoop *bounds_loop = malloc(sizeof(BoundsLoop));
+    bounds_loop->loop = loop;
+    bounds_loop->induction = NULL;
+    bounds_loop->limit = NULL;
+    bounds_loop->facts = NULL;
+    bounds_loop->proven = NULL;
+    bounds_loop->next = NULL;
+    return bounds_loop;
+}
+
+BoundsLoop *analyze_loop(BoundsName *names, While *while_, bool trapping, BoundsLoop *loops)
+{
+    BoundsContext context;
+    context.names = names;
+    context.assigned = new_hash_table(BOUNDS_TABLE_SIZE);
+    context.grown = new_hash_table(BOUNDS_TABLE_SIZE);
+    context.calls = false;
+    context.trapping = trapping;
+    context.loop = new_bounds_loop(while_);
+    context.induction = NULL;
+    context.induction_unsigned = false;
+    context.step = 0;
+
+    scan_loop_expression(&context, while_->condition);
+    scan_loop_statements(&context, while_->body->statements);
+    Node *increment = find_induction(&context, while_);
+    prove_statements(&context, while_->body->statements, increment);
+
+    dispose_hash_table(context.assigned, NULL);
+    dispose_hash_table(context.grown, NULL);
+    if (context.loop->proven == NULL)
+    {
+        dispose_bounds(context.loop);
+        return loops;
+    }
+    context.loop->next = loops;
+    return context.loop;
+}
+
+BoundsLoop *analyze_block(BoundsName **names, Node *statements, bool trapping, BoundsLoop *loops)
+{
+    BoundsName *scope = *names;
+    for (Node *node = statements; node != NULL; node = node->next)
+    {
+        if (node->node_type == N_VARIABLE)
+        {
+            Variable *variable = node->data;
+            *names = push_bounds_name(*names, variable->name, variable->type_info, true);
+        }
+        else if (node->node_type == N_IF)
+        {
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                loops = analyze_block(names, if_->body->statements, trapping, loops);
+            }
+        }
+        else if (node->node_type == N_WHILE)
+        {
+            While *while_ = node->data;
+            if (has_loops(while_->body->statements))
+            {
+                loops = analyze_block(names, while_->body->statements, trapping, loops);
+            }
+            else
+            {
+                loops = analyze_loop(*names, while_, trapping, loops);
+            }
+        }
+    }
+    pop_bounds_names(*names, scope);
+    *names = scope;
+    return loops;
+}
+
+// Finds the innermost loops whose indexes can be proven in bounds, either
+// at compile time or by a few tests before the loop is entered
+BoundsLoop *analyze_bounds(Node *ast, bool trapping)
+{
+    BoundsName *names = NULL;
+    for (Node *node = ast; node != NULL; node = node->next)
+    {
+        if (node->node_type == N_VARIABLE)
+        {
+            Variable *variable = node->data;
+            names = push_bounds_name(names, variable->name, variable->type_info, false);
+        }
+    }
+
+    BoundsLoop *loops = NULL;
+    for (Node *node = ast; node != NULL; node = node->next)
+    {
+        // Only loops have indexes to prove
+        if (node->node_type != N_FUNCTION || !has_loops(((Function *)node->data)->body->statements))
+        {
+            continue;
+        }
+        Function *function = node->data;
+        BoundsName *globals = names;
+        for (Variable *param = function->params; param != NULL; param = param->next)
+        {
+            names = push_bounds_name(names, param->name, param->type_info, true);
+        }
+        loops = analyze_block(&names, function->body->statements, trapping, loops);
+        pop_bounds_names(names, globals);
+        names = globals;
+    }
+    pop_bounds_names(names, NULL);
+    return loops;
+}
+
+BoundsLoop *find_bounds_loop(BoundsLoop *loops, While *loop)
+{
+    for (; loops != NULL; loops = loops->next)
+    {
+        if (loops->loop == loop)
+        {
+            return loops;
+        }
+    }
+    return NULL;
+}
+
+bool bounds_proves(BoundsLoop *loop, Expression *index)
+{
+    for (BoundsIndex *proven = loop != NULL ? loop->proven : NULL; proven != NULL; proven = proven->next)
+    {
+        if (proven->index == index)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void dispose_bounds(BoundsLoop *loops)
+{
+    while (loops != NULL)
+    {
+        BoundsLoop *next = loops->next;
+        while (loops->facts != NULL)
+        {
+            BoundsFact *fact = loops->facts->next;
+            free(loops->facts);
+            loops->facts = fact;
+        }
+        while (loops->proven != NULL)
+        {
+            BoundsIndex *proven = loops->proven->next;
+            free(loops->proven);
+            loops->proven = proven;
+        }
+        free(loops);
+        loops = next;
+    }
+}
@@ -0,0 +1,77 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#ifndef MBOUNDS_H_
+#define MBOUNDS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "node.h"
+
+#define BOUNDS_TABLE_SIZE 64
+
+// Induction offsets beyond this are left to the checks on every access
+#define BOUNDS_MAX_OFFSET (1 << 20)
+
+typedef enum BoundsFactKind
+{
+    // induction + offset >= 0 when the loop is entered
+    BOUNDS_LOW,
+    // limit <= length - offset, offset includes 1 for `i <= limit`
+    BOUNDS_HIGH,
+    // 0 <= index < length for an index the loop does not change
+    BOUNDS_INDEX,
+} BoundsFactKind;
+
+// A condition tested once before a loop instead of on every access in its
+// body. length is the one of the slice named array, or size when array is
+// NULL.
+typedef struct BoundsFact
+{
+    BoundsFactKind kind;
+    Expression *index;
+    int64_t offset;
+    char *array;
+    int size;
+    struct BoundsFact *next;
+} BoundsFact;
+
+typedef struct BoundsIndex
+{
+    Expression *index;
+    struct BoundsIndex *next;
+} BoundsIndex;
+
+// An innermost loop and the indexes of its body that are in bounds once
+// its facts hold. Loops without facts are proven at compile time, the
+// others are compiled twice and the facts pick the copy without checks.
+typedef struct BoundsLoop
+{
+    While *loop;
+    Expression *induction;
+    Expression *limit;
+    BoundsFact *facts;
+    BoundsIndex *proven;
+    struct BoundsLoop *next;
+} BoundsLoop;
+
+BoundsLoop *analyze_bounds(Node *ast, bool trapping);
+BoundsLoop *find_bounds_loop(BoundsLoop *loops, While *loop);
+bool bounds_proves(BoundsLoop *loop, Expression *index);
+void dispose_bounds(BoundsLoop *loops);
+
+#endif
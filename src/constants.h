@@ -27,5 +27,25 @@
 #define FUNCTION "func"
 #define VAR "var"
 #define RETURN "return"
+#define EXPORT "export"
+#define CONST "const"
+#define MEMO "memo"
+#define SPECIALIZE "specialize"
+#define SLICE "slice"
+#define TENSOR "tensor"
+#define PUSH "push"
+#define LEN "len"
+#define ZEROS "zeros"
+#define SUM "sum"
+#define MIN "min"
+#define MAX "max"
+#define DOT "dot"
+#define ARGMAX "argmax"
+#define MATMUL "matmul"
+#define AS_FLOAT "as_float"
+#define AS_INT "as_int"
+#define CAST_PREFIX "as_"
+#define TRUE "true"
+#define FALSE "false"
 
 #endif
@@ -14,7 +14,21 @@
  * limitations under the License.
  ******************************************************************************/
 
+
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define TRON_PROFILE_MAX_DEPTH 4096
+#define TRON_PROFILE_BUCKETS 65
 
 void print_int(int value)
 {
@@ -24,4 +38,1449 @@ void print_int(int value)
 void print_float(float value)
 {
     printf("%f\n", value);
-}
\ No newline at end of file
+}
+
+// Called by code compiled with --trap-on-overflow, output printed so far is
+// flushed before aborting
+void tron_overflow(int line, int col)
+{
+    fflush(stdout);
+    fprintf(stderr, "Integer overflow at %d:%d\n", line, col);
+    abort();
+}
+
+// Called on an index out of bounds unless compiled with --unchecked
+void tron_bounds(int line, int col, int64_t index, int64_t length)
+{
+    fflush(stdout);
+    fprintf(stderr, "Index %lld out of bounds for length %lld at %d:%d\n", (long long)index, (long long)length, line, col);
+    abort();
+}
+
+// Called when a tensor does not have the shape of the one it is combined
+// with or assigned to, when the sequences given to dot differ in length,
+// and on a negative size given to zeros, for which expected is -1. Checked
+// even with --unchecked.
+void tron_shape(int line, int col, int dimension, int64_t expected, int64_t actual)
+{
+    fflush(stdout);
+    if (expected < 0)
+    {
+        fprintf(stderr, "Dimension %d can not be %lld at %d:%d\n", dimension, (long long)actual, line, col);
+    }
+    else
+    {
+        fprintf(stderr, "Dimension %d is %lld, expected %lld at %d:%d\n", dimension, (long long)actual, (long long)expected, line, col);
+    }
+    abort();
+}
+
+// Half precision conversions LLVM calls on targets without instructions for
+// them. They normally come from compiler-rt, which programs are not linked
+// against.
+
+uint16_t tron_half_from_double(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 48) & 0x8000;
+    int exponent = (bits >> 52) & 0x7ff;
+    uint64_t mantissa = bits & 0xfffffffffffffULL;
+    if (exponent == 0x7ff)
+    {
+        return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+    }
+    int half_exponent = exponent - 1023 + 15;
+    if (exponent == 0 || half_exponent < -11)
+    {
+        return sign;
+    }
+    if (half_exponent >= 31)
+    {
+        return sign | 0x7c00;
+    }
+
+    // Subnormal halves keep fewer mantissa bits, rounding to nearest even
+    // may carry into the exponent up to infinity
+    uint64_t significand = mantissa | (1ULL << 52);
+    int shift = half_exponent >= 1 ? 42 : 42 + 1 - half_exponent;
+    uint64_t result = significand >> shift;
+    uint64_t rest = significand & ((1ULL << shift) - 1);
+    uint64_t halfway = 1ULL << (shift - 1);
+    if (rest > halfway || (rest == halfway && (result & 1) != 0))
+    {
+        result++;
+    }
+    if (half_exponent >= 1)
+    {
+        result += (uint64_t)(half_exponent - 1) << 10;
+    }
+    return sign | (uint16_t)result;
+}
+
+float tron_half_to_float(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    int exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        // Subnormals are exact multiples of 2^-24
+        float value = (float)mantissa * 5.9604644775390625e-8f;
+        memcpy(&bits, &value, sizeof(bits));
+        bits |= sign;
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((uint32_t)(exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+uint16_t __gnu_f2h_ieee(float value)
+{
+    return tron_half_from_double(value);
+}
+
+float __gnu_h2f_ieee(uint16_t half)
+{
+    return tron_half_to_float(half);
+}
+
+uint16_t __truncdfhf2(double value)
+{
+    return tron_half_from_double(value);
+}
+
+// Instrumentation runtime used by `tron --instrument`. Each thread records
+// into its own call tree so the hot path never takes a lock, the trees are
+// walked once at exit to write collapsed stacks and the summary tables.
+
+typedef struct TronProfileNode
+{
+    const char *name;
+    struct TronProfileNode *parent;
+    struct TronProfileNode *child;
+    struct TronProfileNode *sibling;
+    uint64_t calls;
+    uint64_t inclusive;
+    uint64_t exclusive;
+} TronProfileNode;
+
+typedef struct TronProfileFrame
+{
+    TronProfileNode *node;
+    uint64_t start;
+    uint64_t children;
+} TronProfileFrame;
+
+typedef struct TronProfileLoop
+{
+    const char *site;
+    uint64_t runs;
+    uint64_t iterations;
+    uint64_t histogram[TRON_PROFILE_BUCKETS];
+    struct TronProfileLoop *next;
+} TronProfileLoop;
+
+typedef struct TronProfileThread
+{
+    TronProfileNode root;
+    TronProfileFrame frames[TRON_PROFILE_MAX_DEPTH];
+    int depth;
+    TronProfileLoop *loops;
+    struct TronProfileThread *next;
+} TronProfileThread;
+
+typedef struct TronProfileFunction
+{
+    const char *name;
+    uint64_t calls;
+    uint64_t inclusive;
+    uint64_t exclusive;
+    struct TronProfileFunction *next;
+} TronProfileFunction;
+
+__thread TronProfileThread *tron_profile_thread = NULL;
+TronProfileThread *tron_profile_threads = NULL;
+
+uint64_t tron_profile_now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+int tron_profile_is_recursive(TronProfileNode *node)
+{
+    for (TronProfileNode *ancestor = node->parent; ancestor != NULL; ancestor = ancestor->parent)
+    {
+        if (ancestor->name != NULL && strcmp(ancestor->name, node->name) == 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+TronProfileFunction *tron_profile_collect(TronProfileFunction *functions, TronProfileNode *node)
+{
+    for (TronProfileNode *child = node->child; child != NULL; child = child->sibling)
+    {
+        TronProfileFunction *function = functions;
+        while (function != NULL && strcmp(function->name, child->name) != 0)
+        {
+            function = function->next;
+        }
+        if (function == NULL)
+        {
+            function = calloc(1, sizeof(TronProfileFunction));
+            function->name = child->name;
+            function->next = functions;
+            functions = function;
+        }
+        function->calls += child->calls;
+        function->exclusive += child->exclusive;
+        // Recursive activations are already covered by the outermost one
+        if (!tron_profile_is_recursive(child))
+        {
+            function->inclusive += child->inclusive;
+        }
+        functions = tron_profile_collect(functions, child);
+    }
+    return functions;
+}
+
+void tron_profile_write_stacks(FILE *out, TronProfileNode *node, const char **path, int depth)
+{
+    for (TronProfileNode *child = node->child; child != NULL; child = child->sibling)
+    {
+        path[depth] = child->name;
+        if (child->exclusive > 0)
+        {
+            for (int i = 0; i <= depth; i++)
+            {
+                fprintf(out, i == 0 ? "%s" : ";%s", path[i]);
+            }
+            fprintf(out, " %llu\n", (unsigned long long)child->exclusive);
+        }
+        tron_profile_write_stacks(out, child, path, depth + 1);
+    }
+}
+
+void tron_profile_dump()
+{
+    char *path = getenv("TRON_PROFILE");
+    if (path == NULL)
+    {
+        path = "tron-profile.folded";
+    }
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "tron: unable to write profile to %s\n", path);
+        return;
+    }
+
+    const char *stack[TRON_PROFILE_MAX_DEPTH];
+    TronProfileFunction *functions = NULL;
+    for (TronProfileThread *thread = tron_profile_threads; thread != NULL; thread = thread->next)
+    {
+        tron_profile_write_stacks(out, &thread->root, stack, 0);
+        functions = tron_profile_collect(functions, &thread->root);
+    }
+    fclose(out);
+
+    fprintf(stderr, "tron profile (%s), times in cycles\n", path);
+    fprintf(stderr, "%-24s %12s %16s %16s\n", "function", "calls", "inclusive", "exclusive");
+    while (functions != NULL)
+    {
+        fprintf(stderr, "%-24s %12llu %16llu %16llu\n", functions->name,
+                (unsigned long long)functions->calls,
+                (unsigned long long)functions->inclusive,
+                (unsigned long long)functions->exclusive);
+        TronProfileFunction *next = functions->next;
+        free(functions);
+        functions = next;
+    }
+
+    for (TronProfileThread *thread = tron_profile_threads; thread != NULL; thread = thread->next)
+    {
+        for (TronProfileLoop *loop = thread->loops; loop != NULL; loop = loop->next)
+        {
+            fprintf(stderr, "loop %s: runs %llu, iterations %llu\n", loop->site,
+                    (unsigned long long)loop->runs, (unsigned long long)loop->iterations);
+            for (int bucket = 0; bucket < TRON_PROFILE_BUCKETS; bucket++)
+            {
+                if (loop->histogram[bucket] == 0)
+                {
+                    continue;
+                }
+                uint64_t low = bucket == 0 ? 0 : (uint64_t)1 << (bucket - 1);
+                uint64_t high = bucket == 0 ? 0 : (low << 1) - 1;
+                fprintf(stderr, "  trips %llu..%llu: %llu\n", (unsigned long long)low,
+                        (unsigned long long)high, (unsigned long long)loop->histogram[bucket]);
+            }
+        }
+    }
+}
+
+TronProfileThread *tron_profile_get_thread()
+{
+    if (tron_profile_thread == NULL)
+    {
+        TronProfileThread *thread = calloc(1, sizeof(TronProfileThread));
+        thread->next = __atomic_load_n(&tron_profile_threads, __ATOMIC_ACQUIRE);
+        while (!__atomic_compare_exchange_n(&tron_profile_threads, &thread->next, thread, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+        }
+        if (thread->next == NULL)
+        {
+            atexit(tron_profile_dump);
+        }
+        tron_profile_thread = thread;
+    }
+    return tron_profile_thread;
+}
+
+void tron_profile_enter(const char *name)
+{
+    TronProfileThread *thread = tron_profile_get_thread();
+    if (thread->depth < TRON_PROFILE_MAX_DEPTH)
+    {
+        TronProfileNode *parent = thread->depth > 0 ? thread->frames[thread->depth - 1].node : &thread->root;
+        TronProfileNode *node = parent->child;
+        while (node != NULL && node->name != name && strcmp(node->name, name) != 0)
+        {
+            node = node->sibling;
+        }
+        if (node == NULL)
+        {
+            node = calloc(1, sizeof(TronProfileNode));
+            node->name = name;
+            node->parent = parent;
+            node->sibling = parent->child;
+            parent->child = node;
+        }
+        node->calls++;
+
+        TronProfileFrame *frame = &thread->frames[thread->depth];
+        frame->node = node;
+        frame->children = 0;
+        frame->start = tron_profile_now();
+    }
+    thread->depth++;
+}
+
+void tron_profile_exit()
+{
+    uint64_t now = tron_profile_now();
+    TronProfileThread *thread = tron_profile_thread;
+    if (thread == NULL || thread->depth == 0)
+    {
+        return;
+    }
+    thread->depth--;
+    if (thread->depth < TRON_PROFILE_MAX_DEPTH)
+    {
+        TronProfileFrame *frame = &thread->frames[thread->depth];
+        uint64_t elapsed = now - frame->start;
+        frame->node->inclusive += elapsed;
+        frame->node->exclusive += elapsed - frame->children;
+        if (thread->depth > 0)
+        {
+            thread->frames[thread->depth - 1].children += elapsed;
+        }
+    }
+}
+
+void tron_profile_loop(const char *site, uint64_t trips)
+{
+    TronProfileThread *thread = tron_profile_get_thread();
+    TronProfileLoop *loop = thread->loops;
+    while (loop != NULL && loop->site != site && strcmp(loop->site, site) != 0)
+    {
+        loop = loop->next;
+    }
+    if (loop == NULL)
+    {
+        loop = calloc(1, sizeof(TronProfileLoop));
+        loop->site = site;
+        loop->next = thread->loops;
+        thread->loops = loop;
+    }
+    loop->runs++;
+    loop->iterations += trips;
+    loop->histogram[trips == 0 ? 0 : 64 - __builtin_clzll(trips)]++;
+}
+
+// Counter runtime used by `tron --profile-generate`. Every instrumented site
+// registers its counter from a module constructor, the counts are written
+// in registration order, grouped by function, when the program exits.
+
+typedef struct TronPgoCounter
+{
+    const char *function;
+    const char *site;
+    uint64_t *count;
+    struct TronPgoCounter *next;
+} TronPgoCounter;
+
+TronPgoCounter *tron_pgo_counters = NULL;
+TronPgoCounter *tron_pgo_last_counter = NULL;
+
+void tron_pgo_dump()
+{
+    char *path = getenv("TRON_PGO_PROFILE");
+    if (path == NULL)
+    {
+        path = "tron.profile";
+    }
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+        fprintf(stderr, "tron: unable to write profile to %s\n", path);
+        return;
+    }
+
+    fprintf(out, "# tron profile\n");
+    const char *function = NULL;
+    for (TronPgoCounter *counter = tron_pgo_counters; counter != NULL; counter = counter->next)
+    {
+        if (function == NULL || strcmp(function, counter->function) != 0)
+        {
+            function = counter->function;
+            fprintf(out, "function %s\n", function);
+        }
+        fprintf(out, "%s %llu\n", counter->site, (unsigned long long)*counter->count);
+    }
+    fclose(out);
+}
+
+void tron_pgo_register(const char *function, const char *site, uint64_t *count)
+{
+    TronPgoCounter *counter = calloc(1, sizeof(TronPgoCounter));
+    counter->function = function;
+    counter->site = site;
+    counter->count = count;
+    if (tron_pgo_last_counter == NULL)
+    {
+        tron_pgo_counters = counter;
+        atexit(tron_pgo_dump);
+    }
+    else
+    {
+        tron_pgo_last_counter->next = counter;
+    }
+    tron_pgo_last_counter = counter;
+}
+
+// Memoization runtime used by `@memo` functions whose keys don't fit the
+// dense table emitted by the compiler. Every function owns an open
+// addressing table reached through a handle global, allocated on first use.
+// Slots are laid out as [used, keys..., value] 32 bit words.
+typedef struct TronMemoTable
+{
+    int num_keys;
+    uint32_t capacity;
+    uint32_t count;
+    int32_t *slots;
+} TronMemoTable;
+
+#define TRON_MEMO_INITIAL_CAPACITY 1024
+
+uint32_t tron_memo_hash(int num_keys, int32_t *keys)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < num_keys; i++)
+    {
+        hash = (hash ^ (uint32_t)keys[i]) * 16777619u;
+    }
+    return hash;
+}
+
+int32_t *tron_memo_find(TronMemoTable *table, int32_t *keys)
+{
+    int slot_size = table->num_keys + 2;
+    uint32_t mask = table->capacity - 1;
+    for (uint32_t index = tron_memo_hash(table->num_keys, keys) & mask;; index = (index + 1) & mask)
+    {
+        int32_t *slot = &table->slots[index * slot_size];
+        if (!slot[0] || memcmp(&slot[1], keys, table->num_keys * sizeof(int32_t)) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+void tron_memo_grow(TronMemoTable *table)
+{
+    int slot_size = table->num_keys + 2;
+    uint32_t capacity = table->capacity;
+    int32_t *slots = table->slots;
+    table->capacity = capacity == 0 ? TRON_MEMO_INITIAL_CAPACITY : capacity * 2;
+    table->slots = calloc((size_t)table->capacity * slot_size, sizeof(int32_t));
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        int32_t *slot = &slots[i * slot_size];
+        if (slot[0])
+        {
+            memcpy(tron_memo_find(table, &slot[1]), slot, slot_size * sizeof(int32_t));
+        }
+    }
+    free(slots);
+}
+
+int tron_memo_lookup(void **handle, int num_keys, int32_t *keys, int32_t *value)
+{
+    TronMemoTable *table = *handle;
+    if (table == NULL)
+    {
+        return 0;
+    }
+    int32_t *slot = tron_memo_find(table, keys);
+    if (!slot[0])
+    {
+        return 0;
+    }
+    *value = slot[num_keys + 1];
+    return 1;
+}
+
+void tron_memo_store(void **handle, int num_keys, int32_t *keys, int32_t value)
+{
+    TronMemoTable *table = *handle;
+    if (table == NULL)
+    {
+        table = calloc(1, sizeof(TronMemoTable));
+        table->num_keys = num_keys;
+        *handle = table;
+    }
+    // Keep the load factor under 70% so probe sequences stay short
+    if ((uint64_t)(table->count + 1) * 10 > (uint64_t)table->capacity * 7)
+    {
+        tron_memo_grow(table);
+    }
+    int32_t *slot = tron_memo_find(table, keys);
+    if (!slot[0])
+    {
+        slot[0] = 1;
+        memcpy(&slot[1], keys, num_keys * sizeof(int32_t));
+        table->count++;
+    }
+    slot[num_keys + 1] = value;
+}
+
+// Slice runtime. Buffers come from per thread free lists, one per power of
+// two size class, so a slice that is built and dropped in a loop reuses the
+// same memory without going through malloc. Headers are laid out like the
+// {T*, i64, i64} struct the compiler emits. Views have a capacity of 0 and
+// own nothing, pushing to one moves its elements to a buffer of its own.
+typedef struct TronSlice
+{
+    void *data;
+    int64_t length;
+    int64_t capacity;
+} TronSlice;
+
+#define TRON_POOL_MIN_SHIFT 4
+#define TRON_POOL_CLASSES 23
+#define TRON_POOL_MAX_CACHED 16
+
+typedef struct TronPoolBuffer
+{
+    struct TronPoolBuffer *next;
+} TronPoolBuffer;
+
+__thread TronPoolBuffer *tron_pool_buffers[TRON_POOL_CLASSES];
+__thread int tron_pool_cached[TRON_POOL_CLASSES];
+
+int tron_pool_class(uint64_t size)
+{
+    int size_class = 0;
+    while (size_class < TRON_POOL_CLASSES && ((uint64_t)1 << (size_class + TRON_POOL_MIN_SHIFT)) < size)
+    {
+        size_class++;
+    }
+    return size_class;
+}
+
+// Rounds size up to its class, the caller can use all of it
+void *tron_pool_alloc(uint64_t *size)
+{
+    int size_class = tron_pool_class(*size);
+    void *data;
+    if (size_class == TRON_POOL_CLASSES)
+    {
+        data = malloc(*size);
+    }
+    else
+    {
+        *size = (uint64_t)1 << (size_class + TRON_POOL_MIN_SHIFT);
+        TronPoolBuffer *buffer = tron_pool_buffers[size_class];
+        if (buffer != NULL)
+        {
+            tron_pool_buffers[size_class] = buffer->next;
+            tron_pool_cached[size_class]--;
+            return buffer;
+        }
+        // Buffers of a cache line and more start on one
+        data = aligned_alloc(*size < 64 ? *size : 64, *size);
+    }
+    if (data == NULL)
+    {
+        fprintf(stderr, "Out of memory allocating %llu bytes\n", (unsigned long long)*size);
+        abort();
+    }
+    return data;
+}
+
+void tron_pool_free(void *data, uint64_t size)
+{
+    int size_class = tron_pool_class(size);
+    if (size_class == TRON_POOL_CLASSES || tron_pool_cached[size_class] == TRON_POOL_MAX_CACHED)
+    {
+        free(data);
+        return;
+    }
+    TronPoolBuffer *buffer = data;
+    buffer->next = tron_pool_buffers[size_class];
+    tron_pool_buffers[size_class] = buffer;
+    tron_pool_cached[size_class]++;
+}
+
+// Makes room for length elements, at least doubling the capacity so that a
+// run of pushes copies every element a constant number of times
+void tron_slice_reserve(TronSlice *slice, int64_t length, int64_t element_size)
+{
+    if (length <= slice->capacity)
+    {
+        return;
+    }
+    int64_t capacity = slice->capacity * 2 > length ? slice->capacity * 2 : length;
+    uint64_t size = (uint64_t)capacity * element_size;
+    void *data = tron_pool_alloc(&size);
+    if (slice->length > 0)
+    {
+        memcpy(data, slice->data, slice->length * element_size);
+    }
+    if (slice->capacity > 0)
+    {
+        tron_pool_free(slice->data, slice->capacity * element_size);
+    }
+    slice->data = data;
+    slice->capacity = size / element_size;
+}
+
+void tron_slice_release(TronSlice *slice, int64_t element_size)
+{
+    if (slice->capacity > 0)
+    {
+        tron_pool_free(slice->data, slice->capacity * element_size);
+    }
+    slice->data = NULL;
+    slice->length = 0;
+    slice->capacity = 0;
+}
+
+// Reductions behind the sum, min, max, dot and argmax builtins, one set per
+// element type. Kernels load vectors of TRON_VECTOR_BYTES into several
+// accumulators so that consecutive additions do not wait on each other.
+// Float sums add blocks of TRON_PAIRWISE_BLOCK elements that way and combine
+// the blocks pairwise, which keeps the rounding error growing with the
+// logarithm of the length and the result the same on every run. Inputs of
+// TRON_PARALLEL_MIN elements and more are cut into TRON_REDUCE_PARTS parts
+// reduced on threads. The parts are the subtrees of the pairwise sum, so
+// threads do not change the result either.
+
+// Vectors the target has registers for, wider ones are split up and their
+// compares done lane by lane
+#if defined(__AVX2__)
+#define TRON_VECTOR_BYTES 32
+#else
+#define TRON_VECTOR_BYTES 16
+#endif
+#define TRON_PAIRWISE_BLOCK 256
+#define TRON_REDUCE_PARTS 8
+#define TRON_PARALLEL_MIN (1 << 20)
+
+typedef struct TronReduceTask
+{
+    void (*kernel)(struct TronReduceTask *task);
+    const void *data;
+    const void *other;
+    int64_t offset;
+    int64_t length;
+    int64_t integer;
+    double real;
+} TronReduceTask;
+
+// Length of the first half of a pairwise sum, a whole number of blocks
+int64_t tron_pairwise_half(int64_t length)
+{
+    int64_t blocks = (length + TRON_PAIRWISE_BLOCK - 1) / TRON_PAIRWISE_BLOCK;
+    return blocks / 2 * TRON_PAIRWISE_BLOCK;
+}
+
+void tron_reduce_split(TronReduceTask *tasks, int parts, int64_t offset, int64_t length)
+{
+    if (parts == 1)
+    {
+        tasks->offset = offset;
+        tasks->length = length;
+        return;
+    }
+    int64_t half = tron_pairwise_half(length);
+    tron_reduce_split(tasks, parts / 2, offset, half);
+    tron_reduce_split(tasks + parts / 2, parts / 2, offset + half, length - half);
+}
+
+void *tron_reduce_thread(void *task)
+{
+    ((TronReduceTask *)task)->kernel(task);
+    return NULL;
+}
+
+// Runs kernel on every part of length elements, the first part on the
+// calling thread. A part whose thread can not be started runs there too.
+void tron_reduce_parts(TronReduceTask *tasks, void (*kernel)(TronReduceTask *), const void *data, const void *other,
+                       int64_t length)
+{
+    pthread_t threads[TRON_REDUCE_PARTS];
+    bool started[TRON_REDUCE_PARTS];
+    bool parallel = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    tron_reduce_split(tasks, TRON_REDUCE_PARTS, 0, length);
+    for (int i = 0; i < TRON_REDUCE_PARTS; i++)
+    {
+        tasks[i].kernel = kernel;
+        tasks[i].data = data;
+        tasks[i].other = other;
+        started[i] = parallel && i > 0 && pthread_create(&threads[i], NULL, tron_reduce_thread, &tasks[i]) == 0;
+    }
+    kernel(&tasks[0]);
+    for (int i = 1; i < TRON_REDUCE_PARTS; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+        else
+        {
+            kernel(&tasks[i]);
+        }
+    }
+}
+
+float tron_bf16_to_float(uint16_t bits)
+{
+    uint32_t wide = (uint32_t)bits << 16;
+    float value;
+    memcpy(&value, &wide, sizeof(value));
+    return value;
+}
+
+// Sum and dot product of length elements accumulated in four vectors of
+// lanes of type A, unsigned for integers so that they wrap. The lanes are
+// added up in a fixed order.
+#define TRON_SUM_KERNELS(NAME, T, A)                                                                \
+    typedef A tron_##NAME##_sum_vector __attribute__((vector_size(TRON_VECTOR_BYTES)));            \
+                                                                                                    \
+    A tron_vector_sum_##NAME(const T *data, int64_t length)                                        \
+    {                                                                                               \
+        const int lanes = sizeof(tron_##NAME##_sum_vector) / sizeof(A);                            \
+        tron_##NAME##_sum_vector sum0 = {0}, sum1 = {0}, sum2 = {0}, sum3 = {0};                   \
+        tron_##NAME##_sum_vector value0, value1, value2, value3;                                   \
+        int64_t i = 0;                                                                              \
+        for (; i + 4 * lanes <= length; i += 4 * lanes)                                             \
+        {                                                                                           \
+            memcpy(&value0, data + i, sizeof(value0));                                              \
+            memcpy(&value1, data + i + lanes, sizeof(value1));                                      \
+            memcpy(&value2, data + i + 2 * lanes, sizeof(value2));                                  \
+            memcpy(&value3, data + i + 3 * lanes, sizeof(value3));                                  \
+            sum0 += value0;                                                                         \
+            sum1 += value1;                                                                         \
+            sum2 += value2;                                                                         \
+            sum3 += value3;                                                                         \
+        }                                                                                           \
+        tron_##NAME##_sum_vector total = (sum0 + sum1) + (sum2 + sum3);                             \
+        A sum = 0;                                                                                  \
+        for (int j = 0; j < lanes; j++)                                                             \
+        {                                                                                           \
+            sum += total[j];                                                                        \
+        }                                                                                           \
+        for (; i < length; i++)                                                                     \
+        {                                                                                           \
+            sum += (A)data[i];                                                                      \
+        }                                                                                           \
+        return sum;                                                                                 \
+    }                                                                                               \
+                                                                                                    \
+    A tron_vector_dot_##NAME(const T *data, const T *other, int64_t length)                        \
+    {                                                                                               \
+        const int lanes = sizeof(tron_##NAME##_sum_vector) / sizeof(A);                            \
+        tron_##NAME##_sum_vector sum0 = {0}, sum1 = {0}, sum2 = {0}, sum3 = {0};                   \
+        tron_##NAME##_sum_vector left0, left1, left2, left3, right0, right1, right2, right3;       \
+        int64_t i = 0;                                                                              \
+        for (; i + 4 * lanes <= length; i += 4 * lanes)                                             \
+        {                                                                                           \
+            memcpy(&left0, data + i, sizeof(left0));                                                \
+            memcpy(&left1, data + i + lanes, sizeof(left1));                                        \
+            memcpy(&left2, data + i + 2 * lanes, sizeof(left2));                                    \
+            memcpy(&left3, data + i + 3 * lanes, sizeof(left3));                                    \
+            memcpy(&right0, other + i, sizeof(right0));                                             \
+            memcpy(&right1, other + i + lanes, sizeof(right1));                                     \
+            memcpy(&right2, other + i + 2 * lanes, sizeof(right2));                                 \
+            memcpy(&right3, other + i + 3 * lanes, sizeof(right3));                                 \
+            sum0 += left0 * right0;                                                                 \
+            sum1 += left1 * right1;                                                                 \
+            sum2 += left2 * right2;                                                                 \
+            sum3 += left3 * right3;                                                                 \
+        }                                                                                           \
+        tron_##NAME##_sum_vector total = (sum0 + sum1) + (sum2 + sum3);                             \
+        A sum = 0;                                                                                  \
+        for (int j = 0; j < lanes; j++)                                                             \
+        {                                                                                           \
+            sum += total[j];                                                                        \
+        }                                                                                           \
+        for (; i < length; i++)                                                                     \
+        {                                                                                           \
+            sum += (A)data[i] * (A)other[i];                                                        \
+        }                                                                                           \
+        return sum;                                                                                 \
+    }
+
+// Keeps the lanes of value that compare CMP to those of result, through
+// the mask of the compare
+#define TRON_SELECT(CMP, value, result, mask)                                                       \
+    (result) = (__typeof__(result))(((mask)(value) & ((value)CMP(result))) | ((mask)(result) & ~((value)CMP(result))))
+
+// Smallest or largest of length > 0 elements, CMP being < or >, M the
+// signed integer type of the width of T
+#define TRON_EXTREMUM_KERNEL(OP, NAME, T, M, CMP)                                                   \
+    T tron_vector_##OP##_##NAME(const T *data, int64_t length)                                     \
+    {                                                                                               \
+        typedef T vector __attribute__((vector_size(TRON_VECTOR_BYTES)));                           \
+        typedef M mask __attribute__((vector_size(TRON_VECTOR_BYTES)));                             \
+        const int lanes = sizeof(vector) / sizeof(T);                                               \
+        vector result0 = (vector){0} + data[0];                                                     \
+        vector result1 = result0, result2 = result0, result3 = result0;                             \
+        vector value0, value1, value2, value3;                                                      \
+        int64_t i = 0;                                                                              \
+        for (; i + 4 * lanes <= length; i += 4 * lanes)                                             \
+        {                                                                                           \
+            memcpy(&value0, data + i, sizeof(value0));                                              \
+            memcpy(&value1, data + i + lanes, sizeof(value1));                                      \
+            memcpy(&value2, data + i + 2 * lanes, sizeof(value2));                                  \
+            memcpy(&value3, data + i + 3 * lanes, sizeof(value3));                                  \
+            TRON_SELECT(CMP, value0, result0, mask);                                                \
+            TRON_SELECT(CMP, value1, result1, mask);                                                \
+            TRON_SELECT(CMP, value2, result2, mask);                                                \
+            TRON_SELECT(CMP, value3, result3, mask);                                                \
+        }                                                                                           \
+        TRON_SELECT(CMP, result1, result0, mask);                                                   \
+        TRON_SELECT(CMP, result3, result2, mask);                                                   \
+        TRON_SELECT(CMP, result2, result0, mask);                                                   \
+        T result = data[0];                                                                         \
+        for (int j = 0; j < lanes; j++)                                                             \
+        {                                                                                           \
+            if (result0[j] CMP result)                                                              \
+            {                                                                                       \
+                result = result0[j];                                                                \
+            }                                                                                       \
+        }                                                                                           \
+        for (; i < length; i++)                                                                     \
+        {                                                                                           \
+            if (data[i] CMP result)                                                                 \
+            {                                                                                       \
+                result = data[i];                                                                   \
+            }                                                                                       \
+        }                                                                                           \
+        return result;                                                                              \
+    }
+
+// min and max of an integer type, the empty sequence gives 0
+#define TRON_INT_EXTREMUM(OP, NAME, T, M, CMP)                                                      \
+    TRON_EXTREMUM_KERNEL(OP, NAME, T, M, CMP)                                                       \
+                                                                                                    \
+    void tron_##OP##_part_##NAME(TronReduceTask *task)                                              \
+    {                                                                                               \
+        task->integer = tron_vector_##OP##_##NAME((const T *)task->data + task->offset, task->length); \
+    }                                                                                               \
+                                                                                                    \
+    T tron_##OP##_##NAME(const T *data, int64_t length)                                             \
+    {                                                                                               \
+        if (length < TRON_PARALLEL_MIN)                                                             \
+        {                                                                                           \
+            return length > 0 ? tron_vector_##OP##_##NAME(data, length) : 0;                        \
+        }                                                                                           \
+        TronReduceTask tasks[TRON_REDUCE_PARTS];                                                    \
+        tron_reduce_parts(tasks, tron_##OP##_part_##NAME, data, NULL, length);                      \
+        T result = (T)tasks[0].integer;                                                             \
+        for (int i = 1; i < TRON_REDUCE_PARTS; i++)                                                 \
+        {                                                                                           \
+            if ((T)tasks[i].integer CMP result)                                                     \
+            {                                                                                       \
+                result = (T)tasks[i].integer;                                                       \
+            }                                                                                       \
+        }                                                                                           \
+        return result;                                                                              \
+    }
+
+// Integer sums and dot products wrap around like unsigned arithmetic,
+// argmax is the first index of the largest element and -1 for none
+#define TRON_INT_REDUCTIONS(NAME, T, U, M)                                                          \
+    TRON_SUM_KERNELS(NAME, T, U)                                                                    \
+    TRON_INT_EXTREMUM(min, NAME, T, M, <)                                                           \
+    TRON_INT_EXTREMUM(max, NAME, T, M, >)                                                           \
+                                                                                                    \
+    void tron_sum_part_##NAME(TronReduceTask *task)                                                 \
+    {                                                                                               \
+        task->integer = (T)tron_vector_sum_##NAME((const T *)task->data + task->offset, task->length); \
+    }                                                                                               \
+                                                                                                    \
+    void tron_dot_part_##NAME(TronReduceTask *task)                                                 \
+    {                                                                                               \
+        task->integer = (T)tron_vector_dot_##NAME((const T *)task->data + task->offset,            \
+                                                  (const T *)task->other + task->offset, task->length); \
+    }                                                                                               \
+                                                                                                    \
+    T tron_sum_##NAME(const T *data, int64_t length)                                                \
+    {                                                                                               \
+        if (length < TRON_PARALLEL_MIN)                                                             \
+        {                                                                                           \
+            return (T)tron_vector_sum_##NAME(data, length);                                         \
+        }                                                                                           \
+        TronReduceTask tasks[TRON_REDUCE_PARTS];                                                    \
+        tron_reduce_parts(tasks, tron_sum_part_##NAME, data, NULL, length);                         \
+        U sum = 0;                                                                                  \
+        for (int i = 0; i < TRON_REDUCE_PARTS; i++)                                                 \
+        {                                                                                           \
+            sum += (U)(T)tasks[i].integer;                                                          \
+        }                                                                                           \
+        return (T)sum;                                                                              \
+    }                                                                                               \
+                                                                                                    \
+    T tron_dot_##NAME(const T *data, const T *other, int64_t length)                                \
+    {                                                                                               \
+        if (length < TRON_PARALLEL_MIN)                                                             \
+        {                                                                                           \
+            return (T)tron_vector_dot_##NAME(data, other, length);                                  \
+        }                                                                                           \
+        TronReduceTask tasks[TRON_REDUCE_PARTS];                                                    \
+        tron_reduce_parts(tasks, tron_dot_part_##NAME, data, other, length);                        \
+        U sum = 0;                                                                                  \
+        for (int i = 0; i < TRON_REDUCE_PARTS; i++)                                                 \
+        {                                                                                           \
+            sum += (U)(T)tasks[i].integer;                                                          \
+        }                                                                                           \
+        return (T)sum;                                                                              \
+    }                                                                                               \
+                                                                                                    \
+    int64_t tron_argmax_##NAME(const T *data, int64_t length)                                       \
+    {                                                                                               \
+        if (length == 0)                                                                            \
+        {                                                                                           \
+            return -1;                                                                              \
+        }                                                                                           \
+        T max = tron_max_##NAME(data, length);                                                      \
+        int64_t i = 0;                                                                              \
+        while (data[i] != max)                                                                      \
+        {                                                                                           \
+            i++;                                                                                    \
+        }                                                                                           \
+        return i;                                                                                   \
+    }
+
+TRON_INT_REDUCTIONS(int, int32_t, uint32_t, int32_t)
+TRON_INT_REDUCTIONS(i8, int8_t, uint8_t, int8_t)
+TRON_INT_REDUCTIONS(i16, int16_t, uint16_t, int16_t)
+TRON_INT_REDUCTIONS(i64, int64_t, uint64_t, int64_t)
+TRON_INT_REDUCTIONS(u8, uint8_t, uint8_t, int8_t)
+TRON_INT_REDUCTIONS(u16, uint16_t, uint16_t, int16_t)
+TRON_INT_REDUCTIONS(u32, uint32_t, uint32_t, int32_t)
+TRON_INT_REDUCTIONS(u64, uint64_t, uint64_t, int64_t)
+
+// Kernels of the types floats are computed in, blocks of half precision
+// elements are converted to float before going through them
+TRON_SUM_KERNELS(float, float, float)
+TRON_EXTREMUM_KERNEL(min, float, float, int32_t, <)
+TRON_EXTREMUM_KERNEL(max, float, float, int32_t, >)
+TRON_SUM_KERNELS(f64, double, double)
+TRON_EXTREMUM_KERNEL(min, f64, double, int64_t, <)
+TRON_EXTREMUM_KERNEL(max, f64, double, int64_t, >)
+
+// min and max of a float type by blocks, the empty sequence gives 0. NaNs
+// are skipped unless the first element is one.
+#define TRON_FLOAT_EXTREMUM(OP, NAME, T, S, KERNEL, CMP)                                            \
+    S tron_range_##OP##_##NAME(const T *data, int64_t length)                                       \
+    {                                                                                               \
+        S buffer[TRON_PAIRWISE_BLOCK];                                                              \
+        S result = tron_load_##NAME(data, 1, buffer)[0];                                            \
+        for (int64_t i = 0; i < length; i += TRON_PAIRWISE_BLOCK)                                   \
+        {                                                                                           \
+            int64_t block = length - i < TRON_PAIRWISE_BLOCK ? length - i : TRON_PAIRWISE_BLOCK;    \
+            S value = tron_vector_##OP##_##KERNEL(tron_load_##NAME(data + i, block, buffer), block); \
+            if (value CMP result)                                                                   \
+            {                                                                                       \
+                result = value;                                                                     \
+            }                                                                                       \
+        }                                                                                           \
+        return result;                                                                              \
+    }                                                                                               \
+                                                                                                    \
+    void tron_##OP##_part_##NAME(TronReduceTask *task)                                              \
+    {                                                                                               \
+        task->real = tron_range_##OP##_##NAME((const T *)task->data + task->offset, task->length);  \
+    }                                                                                               \
+                                                                                                    \
+    S tron_##OP##_##NAME(const T *data, int64_t length)                                             \
+    {                                                                                               \
+        if (length < TRON_PARALLEL_MIN)                                                             \
+        {                                                                                           \
+            return length > 0 ? tron_range_##OP##_##NAME(data, length) : 0;                         \
+        }                                                                                           \
+        TronReduceTask tasks[TRON_REDUCE_PARTS];                                                    \
+        tron_reduce_parts(tasks, tron_##OP##_part_##NAME, data, NULL, length);                      \
+        S result = (S)tasks[0].real;                                                                \
+        for (int i = 1; i < TRON_REDUCE_PARTS; i++)                                                 \
+        {                                                                                           \
+            if ((S)tasks[i].real CMP result)                                                        \
+            {                                                                                       \
+                result = (S)tasks[i].real;                                                          \
+            }                                                                                       \
+        }                                                                                           \
+        return result;                                                                              \
+    }
+
+// Float reductions of elements of type T computed in S, with KERNEL the
+// kernels of S and TO_S converting an element. Sums and dot products are
+// pairwise, the parts of a parallel one are combined in the same tree.
+#define TRON_FLOAT_REDUCTIONS(NAME, T, S, KERNEL, TO_S)                                             \
+    const S *tron_load_##NAME(const T *data, int64_t length, S *buffer)                             \
+    {                                                                                               \
+        if (sizeof(T) == sizeof(S))                                                                 \
+        {                                                                                           \
+            return (const S *)data;                                                                 \
+        }                                                                                           \
+        for (int64_t i = 0; i < length; i++)                                                        \
+        {                                                                                           \
+            buffer[i] = TO_S(data[i]);                                                              \
+        }                                                                                           \
+        return buffer;                                                                              \
+    }                                                                                               \
+                                                                                                    \
+    S tron_pairwise_sum_##NAME(const T *data, int64_t length)                                       \
+    {                                                                                               \
+        if (length <= TRON_PAIRWISE_BLOCK)                                                          \
+        {                                                                                           \
+            S buffer[TRON_PAIRWISE_BLOCK];                                                          \
+            return tron_vector_sum_##KERNEL(tron_load_##NAME(data, length, buffer), length);        \
+        }                                                                                           \
+        int64_t half = tron_pairwise_half(length);                                                  \
+        return tron_pairwise_sum_##NAME(data, half) + tron_pairwise_sum_##NAME(data + half, length - half); \
+    }                                                                                               \
+                                                                                                    \
+    S tron_pairwise_dot_##NAME(const T *data, const T *other, int64_t length)                       \
+    {                                                                                               \
+        if (length <= TRON_PAIRWISE_BLOCK)                                                          \
+        {                                                                                           \
+            S left[TRON_PAIRWISE_BLOCK];                                                            \
+            S right[TRON_PAIRWISE_BLOCK];                                                           \
+            return tron_vector_dot_##KERNEL(tron_load_##NAME(data, length, left),                   \
+                                            tron_load_##NAME(other, length, right), length);        \
+        }                                                                                           \
+        int64_t half = tron_pairwise_half(length);                                                  \
+        return tron_pairwise_dot_##NAME(data, other, half) +                                        \
+               tron_pairwise_dot_##NAME(data + half, other + half, length - half);                  \
+    }                                                                                               \
+                                                                                                    \
+    void tron_sum_part_##NAME(TronReduceTask *task)                                                 \
+    {                                                                                               \
+        task->real = tron_pairwise_sum_##NAME((const T *)task->data + task->offset, task->length);  \
+    }                                                                                               \
+                                                                                                    \
+    void tron_dot_part_##NAME(TronReduceTask *task)                                                 \
+    {                                                                                               \
+        task->real = tron_pairwise_dot_##NAME((const T *)task->data + task->offset,                 \
+                                              (const T *)task->other + task->offset, task->length); \
+    }                                                                                               \
+                                                                                                    \
+    S tron_combine_##NAME(TronReduceTask *tasks)                                                    \
+    {                                                                                               \
+        S values[TRON_REDUCE_PARTS];                                                                \
+        for (int i = 0; i < TRON_REDUCE_PARTS; i++)                                                 \
+        {                                                                                           \
+            values[i] = (S)tasks[i].real;                                                           \
+        }                                                                                           \
+        for (int width = 1; width < TRON_REDUCE_PARTS; width *= 2)                                  \
+        {                                                                                           \
+            for (int i = 0; i < TRON_REDUCE_PARTS; i += 2 * width)                                  \
+            {                                                                                       \
+                values[i] += values[i + width];                                                     \
+            }                                                                                       \
+        }                                                                                           \
+        return values[0];                                                                           \
+    }                                                                                               \
+                                                                                                    \
+    S tron_sum_##NAME(const T *data, int64_t length)                                                \
+    {                                                                                               \
+        if (length < TRON_PARALLEL_MIN)                                                             \
+        {                                                                                           \
+            return tron_pairwise_sum_##NAME(data, length);                                          \
+        }                                                                                           \
+        TronReduceTask tasks[TRON_REDUCE_PARTS];                                                    \
+        tron_reduce_parts(tasks, tron_sum_part_##NAME, data, NULL, length);                         \
+        return tron_combine_##NAME(tasks);                                                          \
+    }                                                                                               \
+                                                                                                    \
+    S tron_dot_##NAME(const T *data, const T *other, int64_t length)                                \
+    {                                                                                               \
+        if (length < TRON_PARALLEL_MIN)                                                             \
+        {                                                                                           \
+            return tron_pairwise_dot_##NAME(data, other, length);                                   \
+        }                                                                                           \
+        TronReduceTask tasks[TRON_REDUCE_PARTS];                                                    \
+        tron_reduce_parts(tasks, tron_dot_part_##NAME, data, other, length);                        \
+        return tron_combine_##NAME(tasks);                                                          \
+    }                                                                                               \
+                                                                                                    \
+    TRON_FLOAT_EXTREMUM(min, NAME, T, S, KERNEL, <)                                                 \
+    TRON_FLOAT_EXTREMUM(max, NAME, T, S, KERNEL, >)                                                 \
+                                                                                                    \
+    int64_t tron_argmax_##NAME(const T *data, int64_t length)                                       \
+    {                                                                                               \
+        if (length == 0)                                                                            \
+        {                                                                                           \
+            return -1;                                                                              \
+        }                                                                                           \
+        S max = tron_max_##NAME(data, length);                                                      \
+        for (int64_t i = 0; i < length; i++)                                                        \
+        {                                                                                           \
+            if (TO_S(data[i]) == max)                                                               \
+            {                                                                                       \
+                return i;                                                                           \
+            }                                                                                       \
+        }                                                                                           \
+        return 0;                                                                                   \
+    }
+
+TRON_FLOAT_REDUCTIONS(float, float, float, float, (float))
+TRON_FLOAT_REDUCTIONS(f64, double, double, f64, (double))
+TRON_FLOAT_REDUCTIONS(f16, uint16_t, float, float, tron_half_to_float)
+TRON_FLOAT_REDUCTIONS(bf16, uint16_t, float, float, tron_bf16_to_float)
+
+// Matrix products behind the matmul builtin. C = A B is computed by
+// blocks: a TRON_GEMM_KC x TRON_GEMM_NC panel of B is packed into slivers
+// of NR columns and a TRON_GEMM_MC x TRON_GEMM_KC block of A into slivers
+// of TRON_GEMM_MR rows, so that the micro-kernel streams both from
+// contiguous memory while the B sliver stays in L1 and the A block in L2.
+// The micro-kernel keeps a TRON_GEMM_MR x NR tile of C in vector registers,
+// NR being two vectors of the widest instruction set the CPU has: AVX-512,
+// AVX2 with FMA or the baseline one, picked at runtime. Large products are
+// split by rows over threads, every element of C is computed by one thread
+// in the same order whatever their number.
+
+#define TRON_GEMM_MR 6
+#define TRON_GEMM_KC 256
+#define TRON_GEMM_MC 120
+#define TRON_GEMM_NC 2048
+#define TRON_GEMM_MAX_THREADS 16
+// Multiply-adds below which a product stays on the calling thread
+#define TRON_GEMM_PARALLEL_MIN (1 << 22)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRON_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TRON_TARGET_AVX512 __attribute__((target("avx512f")))
+#define TRON_AVX2_BYTES 32
+#define TRON_AVX512_BYTES 64
+#else
+#define TRON_TARGET_AVX2
+#define TRON_TARGET_AVX512
+#define TRON_AVX2_BYTES 16
+#define TRON_AVX512_BYTES 16
+#endif
+
+typedef enum TronGemmIsa
+{
+    TRON_GEMM_BASELINE,
+    TRON_GEMM_AVX2,
+    TRON_GEMM_AVX512,
+} TronGemmIsa;
+
+// $TRON_MATMUL_ISA set to baseline or avx2 caps the instruction set, to
+// compare the kernels
+TronGemmIsa tron_gemm_isa()
+{
+    TronGemmIsa isa = TRON_GEMM_BASELINE;
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        isa = TRON_GEMM_AVX512;
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        isa = TRON_GEMM_AVX2;
+    }
+#endif
+    const char *cap = getenv("TRON_MATMUL_ISA");
+    if (cap != NULL && strcmp(cap, "baseline") == 0)
+    {
+        isa = TRON_GEMM_BASELINE;
+    }
+    else if (cap != NULL && strcmp(cap, "avx2") == 0 && isa > TRON_GEMM_AVX2)
+    {
+        isa = TRON_GEMM_AVX2;
+    }
+    return isa;
+}
+
+// Computes the mr x nr tile at c from kc columns of a packed A sliver and
+// kc rows of a packed B one, adding to the tile unless it is the first
+// block of the inner dimension
+#define TRON_GEMM_KERNEL(NAME, VARIANT, T, BYTES, TARGET)                                           \
+    TARGET void tron_gemm_kernel_##NAME##_##VARIANT(int64_t kc, const T *a, const T *b, T *c, int64_t ldc, \
+                                                     int mr, int nr, bool accumulate)              \
+    {                                                                                               \
+        typedef T vector __attribute__((vector_size(BYTES)));                                       \
+        enum                                                                                        \
+        {                                                                                           \
+            lanes = BYTES / sizeof(T)                                                               \
+        };                                                                                          \
+        vector c00 = {0}, c01 = {0}, c10 = {0}, c11 = {0}, c20 = {0}, c21 = {0};                    \
+        vector c30 = {0}, c31 = {0}, c40 = {0}, c41 = {0}, c50 = {0}, c51 = {0};                    \
+        vector b0, b1;                                                                              \
+        for (int64_t p = 0; p < kc; p++)                                                            \
+        {                                                                                           \
+            memcpy(&b0, b + p * 2 * lanes, sizeof(b0));                                             \
+            memcpy(&b1, b + p * 2 * lanes + lanes, sizeof(b1));                                    \
+            const T *column = a + p * TRON_GEMM_MR;                                                 \
+            c00 += b0 * column[0];                                                                  \
+            c01 += b1 * column[0];                                                                  \
+            c10 += b0 * column[1];                                                                  \
+            c11 += b1 * column[1];                                                                  \
+            c20 += b0 * column[2];                                                                  \
+            c21 += b1 * column[2];                                                                  \
+            c30 += b0 * column[3];                                                                  \
+            c31 += b1 * column[3];                                                                  \
+            c40 += b0 * column[4];                                                                  \
+            c41 += b1 * column[4];                                                                  \
+            c50 += b0 * column[5];                                                                  \
+            c51 += b1 * column[5];                                                                  \
+        }                                                                                           \
+        vector tile[TRON_GEMM_MR][2] = {{c00, c01}, {c10, c11}, {c20, c21},                         \
+                                        {c30, c31}, {c40, c41}, {c50, c51}};                        \
+        for (int i = 0; i < mr; i++)                                                                \
+        {                                                                                           \
+            const T *row = (const T *)tile[i];                                                      \
+            for (int j = 0; j < nr; j++)                                                            \
+            {                                                                                       \
+                c[i * ldc + j] = accumulate ? c[i * ldc + j] + row[j] : row[j];                     \
+            }                                                                                       \
+        }                                                                                           \
+    }
+
+typedef struct TronGemmTask
+{
+    const void *a;
+    const void *b;
+    void *c;
+    int64_t m;
+    int64_t k;
+    int64_t n;
+    // Rows first and last of the batch seen as one tall matrix
+    int64_t first;
+    int64_t last;
+    void (*run)(struct TronGemmTask *task);
+} TronGemmTask;
+
+void *tron_gemm_thread(void *task)
+{
+    ((TronGemmTask *)task)->run(task);
+    return NULL;
+}
+
+// Multiplies batch pairs of m x k and k x n matrices, on as many threads as
+// there are processors for products large enough, with rows of at least
+// TRON_GEMM_MC per thread
+void tron_gemm_parallel(TronGemmTask *task, int64_t batch)
+{
+    int64_t rows = batch * task->m;
+    int64_t work = rows * task->k * task->n;
+    int64_t threads = work < TRON_GEMM_PARALLEL_MIN ? 1 : sysconf(_SC_NPROCESSORS_ONLN);
+    threads = threads < TRON_GEMM_MAX_THREADS ? threads : TRON_GEMM_MAX_THREADS;
+    threads = threads < (rows + TRON_GEMM_MC - 1) / TRON_GEMM_MC ? threads : (rows + TRON_GEMM_MC - 1) / TRON_GEMM_MC;
+    if (threads <= 1)
+    {
+        task->first = 0;
+        task->last = rows;
+        task->run(task);
+        return;
+    }
+    TronGemmTask tasks[TRON_GEMM_MAX_THREADS];
+    pthread_t ids[TRON_GEMM_MAX_THREADS];
+    bool started[TRON_GEMM_MAX_THREADS];
+    for (int64_t i = 0; i < threads; i++)
+    {
+        tasks[i] = *task;
+        tasks[i].first = rows * i / threads;
+        tasks[i].last = rows * (i + 1) / threads;
+        started[i] = i > 0 && pthread_create(&ids[i], NULL, tron_gemm_thread, &tasks[i]) == 0;
+    }
+    task->run(&tasks[0]);
+    for (int64_t i = 1; i < threads; i++)
+    {
+        if (started[i])
+        {
+            pthread_join(ids[i], NULL);
+        }
+        else
+        {
+            task->run(&tasks[i]);
+        }
+    }
+}
+
+// Packing, the blocked loops and the kernels of one element type. Each
+// thread packs into buffers of its own.
+#define TRON_GEMM(NAME, T)                                                                          \
+    typedef void (*tron_gemm_kernel_##NAME)(int64_t kc, const T *a, const T *b, T *c, int64_t ldc, int mr, int nr, \
+                                            bool accumulate);                                       \
+                                                                                                    \
+    TRON_GEMM_KERNEL(NAME, baseline, T, 16, )                                                       \
+    TRON_GEMM_KERNEL(NAME, avx2, T, TRON_AVX2_BYTES, TRON_TARGET_AVX2)                              \
+    TRON_GEMM_KERNEL(NAME, avx512, T, TRON_AVX512_BYTES, TRON_TARGET_AVX512)                        \
+                                                                                                    \
+    void tron_gemm_pack_a_##NAME(const T *a, int64_t lda, int64_t mc, int64_t kc, T *packed)        \
+    {                                                                                               \
+        for (int64_t i = 0; i < mc; i += TRON_GEMM_MR)                                              \
+        {                                                                                           \
+            for (int64_t p = 0; p < kc; p++)                                                        \
+            {                                                                                       \
+                for (int64_t r = i; r < i + TRON_GEMM_MR; r++)                                      \
+                {                                                                                   \
+                    *packed++ = r < mc ? a[r * lda + p] : 0;                                        \
+                }                                                                                   \
+            }                                                                                       \
+        }                                                                                           \
+    }                                                                                               \
+                                                                                                    \
+    void tron_gemm_pack_b_##NAME(const T *b, int64_t ldb, int64_t kc, int64_t nc, int nr, T *packed) \
+    {                                                                                               \
+        for (int64_t j = 0; j < nc; j += nr)                                                        \
+        {                                                                                           \
+            for (int64_t p = 0; p < kc; p++)                                                        \
+            {                                                                                       \
+                for (int64_t s = j; s < j + nr; s++)                                                \
+                {                                                                                   \
+                    *packed++ = s < nc ? b[p * ldb + s] : 0;                                        \
+                }                                                                                   \
+            }                                                                                       \
+        }                                                                                           \
+    }                                                                                               \
+                                                                                                    \
+    void tron_gemm_block_##NAME(const T *a, const T *b, T *c, int64_t m, int64_t k, int64_t n,      \
+                                tron_gemm_kernel_##NAME kernel, int nr, T *packed_a, T *packed_b)    \
+    {                                                                                               \
+        if (k == 0)                                                                                 \
+        {                                                                                           \
+            memset(c, 0, m * n * sizeof(T));                                                        \
+        }                                                                                           \
+        for (int64_t jc = 0; jc < n; jc += TRON_GEMM_NC)                                            \
+        {                                                                                           \
+            int64_t nc = n - jc < TRON_GEMM_NC ? n - jc : TRON_GEMM_NC;                             \
+            for (int64_t pc = 0; pc < k; pc += TRON_GEMM_KC)                                        \
+            {                                                                                       \
+                int64_t kc = k - pc < TRON_GEMM_KC ? k - pc : TRON_GEMM_KC;                         \
+                tron_gemm_pack_b_##NAME(b + pc * n + jc, n, kc, nc, nr, packed_b);                  \
+                for (int64_t ic = 0; ic < m; ic += TRON_GEMM_MC)                                    \
+                {                                                                                   \
+                    int64_t mc = m - ic < TRON_GEMM_MC ? m - ic : TRON_GEMM_MC;                     \
+                    tron_gemm_pack_a_##NAME(a + ic * k + pc, k, mc, kc, packed_a);                  \
+                    for (int64_t jr = 0; jr < nc; jr += nr)                                         \
+                    {                                                                               \
+                        for (int64_t ir = 0; ir < mc; ir += TRON_GEMM_MR)                           \
+                        {                                                                           \
+                            kernel(kc, packed_a + ir * kc, packed_b + jr * kc, c + (ic + ir) * n + jc + jr, n, \
+                                   mc - ir < TRON_GEMM_MR ? mc - ir : TRON_GEMM_MR, nc - jr < nr ? nc - jr : nr, \
+                                   pc > 0);                                                         \
+                        }                                                                           \
+                    }                                                                               \
+                }                                                                                   \
+            }                                                                                       \
+        }                                                                                           \
+    }                                                                                               \
+                                                                                                    \
+    /* Rows task->first to task->last of the batch, a run of rows per matrix */                   \
+    void tron_gemm_run_##NAME(TronGemmTask *task)                                                   \
+    {                                                                                               \
+        TronGemmIsa isa = tron_gemm_isa();                                                          \
+        tron_gemm_kernel_##NAME kernel = isa == TRON_GEMM_AVX512 ? tron_gemm_kernel_##NAME##_avx512 \
+                                         : isa == TRON_GEMM_AVX2 ? tron_gemm_kernel_##NAME##_avx2   \
+                                                                 : tron_gemm_kernel_##NAME##_baseline; \
+        int bytes = isa == TRON_GEMM_AVX512 ? TRON_AVX512_BYTES : isa == TRON_GEMM_AVX2 ? TRON_AVX2_BYTES : 16; \
+        int nr = 2 * bytes / sizeof(T);                                                             \
+        int64_t m = task->m, k = task->k, n = task->n;                                              \
+        /* Blocks padded to whole slivers, no larger than the matrices */                          \
+        int64_t mc = m < TRON_GEMM_MC ? (m + TRON_GEMM_MR - 1) / TRON_GEMM_MR * TRON_GEMM_MR : TRON_GEMM_MC; \
+        int64_t kc = k < TRON_GEMM_KC ? k + 1 : TRON_GEMM_KC;                                       \
+        int64_t nc = (n < TRON_GEMM_NC ? n : TRON_GEMM_NC) + nr - 1;                                \
+        T *packed_a = malloc(mc * kc * sizeof(T));                                                  \
+        T *packed_b = malloc(kc * (nc - nc % nr) * sizeof(T));                                      \
+        if (packed_a == NULL || packed_b == NULL)                                                   \
+        {                                                                                           \
+            fprintf(stderr, "Out of memory multiplying matrices\n");                                \
+            abort();                                                                                \
+        }                                                                                           \
+        for (int64_t row = task->first; row < task->last;)                                          \
+        {                                                                                           \
+            int64_t matrix = row / m;                                                               \
+            int64_t rows = (matrix + 1) * m < task->last ? (matrix + 1) * m - row : task->last - row; \
+            tron_gemm_block_##NAME((const T *)task->a + row * k, (const T *)task->b + matrix * k * n,  \
+                                   (T *)task->c + row * n, rows, k, n, kernel, nr, packed_a, packed_b); \
+            row += rows;                                                                            \
+        }                                                                                           \
+        free(packed_a);                                                                             \
+        free(packed_b);                                                                             \
+    }                                                                                               \
+                                                                                                    \
+    /* c may be a or b, the product then goes through a buffer */                                  \
+    void tron_matmul_##NAME(const T *a, const T *b, T *c, int64_t batch, int64_t m, int64_t k, int64_t n) \
+    {                                                                                               \
+        T *product = c;                                                                             \
+        if (c == a || c == b)                                                                       \
+        {                                                                                           \
+            product = malloc(batch * m * n * sizeof(T) + 1);                                        \
+            if (product == NULL)                                                                    \
+            {                                                                                       \
+                fprintf(stderr, "Out of memory multiplying matrices\n");                            \
+                abort();                                                                            \
+            }                                                                                       \
+        }                                                                                           \
+        if (batch * m * n > 0)                                                                      \
+        {                                                                                           \
+            TronGemmTask task = {a, b, product, m, k, n, 0, 0, tron_gemm_run_##NAME};               \
+            tron_gemm_parallel(&task, batch);                                                       \
+        }                                                                                           \
+        if (product != c)                                                                           \
+        {                                                                                           \
+            memcpy(c, product, batch * m * n * sizeof(T));                                          \
+            free(product);                                                                          \
+        }                                                                                           \
+    }
+
+TRON_GEMM(int, int32_t)
+TRON_GEMM(i64, int64_t)
+TRON_GEMM(float, float)
+TRON_GEMM(f64, double)
@@ -0,0 +1,417 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "effects.h"
+
+FunctionEffects *new_function_effects(char *name)
+{
+    FunctionEffects *effects = malloc(sizeof(FunctionEffects));
+    effects->name = name;
+    effects->callees = NULL;
+    effects->reads_globals = false;
+    effects->writes_globals = false;
+    effects->has_loops = false;
+    effects->calls_external = false;
+    effects->allocates = false;
+    effects->indexes = false;
+    effects->checks_shapes = false;
+    effects->signed_arithmetic = false;
+    effects->self_calls = 0;
+    effects->memoized = false;
+    effects->may_abort = false;
+    effects->pure = false;
+    effects->readnone = false;
+    effects->readonly = false;
+    effects->willreturn = false;
+    effects->norecurse = false;
+    effects->nofree = false;
+    return effects;
+}
+
+void push_local(Locals *locals, char *name)
+{
+    LocalName *local = malloc(sizeof(LocalName));
+    local->name = name;
+    local->next = locals->names;
+    locals->names = local;
+
+    Bucket *bucket = lookup_value(locals->visible, name);
+    if (bucket == NULL)
+    {
+        insert_value(locals->visible, name, (void *)1);
+    }
+    else
+    {
+        bucket->value = (void *)((intptr_t)bucket->value + 1);
+    }
+}
+
+void pop_locals(Locals *locals, LocalName *until)
+{
+    while (locals->names != until)
+    {
+        LocalName *next = locals->names->next;
+        Bucket *bucket = lookup_value(locals->visible, locals->names->name);
+        bucket->value = (void *)((intptr_t)bucket->value - 1);
+        free(locals->names);
+        locals->names = next;
+    }
+}
+
+bool is_local(Locals *locals, char *name)
+{
+    Bucket *bucket = lookup_value(locals->visible, name);
+    return bucket != NULL && (intptr_t)bucket->value > 0;
+}
+
+// One edge per call site, the call graph walk visits a callee only once
+void add_callee(FunctionEffects *effects, char *callee)
+{
+    CallEdge *edge = malloc(sizeof(CallEdge));
+    edge->callee = callee;
+    edge->function = NULL;
+    edge->next = effects->callees;
+    effects->callees = edge;
+}
+
+void collect_expression_effects(FunctionEffects *effects, Locals *locals, Expression *expression);
+
+// push, len and zeros are expanded in place, push writes the slice and may
+// grow it through the corelib allocator. Reductions only read their
+// arguments, matmul allocates its result and the buffers of its kernel.
+// min and max check their sequence is not empty, dot, matmul and zeros
+// check shapes.
+void collect_call_effects(FunctionEffects *effects, Locals *locals, Call *call)
+{
+    if (strcmp(call->name, PUSH) == 0)
+    {
+        effects->writes_globals = true;
+        effects->allocates = true;
+    }
+    else if (strcmp(call->name, MATMUL) == 0)
+    {
+        effects->allocates = true;
+        effects->checks_shapes = true;
+    }
+    else if (strcmp(call->name, ZEROS) == 0 || strcmp(call->name, DOT) == 0)
+    {
+        effects->checks_shapes = true;
+    }
+    else if (strcmp(call->name, MIN) == 0 || strcmp(call->name, MAX) == 0)
+    {
+        effects->indexes = true;
+    }
+    else if (!is_cast(call->name) && strcmp(call->name, LEN) != 0 && strcmp(call->name, ZEROS) != 0 &&
+             !is_reduction(call->name))
+    {
+        add_callee(effects, call->name);
+    }
+    if (strcmp(call->name, effects->name) == 0)
+    {
+        effects->self_calls++;
+    }
+    for (Expression *arg = call->expression; arg != NULL; arg = arg->next)
+    {
+        // A tensor operation passed as an argument is computed into a
+        // temporary, anywhere else it is fused into the assignment
+        if (arg->node == NULL && arg->type_info->tensor && strcmp(call->name, LEN) != 0)
+        {
+            effects->allocates = true;
+        }
+        collect_expression_effects(effects, locals, arg);
+    }
+}
+
+// Signed adds, subtracts and multiplies trap with --trap-on-overflow, as do
+// increments, decrements and negation
+bool is_signed_arithmetic(Expression *expression)
+{
+    TokenType op = expression->token->token_type;
+    Expression *operand = expression->left != NULL ? expression->left : expression->right;
+    return (op == T_ADD || op == T_SUB || op == T_MUL || op == T_INC || op == T_DEC) && operand != NULL &&
+           (operand->type_info->type == TYPE_INFER || is_signed_type(operand->type_info->type));
+}
+
+void collect_expression_effects(FunctionEffects *effects, Locals *locals, Expression *expression)
+{
+    if (expression == NULL)
+    {
+        return;
+    }
+
+    collect_expression_effects(effects, locals, expression->left);
+    collect_expression_effects(effects, locals, expression->right);
+    // Operands of a tensor operation must have the same shape
+    effects->checks_shapes |= expression->type_info->tensor;
+
+    Node *node = expression->node;
+    if (node == NULL)
+    {
+        effects->indexes |= expression->token->token_type == T_LBRACKET;
+        effects->signed_arithmetic |= is_signed_arithmetic(expression);
+        return;
+    }
+    if (node->node_type == N_NAME && !is_local(locals, ((Name *)node->data)->value))
+    {
+        effects->reads_globals = true;
+    }
+    else if (node->node_type == N_CALL)
+    {
+        collect_call_effects(effects, locals, node->data);
+    }
+    else if (node->node_type == N_ARRAY)
+    {
+        for (Expression *element = node->data; element != NULL; element = element->next)
+        {
+            collect_expression_effects(effects, locals, element);
+        }
+    }
+    else if (node->node_type == N_SLICE)
+    {
+        Slice *slice = node->data;
+        effects->indexes = true;
+        collect_expression_effects(effects, locals, slice->array);
+        collect_expression_effects(effects, locals, slice->low);
+        collect_expression_effects(effects, locals, slice->high);
+    }
+}
+
+void collect_block_effects(FunctionEffects *effects, Locals *locals, Block *block)
+{
+    LocalName *scope = locals->names;
+    for (Node *node = block != NULL ? block->statements : NULL; node != NULL; node = node->next)
+    {
+        switch (node->node_type)
+        {
+        case N_VARIABLE:
+        {
+            Variable *variable = node->data;
+            if (variable->assignment != NULL)
+            {
+                collect_expression_effects(effects, locals, variable->assignment->expression);
+            }
+            // Slices may view memory of the caller or a global, their
+            // buffers come from the corelib allocator and are released on
+            // return
+            if (variable->type_info->slice)
+            {
+                effects->allocates = true;
+            }
+            else
+            {
+                // Tensors have buffers of their own
+                effects->allocates |= variable->type_info->tensor;
+                push_local(locals, variable->name);
+            }
+            break;
+        }
+        case N_ASSIGNMENT:
+        {
+            Assignment *assignment = node->data;
+            collect_expression_effects(effects, locals, assignment->expression);
+            for (Expression *index = assignment->index; index != NULL; index = index->next)
+            {
+                effects->indexes = true;
+                collect_expression_effects(effects, locals, index);
+            }
+            if (!is_local(locals, assignment->name))
+            {
+                effects->writes_globals = true;
+            }
+            break;
+        }
+        case N_CALL:
+            collect_call_effects(effects, locals, node->data);
+            break;
+        case N_IF:
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                collect_expression_effects(effects, locals, if_->condition);
+                collect_block_effects(effects, locals, if_->body);
+            }
+            break;
+        case N_WHILE:
+        {
+            While *while_ = node->data;
+            effects->has_loops = true;
+            collect_expression_effects(effects, locals, while_->condition);
+            collect_block_effects(effects, locals, while_->body);
+            break;
+        }
+        case N_RETURN:
+            collect_expression_effects(effects, locals, ((Return *)node->data)->expression);
+            break;
+        default:
+            break;
+        }
+    }
+    pop_locals(locals, scope);
+}
+
+void resolve_callees(Effects *effects, FunctionEffects *function)
+{
+    for (CallEdge *edge = function->callees; edge != NULL; edge = edge->next)
+    {
+        Bucket *callee = lookup_value(effects->functions, edge->callee);
+        edge->function = callee != NULL ? callee->value : NULL;
+        function->calls_external |= callee == NULL;
+    }
+}
+
+// Tron functions can only call the functions defined before them or
+// themselves. Everything else a function calls is final by the time it is
+// analyzed, so its attributes follow from its own effects and a single look
+// at each callee.
+void infer_attributes(FunctionEffects *function)
+{
+    // The cache of a memoized function is written on every miss and grown
+    // through the corelib allocator, as are slices
+    bool recursive = function->self_calls > 0;
+    bool writes = function->writes_globals || function->memoized || function->allocates;
+    bool pure = !function->reads_globals && !function->writes_globals && !function->allocates && !function->calls_external;
+    bool readnone = !function->reads_globals && !writes && !function->calls_external;
+    bool readonly = !writes && !function->calls_external;
+    bool nofree = !function->calls_external && !function->memoized && !function->allocates;
+    bool willreturn = !recursive && !function->has_loops && !function->calls_external;
+    bool may_abort = function->may_abort;
+    for (CallEdge *edge = function->callees; edge != NULL; edge = edge->next)
+    {
+        FunctionEffects *callee = edge->function;
+        if (callee != NULL && callee != function)
+        {
+            may_abort = may_abort || callee->may_abort;
+            pure = pure && callee->pure;
+            readnone = readnone && callee->readnone;
+            readonly = readonly && callee->readonly;
+            nofree = nofree && callee->nofree;
+            willreturn = willreturn && callee->willreturn;
+        }
+    }
+
+    // A call that may abort must not be dropped when its result is unused,
+    // nor moved to where it would not have run
+    function->may_abort = may_abort;
+    function->norecurse = !recursive;
+    function->pure = pure;
+    function->readnone = readnone && !may_abort;
+    function->readonly = readonly;
+    function->nofree = nofree;
+    function->willreturn = willreturn && !may_abort;
+}
+
+Effects *new_effects(Node *ast, Options *options)
+{
+    Effects *effects = malloc(sizeof(Effects));
+    size_t functions = count_functions(ast);
+    effects->functions = new_hash_table(functions > EFFECTS_TABLE_SIZE ? functions : EFFECTS_TABLE_SIZE);
+    effects->locals.names = NULL;
+    effects->locals.visible = new_hash_table(EFFECTS_TABLE_SIZE);
+    effects->options = options;
+
+    // Root level constants never change, reading them is as pure as reading
+    // a local
+    for (Node *node = ast; node != NULL; node = node->next)
+    {
+        if (node->node_type == N_VARIABLE && ((Variable *)node->data)->constant)
+        {
+            push_local(&effects->locals, ((Variable *)node->data)->name);
+        }
+    }
+    effects->constants = effects->locals.names;
+    return effects;
+}
+
+// Collects what function does and infers its attributes. Functions are
+// analyzed in the order they are defined, whether one is memoized is
+// decided on what it computes, the cache only changes what it and its
+// callers may be assumed to do.
+FunctionEffects *analyze_function_effects(Effects *effects, Function *function)
+{
+    FunctionEffects *function_effects = new_function_effects(function->name);
+    for (Variable *param = function->params; param != NULL; param = param->next)
+    {
+        // Slices and tensors are passed by reference
+        if (!param->type_info->slice && !param->type_info->tensor)
+        {
+            push_local(&effects->locals, param->name);
+        }
+    }
+    collect_block_effects(function_effects, &effects->locals, function->body);
+    pop_locals(&effects->locals, effects->constants);
+    // Shapes are checked even with --unchecked
+    function_effects->may_abort = function_effects->checks_shapes || (function_effects->indexes && !effects->options->unchecked) ||
+                                  (function_effects->signed_arithmetic && effects->options->overflow == OVERFLOW_TRAP);
+
+    insert_value(effects->functions, function->name, function_effects);
+    resolve_callees(effects, function_effects);
+    infer_attributes(function_effects);
+
+    if (function->memo && !function_effects->pure)
+    {
+        fprintf(stderr, "@memo function %s must not touch globals or call impure functions\n", function->name);
+        exit(EXIT_FAILURE);
+    }
+    if (function->memo && function->params == NULL)
+    {
+        fprintf(stderr, "@memo function %s must take parameters\n", function->name);
+        exit(EXIT_FAILURE);
+    }
+    if (function->constant && !function_effects->pure)
+    {
+        fprintf(stderr, "const function %s must not touch globals or call impure functions\n", function->name);
+        exit(EXIT_FAILURE);
+    }
+    function_effects->memoized = function->memo || (effects->options->auto_memo && function_effects->pure &&
+                                                    function_effects->self_calls > 1 && function->params != NULL &&
+                                                    has_memo_signature(function));
+    if (function_effects->memoized)
+    {
+        infer_attributes(function_effects);
+    }
+    return function_effects;
+}
+
+FunctionEffects *find_function_effects(Effects *effects, char *name)
+{
+    Bucket *bucket = lookup_value(effects->functions, name);
+    return bucket != NULL ? bucket->value : NULL;
+}
+
+void dispose_function_effects(FunctionEffects *effects)
+{
+    CallEdge *edge = effects->callees;
+    while (edge != NULL)
+    {
+        CallEdge *next = edge->next;
+        free(edge);
+        edge = next;
+    }
+    free(effects);
+}
+
+void dispose_effects(Effects *effects)
+{
+    pop_locals(&effects->locals, NULL);
+    dispose_hash_table(effects->locals.visible, NULL);
+    dispose_hash_table(effects->functions, (void (*)(void *))dispose_function_effects);
+    free(effects);
+}
@@ -0,0 +1,97 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#ifndef MEFFECTS_H_
+#define MEFFECTS_H_
+
+#include <stdbool.h>
+
+#include "hashtable.h"
+#include "node.h"
+#include "options.h"
+
+#define EFFECTS_TABLE_SIZE 1024
+
+// function is resolved once the caller has been seen, it stays NULL for a
+// callee defined elsewhere
+typedef struct CallEdge
+{
+    char *callee;
+    struct FunctionEffects *function;
+    struct CallEdge *next;
+} CallEdge;
+
+// What a function does directly, as seen in its body, and the attributes
+// inferred once the effects of everything it calls are known. pure is what
+// readnone would be if no function were memoized, may_abort whether a check
+// in it or in a callee may end the program.
+typedef struct FunctionEffects
+{
+    char *name;
+    CallEdge *callees;
+    bool reads_globals;
+    bool writes_globals;
+    bool has_loops;
+    bool calls_external;
+    bool allocates;
+    bool indexes;
+    bool checks_shapes;
+    bool signed_arithmetic;
+    int self_calls;
+    bool memoized;
+
+    bool may_abort;
+    bool pure;
+    bool readnone;
+    bool readonly;
+    bool willreturn;
+    bool norecurse;
+    bool nofree;
+} FunctionEffects;
+
+// Names in scope, the list remembers the order they were declared in so a
+// block can drop its own, the table counts how many declarations of a name
+// are visible for a constant time lookup
+typedef struct LocalName
+{
+    char *name;
+    struct LocalName *next;
+} LocalName;
+
+typedef struct Locals
+{
+    LocalName *names;
+    HashTable *visible;
+} Locals;
+
+// The functions analyzed so far. Root level constants stay in scope below
+// the locals of each function.
+typedef struct Effects
+{
+    HashTable *functions;
+    Locals locals;
+    LocalName *constants;
+    Options *options;
+} Effects;
+
+FunctionEffects *new_function_effects(char *name);
+Effects *new_effects(Node *ast, Options *options);
+FunctionEffects *analyze_function_effects(Effects *effects, Function *function);
+FunctionEffects *find_function_effects(Effects *effects, char *name);
+void dispose_function_effects(FunctionEffects *effects);
+void dispose_effects(Effects *effects);
+
+#endif
@@ -0,0 +1,722 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eval.h"
+
+typedef enum EvalStatus
+{
+    EVAL_ERROR,
+    EVAL_NEXT,
+    EVAL_BREAK,
+    EVAL_CONTINUE,
+    EVAL_RETURN
+} EvalStatus;
+
+typedef struct EvalLocal
+{
+    char *name;
+    EvalValue value;
+    struct EvalLocal *next;
+} EvalLocal;
+
+bool eval_fail(Eval *eval, char *format, ...)
+{
+    if (eval->error[0] == '\0')
+    {
+        va_list args;
+        va_start(args, format);
+        vsnprintf(eval->error, sizeof(eval->error), format, args);
+        va_end(args);
+    }
+    return false;
+}
+
+bool eval_step(Eval *eval)
+{
+    if (++eval->steps > eval->budget)
+    {
+        return eval_fail(eval, "evaluation exceeds the budget of %ld steps", eval->budget);
+    }
+    return true;
+}
+
+Eval *new_eval(Node *ast, long budget, EvalLookup lookup, void *lookup_data)
+{
+    Eval *eval = malloc(sizeof(Eval));
+    size_t functions = count_functions(ast);
+    eval->functions = new_hash_table(functions > EVAL_TABLE_SIZE ? functions : EVAL_TABLE_SIZE);
+    eval->lookup = lookup;
+    eval->lookup_data = lookup_data;
+    eval->budget = budget;
+    eval->steps = 0;
+    eval->depth = 0;
+    eval->wrap = false;
+    eval->error[0] = '\0';
+    for (Node *node = ast; node != NULL; node = node->next)
+    {
+        if (node->node_type == N_FUNCTION)
+        {
+            insert_value(eval->functions, ((Function *)node->data)->name, node->data);
+        }
+    }
+    return eval;
+}
+
+Function *eval_function(Eval *eval, char *name)
+{
+    Bucket *bucket = lookup_value(eval->functions, name);
+    return bucket != NULL ? bucket->value : NULL;
+}
+
+EvalLocal *eval_find_local(EvalLocal *locals, char *name)
+{
+    for (; locals != NULL; locals = locals->next)
+    {
+        if (strcmp(locals->name, name) == 0)
+        {
+            return locals;
+        }
+    }
+    return NULL;
+}
+
+EvalLocal *eval_push_local(EvalLocal *locals, char *name, EvalValue value)
+{
+    EvalLocal *local = malloc(sizeof(EvalLocal));
+    local->name = name;
+    local->value = value;
+    local->next = locals;
+    return local;
+}
+
+void eval_pop_locals(EvalLocal *locals, EvalLocal *until)
+{
+    while (locals != until)
+    {
+        EvalLocal *next = locals->next;
+        free(locals);
+        locals = next;
+    }
+}
+
+int64_t eval_wrap(Type type, uint64_t value)
+{
+    int bits = type_bits(type);
+    if (type == TYPE_INFER || bits == 64)
+    {
+        return (int64_t)value;
+    }
+    uint64_t mask = ((uint64_t)1 << bits) - 1;
+    value &= mask;
+    if (is_signed_type(type) && (value >> (bits - 1)) != 0)
+    {
+        value |= ~mask;
+    }
+    return (int64_t)value;
+}
+
+EvalValue eval_int(Type type, int64_t value)
+{
+    EvalValue result;
+    result.type = type;
+    result.int_value = eval_wrap(type, (uint64_t)value);
+    return result;
+}
+
+// Half precision values are never produced, their arithmetic is left to
+// runtime
+EvalValue eval_float(Type type, double value)
+{
+    EvalValue result;
+    result.type = type;
+    result.float_value = type == TYPE_F64 ? value : (float)value;
+    return result;
+}
+
+bool eval_function_call(Eval *eval, Function *function, EvalValue *args, int num_args, EvalValue *value);
+bool eval_expr(Eval *eval, EvalLocal *locals, Expression *expression, EvalValue *value);
+bool eval_condition(Eval *eval, EvalLocal *locals, Expression *condition, bool *result);
+
+// Adds, subtracts or multiplies, failing on signed overflow unless it wraps
+bool eval_arithmetic(Eval *eval, TokenType op, Type type, int64_t left, int64_t right, EvalValue *value)
+{
+    int64_t exact;
+    bool overflow;
+    switch (op)
+    {
+    case T_ADD:
+        overflow = __builtin_add_overflow(left, right, &exact);
+        *value = eval_int(type, (uint64_t)left + (uint64_t)right);
+        break;
+    case T_SUB:
+        overflow = __builtin_sub_overflow(left, right, &exact);
+        *value = eval_int(type, (uint64_t)left - (uint64_t)right);
+        break;
+    default:
+        overflow = __builtin_mul_overflow(left, right, &exact);
+        *value = eval_int(type, (uint64_t)left * (uint64_t)right);
+        break;
+    }
+    if (is_signed_type(type) && !eval->wrap && (overflow || value->int_value != exact))
+    {
+        return eval_fail(eval, "signed overflow");
+    }
+    return true;
+}
+
+// Integer operations follow the code generated for them: arithmetic wraps
+// at the width of the type, division, right shifts and comparisons depend on
+// its signedness, and whatever LLVM would turn into poison or a trap is an
+// error
+bool eval_int_binary(Eval *eval, TokenType op, Type type, int64_t left, int64_t right, EvalValue *value)
+{
+    uint64_t uleft = (uint64_t)left;
+    uint64_t uright = (uint64_t)right;
+    bool is_signed = is_signed_type(type);
+    int bits = type_bits(type);
+    switch (op)
+    {
+    case T_ADD:
+    case T_SUB:
+    case T_MUL:
+        return eval_arithmetic(eval, op, type, left, right, value);
+    case T_DIV:
+    case T_REM:
+        if (right == 0 || (is_signed && right == -1 && left == eval_wrap(type, (uint64_t)1 << (bits - 1))))
+        {
+            return eval_fail(eval, "division overflow or by zero");
+        }
+        if (is_signed)
+        {
+            *value = eval_int(type, op == T_DIV ? left / right : left % right);
+        }
+        else
+        {
+            *value = eval_int(type, op == T_DIV ? uleft / uright : uleft % uright);
+        }
+        return true;
+    case T_SHL:
+    case T_SHR:
+        if (uright >= (uint64_t)bits)
+        {
+            return eval_fail(eval, "shift by %lld bits", (long long)right);
+        }
+        if (op == T_SHL)
+        {
+            *value = eval_int(type, uleft << uright);
+        }
+        else
+        {
+            *value = eval_int(type, is_signed ? (uint64_t)(left >> uright) : uleft >> uright);
+        }
+        return true;
+    case T_AND:
+        *value = eval_int(type, left & right);
+        return true;
+    case T_OR:
+        *value = eval_int(type, left | right);
+        return true;
+    case T_XOR:
+        *value = eval_int(type, left ^ right);
+        return true;
+    case T_BIT_CLEAR:
+        *value = eval_int(type, left & ~right);
+        return true;
+    case T_EQ:
+        *value = eval_int(TYPE_BOOL, left == right);
+        return true;
+    case T_NEQ:
+        *value = eval_int(TYPE_BOOL, left != right);
+        return true;
+    case T_LT:
+        *value = eval_int(TYPE_BOOL, is_signed ? left < right : uleft < uright);
+        return true;
+    case T_LTE:
+        *value = eval_int(TYPE_BOOL, is_signed ? left <= right : uleft <= uright);
+        return true;
+    case T_GT:
+        *value = eval_int(TYPE_BOOL, is_signed ? left > right : uleft > uright);
+        return true;
+    case T_GTE:
+        *value = eval_int(TYPE_BOOL, is_signed ? left >= right : uleft >= uright);
+        return true;
+    default:
+        return eval_fail(eval, "unsupported integer operator");
+    }
+}
+
+bool eval_float_binary(Eval *eval, TokenType op, Type type, double left, double right, EvalValue *value)
+{
+    switch (op)
+    {
+    case T_ADD:
+        *value = eval_float(type, left + right);
+        return true;
+    case T_SUB:
+        *value = eval_float(type, left - right);
+        return true;
+    case T_MUL:
+        *value = eval_float(type, left * right);
+        return true;
+    case T_DIV:
+        *value = eval_float(type, left / right);
+        return true;
+    case T_REM:
+        *value = eval_float(type, fmod(left, right));
+        return true;
+    case T_EQ:
+        *value = eval_int(TYPE_BOOL, left == right);
+        return true;
+    case T_NEQ:
+        *value = eval_int(TYPE_BOOL, left != right);
+        return true;
+    case T_LT:
+        *value = eval_int(TYPE_BOOL, left < right);
+        return true;
+    case T_LTE:
+        *value = eval_int(TYPE_BOOL, left <= right);
+        return true;
+    case T_GT:
+        *value = eval_int(TYPE_BOOL, left > right);
+        return true;
+    case T_GTE:
+        *value = eval_int(TYPE_BOOL, left >= right);
+        return true;
+    default:
+        return eval_fail(eval, "unsupported float operator");
+    }
+}
+
+bool eval_unary(Eval *eval, TokenType op, EvalValue operand, EvalValue *value)
+{
+    if (is_float_type(operand.type))
+    {
+        if (op != T_SUB)
+        {
+            return eval_fail(eval, "unsupported float operator");
+        }
+        *value = eval_float(operand.type, -operand.float_value);
+        return true;
+    }
+    switch (op)
+    {
+    case T_SUB:
+        return eval_arithmetic(eval, T_SUB, operand.type, 0, operand.int_value, value);
+    case T_INC:
+        return eval_arithmetic(eval, T_ADD, operand.type, operand.int_value, 1, value);
+    case T_DEC:
+        return eval_arithmetic(eval, T_SUB, operand.type, operand.int_value, 1, value);
+    case T_XOR:
+        *value = eval_int(operand.type, ~operand.int_value);
+        return true;
+    case T_LOGICAL_NOT:
+        *value = eval_int(TYPE_BOOL, !operand.int_value);
+        return true;
+    default:
+        return eval_fail(eval, "unsupported unary operator");
+    }
+}
+
+bool eval_name(Eval *eval, EvalLocal *locals, char *name, EvalValue *value)
+{
+    EvalLocal *local = eval_find_local(locals, name);
+    if (local != NULL)
+    {
+        if (local->value.type == TYPE_INFER)
+        {
+            return eval_fail(eval, "%s is read before it is assigned", name);
+        }
+        *value = local->value;
+        return true;
+    }
+    if (eval->lookup != NULL && eval->lookup(eval->lookup_data, name, eval->depth > 0, value))
+    {
+        return true;
+    }
+    return eval_fail(eval, "%s is not a constant", name);
+}
+
+// Converts between any two types the way the generated code does, integers
+// are extended according to the signedness of the type they come from
+bool eval_convert(Eval *eval, EvalValue operand, Type type, EvalValue *value)
+{
+    if (type == TYPE_F16 || type == TYPE_BF16 || operand.type == TYPE_F16 || operand.type == TYPE_BF16)
+    {
+        return eval_fail(eval, "half precision floats are only computed at runtime");
+    }
+    bool from_float = is_float_type(operand.type);
+    if (type == TYPE_BOOL)
+    {
+        *value = eval_int(TYPE_BOOL, from_float ? operand.float_value != 0 : operand.int_value != 0);
+        return true;
+    }
+    if (is_float_type(type))
+    {
+        if (from_float)
+        {
+            *value = eval_float(type, operand.float_value);
+        }
+        else if (is_signed_type(operand.type))
+        {
+            *value = eval_float(type, type == TYPE_FLOAT ? (float)operand.int_value : (double)operand.int_value);
+        }
+        else
+        {
+            uint64_t unsigned_value = (uint64_t)operand.int_value;
+            *value = eval_float(type, type == TYPE_FLOAT ? (float)unsigned_value : (double)unsigned_value);
+        }
+        return true;
+    }
+    if (!from_float)
+    {
+        *value = eval_int(type, operand.int_value);
+        return true;
+    }
+    // Out of range conversions are poison in the generated code
+    int bits = type_bits(type);
+    double limit = ldexp(1.0, is_signed_type(type) ? bits - 1 : bits);
+    double truncated = trunc(operand.float_value);
+    if (!(truncated >= (is_signed_type(type) ? -limit : 0) && truncated < limit))
+    {
+        return eval_fail(eval, "%f does not fit %s", operand.float_value, type_name(type));
+    }
+    *value = eval_int(type, is_signed_type(type) ? (uint64_t)(int64_t)truncated : (uint64_t)truncated);
+    return true;
+}
+
+bool eval_cast(Eval *eval, EvalLocal *locals, Call *call, EvalValue *value)
+{
+    EvalValue operand;
+    if (call->expression == NULL || !eval_expr(eval, locals, call->expression, &operand))
+    {
+        return false;
+    }
+    return eval_convert(eval, operand, cast_type(call->name), value);
+}
+
+bool eval_call_expression(Eval *eval, EvalLocal *locals, Call *call, EvalValue *value)
+{
+    if (is_cast(call->name))
+    {
+        return eval_cast(eval, locals, call, value);
+    }
+
+    Function *function = eval_function(eval, call->name);
+    if (function == NULL)
+    {
+        return eval_fail(eval, "%s can only be called at runtime", call->name);
+    }
+
+    int num_args = 0;
+    for (Expression *arg = call->expression; arg != NULL; arg = arg->next)
+    {
+        num_args++;
+    }
+    EvalValue *args = calloc(num_args, sizeof(EvalValue));
+    int i = 0;
+    for (Expression *arg = call->expression; arg != NULL; arg = arg->next)
+    {
+        if (!eval_expr(eval, locals, arg, &args[i++]))
+        {
+            free(args);
+            return false;
+        }
+    }
+    bool ok = eval_function_call(eval, function, args, num_args, value);
+    free(args);
+    return ok;
+}
+
+bool eval_expr(Eval *eval, EvalLocal *locals, Expression *expression, EvalValue *value)
+{
+    if (!eval_step(eval))
+    {
+        return false;
+    }
+
+    if (expression->token != NULL && expression->token->token_type == T_LBRACKET)
+    {
+        return eval_fail(eval, "arrays can not be evaluated at compile time");
+    }
+
+    if (expression->left != NULL && expression->right != NULL &&
+        (expression->token->token_type == T_LOGICAL_AND || expression->token->token_type == T_LOGICAL_OR))
+    {
+        // The right operand only runs when the left one leaves the result
+        // open, as in the generated code
+        bool result;
+        if (!eval_condition(eval, locals, expression->left, &result))
+        {
+            return false;
+        }
+        if (result == (expression->token->token_type == T_LOGICAL_AND) &&
+            !eval_condition(eval, locals, expression->right, &result))
+        {
+            return false;
+        }
+        *value = eval_int(TYPE_BOOL, result);
+        return true;
+    }
+
+    if (expression->left != NULL && expression->right != NULL)
+    {
+        EvalValue left, right;
+        if (!eval_expr(eval, locals, expression->left, &left) || !eval_expr(eval, locals, expression->right, &right))
+        {
+            return false;
+        }
+        if (left.type != right.type)
+        {
+            return eval_fail(eval, "operands of different types");
+        }
+        if (is_float_type(left.type))
+        {
+            return eval_float_binary(eval, expression->token->token_type, left.type, left.float_value, right.float_value, value);
+        }
+        return eval_int_binary(eval, expression->token->token_type, left.type, left.int_value, right.int_value, value);
+    }
+
+    if (expression->left != NULL || expression->right != NULL)
+    {
+        EvalValue operand;
+        Expression *operand_expression = expression->left != NULL ? expression->left : expression->right;
+        if (!eval_expr(eval, locals, operand_expression, &operand))
+        {
+            return false;
+        }
+        return eval_unary(eval, expression->token->token_type, operand, value);
+    }
+
+    Node *node = expression->node;
+    switch (node->node_type)
+    {
+    case N_INTEGER:
+        *value = eval_int(expression->type_info->type, ((Integer *)node->data)->value);
+        return true;
+    case N_FLOAT:
+        if (expression->type_info->type == TYPE_F16 || expression->type_info->type == TYPE_BF16)
+        {
+            return eval_fail(eval, "half precision floats are only computed at runtime");
+        }
+        *value = eval_float(expression->type_info->type, ((Float *)node->data)->value);
+        return true;
+    case N_NAME:
+        return eval_name(eval, locals, ((Name *)node->data)->value, value);
+    case N_CALL:
+        return eval_call_expression(eval, locals, node->data, value);
+    default:
+        return eval_fail(eval, "arrays and slices can not be evaluated at compile time");
+    }
+}
+
+bool eval_condition(Eval *eval, EvalLocal *locals, Expression *condition, bool *result)
+{
+    EvalValue value;
+    if (!eval_expr(eval, locals, condition, &value))
+    {
+        return false;
+    }
+    *result = is_float_type(value.type) ? value.float_value != 0 : value.int_value != 0;
+    return true;
+}
+
+EvalStatus eval_block(Eval *eval, EvalLocal **locals, Block *block, EvalValue *result);
+
+EvalStatus eval_statement(Eval *eval, EvalLocal **locals, Node *node, EvalValue *result)
+{
+    if (!eval_step(eval))
+    {
+        return EVAL_ERROR;
+    }
+
+    switch (node->node_type)
+    {
+    case N_VARIABLE:
+    {
+        Variable *variable = node->data;
+        EvalValue value = eval_int(TYPE_INFER, 0);
+        if (variable->assignment != NULL && !eval_expr(eval, *locals, variable->assignment->expression, &value))
+        {
+            return EVAL_ERROR;
+        }
+        *locals = eval_push_local(*locals, variable->name, value);
+        return EVAL_NEXT;
+    }
+    case N_ASSIGNMENT:
+    {
+        Assignment *assignment = node->data;
+        if (assignment->index != NULL)
+        {
+            eval_fail(eval, "arrays can not be evaluated at compile time");
+            return EVAL_ERROR;
+        }
+        EvalLocal *local = eval_find_local(*locals, assignment->name);
+        if (local == NULL)
+        {
+            eval_fail(eval, "assigns the global %s", assignment->name);
+            return EVAL_ERROR;
+        }
+        return eval_expr(eval, *locals, assignment->expression, &local->value) ? EVAL_NEXT : EVAL_ERROR;
+    }
+    case N_CALL:
+    {
+        EvalValue ignored;
+        return eval_call_expression(eval, *locals, node->data, &ignored) ? EVAL_NEXT : EVAL_ERROR;
+    }
+    case N_RETURN:
+        return eval_expr(eval, *locals, ((Return *)node->data)->expression, result) ? EVAL_RETURN : EVAL_ERROR;
+    case N_BREAK:
+        return EVAL_BREAK;
+    case N_CONTINUE:
+        return EVAL_CONTINUE;
+    case N_BLOCK:
+        return eval_block(eval, locals, node->data, result);
+    case N_IF:
+        for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+        {
+            bool taken = true;
+            if (if_->condition != NULL && !eval_condition(eval, *locals, if_->condition, &taken))
+            {
+                return EVAL_ERROR;
+            }
+            if (taken)
+            {
+                return eval_block(eval, locals, if_->body, result);
+            }
+        }
+        return EVAL_NEXT;
+    case N_WHILE:
+    {
+        While *while_ = node->data;
+        while (true)
+        {
+            bool taken;
+            if (!eval_condition(eval, *locals, while_->condition, &taken))
+            {
+                return EVAL_ERROR;
+            }
+            if (!taken)
+            {
+                return EVAL_NEXT;
+            }
+            EvalStatus status = eval_block(eval, locals, while_->body, result);
+            if (status == EVAL_BREAK)
+            {
+                return EVAL_NEXT;
+            }
+            if (status == EVAL_ERROR || status == EVAL_RETURN)
+            {
+                return status;
+            }
+        }
+    }
+    default:
+        eval_fail(eval, "unsupported statement");
+        return EVAL_ERROR;
+    }
+}
+
+EvalStatus eval_block(Eval *eval, EvalLocal **locals, Block *block, EvalValue *result)
+{
+    EvalLocal *scope = *locals;
+    EvalStatus status = EVAL_NEXT;
+    for (Node *node = block->statements; node != NULL && status == EVAL_NEXT; node = node->next)
+    {
+        status = eval_statement(eval, locals, node, result);
+    }
+    eval_pop_locals(*locals, scope);
+    *locals = scope;
+    return status;
+}
+
+bool eval_function_call(Eval *eval, Function *function, EvalValue *args, int num_args, EvalValue *value)
+{
+    if (eval->depth >= EVAL_MAX_DEPTH)
+    {
+        return eval_fail(eval, "recursion deeper than %d calls", EVAL_MAX_DEPTH);
+    }
+
+    EvalLocal *locals = NULL;
+    int i = 0;
+    for (Variable *param = function->params; param != NULL; param = param->next)
+    {
+        if (i == num_args)
+        {
+            eval_pop_locals(locals, NULL);
+            return eval_fail(eval, "%s called with too few arguments", function->name);
+        }
+        // Arguments are converted to the parameter type as in the
+        // generated call
+        EvalValue arg = args[i++];
+        if (param->type_info->type != arg.type && !eval_convert(eval, arg, param->type_info->type, &arg))
+        {
+            eval_pop_locals(locals, NULL);
+            return false;
+        }
+        locals = eval_push_local(locals, param->name, arg);
+    }
+
+    eval->depth++;
+    EvalStatus status = eval_block(eval, &locals, function->body, value);
+    eval->depth--;
+    eval_pop_locals(locals, NULL);
+
+    if (status == EVAL_ERROR)
+    {
+        return false;
+    }
+    if (status != EVAL_RETURN)
+    {
+        return eval_fail(eval, "%s does not return a value", function->name);
+    }
+    return true;
+}
+
+bool eval_expression(Eval *eval, Expression *expression, EvalValue *value)
+{
+    eval->steps = 0;
+    eval->depth = 0;
+    eval->wrap = false;
+    eval->error[0] = '\0';
+    return eval_expr(eval, NULL, expression, value);
+}
+
+bool eval_call(Eval *eval, char *name, EvalValue *args, int num_args, EvalValue *value)
+{
+    eval->steps = 0;
+    eval->depth = 0;
+    eval->wrap = false;
+    eval->error[0] = '\0';
+    Function *function = eval_function(eval, name);
+    if (function == NULL)
+    {
+        return eval_fail(eval, "%s can only be called at runtime", name);
+    }
+    return eval_function_call(eval, function, args, num_args, value);
+}
+
+void dispose_eval(Eval *eval)
+{
+    dispose_hash_table(eval->functions, NULL);
+    free(eval);
+}
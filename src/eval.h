@@ -0,0 +1,69 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#ifndef MEVAL_H_
+#define MEVAL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "hashtable.h"
+#include "node.h"
+
+#define EVAL_TABLE_SIZE 1024
+#define EVAL_MAX_DEPTH 4096
+
+// Integers are kept sign or zero extended from the width of their type,
+// floats narrower than a double are kept rounded to their precision
+typedef struct EvalValue
+{
+    Type type;
+    union
+    {
+        int64_t int_value;
+        double float_value;
+    };
+} EvalValue;
+
+// Resolves names that are not locals of the evaluated code. global_only is
+// set inside called functions, which only see root level constants.
+typedef bool (*EvalLookup)(void *data, char *name, bool global_only, EvalValue *value);
+
+// Compile time interpreter over the AST. Evaluation stops with an error as
+// soon as the code does something that only makes sense at runtime (reads a
+// mutable global, calls into corelib, divides by zero) or runs longer than
+// `budget` steps. Signed overflow is left to runtime unless `wrap` defines
+// it to wrap around.
+typedef struct Eval
+{
+    HashTable *functions;
+    EvalLookup lookup;
+    void *lookup_data;
+    long budget;
+    long steps;
+    int depth;
+    bool wrap;
+    char error[MAX_BUFFER_SIZE];
+} Eval;
+
+Eval *new_eval(Node *ast, long budget, EvalLookup lookup, void *lookup_data);
+bool eval_expression(Eval *eval, Expression *expression, EvalValue *value);
+bool eval_call(Eval *eval, char *name, EvalValue *args, int num_args, EvalValue *value);
+Function *eval_function(Eval *eval, char *name);
+void dispose_eval(Eval *eval);
+
+#endif
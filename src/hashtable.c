@@ -52,7 +52,7 @@ Bucket *insert_value(HashTable *table, char *key, void *value)
     }
     unsigned int index = hash(table, key);
     Bucket *next_bucket = new_bucket(key, value);
-    next_bucket->next = bucket;
+    next_bucket->next = table->buckets[index];
     table->buckets[index] = next_bucket;
     return next_bucket;
 }
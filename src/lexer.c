@@ -50,6 +50,8 @@ void accept(Lexer *l, TokenType type)
 Token *reset(Lexer *l)
 {
   Token *token = new_token(l->token_type, l->buffer, l->length);
+  token->line = l->token_line;
+  token->col = l->token_col;
   l->length = 0;
   return token;
 }
@@ -59,7 +61,7 @@ Lexer *new_lexer(FILE *file)
   Lexer *l = malloc(sizeof(Lexer));
   l->length = 0;
   l->col = 0;
-  l->line = 0;
+  l->line = 1;
   l->token_type = T_NOMATCH;
   l->file = file;
   next(l);
@@ -73,6 +75,9 @@ void dispose_lexer(Lexer *l)
 
 Token *lex(Lexer *l)
 {
+  l->token_line = l->line;
+  l->token_col = l->col;
+
   if (l->c == EOF)
   {
     accept(l, T_EOF);
@@ -117,6 +122,10 @@ Token *lex(Lexer *l)
   {
     accept(l, T_SEMICOLON);
   }
+  else if (l->c == '@')
+  {
+    accept(l, T_AT);
+  }
   else if (l->c == '+')
   {
     accept(l, T_ADD);
@@ -172,6 +181,11 @@ Token *lex(Lexer *l)
   else if (l->c == '!')
   {
     accept(l, T_LOGICAL_NOT);
+
+    if (l->c == '=')
+    {
+      accept(l, T_NEQ);
+    }
   }
   else if (l->c == '&')
   {
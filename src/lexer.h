@@ -30,6 +30,8 @@ typedef struct Lexer
   char c;
   int line;
   int col;
+  int token_line;
+  int token_col;
 } Lexer;
 
 Lexer *new_lexer(FILE *file);
@@ -16,9 +16,18 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <limits.h>
 
+#include "constants.h"
 #include "llvm.h"
 
+// DWARF base type encodings, not exposed by the LLVM C API
+#define DW_ATE_BOOLEAN 0x02
+#define DW_ATE_FLOAT 0x04
+#define DW_ATE_SIGNED 0x05
+#define DW_ATE_UNSIGNED 0x08
+
 LlvmScopeInfo *new_llvm_scope_info(LLVMValueRef function_ref, LLVMBasicBlockRef break_block, LLVMBasicBlockRef continue_block)
 {
     LlvmScopeInfo *llvm_scope_info = malloc(sizeof(LlvmScopeInfo));
@@ -26,6 +35,7 @@ LlvmScopeInfo *new_llvm_scope_info(LLVMValueRef function_ref, LLVMBasicBlockRef
     llvm_scope_info->break_block = break_block;
     llvm_scope_info->continue_block = continue_block;
     llvm_scope_info->jump_to = NULL;
+    llvm_scope_info->has_returned = false;
     return llvm_scope_info;
 }
 
@@ -39,6 +49,8 @@ LlvmSymbolInfo *new_llvm_symbol_info(LLVMTypeRef type, LLVMValueRef value)
     LlvmSymbolInfo *llvm_symbol_info = malloc(sizeof(LlvmSymbolInfo));
     llvm_symbol_info->type = type;
     llvm_symbol_info->value = value;
+    llvm_symbol_info->value_type = TYPE_INFER;
+    llvm_symbol_info->type_info = NULL;
     return llvm_symbol_info;
 }
 
@@ -47,86 +59,2183 @@ void dispose_llvm_symbol_info(LlvmSymbolInfo *llvm_symbol_info)
     free(llvm_symbol_info);
 }
 
+LLVMMetadataRef llvm_debug_location(Llvm *llvm)
+{
+    return LLVMDIBuilderCreateDebugLocation(llvm->context, llvm->line, llvm->col, llvm->di_scope, NULL);
+}
+
+void llvm_set_location(Llvm *llvm, int line, int col)
+{
+    if (line <= 0)
+    {
+        return;
+    }
+    llvm->line = line;
+    llvm->col = col;
+    if (llvm->di_scope != NULL)
+    {
+        LLVMSetCurrentDebugLocation2(llvm->builder, llvm_debug_location(llvm));
+    }
+}
+
+LLVMValueRef llvm_build_entry_alloca(Llvm *llvm, LLVMTypeRef type, char *name)
+{
+    LLVMBasicBlockRef current_block = LLVMGetInsertBlock(llvm->builder);
+    LLVMBasicBlockRef entry_block = LLVMGetEntryBasicBlock(LLVMGetBasicBlockParent(current_block));
+    LLVMValueRef first = LLVMGetFirstInstruction(entry_block);
+    if (first != NULL)
+    {
+        LLVMPositionBuilderBefore(llvm->builder, first);
+    }
+    else
+    {
+        LLVMPositionBuilderAtEnd(llvm->builder, entry_block);
+    }
+    LLVMValueRef value = LLVMBuildAlloca(llvm->builder, type, name);
+    LLVMPositionBuilderAtEnd(llvm->builder, current_block);
+    return value;
+}
+
+LLVMValueRef llvm_call_runtime(Llvm *llvm, char *name, LLVMValueRef *args, int num_args)
+{
+    LLVMValueRef function = LLVMGetNamedFunction(llvm->module, name);
+    return LLVMBuildCall2(llvm->builder, LLVMGlobalGetValueType(function), function, args, num_args, "");
+}
+
+LLVMMetadataRef llvm_profile_node(Llvm *llvm, char *name, LLVMValueRef *values, int num_values)
+{
+    LLVMMetadataRef *operands = malloc((num_values + 1) * sizeof(LLVMMetadataRef));
+    operands[0] = LLVMMDStringInContext2(llvm->context, name, strlen(name));
+    for (int i = 0; i < num_values; i++)
+    {
+        operands[i + 1] = LLVMValueAsMetadata(values[i]);
+    }
+    LLVMMetadataRef node = LLVMMDNodeInContext2(llvm->context, operands, num_values + 1);
+    free(operands);
+    return node;
+}
+
+void llvm_set_branch_weights(Llvm *llvm, LLVMValueRef branch, uint64_t taken, uint64_t not_taken)
+{
+    // Weights are 32 bit, offset by one so that never taken edges keep a
+    // weight and scaled down together so that their ratio is preserved
+    taken++;
+    not_taken++;
+    while (taken > UINT32_MAX || not_taken > UINT32_MAX)
+    {
+        taken >>= 1;
+        not_taken >>= 1;
+    }
+    LLVMTypeRef weight_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMValueRef weights[2] = {LLVMConstInt(weight_type, taken, 0), LLVMConstInt(weight_type, not_taken, 0)};
+    LLVMMetadataRef node = llvm_profile_node(llvm, "branch_weights", weights, 2);
+    LLVMSetMetadata(branch, LLVMGetMDKindIDInContext(llvm->context, "prof", 4), LLVMMetadataAsValue(llvm->context, node));
+}
+
+// Marks a profiled site. With --profile-generate this increments a counter
+// registered with the corelib runtime, with --profile-use it returns the
+// count recorded for the site if the profile still matches it.
+bool llvm_profile_site(Llvm *llvm, char *kind, Expression *expression, uint64_t *count)
+{
+    if (llvm->profile == NULL && !llvm->options->profile_generate)
+    {
+        return false;
+    }
+
+    char signature[PROFILE_SIGNATURE_SIZE];
+    profile_site_signature(signature, kind, expression);
+
+    if (llvm->profile != NULL)
+    {
+        return profile_lookup(llvm->profile, signature, count);
+    }
+
+    LLVMTypeRef counter_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMValueRef counter = LLVMAddGlobal(llvm->module, counter_type, "profile_counter");
+    LLVMSetInitializer(counter, LLVMConstInt(counter_type, 0, 0));
+    LLVMSetLinkage(counter, LLVMPrivateLinkage);
+    LLVMValueRef value = LLVMBuildLoad2(llvm->builder, counter_type, counter, "profile_count");
+    LLVMBuildStore(llvm->builder, LLVMBuildAdd(llvm->builder, value, LLVMConstInt(counter_type, 1, 0), "profile_count"), counter);
+
+    LLVMBasicBlockRef current_block = LLVMGetInsertBlock(llvm->builder);
+    LLVMMetadataRef location = LLVMGetCurrentDebugLocation2(llvm->builder);
+    LLVMSetCurrentDebugLocation2(llvm->builder, NULL);
+    LLVMPositionBuilderAtEnd(llvm->builder, LLVMGetEntryBasicBlock(llvm->profile_init));
+    LLVMValueRef args[3];
+    args[0] = LLVMBuildGlobalStringPtr(llvm->builder, LLVMGetValueName(LLVMGetBasicBlockParent(current_block)), "profile_function");
+    args[1] = LLVMBuildGlobalStringPtr(llvm->builder, signature, "profile_site");
+    args[2] = counter;
+    llvm_call_runtime(llvm, "tron_pgo_register", args, 3);
+    LLVMPositionBuilderAtEnd(llvm->builder, current_block);
+    LLVMSetCurrentDebugLocation2(llvm->builder, location);
+    return false;
+}
+
+// LLVM 14 can not select bfloat on most targets, bf16 values are kept as
+// their bit pattern in an i16 and computed on as floats
+LLVMTypeRef llvm_scalar_type(Llvm *llvm, Type type)
+{
+    switch (type)
+    {
+    case TYPE_FLOAT:
+        return LLVMFloatTypeInContext(llvm->context);
+    case TYPE_F64:
+        return LLVMDoubleTypeInContext(llvm->context);
+    case TYPE_F16:
+        return LLVMHalfTypeInContext(llvm->context);
+    case TYPE_INFER:
+        fprintf(stderr, "Unsupported type for variable: %d\n", type);
+        exit(1);
+    default:
+        // bool, bf16 and the integer types, signedness is up to the
+        // operations
+        return LLVMIntTypeInContext(llvm->context, type_bits(type));
+    }
+}
+
+// Arrays nest from their outermost dimension in, int[2][3] is [2 x [3 x i32]]
+LLVMTypeRef llvm_array_type(Llvm *llvm, Type type, ArrayInfo *array_info)
+{
+    if (array_info == NULL)
+    {
+        return llvm_scalar_type(llvm, type);
+    }
+    if (array_info->size < 0)
+    {
+        fatal("Array size is unknown");
+    }
+    return LLVMArrayType(llvm_array_type(llvm, type, array_info->next), array_info->size);
+}
+
+// Slices are {data, length, capacity} headers. Variables hold their header,
+// functions get a pointer to the one of their caller. A capacity of 0 marks
+// a view, whose data belongs to another slice or array.
+LLVMTypeRef llvm_slice_type(Llvm *llvm, Type type)
+{
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMTypeRef fields[3] = {LLVMPointerType(llvm_scalar_type(llvm, type), 0), i64_type, i64_type};
+    return LLVMStructTypeInContext(llvm->context, fields, 3, 0);
+}
+
+// Tensors are named {data, length, capacity, [rank x i64] shape} headers,
+// a slice header over the elements in row major order followed by the size
+// of every dimension, which lets the slice runtime allocate and release
+// them. Like slices, variables hold their header and functions get a
+// pointer to the one of their caller.
+LLVMTypeRef llvm_tensor_type(Llvm *llvm, Type type, int rank)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "tensor.%s.%d", type_name(type), rank);
+    LLVMTypeRef tensor_type = LLVMGetTypeByName2(llvm->context, name);
+    if (tensor_type == NULL)
+    {
+        LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+        LLVMTypeRef fields[4] = {LLVMPointerType(llvm_scalar_type(llvm, type), 0), i64_type, i64_type, LLVMArrayType(i64_type, rank)};
+        tensor_type = LLVMStructCreateNamed(llvm->context, name);
+        LLVMStructSetBody(tensor_type, fields, 4, 0);
+    }
+    return tensor_type;
+}
+
 LLVMTypeRef get_llvm_type(Llvm *llvm, TypeInfo *type_info)
 {
-    LLVMTypeRef var_type;
-    switch (type_info->type)
+    if (type_info->tensor)
+    {
+        return llvm_tensor_type(llvm, type_info->type, count_dimensions(type_info->array_info));
+    }
+    if (type_info->slice)
+    {
+        return llvm_slice_type(llvm, type_info->type);
+    }
+    return llvm_array_type(llvm, type_info->type, type_info->array_info);
+}
+
+// Arrays are aligned to their element size, which is what memcpy and
+// memset of them are told
+unsigned llvm_array_alignment(Type type)
+{
+    return type == TYPE_BOOL ? 1 : type_bits(type) / 8;
+}
+
+bool llvm_is_float_type(LLVMTypeRef type)
+{
+    switch (LLVMGetTypeKind(type))
+    {
+    case LLVMHalfTypeKind:
+    case LLVMFloatTypeKind:
+    case LLVMDoubleTypeKind:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int llvm_float_bits(LLVMTypeRef type)
+{
+    switch (LLVMGetTypeKind(type))
+    {
+    case LLVMHalfTypeKind:
+        return 16;
+    case LLVMDoubleTypeKind:
+        return 64;
+    default:
+        return 32;
+    }
+}
+
+// Operands the parser could not give a type keep the signed operations int
+// always had
+bool llvm_is_signed(Type type)
+{
+    return type == TYPE_INFER || is_signed_type(type);
+}
+
+bool llvm_has_debug_variables(Llvm *llvm)
+{
+    return llvm->di_scope != NULL && llvm->options->debug_info == DEBUG_INFO_FULL;
+}
+
+LLVMMetadataRef llvm_debug_scalar_type(Llvm *llvm, Type type)
+{
+    if (type == TYPE_INFER)
+    {
+        fprintf(stderr, "Unsupported type for debug info: %d\n", type);
+        exit(1);
+    }
+    char *name = type_name(type);
+    if (type == TYPE_BOOL)
+    {
+        return LLVMDIBuilderCreateBasicType(llvm->di_builder, name, strlen(name), 8, DW_ATE_BOOLEAN, LLVMDIFlagZero);
+    }
+    int encoding = is_float_type(type) ? DW_ATE_FLOAT : is_signed_type(type) ? DW_ATE_SIGNED : DW_ATE_UNSIGNED;
+    return LLVMDIBuilderCreateBasicType(llvm->di_builder, name, strlen(name), type_bits(type), encoding, LLVMDIFlagZero);
+}
+
+LLVMMetadataRef llvm_debug_slice_type(Llvm *llvm, Type type, LLVMMetadataRef element)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "slice<%s>", type_name(type));
+    LLVMMetadataRef i64_type = llvm_debug_scalar_type(llvm, TYPE_I64);
+    LLVMMetadataRef data_type = LLVMDIBuilderCreatePointerType(llvm->di_builder, element, 64, 0, 0, NULL, 0);
+    LLVMMetadataRef members[3] = {
+        LLVMDIBuilderCreateMemberType(llvm->di_builder, llvm->di_file, "data", 4, llvm->di_file, 0, 64, 64, 0, LLVMDIFlagZero, data_type),
+        LLVMDIBuilderCreateMemberType(llvm->di_builder, llvm->di_file, "length", 6, llvm->di_file, 0, 64, 64, 64, LLVMDIFlagZero, i64_type),
+        LLVMDIBuilderCreateMemberType(llvm->di_builder, llvm->di_file, "capacity", 8, llvm->di_file, 0, 64, 64, 128, LLVMDIFlagZero, i64_type),
+    };
+    return LLVMDIBuilderCreateStructType(llvm->di_builder, llvm->di_file, name, strlen(name), llvm->di_file, 0, 192, 64,
+                                         LLVMDIFlagZero, NULL, members, 3, 0, NULL, name, strlen(name));
+}
+
+LLVMMetadataRef llvm_debug_tensor_type(Llvm *llvm, TypeInfo *type_info, LLVMMetadataRef element)
+{
+    int rank = count_dimensions(type_info->array_info);
+    char name[32];
+    snprintf(name, sizeof(name), "tensor<%s>[%d]", type_name(type_info->type), rank);
+    LLVMMetadataRef i64_type = llvm_debug_scalar_type(llvm, TYPE_I64);
+    LLVMMetadataRef data_type = LLVMDIBuilderCreatePointerType(llvm->di_builder, element, 64, 0, 0, NULL, 0);
+    LLVMMetadataRef subscript = LLVMDIBuilderGetOrCreateSubrange(llvm->di_builder, 0, rank);
+    LLVMMetadataRef shape_type = LLVMDIBuilderCreateArrayType(llvm->di_builder, 64 * rank, 64, i64_type, &subscript, 1);
+    LLVMMetadataRef members[4] = {
+        LLVMDIBuilderCreateMemberType(llvm->di_builder, llvm->di_file, "data", 4, llvm->di_file, 0, 64, 64, 0, LLVMDIFlagZero, data_type),
+        LLVMDIBuilderCreateMemberType(llvm->di_builder, llvm->di_file, "length", 6, llvm->di_file, 0, 64, 64, 64, LLVMDIFlagZero, i64_type),
+        LLVMDIBuilderCreateMemberType(llvm->di_builder, llvm->di_file, "capacity", 8, llvm->di_file, 0, 64, 64, 128, LLVMDIFlagZero, i64_type),
+        LLVMDIBuilderCreateMemberType(llvm->di_builder, llvm->di_file, "shape", 5, llvm->di_file, 0, 64 * rank, 64, 192, LLVMDIFlagZero, shape_type),
+    };
+    return LLVMDIBuilderCreateStructType(llvm->di_builder, llvm->di_file, name, strlen(name), llvm->di_file, 0, 192 + 64 * rank, 64,
+                                         LLVMDIFlagZero, NULL, members, 4, 0, NULL, name, strlen(name));
+}
+
+LLVMMetadataRef get_llvm_debug_type(Llvm *llvm, TypeInfo *type_info)
+{
+    LLVMMetadataRef element = llvm_debug_scalar_type(llvm, type_info->type);
+    if (type_info->tensor)
+    {
+        return llvm_debug_tensor_type(llvm, type_info, element);
+    }
+    if (type_info->slice)
+    {
+        return llvm_debug_slice_type(llvm, type_info->type, element);
+    }
+    if (type_info->array_info == NULL)
+    {
+        return element;
+    }
+    int num_dimensions = 0;
+    for (ArrayInfo *array_info = type_info->array_info; array_info != NULL; array_info = array_info->next)
+    {
+        num_dimensions++;
+    }
+    LLVMMetadataRef *subscripts = malloc(num_dimensions * sizeof(LLVMMetadataRef));
+    uint64_t size = llvm_array_alignment(type_info->type) * 8;
+    int i = 0;
+    for (ArrayInfo *array_info = type_info->array_info; array_info != NULL; array_info = array_info->next)
+    {
+        subscripts[i++] = LLVMDIBuilderGetOrCreateSubrange(llvm->di_builder, 0, array_info->size);
+        size *= array_info->size;
+    }
+    LLVMMetadataRef array = LLVMDIBuilderCreateArrayType(llvm->di_builder, size, llvm_array_alignment(type_info->type) * 8,
+                                                         element, subscripts, num_dimensions);
+    free(subscripts);
+    return array;
+}
+
+// Slices and tensors are passed as a pointer to the header of the caller
+LLVMTypeRef llvm_param_type(Llvm *llvm, TypeInfo *type_info)
+{
+    LLVMTypeRef type = get_llvm_type(llvm, type_info);
+    return type_info->slice || type_info->tensor ? LLVMPointerType(type, 0) : type;
+}
+
+LLVMMetadataRef llvm_debug_param_type(Llvm *llvm, TypeInfo *type_info)
+{
+    LLVMMetadataRef type = get_llvm_debug_type(llvm, type_info);
+    return type_info->slice || type_info->tensor ? LLVMDIBuilderCreatePointerType(llvm->di_builder, type, 64, 0, 0, NULL, 0) : type;
+}
+
+void llvm_add_function_attribute(Llvm *llvm, LLVMValueRef value, char *name)
+{
+    LLVMAttributeRef attribute = LLVMCreateEnumAttribute(llvm->context, LLVMGetEnumAttributeKindForName(name, strlen(name)), 0);
+    if (LLVMIsACallInst(value))
+    {
+        LLVMAddCallSiteAttribute(value, LLVMAttributeFunctionIndex, attribute);
+    }
+    else
+    {
+        LLVMAddAttributeAtIndex(value, LLVMAttributeFunctionIndex, attribute);
+    }
+}
+
+void llvm_add_param_attribute(Llvm *llvm, LLVMValueRef function_ref, int i, char *name)
+{
+    LLVMAttributeRef attribute = LLVMCreateEnumAttribute(llvm->context, LLVMGetEnumAttributeKindForName(name, strlen(name)), 0);
+    LLVMAddAttributeAtIndex(function_ref, i + 1, attribute);
+}
+
+// Attaches what llvm_analyze inferred about a function to its definition or
+// to a call site. Tron has no exceptions, so nothing it compiles unwinds.
+void llvm_add_effect_attributes(Llvm *llvm, LLVMValueRef value, char *name)
+{
+    FunctionEffects *effects = llvm->effects != NULL ? find_function_effects(llvm->effects, name) : NULL;
+    if (effects == NULL)
+    {
+        return;
+    }
+
+    llvm_add_function_attribute(llvm, value, "nounwind");
+    if (effects->norecurse)
+    {
+        llvm_add_function_attribute(llvm, value, "norecurse");
+    }
+    if (effects->willreturn)
+    {
+        llvm_add_function_attribute(llvm, value, "willreturn");
+    }
+
+    // Instrumented code calls into the profiling runtimes
+    if (llvm->options->instrument || llvm->options->profile_generate)
+    {
+        return;
+    }
+    if (effects->readnone)
+    {
+        llvm_add_function_attribute(llvm, value, "readnone");
+    }
+    else if (effects->readonly)
+    {
+        llvm_add_function_attribute(llvm, value, "readonly");
+    }
+    if (effects->nofree)
+    {
+        // Tron code has no threads or atomics of its own either
+        llvm_add_function_attribute(llvm, value, "nofree");
+        llvm_add_function_attribute(llvm, value, "nosync");
+    }
+}
+
+uint16_t llvm_bf16_bits(double value)
+{
+    float narrowed = (float)value;
+    uint32_t bits;
+    memcpy(&bits, &narrowed, sizeof(bits));
+    if (narrowed != narrowed)
+    {
+        return (bits >> 16) | 0x40;
+    }
+    return (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+}
+
+// Literals take the type of the expression they appear in
+LLVMValueRef llvm_visit_integer(Llvm *llvm, Integer *integer, TypeInfo *type_info)
+{
+    return LLVMConstInt(get_llvm_type(llvm, type_info), (unsigned long long)integer->value, 0);
+}
+
+LLVMValueRef llvm_visit_float(Llvm *llvm, Float *floating_point, TypeInfo *type_info)
+{
+    if (type_info->type == TYPE_BF16)
+    {
+        return LLVMConstInt(LLVMInt16TypeInContext(llvm->context), llvm_bf16_bits(floating_point->value), 0);
+    }
+    return LLVMConstReal(get_llvm_type(llvm, type_info), floating_point->value);
+}
+
+LLVMValueRef llvm_eval_value_to_const(EvalValue value, LLVMTypeRef type)
+{
+    if (llvm_is_float_type(type))
+    {
+        return LLVMConstReal(type, is_float_type(value.type) ? value.float_value : value.int_value);
+    }
+    return LLVMConstInt(type, (unsigned long long)value.int_value, 1);
+}
+
+bool llvm_const_to_eval_value(LLVMValueRef constant, Type type, EvalValue *value)
+{
+    if (LLVMIsAConstantInt(constant) && type != TYPE_INFER)
+    {
+        value->type = type;
+        value->int_value = is_signed_type(type) ? LLVMConstIntGetSExtValue(constant) : (int64_t)LLVMConstIntGetZExtValue(constant);
+        return true;
+    }
+    if (LLVMIsAConstantFP(constant) && (type == TYPE_FLOAT || type == TYPE_F64))
+    {
+        LLVMBool loses_info;
+        value->type = type;
+        value->float_value = LLVMConstRealGetDouble(constant, &loses_info);
+        return true;
+    }
+    return false;
+}
+
+// Gives the compile time interpreter the constants in scope, functions it
+// calls only see the root level ones
+bool llvm_eval_lookup(void *data, char *name, bool global_only, EvalValue *value)
+{
+    Llvm *llvm = data;
+    Scope *scope = llvm->scope;
+    while (global_only && scope->parent != NULL)
+    {
+        scope = scope->parent;
+    }
+    Symbol *symbol = lookup_symbol(scope, name);
+    if (symbol == NULL || symbol->type != SYMBOL_CONSTANT)
+    {
+        return false;
+    }
+    LlvmSymbolInfo *llvm_symbol_info = symbol->info;
+    return llvm_const_to_eval_value(llvm_symbol_info->value, llvm_symbol_info->value_type, value);
+}
+
+// Evaluates expression at compile time, NULL when it can only be computed at
+// runtime with the reason left in llvm->eval->error
+LLVMValueRef llvm_eval_constant(Llvm *llvm, Expression *expression, LLVMTypeRef type)
+{
+    EvalValue value;
+    if (llvm->eval == NULL || !eval_expression(llvm->eval, expression, &value))
+    {
+        return NULL;
+    }
+    return llvm_eval_value_to_const(value, type);
+}
+
+// Calls to const functions with constant arguments are replaced by their
+// result. Anything the interpreter gives up on, such as a call running over
+// the step budget, is left to runtime.
+LLVMValueRef llvm_fold_const_call(Llvm *llvm, Call *call, LLVMValueRef *args, int num_args, LLVMTypeRef return_type)
+{
+    Function *function = llvm->eval != NULL ? eval_function(llvm->eval, call->name) : NULL;
+    if (function == NULL || !function->constant)
+    {
+        return NULL;
+    }
+    EvalValue *values = calloc(num_args, sizeof(EvalValue));
+    bool constant = true;
+    Variable *param = function->params;
+    for (int i = 0; i < num_args && constant; i++, param = param != NULL ? param->next : NULL)
+    {
+        constant = param != NULL && llvm_const_to_eval_value(args[i], param->type_info->type, &values[i]);
+    }
+    EvalValue result;
+    LLVMValueRef folded = NULL;
+    if (constant && eval_call(llvm->eval, call->name, values, num_args, &result))
+    {
+        folded = llvm_eval_value_to_const(result, return_type);
+    }
+    free(values);
+    return folded;
+}
+
+LLVMValueRef llvm_to_bool(Llvm *llvm, LLVMValueRef value);
+
+LLVMValueRef llvm_bf16_to_float(Llvm *llvm, LLVMValueRef value)
+{
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMValueRef bits = LLVMBuildZExt(llvm->builder, value, i32_type, "bf16_bits");
+    bits = LLVMBuildShl(llvm->builder, bits, LLVMConstInt(i32_type, 16, 0), "bf16_bits");
+    return LLVMBuildBitCast(llvm->builder, bits, LLVMFloatTypeInContext(llvm->context), "bf16_float");
+}
+
+// Rounds to nearest even, NaNs stay quiet NaNs
+LLVMValueRef llvm_float_to_bf16(Llvm *llvm, LLVMValueRef value)
+{
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMValueRef bits = LLVMBuildBitCast(llvm->builder, value, i32_type, "float_bits");
+    LLVMValueRef upper = LLVMBuildLShr(llvm->builder, bits, LLVMConstInt(i32_type, 16, 0), "float_upper");
+    LLVMValueRef odd = LLVMBuildAnd(llvm->builder, upper, LLVMConstInt(i32_type, 1, 0), "float_odd");
+    LLVMValueRef rounded = LLVMBuildAdd(llvm->builder, bits, LLVMBuildAdd(llvm->builder, odd, LLVMConstInt(i32_type, 0x7fff, 0), "bias"), "rounded");
+    rounded = LLVMBuildLShr(llvm->builder, rounded, LLVMConstInt(i32_type, 16, 0), "rounded");
+    LLVMValueRef quiet = LLVMBuildOr(llvm->builder, upper, LLVMConstInt(i32_type, 0x40, 0), "quiet");
+    LLVMValueRef is_nan = LLVMBuildFCmp(llvm->builder, LLVMRealUNO, value, value, "is_nan");
+    LLVMValueRef result = LLVMBuildSelect(llvm->builder, is_nan, quiet, rounded, "bf16");
+    return LLVMBuildTrunc(llvm->builder, result, LLVMInt16TypeInContext(llvm->context), "bf16");
+}
+
+// Integers are extended according to the signedness of the type they come
+// from, floats converted to an integer type out of its range are poison
+LLVMValueRef llvm_build_conversion(Llvm *llvm, LLVMValueRef value, Type from, Type to, char *name)
+{
+    if (from == TYPE_BF16)
+    {
+        value = llvm_bf16_to_float(llvm, value);
+        from = TYPE_FLOAT;
+    }
+    if (to == TYPE_BF16)
+    {
+        return llvm_float_to_bf16(llvm, llvm_build_conversion(llvm, value, from, TYPE_FLOAT, name));
+    }
+    LLVMTypeRef from_type = LLVMTypeOf(value);
+    LLVMTypeRef to_type = llvm_scalar_type(llvm, to);
+    if (from_type == to_type)
+    {
+        return value;
+    }
+    if (to == TYPE_BOOL)
+    {
+        return llvm_to_bool(llvm, value);
+    }
+    bool from_float = llvm_is_float_type(from_type);
+    if (llvm_is_float_type(to_type))
+    {
+        if (!from_float)
+        {
+            return llvm_is_signed(from) ? LLVMBuildSIToFP(llvm->builder, value, to_type, name)
+                                        : LLVMBuildUIToFP(llvm->builder, value, to_type, name);
+        }
+        if (llvm_float_bits(from_type) < llvm_float_bits(to_type))
+        {
+            return LLVMBuildFPExt(llvm->builder, value, to_type, name);
+        }
+        return LLVMBuildFPTrunc(llvm->builder, value, to_type, name);
+    }
+    if (from_float)
+    {
+        return is_signed_type(to) ? LLVMBuildFPToSI(llvm->builder, value, to_type, name)
+                                  : LLVMBuildFPToUI(llvm->builder, value, to_type, name);
+    }
+    return LLVMBuildIntCast2(llvm->builder, value, to_type, llvm_is_signed(from), name);
+}
+
+LLVMValueRef llvm_visit_push(Llvm *llvm, Call *call);
+LLVMValueRef llvm_visit_len(Llvm *llvm, Call *call);
+void llvm_release_slice(Llvm *llvm, LLVMValueRef header, Type type);
+LLVMValueRef llvm_slice_header(Llvm *llvm, Expression *expression);
+LLVMValueRef llvm_tensor_operand(Llvm *llvm, Expression *expression);
+void llvm_tensor_shape(Llvm *llvm, Expression *expression, LLVMValueRef *dimensions);
+LLVMValueRef llvm_visit_reduction(Llvm *llvm, Call *call);
+
+LLVMValueRef llvm_visit_cast(Llvm *llvm, Call *call)
+{
+    LLVMValueRef value = llvm_visit_expression(llvm, call->expression);
+    return llvm_build_conversion(llvm, value, call->expression->type_info->type, cast_type(call->name), call->name);
+}
+
+// Literal arguments are converted to the parameter type, anything else has
+// to be converted explicitly
+LLVMValueRef llvm_coerce_argument(Llvm *llvm, Call *call, int i, Expression *arg, LLVMValueRef value, LLVMTypeRef type)
+{
+    if (LLVMTypeOf(value) == type)
+    {
+        return value;
+    }
+    if (LLVMIsAConstantInt(value) && LLVMGetTypeKind(type) == LLVMIntegerTypeKind)
+    {
+        return LLVMConstIntCast(value, type, llvm_is_signed(arg->type_info->type));
+    }
+    if (LLVMIsAConstantFP(value) && llvm_is_float_type(type))
+    {
+        return LLVMConstFPCast(value, type);
+    }
+    // Tensor headers are named structs, slice headers are not
+    LLVMTypeRef header_type = LLVMGetTypeKind(type) == LLVMPointerTypeKind ? LLVMGetElementType(type) : NULL;
+    if (arg->type_info->tensor || (header_type != NULL && !LLVMIsLiteralStruct(header_type)))
+    {
+        fatal("Argument %d of %s at %d:%d must be a tensor of the element type and rank of the parameter", i + 1, call->name,
+              arg->line, arg->col);
+    }
+    if (arg->type_info->slice)
+    {
+        fatal("Argument %d of %s at %d:%d is a slice, the parameter is not", i + 1, call->name, arg->line, arg->col);
+    }
+    if (header_type != NULL)
+    {
+        fatal("Argument %d of %s at %d:%d must be a slice", i + 1, call->name, arg->line, arg->col);
+    }
+    fatal("Argument %d of %s at %d:%d has type %s, convert it with %s<type>", i + 1, call->name, arg->line, arg->col,
+          type_name(arg->type_info->type), CAST_PREFIX);
+}
+
+LLVMValueRef llvm_visit_call(Llvm *llvm, Call *call)
+{
+    if (is_cast(call->name))
+    {
+        return llvm_visit_cast(llvm, call);
+    }
+    if (strcmp(call->name, PUSH) == 0)
+    {
+        return llvm_visit_push(llvm, call);
+    }
+    if (strcmp(call->name, LEN) == 0)
+    {
+        return llvm_visit_len(llvm, call);
+    }
+    if (is_reduction(call->name))
+    {
+        return llvm_visit_reduction(llvm, call);
+    }
+
+    Symbol *symbol = lookup_symbol(llvm->scope, call->name);
+    if (symbol == NULL)
+    {
+        fatal("Symbol not found: %s\n", call->name);
+    }
+
+    int line = llvm->line;
+    int col = llvm->col;
+
+    int num_args = 0;
+    Expression *arg = call->expression;
+    while (arg != NULL)
+    {
+        num_args++;
+        arg = arg->next;
+    }
+    LlvmSymbolInfo *llvm_symbol_info = (LlvmSymbolInfo *)symbol->info;
+    int num_params = LLVMCountParamTypes(llvm_symbol_info->type);
+    LLVMTypeRef *param_types = calloc(num_params, sizeof(LLVMTypeRef));
+    LLVMGetParamTypes(llvm_symbol_info->type, param_types);
+    LLVMValueRef *args = calloc(num_args, sizeof(LLVMValueRef));
+    int i = 0;
+    arg = call->expression;
+    while (arg != NULL)
+    {
+        // Slices and tensors are passed by the address of their header
+        if (arg->type_info->slice)
+        {
+            args[i] = llvm_slice_header(llvm, arg);
+        }
+        else
+        {
+            args[i] = arg->type_info->tensor ? llvm_tensor_operand(llvm, arg) : llvm_visit_expression(llvm, arg);
+        }
+        if (i < num_params)
+        {
+            args[i] = llvm_coerce_argument(llvm, call, i, arg, args[i], param_types[i]);
+        }
+        i++;
+        arg = arg->next;
+    }
+    free(param_types);
+    llvm_set_location(llvm, line, col);
+
+    LLVMValueRef folded = llvm_fold_const_call(llvm, call, args, num_args, LLVMGetReturnType(llvm_symbol_info->type));
+    if (folded != NULL)
+    {
+        free(args);
+        return folded;
+    }
+
+    // Calls returning void can not be named
+    char *call_name = LLVMGetTypeKind(LLVMGetReturnType(llvm_symbol_info->type)) == LLVMVoidTypeKind ? "" : call->name;
+    LLVMValueRef llvm_call = LLVMBuildCall2(llvm->builder, llvm_symbol_info->type, llvm_symbol_info->value, args, num_args, call_name);
+    LLVMSetInstructionCallConv(llvm_call, LLVMGetFunctionCallConv(llvm_symbol_info->value));
+    llvm_add_effect_attributes(llvm, llvm_call, call->name);
+    // The callee may have pushed to a view, which then owns a buffer
+    i = 0;
+    for (arg = call->expression; arg != NULL; arg = arg->next, i++)
+    {
+        if (arg->node != NULL && arg->node->node_type == N_SLICE)
+        {
+            llvm_release_slice(llvm, args[i], arg->type_info->type);
+        }
+    }
+    free(args);
+
+    return llvm_call;
+}
+
+LLVMValueRef llvm_visit_name(Llvm *llvm, Name *name)
+{
+    Symbol *symbol = lookup_symbol(llvm->scope, name->value);
+    if (symbol == NULL)
+    {
+        fatal("Symbol not found: %s\n", name->value);
+    }
+
+    LlvmSymbolInfo *llvm_symbol_info = symbol->info;
+    if (symbol->type == SYMBOL_ARG || symbol->type == SYMBOL_CONSTANT)
+    {
+        return llvm_symbol_info->value;
+    }
+    else if (symbol->type == SYMBOL_VARIABLE)
+    {
+        return LLVMBuildLoad2(llvm->builder, llvm_symbol_info->type, llvm_symbol_info->value, name->value);
+    }
+    else
+    {
+        fatal("Invalid symbol type");
+    }
+}
+
+// Indexes are sign or zero extended to 64 bits according to their type
+LLVMValueRef llvm_visit_index(Llvm *llvm, Expression *index)
+{
+    LLVMValueRef value = llvm_visit_expression(llvm, index);
+    return LLVMBuildIntCast2(llvm->builder, value, LLVMInt64TypeInContext(llvm->context), llvm_is_signed(index->type_info->type), "index");
+}
+
+// Aborts with the source location unless index is below length, or up to
+// it for the bounds of a view. The unsigned compare catches negative
+// indexes too. Indexes the innermost loop being compiled has proven in
+// bounds are not checked.
+void llvm_check_index(Llvm *llvm, Expression *index, LLVMValueRef value, LLVMValueRef length, bool inclusive)
+{
+    if (llvm->options->unchecked || bounds_proves(llvm->unchecked_loop, index))
+    {
+        return;
+    }
+    LLVMBasicBlockRef block = LLVMGetInsertBlock(llvm->builder);
+    LLVMValueRef function_ref = LLVMGetBasicBlockParent(block);
+    LLVMBasicBlockRef next_block = LLVMGetNextBasicBlock(block);
+    LLVMBasicBlockRef ok_block = next_block != NULL ? LLVMInsertBasicBlockInContext(llvm->context, next_block, "in_bounds")
+                                                    : LLVMAppendBasicBlockInContext(llvm->context, function_ref, "in_bounds");
+    LLVMBasicBlockRef trap_block = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "out_of_bounds");
+    LLVMValueRef in_bounds = LLVMBuildICmp(llvm->builder, inclusive ? LLVMIntULE : LLVMIntULT, value, length, "in_bounds");
+    LLVMBuildCondBr(llvm->builder, in_bounds, ok_block, trap_block);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, trap_block);
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMValueRef args[4] = {LLVMConstInt(i32_type, index->line, 0), LLVMConstInt(i32_type, index->col, 0), value, length};
+    llvm_call_runtime(llvm, "tron_bounds", args, 4);
+    LLVMBuildUnreachable(llvm->builder);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, ok_block);
+}
+
+LLVMValueRef llvm_build_element_pointer(Llvm *llvm, LLVMValueRef array, LLVMTypeRef type, Expression *index)
+{
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMValueRef indices[2] = {
+        LLVMConstInt(i64_type, 0, 0),
+        llvm_visit_index(llvm, index),
+    };
+    llvm_check_index(llvm, index, indices[1], LLVMConstInt(i64_type, LLVMGetArrayLength(type), 0), false);
+    return LLVMBuildInBoundsGEP2(llvm->builder, type, array, indices, 2, "element");
+}
+
+// Slice headers and elements are told apart by type based alias analysis,
+// storing an element then does not force the data pointer to be reloaded
+void llvm_set_tbaa(Llvm *llvm, LLVMValueRef access, char *name)
+{
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMMetadataRef root_name = LLVMMDStringInContext2(llvm->context, "tron", 4);
+    LLVMMetadataRef root = LLVMMDNodeInContext2(llvm->context, &root_name, 1);
+    LLVMMetadataRef type[3] = {LLVMMDStringInContext2(llvm->context, name, strlen(name)), root,
+                               LLVMValueAsMetadata(LLVMConstInt(i64_type, 0, 0))};
+    LLVMMetadataRef type_node = LLVMMDNodeInContext2(llvm->context, type, 3);
+    LLVMMetadataRef tag[3] = {type_node, type_node, LLVMValueAsMetadata(LLVMConstInt(i64_type, 0, 0))};
+    LLVMSetMetadata(access, LLVMGetMDKindIDInContext(llvm->context, "tbaa", 4),
+                    LLVMMetadataAsValue(llvm->context, LLVMMDNodeInContext2(llvm->context, tag, 3)));
+}
+
+LLVMValueRef llvm_load_slice_field(Llvm *llvm, LLVMValueRef header, Type type, int field, char *name)
+{
+    LLVMTypeRef slice_type = llvm_slice_type(llvm, type);
+    LLVMValueRef pointer = LLVMBuildStructGEP2(llvm->builder, slice_type, header, field, "");
+    LLVMValueRef value = LLVMBuildLoad2(llvm->builder, LLVMStructGetTypeAtIndex(slice_type, field), pointer, name);
+    llvm_set_tbaa(llvm, value, "slice header");
+    return value;
+}
+
+void llvm_store_slice_field(Llvm *llvm, LLVMValueRef header, Type type, int field, LLVMValueRef value)
+{
+    LLVMValueRef pointer = LLVMBuildStructGEP2(llvm->builder, llvm_slice_type(llvm, type), header, field, "");
+    llvm_set_tbaa(llvm, LLVMBuildStore(llvm->builder, value, pointer), "slice header");
+}
+
+LLVMValueRef llvm_build_slice_element_pointer(Llvm *llvm, LLVMValueRef header, Type type, Expression *index)
+{
+    LLVMValueRef offset = llvm_visit_index(llvm, index);
+    llvm_check_index(llvm, index, offset, llvm_load_slice_field(llvm, header, type, 1, "length"), false);
+    LLVMValueRef data = llvm_load_slice_field(llvm, header, type, 0, "data");
+    return LLVMBuildInBoundsGEP2(llvm->builder, llvm_scalar_type(llvm, type), data, &offset, 1, "element");
+}
+
+LLVMValueRef llvm_load_tensor_field(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info, int field, char *name)
+{
+    LLVMTypeRef tensor_type = get_llvm_type(llvm, type_info);
+    LLVMValueRef pointer = LLVMBuildStructGEP2(llvm->builder, tensor_type, header, field, "");
+    LLVMValueRef value = LLVMBuildLoad2(llvm->builder, LLVMStructGetTypeAtIndex(tensor_type, field), pointer, name);
+    llvm_set_tbaa(llvm, value, "tensor header");
+    return value;
+}
+
+void llvm_store_tensor_field(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info, int field, LLVMValueRef value)
+{
+    LLVMValueRef pointer = LLVMBuildStructGEP2(llvm->builder, get_llvm_type(llvm, type_info), header, field, "");
+    llvm_set_tbaa(llvm, LLVMBuildStore(llvm->builder, value, pointer), "tensor header");
+}
+
+LLVMValueRef llvm_tensor_dimension_pointer(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info, int dimension)
+{
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMValueRef indices[3] = {LLVMConstInt(i32_type, 0, 0), LLVMConstInt(i32_type, 3, 0), LLVMConstInt(i32_type, dimension, 0)};
+    return LLVMBuildInBoundsGEP2(llvm->builder, get_llvm_type(llvm, type_info), header, indices, 3, "");
+}
+
+// Dimensions the type knows are constants, the others are read from the
+// shape in the header
+LLVMValueRef llvm_tensor_dimension(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info, int dimension)
+{
+    ArrayInfo *array_info = type_info->array_info;
+    for (int i = 0; i < dimension; i++)
+    {
+        array_info = array_info->next;
+    }
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    if (array_info->size >= 0)
+    {
+        return LLVMConstInt(i64_type, array_info->size, 0);
+    }
+    LLVMValueRef size = LLVMBuildLoad2(llvm->builder, i64_type, llvm_tensor_dimension_pointer(llvm, header, type_info, dimension), "dimension");
+    llvm_set_tbaa(llvm, size, "tensor header");
+    return size;
+}
+
+void llvm_tensor_dimensions(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info, LLVMValueRef *dimensions)
+{
+    int rank = count_dimensions(type_info->array_info);
+    for (int i = 0; i < rank; i++)
+    {
+        dimensions[i] = llvm_tensor_dimension(llvm, header, type_info, i);
+    }
+}
+
+// Row major address of t[i][j]..., every index is checked against its
+// dimension
+LLVMValueRef llvm_build_tensor_element_pointer(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info, Expression **indexes)
+{
+    int rank = count_dimensions(type_info->array_info);
+    LLVMValueRef offset = NULL;
+    for (int i = 0; i < rank; i++)
+    {
+        LLVMValueRef dimension = llvm_tensor_dimension(llvm, header, type_info, i);
+        LLVMValueRef index = llvm_visit_index(llvm, indexes[i]);
+        llvm_check_index(llvm, indexes[i], index, dimension, false);
+        if (offset == NULL)
+        {
+            offset = index;
+        }
+        else
+        {
+            offset = LLVMBuildNSWAdd(llvm->builder, LLVMBuildNSWMul(llvm->builder, offset, dimension, "stride"), index, "offset");
+        }
+    }
+    LLVMValueRef data = llvm_load_tensor_field(llvm, header, type_info, 0, "data");
+    return LLVMBuildInBoundsGEP2(llvm->builder, llvm_scalar_type(llvm, type_info->type), data, &offset, 1, "element");
+}
+
+LLVMValueRef llvm_element_pointer(Llvm *llvm, Expression *expression);
+
+// Arrays live in memory and are worked on through their address: the one of
+// a variable or constant, or of a row of an enclosing array
+LLVMValueRef llvm_array_address(Llvm *llvm, Expression *expression)
+{
+    if (expression->token != NULL && expression->token->token_type == T_LBRACKET)
+    {
+        return llvm_element_pointer(llvm, expression);
+    }
+    if (expression->node == NULL || expression->node->node_type != N_NAME)
+    {
+        fatal("Array expression at %d:%d must be a variable or one of its rows", expression->line, expression->col);
+    }
+    Name *name = expression->node->data;
+    Symbol *symbol = lookup_symbol(llvm->scope, name->value);
+    if (symbol == NULL)
+    {
+        fatal("Symbol not found: %s\n", name->value);
+    }
+    return ((LlvmSymbolInfo *)symbol->info)->value;
+}
+
+LLVMValueRef llvm_element_pointer(Llvm *llvm, Expression *expression)
+{
+    LLVMValueRef element;
+    if (expression->left->type_info->tensor)
+    {
+        // t[i][j] nests as (t[i])[j], the indexes are gathered from the last
+        // one back to the tensor
+        Expression *tensor = expression;
+        int rank = 0;
+        while (tensor->token != NULL && tensor->token->token_type == T_LBRACKET)
+        {
+            tensor = tensor->left;
+            rank++;
+        }
+        Expression **indexes = malloc(rank * sizeof(Expression *));
+        Expression *element_expression = expression;
+        for (int i = rank - 1; i >= 0; i--)
+        {
+            indexes[i] = element_expression->right;
+            element_expression = element_expression->left;
+        }
+        element = llvm_build_tensor_element_pointer(llvm, llvm_array_address(llvm, tensor), tensor->type_info, indexes);
+        free(indexes);
+    }
+    else if (expression->left->type_info->slice)
+    {
+        LLVMValueRef header = llvm_slice_header(llvm, expression->left);
+        element = llvm_build_slice_element_pointer(llvm, header, expression->left->type_info->type, expression->right);
+    }
+    else
+    {
+        LLVMValueRef array = llvm_array_address(llvm, expression->left);
+        element = llvm_build_element_pointer(llvm, array, get_llvm_type(llvm, expression->left->type_info), expression->right);
+    }
+    llvm_set_location(llvm, expression->line, expression->col);
+    return element;
+}
+
+LLVMValueRef llvm_visit_element(Llvm *llvm, Expression *expression)
+{
+    if (expression->type_info->array_info != NULL)
+    {
+        fatal("Array row at %d:%d can only be indexed or assigned", expression->line, expression->col);
+    }
+    LLVMValueRef element = llvm_element_pointer(llvm, expression);
+    LLVMValueRef value = LLVMBuildLoad2(llvm->builder, get_llvm_type(llvm, expression->type_info), element, "element");
+    if (expression->left->type_info->slice || expression->left->type_info->tensor)
+    {
+        llvm_set_tbaa(llvm, value, expression->left->type_info->slice ? "slice element" : "tensor element");
+    }
+    return value;
+}
+
+// Constant array literals are emitted once as private read only globals and
+// copied from, literals with the same contents share one
+LLVMValueRef llvm_pool_constant(Llvm *llvm, LLVMValueRef constant, unsigned alignment)
+{
+    for (LLVMValueRef global = LLVMGetFirstGlobal(llvm->module); global != NULL; global = LLVMGetNextGlobal(global))
+    {
+        if (LLVMIsGlobalConstant(global) && LLVMGetLinkage(global) == LLVMPrivateLinkage &&
+            LLVMGetInitializer(global) == constant && LLVMGetAlignment(global) >= alignment)
+        {
+            return global;
+        }
+    }
+    LLVMValueRef global = LLVMAddGlobal(llvm->module, LLVMTypeOf(constant), "array.literal");
+    LLVMSetInitializer(global, constant);
+    LLVMSetGlobalConstant(global, 1);
+    LLVMSetLinkage(global, LLVMPrivateLinkage);
+    LLVMSetUnnamedAddress(global, LLVMGlobalUnnamedAddr);
+    LLVMSetAlignment(global, alignment);
+    return global;
+}
+
+int llvm_count_elements(LLVMTypeRef type)
+{
+    if (LLVMGetTypeKind(type) != LLVMArrayTypeKind)
+    {
+        return 1;
+    }
+    return LLVMGetArrayLength(type) * llvm_count_elements(LLVMGetElementType(type));
+}
+
+// Visits the elements of a possibly nested literal into values in row major
+// order and returns whether they are all constants. Elements of root level
+// literals initialize globals and are evaluated at compile time.
+bool llvm_visit_elements(Llvm *llvm, Expression *literal, bool global, LLVMValueRef *values, int *count)
+{
+    bool constant = true;
+    LLVMTypeRef type = llvm_scalar_type(llvm, literal->type_info->type);
+    for (Expression *element = literal->node->data; element != NULL; element = element->next)
+    {
+        LLVMValueRef value;
+        if (element->node != NULL && element->node->node_type == N_ARRAY)
+        {
+            constant = llvm_visit_elements(llvm, element, global, values, count) && constant;
+            continue;
+        }
+        if (global && (element->node == NULL || (element->node->node_type != N_INTEGER && element->node->node_type != N_FLOAT)))
+        {
+            value = llvm_eval_constant(llvm, element, type);
+            if (value == NULL)
+            {
+                fatal("Array element at %d:%d can not be evaluated at compile time: %s", element->line, element->col,
+                      llvm->eval != NULL ? llvm->eval->error : "no analysis was run");
+            }
+        }
+        else
+        {
+            value = llvm_visit_expression(llvm, element);
+        }
+        constant = constant && LLVMIsAConstant(value);
+        values[(*count)++] = value;
+    }
+    return constant;
+}
+
+LLVMValueRef llvm_build_const_array(LLVMTypeRef type, LLVMValueRef **values)
+{
+    if (LLVMGetTypeKind(type) != LLVMArrayTypeKind)
+    {
+        return *(*values)++;
+    }
+    unsigned length = LLVMGetArrayLength(type);
+    LLVMTypeRef element_type = LLVMGetElementType(type);
+    LLVMValueRef *elements = malloc(length * sizeof(LLVMValueRef));
+    for (unsigned i = 0; i < length; i++)
+    {
+        elements[i] = llvm_build_const_array(element_type, values);
+    }
+    LLVMValueRef array = LLVMConstArray(element_type, elements, length);
+    free(elements);
+    return array;
+}
+
+bool llvm_is_array_literal(Expression *expression)
+{
+    return expression->node != NULL && expression->node->node_type == N_ARRAY;
+}
+
+// Initializer of a root level array, which must be a literal of constants
+LLVMValueRef llvm_const_array_literal(Llvm *llvm, char *name, LLVMTypeRef type, Expression *literal)
+{
+    if (!llvm_is_array_literal(literal))
+    {
+        fatal("Array %s at root level must be initialized with an array literal", name);
+    }
+    if (literal->node->data == NULL)
+    {
+        return LLVMConstNull(type);
+    }
+    LLVMValueRef *values = malloc(llvm_count_elements(type) * sizeof(LLVMValueRef));
+    int count = 0;
+    llvm_visit_elements(llvm, literal, true, values, &count);
+    LLVMValueRef *cursor = values;
+    LLVMValueRef constant = llvm_build_const_array(type, &cursor);
+    free(values);
+    return constant;
+}
+
+// Stores an array value into the array of the given type at address. {}
+// zero fills it, a literal of constants is copied from its pooled global,
+// any other literal is stored element by element and a variable or row is
+// copied over.
+void llvm_store_array(Llvm *llvm, LLVMValueRef address, LLVMTypeRef type, Type element_type, Expression *expression)
+{
+    unsigned alignment = llvm_array_alignment(element_type);
+    if (!llvm_is_array_literal(expression))
+    {
+        LLVMValueRef source = llvm_array_address(llvm, expression);
+        if (source != address)
+        {
+            LLVMBuildMemCpy(llvm->builder, address, alignment, source, alignment, LLVMSizeOf(type));
+        }
+        return;
+    }
+    if (expression->node->data == NULL)
+    {
+        LLVMBuildMemSet(llvm->builder, address, LLVMConstNull(LLVMInt8TypeInContext(llvm->context)), LLVMSizeOf(type), alignment);
+        return;
+    }
+
+    int num_elements = llvm_count_elements(type);
+    LLVMValueRef *values = malloc(num_elements * sizeof(LLVMValueRef));
+    int count = 0;
+    if (llvm_visit_elements(llvm, expression, false, values, &count))
+    {
+        LLVMValueRef *cursor = values;
+        LLVMValueRef source = llvm_pool_constant(llvm, llvm_build_const_array(type, &cursor), alignment);
+        LLVMBuildMemCpy(llvm->builder, address, alignment, source, alignment, LLVMSizeOf(type));
+    }
+    else
+    {
+        // Nested arrays are contiguous, elements are stored at their row
+        // major position
+        LLVMTypeRef scalar_type = llvm_scalar_type(llvm, element_type);
+        LLVMValueRef elements = LLVMBuildBitCast(llvm->builder, address, LLVMPointerType(scalar_type, 0), "elements");
+        LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+        for (int i = 0; i < num_elements; i++)
+        {
+            LLVMValueRef index = LLVMConstInt(i64_type, i, 0);
+            LLVMBuildStore(llvm->builder, values[i], LLVMBuildInBoundsGEP2(llvm->builder, scalar_type, elements, &index, 1, "element"));
+        }
+    }
+    free(values);
+}
+
+// The runtime works on any slice through an untyped {i8*, i64, i64} header
+void llvm_call_slice_runtime(Llvm *llvm, char *name, LLVMValueRef header, Type type, LLVMValueRef length)
+{
+    LLVMTypeRef void_type = LLVMVoidTypeInContext(llvm->context);
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMTypeRef header_type = LLVMPointerType(llvm_slice_type(llvm, TYPE_I8), 0);
+    if (LLVMGetNamedFunction(llvm->module, "tron_slice_reserve") == NULL)
+    {
+        LLVMTypeRef params[3] = {header_type, i64_type, i64_type};
+        LLVMAddFunction(llvm->module, "tron_slice_reserve", LLVMFunctionType(void_type, params, 3, 0));
+        params[1] = i64_type;
+        LLVMAddFunction(llvm->module, "tron_slice_release", LLVMFunctionType(void_type, params, 2, 0));
+    }
+
+    LLVMValueRef args[3];
+    int num_args = 0;
+    args[num_args++] = LLVMBuildBitCast(llvm->builder, header, header_type, "");
+    if (length != NULL)
+    {
+        args[num_args++] = length;
+    }
+    args[num_args++] = LLVMConstInt(i64_type, llvm_array_alignment(type), 0);
+    llvm_call_runtime(llvm, name, args, num_args);
+}
+
+// Gives the buffer of a slice back to the pool unless it is a view
+void llvm_release_slice(Llvm *llvm, LLVMValueRef header, Type type)
+{
+    LLVMValueRef function_ref = LLVMGetBasicBlockParent(LLVMGetInsertBlock(llvm->builder));
+    LLVMValueRef capacity = llvm_load_slice_field(llvm, header, type, 2, "capacity");
+    LLVMValueRef owned = LLVMBuildICmp(llvm->builder, LLVMIntNE, capacity, LLVMConstNull(LLVMTypeOf(capacity)), "owned");
+    LLVMBasicBlockRef release_block = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "release");
+    LLVMBasicBlockRef released_block = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "released");
+    LLVMBuildCondBr(llvm->builder, owned, release_block, released_block);
+    LLVMPositionBuilderAtEnd(llvm->builder, release_block);
+    llvm_call_slice_runtime(llvm, "tron_slice_release", header, type, NULL);
+    LLVMBuildBr(llvm->builder, released_block);
+    LLVMPositionBuilderAtEnd(llvm->builder, released_block);
+}
+
+void llvm_store_slice(Llvm *llvm, LLVMValueRef header, Type type, LLVMValueRef data, LLVMValueRef length, LLVMValueRef capacity)
+{
+    llvm_store_slice_field(llvm, header, type, 0, data);
+    llvm_store_slice_field(llvm, header, type, 1, length);
+    llvm_store_slice_field(llvm, header, type, 2, capacity);
+}
+
+// Data and length of array[low:high], array being a slice or a one
+// dimensional array
+void llvm_build_view(Llvm *llvm, Expression *expression, LLVMValueRef *data, LLVMValueRef *length)
+{
+    Slice *slice = expression->node->data;
+    Type type = expression->type_info->type;
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMTypeRef element_type = llvm_scalar_type(llvm, type);
+    LLVMValueRef base;
+    LLVMValueRef size;
+    if (slice->array->type_info->slice)
+    {
+        LLVMValueRef header = llvm_slice_header(llvm, slice->array);
+        base = llvm_load_slice_field(llvm, header, type, 0, "data");
+        size = llvm_load_slice_field(llvm, header, type, 1, "length");
+    }
+    else
+    {
+        LLVMValueRef array = llvm_array_address(llvm, slice->array);
+        base = LLVMBuildBitCast(llvm->builder, array, LLVMPointerType(element_type, 0), "data");
+        size = LLVMConstInt(i64_type, slice->array->type_info->array_info->size, 0);
+    }
+    LLVMValueRef low = slice->low != NULL ? llvm_visit_index(llvm, slice->low) : LLVMConstNull(i64_type);
+    LLVMValueRef high = slice->high != NULL ? llvm_visit_index(llvm, slice->high) : size;
+    if (slice->high != NULL)
+    {
+        llvm_check_index(llvm, slice->high, high, size, true);
+    }
+    if (slice->low != NULL)
+    {
+        llvm_check_index(llvm, slice->low, low, high, true);
+    }
+    *data = LLVMBuildInBoundsGEP2(llvm->builder, element_type, base, &low, 1, "view");
+    *length = LLVMBuildNSWSub(llvm->builder, high, low, "view_length");
+}
+
+// Address of the header of a slice expression: the one of a variable or
+// parameter, or a temporary one holding a view
+LLVMValueRef llvm_slice_header(Llvm *llvm, Expression *expression)
+{
+    if (expression->node == NULL || expression->node->node_type != N_SLICE)
+    {
+        return llvm_array_address(llvm, expression);
+    }
+    LLVMValueRef data;
+    LLVMValueRef length;
+    llvm_build_view(llvm, expression, &data, &length);
+    LLVMValueRef header = llvm_build_entry_alloca(llvm, llvm_slice_type(llvm, expression->type_info->type), "view");
+    llvm_store_slice(llvm, header, expression->type_info->type, data, length, LLVMConstNull(LLVMTypeOf(length)));
+    return header;
+}
+
+// Slice and tensor variables get their header in the entry block, zeroed
+// there so that releasing it on return is fine even where the declaration
+// did not run
+LLVMValueRef llvm_build_entry_header(Llvm *llvm, LLVMTypeRef header_type, Type type, char *name)
+{
+    LLVMBasicBlockRef current_block = LLVMGetInsertBlock(llvm->builder);
+    LLVMValueRef header = llvm_build_entry_alloca(llvm, header_type, name);
+    LLVMValueRef next = LLVMGetNextInstruction(header);
+    if (next != NULL)
+    {
+        LLVMPositionBuilderBefore(llvm->builder, next);
+    }
+    else
+    {
+        LLVMPositionBuilderAtEnd(llvm->builder, LLVMGetInstructionParent(header));
+    }
+    LLVMBuildStore(llvm->builder, LLVMConstNull(header_type), header);
+    LLVMPositionBuilderAtEnd(llvm->builder, current_block);
+
+    LlvmLocalSlice *local_slice = malloc(sizeof(LlvmLocalSlice));
+    local_slice->header = header;
+    local_slice->type = type;
+    local_slice->next = llvm->local_slices;
+    llvm->local_slices = local_slice;
+    return header;
+}
+
+// Sets a slice being declared. A declaration that runs again, in a loop or
+// a tail recursive function, first releases the buffer the slice took the
+// last time. A literal is copied into a new buffer, anything else is viewed.
+void llvm_init_slice(Llvm *llvm, LLVMValueRef header, Type type, Expression *expression)
+{
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMValueRef zero = LLVMConstNull(i64_type);
+    if (expression != NULL && !llvm_is_array_literal(expression))
+    {
+        LLVMValueRef data;
+        LLVMValueRef length;
+        if (expression->node != NULL && expression->node->node_type == N_SLICE)
+        {
+            llvm_build_view(llvm, expression, &data, &length);
+        }
+        else
+        {
+            LLVMValueRef source = llvm_slice_header(llvm, expression);
+            data = llvm_load_slice_field(llvm, source, type, 0, "data");
+            length = llvm_load_slice_field(llvm, source, type, 1, "length");
+        }
+        llvm_release_slice(llvm, header, type);
+        llvm_store_slice(llvm, header, type, data, length, zero);
+        return;
+    }
+
+    llvm_release_slice(llvm, header, type);
+    llvm_store_slice(llvm, header, type, LLVMConstNull(LLVMPointerType(llvm_scalar_type(llvm, type), 0)), zero, zero);
+    if (expression == NULL || expression->node->data == NULL)
+    {
+        return;
+    }
+    int num_elements = 0;
+    for (Expression *element = expression->node->data; element != NULL; element = element->next)
+    {
+        num_elements++;
+    }
+    LLVMValueRef length = LLVMConstInt(i64_type, num_elements, 0);
+    llvm_call_slice_runtime(llvm, "tron_slice_reserve", header, type, length);
+    LLVMTypeRef array_type = LLVMArrayType(llvm_scalar_type(llvm, type), num_elements);
+    LLVMValueRef data = llvm_load_slice_field(llvm, header, type, 0, "data");
+    llvm_store_array(llvm, LLVMBuildBitCast(llvm->builder, data, LLVMPointerType(array_type, 0), "elements"), array_type, type, expression);
+    llvm_store_slice_field(llvm, header, type, 1, length);
+}
+
+// Root level slices view a private global holding their literal, pushing to
+// one moves it to a buffer of its own
+LLVMValueRef llvm_const_slice(Llvm *llvm, char *name, Type type, Expression *expression)
+{
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMTypeRef element_type = llvm_scalar_type(llvm, type);
+    if (!llvm_is_array_literal(expression))
+    {
+        fatal("Slice %s at root level must be initialized with an array literal", name);
+    }
+    int num_elements = 0;
+    for (Expression *element = expression->node->data; element != NULL; element = element->next)
+    {
+        num_elements++;
+    }
+    if (num_elements == 0)
+    {
+        return LLVMConstNull(llvm_slice_type(llvm, type));
+    }
+    LLVMTypeRef array_type = LLVMArrayType(element_type, num_elements);
+    LLVMValueRef elements = LLVMAddGlobal(llvm->module, array_type, "slice.literal");
+    LLVMSetInitializer(elements, llvm_const_array_literal(llvm, name, array_type, expression));
+    LLVMSetLinkage(elements, LLVMPrivateLinkage);
+    LLVMSetAlignment(elements, llvm_array_alignment(type));
+    LLVMValueRef fields[3] = {
+        LLVMConstBitCast(elements, LLVMPointerType(element_type, 0)),
+        LLVMConstInt(i64_type, num_elements, 0),
+        LLVMConstNull(i64_type),
+    };
+    return LLVMConstStructInContext(llvm->context, fields, 3, 0);
+}
+
+// push(slice, value) stores value after the last element, growing the
+// buffer when it is full, and returns the new length
+LLVMValueRef llvm_visit_push(Llvm *llvm, Call *call)
+{
+    Expression *target = call->expression;
+    Type type = target->type_info->type;
+    LLVMValueRef value = llvm_visit_expression(llvm, target->next);
+    LLVMValueRef header = llvm_slice_header(llvm, target);
+    LLVMValueRef length = llvm_load_slice_field(llvm, header, type, 1, "length");
+    LLVMValueRef capacity = llvm_load_slice_field(llvm, header, type, 2, "capacity");
+    LLVMValueRef new_length = LLVMBuildNSWAdd(llvm->builder, length, LLVMConstInt(LLVMTypeOf(length), 1, 0), "new_length");
+
+    LLVMValueRef function_ref = LLVMGetBasicBlockParent(LLVMGetInsertBlock(llvm->builder));
+    LLVMBasicBlockRef grow_block = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "grow");
+    LLVMBasicBlockRef store_block = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "push");
+    LLVMValueRef full = LLVMBuildICmp(llvm->builder, LLVMIntSGE, length, capacity, "full");
+    // Growing doubles the capacity, it is rare on a long run of pushes
+    llvm_set_branch_weights(llvm, LLVMBuildCondBr(llvm->builder, full, grow_block, store_block), 1, 1000);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, grow_block);
+    llvm_call_slice_runtime(llvm, "tron_slice_reserve", header, type, new_length);
+    LLVMBuildBr(llvm->builder, store_block);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, store_block);
+    LLVMValueRef data = llvm_load_slice_field(llvm, header, type, 0, "data");
+    LLVMValueRef element = LLVMBuildInBoundsGEP2(llvm->builder, llvm_scalar_type(llvm, type), data, &length, 1, "element");
+    llvm_set_tbaa(llvm, LLVMBuildStore(llvm->builder, value, element), "slice element");
+    llvm_store_slice_field(llvm, header, type, 1, new_length);
+    return LLVMBuildTrunc(llvm->builder, new_length, LLVMInt32TypeInContext(llvm->context), "push");
+}
+
+LLVMValueRef llvm_visit_len(Llvm *llvm, Call *call)
+{
+    Expression *sequence = call->expression;
+    LLVMTypeRef int_type = LLVMInt32TypeInContext(llvm->context);
+    if (sequence->type_info->tensor)
+    {
+        // len(t, d) is the size of dimension d, len(t) the one of the first
+        int dimension = sequence->next != NULL ? ((Integer *)sequence->next->node->data)->value : 0;
+        LLVMValueRef *dimensions = malloc(count_dimensions(sequence->type_info->array_info) * sizeof(LLVMValueRef));
+        llvm_tensor_shape(llvm, sequence, dimensions);
+        LLVMValueRef size = dimensions[dimension];
+        free(dimensions);
+        return LLVMBuildTrunc(llvm->builder, size, int_type, "len");
+    }
+    if (!sequence->type_info->slice)
+    {
+        return LLVMConstInt(int_type, sequence->type_info->array_info->size, 0);
+    }
+    LLVMValueRef header = llvm_slice_header(llvm, sequence);
+    return LLVMBuildTrunc(llvm->builder, llvm_load_slice_field(llvm, header, sequence->type_info->type, 1, "length"), int_type, "len");
+}
+
+// Releases the slice variables of the function before each of its returns
+void llvm_release_local_slices(Llvm *llvm, LLVMValueRef function_ref)
+{
+    for (LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(function_ref); block != NULL; block = LLVMGetNextBasicBlock(block))
+    {
+        LLVMValueRef terminator = LLVMGetBasicBlockTerminator(block);
+        if (terminator == NULL || LLVMGetInstructionOpcode(terminator) != LLVMRet)
+        {
+            continue;
+        }
+        LLVMPositionBuilderBefore(llvm->builder, terminator);
+        for (LlvmLocalSlice *slice = llvm->local_slices; slice != NULL; slice = slice->next)
+        {
+            llvm_call_slice_runtime(llvm, "tron_slice_release", slice->header, slice->type, NULL);
+        }
+    }
+    while (llvm->local_slices != NULL)
+    {
+        LlvmLocalSlice *next = llvm->local_slices->next;
+        free(llvm->local_slices);
+        llvm->local_slices = next;
+    }
+}
+
+LLVMValueRef llvm_build_float_binary(Llvm *llvm, LLVMOpcode opcode, LLVMValueRef left, LLVMValueRef right, char *name)
+{
+    LLVMValueRef value = LLVMBuildBinOp(llvm->builder, opcode, left, right, name);
+    // Contraction only concerns the operations an FMA can fuse
+    bool contractable = opcode == LLVMFAdd || opcode == LLVMFSub || opcode == LLVMFMul;
+    llvm_set_fast_math_flags(value, llvm->options->fast_math, llvm->options->fp_contract && contractable);
+    return value;
+}
+
+LLVMValueRef llvm_build_fcmp(Llvm *llvm, LLVMRealPredicate predicate, LLVMValueRef left, LLVMValueRef right, char *name)
+{
+    LLVMValueRef value = LLVMBuildFCmp(llvm->builder, predicate, left, right, name);
+    llvm_set_fast_math_flags(value, llvm->options->fast_math, false);
+    return value;
+}
+
+LLVMValueRef llvm_build_fneg(Llvm *llvm, LLVMValueRef value)
+{
+    LLVMValueRef negated = LLVMBuildFNeg(llvm->builder, value, "fneg");
+    llvm_set_fast_math_flags(negated, llvm->options->fast_math, false);
+    return negated;
+}
+
+LLVMValueRef llvm_visit_float_binary(Llvm *llvm, Expression *expression, LLVMValueRef left, LLVMValueRef right)
+{
+    switch (expression->token->token_type)
+    {
+    case T_ADD:
+        return llvm_build_float_binary(llvm, LLVMFAdd, left, right, "fadd");
+    case T_SUB:
+        return llvm_build_float_binary(llvm, LLVMFSub, left, right, "fsub");
+    case T_MUL:
+        return llvm_build_float_binary(llvm, LLVMFMul, left, right, "fmul");
+    case T_DIV:
+        return llvm_build_float_binary(llvm, LLVMFDiv, left, right, "fdiv");
+    case T_REM:
+        return llvm_build_float_binary(llvm, LLVMFRem, left, right, "frem");
+    case T_EQ:
+        return llvm_build_fcmp(llvm, LLVMRealOEQ, left, right, "eq");
+    case T_NEQ:
+        return llvm_build_fcmp(llvm, LLVMRealUNE, left, right, "neq");
+    case T_LT:
+        return llvm_build_fcmp(llvm, LLVMRealOLT, left, right, "lt");
+    case T_LTE:
+        return llvm_build_fcmp(llvm, LLVMRealOLE, left, right, "lte");
+    case T_GT:
+        return llvm_build_fcmp(llvm, LLVMRealOGT, left, right, "gt");
+    case T_GTE:
+        return llvm_build_fcmp(llvm, LLVMRealOGE, left, right, "gte");
+    default:
+        fatal("Operator %s at %d:%d does not apply to float operands", expression->token->buffer, expression->line, expression->col);
+    }
+}
+
+// True when op on operands of type is checked with --trap-on-overflow,
+// unsigned arithmetic wraps in every mode
+bool llvm_checks_overflow(Llvm *llvm, TokenType op, Type type)
+{
+    return llvm->options->overflow == OVERFLOW_TRAP && llvm_is_signed(type) &&
+           (op == T_ADD || op == T_SUB || op == T_MUL || op == T_INC || op == T_DEC);
+}
+
+// Signed overflow is an error. By default the optimizer may assume that it
+// never happens, which lets it widen induction variables and compute trip
+// counts, --wrap defines it to wrap and --trap-on-overflow checks it with
+// the overflow intrinsics.
+LLVMValueRef llvm_build_arithmetic(Llvm *llvm, Expression *expression, TokenType op, Type type, LLVMValueRef left, LLVMValueRef right, char *name)
+{
+    if (!llvm_is_signed(type) || llvm->options->overflow == OVERFLOW_WRAP)
+    {
+        switch (op)
+        {
+        case T_ADD:
+            return LLVMBuildAdd(llvm->builder, left, right, name);
+        case T_SUB:
+            return LLVMBuildSub(llvm->builder, left, right, name);
+        default:
+            return LLVMBuildMul(llvm->builder, left, right, name);
+        }
+    }
+    if (llvm->options->overflow == OVERFLOW_UNDEFINED)
+    {
+        switch (op)
+        {
+        case T_ADD:
+            return LLVMBuildNSWAdd(llvm->builder, left, right, name);
+        case T_SUB:
+            return LLVMBuildNSWSub(llvm->builder, left, right, name);
+        default:
+            return LLVMBuildNSWMul(llvm->builder, left, right, name);
+        }
+    }
+
+    char *intrinsic = op == T_ADD ? "llvm.sadd.with.overflow" : op == T_SUB ? "llvm.ssub.with.overflow" : "llvm.smul.with.overflow";
+    unsigned id = LLVMLookupIntrinsicID(intrinsic, strlen(intrinsic));
+    LLVMTypeRef value_type = LLVMTypeOf(left);
+    LLVMValueRef function = LLVMGetIntrinsicDeclaration(llvm->module, id, &value_type, 1);
+    LLVMValueRef args[2] = {left, right};
+    LLVMValueRef checked = LLVMBuildCall2(llvm->builder, LLVMIntrinsicGetType(llvm->context, id, &value_type, 1), function, args, 2, name);
+
+    // The trap block goes to the end of the function, out of the way of the
+    // code that runs. tron_overflow is cold, which marks the branch unlikely.
+    LLVMBasicBlockRef block = LLVMGetInsertBlock(llvm->builder);
+    LLVMValueRef function_ref = LLVMGetBasicBlockParent(block);
+    LLVMBasicBlockRef next_block = LLVMGetNextBasicBlock(block);
+    LLVMBasicBlockRef ok_block = next_block != NULL ? LLVMInsertBasicBlockInContext(llvm->context, next_block, "no_overflow")
+                                                    : LLVMAppendBasicBlockInContext(llvm->context, function_ref, "no_overflow");
+    LLVMBasicBlockRef trap_block = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "overflow");
+    LLVMBuildCondBr(llvm->builder, LLVMBuildExtractValue(llvm->builder, checked, 1, "overflow"), trap_block, ok_block);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, trap_block);
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMValueRef location[2] = {LLVMConstInt(i32_type, expression->line, 0), LLVMConstInt(i32_type, expression->col, 0)};
+    llvm_call_runtime(llvm, "tron_overflow", location, 2);
+    LLVMBuildUnreachable(llvm->builder);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, ok_block);
+    return LLVMBuildExtractValue(llvm->builder, checked, 0, name);
+}
+
+// Aborts with the source location unless ok holds, expected is -1 for a
+// negative size given to zeros. Shapes are checked even with --unchecked,
+// a wrong one would read or write past the end of a buffer on every
+// element.
+void llvm_build_shape_check(Llvm *llvm, LLVMValueRef ok, int line, int col, int dimension, LLVMValueRef expected, LLVMValueRef actual)
+{
+    LLVMBasicBlockRef block = LLVMGetInsertBlock(llvm->builder);
+    LLVMValueRef function_ref = LLVMGetBasicBlockParent(block);
+    LLVMBasicBlockRef next_block = LLVMGetNextBasicBlock(block);
+    LLVMBasicBlockRef ok_block = next_block != NULL ? LLVMInsertBasicBlockInContext(llvm->context, next_block, "shape_ok")
+                                                    : LLVMAppendBasicBlockInContext(llvm->context, function_ref, "shape_ok");
+    LLVMBasicBlockRef trap_block = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "shape_mismatch");
+    LLVMBuildCondBr(llvm->builder, ok, ok_block, trap_block);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, trap_block);
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMValueRef args[5] = {LLVMConstInt(i32_type, line, 0), LLVMConstInt(i32_type, col, 0), LLVMConstInt(i32_type, dimension, 0), expected, actual};
+    llvm_call_runtime(llvm, "tron_shape", args, 5);
+    LLVMBuildUnreachable(llvm->builder);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, ok_block);
+}
+
+// Dimensions that are the same value, or equal constants, are not checked
+void llvm_check_shape(Llvm *llvm, int line, int col, LLVMValueRef *expected, LLVMValueRef *actual, int rank)
+{
+    for (int i = 0; i < rank; i++)
+    {
+        if (expected[i] == actual[i] || (LLVMIsAConstantInt(expected[i]) && LLVMIsAConstantInt(actual[i]) &&
+                                         LLVMConstIntGetSExtValue(expected[i]) == LLVMConstIntGetSExtValue(actual[i])))
+        {
+            continue;
+        }
+        LLVMValueRef ok = LLVMBuildICmp(llvm->builder, LLVMIntEQ, expected[i], actual[i], "same_dimension");
+        llvm_build_shape_check(llvm, ok, line, col, i, expected[i], actual[i]);
+    }
+}
+
+// Dimensions of a tensor expression. Those its type knows are constants,
+// the others come from the header of a tensor, from the tensor operand of
+// an operation, from the operands of matmul or from the arguments of zeros,
+// which are evaluated here.
+void llvm_tensor_shape(Llvm *llvm, Expression *expression, LLVMValueRef *dimensions)
+{
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    Node *node = expression->node;
+    if (node != NULL && node->node_type == N_CALL && strcmp(((Call *)node->data)->name, MATMUL) == 0)
+    {
+        // Rows and batch of the left operand, columns of the right one
+        Expression *first = ((Call *)node->data)->expression;
+        int rank = count_dimensions(expression->type_info->array_info);
+        LLVMValueRef right[3];
+        llvm_tensor_shape(llvm, first, dimensions);
+        llvm_tensor_shape(llvm, first->next, right);
+        dimensions[rank - 1] = right[rank - 1];
+    }
+    else if (node != NULL && node->node_type == N_CALL)
+    {
+        int i = 0;
+        for (Expression *size = ((Call *)node->data)->expression; size != NULL; size = size->next, i++)
+        {
+            dimensions[i] = llvm_visit_index(llvm, size);
+            if (!LLVMIsAConstantInt(dimensions[i]) || LLVMConstIntGetSExtValue(dimensions[i]) < 0)
+            {
+                LLVMValueRef ok = LLVMBuildICmp(llvm->builder, LLVMIntSGE, dimensions[i], LLVMConstNull(i64_type), "valid_dimension");
+                llvm_build_shape_check(llvm, ok, size->line, size->col, i, LLVMConstAllOnes(i64_type), dimensions[i]);
+            }
+        }
+        return;
+    }
+    if (node != NULL && node->node_type == N_NAME)
+    {
+        llvm_tensor_dimensions(llvm, llvm_array_address(llvm, expression), expression->type_info, dimensions);
+        return;
+    }
+    if (node == NULL)
+    {
+        llvm_tensor_shape(llvm, expression->left->type_info->tensor ? expression->left : expression->right, dimensions);
+    }
+    // Literals have a static shape, so may one operand of an operation
+    int i = 0;
+    for (ArrayInfo *array_info = expression->type_info->array_info; array_info != NULL; array_info = array_info->next, i++)
+    {
+        if (array_info->size >= 0)
+        {
+            dimensions[i] = LLVMConstInt(i64_type, array_info->size, 0);
+        }
+    }
+}
+
+LLVMValueRef llvm_tensor_count(Llvm *llvm, LLVMValueRef *dimensions, int rank)
+{
+    LLVMValueRef count = dimensions[0];
+    for (int i = 1; i < rank; i++)
+    {
+        count = LLVMBuildNUWMul(llvm->builder, count, dimensions[i], "count");
+    }
+    return count;
+}
+
+// Sets the shape of the tensor at header and makes room for its elements.
+// A declaration that runs again, in a loop or a tail recursive function,
+// reuses the buffer it took the last time when that is large enough.
+void llvm_alloc_tensor(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info, LLVMValueRef *dimensions)
+{
+    int rank = count_dimensions(type_info->array_info);
+    for (int i = 0; i < rank; i++)
+    {
+        LLVMValueRef store = LLVMBuildStore(llvm->builder, dimensions[i], llvm_tensor_dimension_pointer(llvm, header, type_info, i));
+        llvm_set_tbaa(llvm, store, "tensor header");
+    }
+    LLVMValueRef count = llvm_tensor_count(llvm, dimensions, rank);
+    // Nothing is copied over when the buffer grows, every element is set
+    // right after
+    llvm_store_tensor_field(llvm, header, type_info, 1, LLVMConstNull(LLVMTypeOf(count)));
+    llvm_call_slice_runtime(llvm, "tron_slice_reserve", header, type_info->type, count);
+    llvm_store_tensor_field(llvm, header, type_info, 1, count);
+}
+
+// One element of an element-wise operation, computed as the operator
+// would on two scalars of the element type
+LLVMValueRef llvm_build_element_operation(Llvm *llvm, Expression *expression, Type type, LLVMValueRef left, LLVMValueRef right)
+{
+    if (type == TYPE_BF16)
+    {
+        LLVMValueRef result = llvm_visit_float_binary(llvm, expression, llvm_bf16_to_float(llvm, left), llvm_bf16_to_float(llvm, right));
+        return llvm_float_to_bf16(llvm, result);
+    }
+    if (is_float_type(type))
+    {
+        return llvm_visit_float_binary(llvm, expression, left, right);
+    }
+    TokenType op = expression->token->token_type;
+    if (op == T_DIV)
+    {
+        return llvm_is_signed(type) ? LLVMBuildSDiv(llvm->builder, left, right, "div") : LLVMBuildUDiv(llvm->builder, left, right, "div");
+    }
+    return llvm_build_arithmetic(llvm, expression, op, type, left, right, op == T_ADD ? "add" : op == T_SUB ? "sub" : "mul");
+}
+
+bool llvm_is_tensor_operation(Expression *expression)
+{
+    return expression->node == NULL && expression->type_info->tensor;
+}
+
+// Evaluates the leaves of a fused tensor expression before its loop, in
+// the order the operations would: scalars once, and tensors down to their
+// data pointer after checking they have the shape dimensions
+LlvmFusedLeaf *llvm_fuse_leaves(Llvm *llvm, Expression *expression, LLVMValueRef *dimensions, LlvmFusedLeaf *leaves)
+{
+    if (llvm_is_tensor_operation(expression))
+    {
+        leaves = llvm_fuse_leaves(llvm, expression->left, dimensions, leaves);
+        return llvm_fuse_leaves(llvm, expression->right, dimensions, leaves);
+    }
+    LlvmFusedLeaf *leaf = malloc(sizeof(LlvmFusedLeaf));
+    leaf->expression = expression;
+    leaf->next = leaves;
+    leaf->indexed = expression->type_info->tensor;
+    if (!leaf->indexed)
+    {
+        leaf->value = llvm_visit_expression(llvm, expression);
+        return leaf;
+    }
+    int rank = count_dimensions(expression->type_info->array_info);
+    LLVMValueRef *leaf_dimensions = malloc(rank * sizeof(LLVMValueRef));
+    LLVMValueRef header = llvm_tensor_operand(llvm, expression);
+    llvm_tensor_dimensions(llvm, header, expression->type_info, leaf_dimensions);
+    llvm_check_shape(llvm, expression->line, expression->col, dimensions, leaf_dimensions, rank);
+    free(leaf_dimensions);
+    leaf->value = llvm_load_tensor_field(llvm, header, expression->type_info, 0, "data");
+    return leaf;
+}
+
+// Element k of a fused tensor expression, intermediate results stay in
+// registers
+LLVMValueRef llvm_fused_element(Llvm *llvm, Expression *expression, LlvmFusedLeaf *leaves, LLVMValueRef k)
+{
+    if (llvm_is_tensor_operation(expression))
+    {
+        LLVMValueRef left = llvm_fused_element(llvm, expression->left, leaves, k);
+        LLVMValueRef right = llvm_fused_element(llvm, expression->right, leaves, k);
+        return llvm_build_element_operation(llvm, expression, expression->type_info->type, left, right);
+    }
+    LlvmFusedLeaf *leaf = leaves;
+    while (leaf->expression != expression)
+    {
+        leaf = leaf->next;
+    }
+    if (!leaf->indexed)
+    {
+        return leaf->value;
+    }
+    LLVMTypeRef element_type = llvm_scalar_type(llvm, expression->type_info->type);
+    LLVMValueRef pointer = LLVMBuildInBoundsGEP2(llvm->builder, element_type, leaf->value, &k, 1, "element");
+    LLVMValueRef element = LLVMBuildLoad2(llvm->builder, element_type, pointer, "element");
+    llvm_set_tbaa(llvm, element, "tensor element");
+    return element;
+}
+
+void dispose_llvm_fused_leaves(LlvmFusedLeaf *leaves)
+{
+    while (leaves != NULL)
+    {
+        LlvmFusedLeaf *next = leaves->next;
+        free(leaves);
+        leaves = next;
+    }
+}
+
+// Computes a whole tensor expression into data, the elements of a tensor
+// of the shape dimensions. Operations are fused into a single loop over
+// contiguous memory whatever their number and rank, which LLVM vectorizes:
+// each element is read once from every tensor of the expression and
+// written once, with no temporaries in between. Element k only depends on
+// element k of the operands, so data may be one of them.
+void llvm_build_elementwise(Llvm *llvm, Expression *expression, LLVMValueRef data, LLVMValueRef *dimensions)
+{
+    Type type = expression->type_info->type;
+    int rank = count_dimensions(expression->type_info->array_info);
+    LLVMTypeRef element_type = llvm_scalar_type(llvm, type);
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LlvmFusedLeaf *leaves = llvm_fuse_leaves(llvm, expression, dimensions, NULL);
+    LLVMValueRef count = llvm_tensor_count(llvm, dimensions, rank);
+    llvm_set_location(llvm, expression->line, expression->col);
+
+    LLVMBasicBlockRef preheader = LLVMGetInsertBlock(llvm->builder);
+    LLVMValueRef function_ref = LLVMGetBasicBlockParent(preheader);
+    LLVMBasicBlockRef loop_block = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "elementwise");
+    LLVMBasicBlockRef done_block = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "elementwise_done");
+    LLVMValueRef zero = LLVMConstNull(i64_type);
+    LLVMBuildCondBr(llvm->builder, LLVMBuildICmp(llvm->builder, LLVMIntNE, count, zero, "nonempty"), loop_block, done_block);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, loop_block);
+    LLVMValueRef k = LLVMBuildPhi(llvm->builder, i64_type, "k");
+    LLVMValueRef result = llvm_fused_element(llvm, expression, leaves, k);
+    dispose_llvm_fused_leaves(leaves);
+    LLVMValueRef target = LLVMBuildInBoundsGEP2(llvm->builder, element_type, data, &k, 1, "element");
+    llvm_set_tbaa(llvm, LLVMBuildStore(llvm->builder, result, target), "tensor element");
+    LLVMValueRef next = LLVMBuildNUWAdd(llvm->builder, k, LLVMConstInt(i64_type, 1, 0), "next");
+    // Trapping arithmetic leaves the loop body in another block
+    LLVMBasicBlockRef latch = LLVMGetInsertBlock(llvm->builder);
+    LLVMBuildCondBr(llvm->builder, LLVMBuildICmp(llvm->builder, LLVMIntULT, next, count, "more"), loop_block, done_block);
+    LLVMValueRef incoming[2] = {zero, next};
+    LLVMBasicBlockRef blocks[2] = {preheader, latch};
+    LLVMAddIncoming(k, incoming, blocks, 2);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, done_block);
+}
+
+// matmul calls the corelib kernel of its element type, which writes the
+// products into data after checking the batch and inner dimensions of the
+// right operand against the left one. The kernel goes through a buffer of
+// its own when data is one of the operands.
+void llvm_build_matmul(Llvm *llvm, Call *call, LLVMValueRef data)
+{
+    int line = llvm->line;
+    int col = llvm->col;
+    Expression *first = call->expression;
+    Expression *second = first->next;
+    Type type = first->type_info->type;
+    int rank = count_dimensions(first->type_info->array_info);
+    LLVMValueRef left_header = llvm_tensor_operand(llvm, first);
+    LLVMValueRef right_header = llvm_tensor_operand(llvm, second);
+    LLVMValueRef left[3];
+    LLVMValueRef right[3];
+    LLVMValueRef expected[3];
+    llvm_tensor_dimensions(llvm, left_header, first->type_info, left);
+    llvm_tensor_dimensions(llvm, right_header, second->type_info, right);
+    // [b][m][k] times [b][k][n] or [m][k] times [k][n]
+    for (int i = 0; i < rank; i++)
+    {
+        expected[i] = right[i];
+    }
+    expected[0] = left[0];
+    expected[rank - 2] = left[rank - 1];
+    llvm_check_shape(llvm, second->line, second->col, expected, right, rank);
+
+    char name[64];
+    snprintf(name, sizeof(name), "tron_%s_%s", MATMUL, type_name(type));
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMTypeRef pointer_type = LLVMPointerType(llvm_scalar_type(llvm, type), 0);
+    LLVMValueRef function = LLVMGetNamedFunction(llvm->module, name);
+    if (function == NULL)
+    {
+        LLVMTypeRef params[7] = {pointer_type, pointer_type, pointer_type, i64_type, i64_type, i64_type, i64_type};
+        function = LLVMAddFunction(llvm->module, name, LLVMFunctionType(LLVMVoidTypeInContext(llvm->context), params, 7, 0));
+        llvm_add_function_attribute(llvm, function, "nounwind");
+    }
+    LLVMValueRef args[7] = {
+        LLVMBuildBitCast(llvm->builder, llvm_load_tensor_field(llvm, left_header, first->type_info, 0, "data"), pointer_type, "left"),
+        LLVMBuildBitCast(llvm->builder, llvm_load_tensor_field(llvm, right_header, second->type_info, 0, "data"), pointer_type, "right"),
+        LLVMBuildBitCast(llvm->builder, data, pointer_type, "product"),
+        rank == 3 ? left[0] : LLVMConstInt(i64_type, 1, 0),
+        left[rank - 2],
+        left[rank - 1],
+        right[rank - 1],
+    };
+    llvm_set_location(llvm, line, col);
+    LLVMBuildCall2(llvm->builder, LLVMGlobalGetValueType(function), function, args, 7, "");
+}
+
+// Evaluates a tensor expression into the tensor at header, which already
+// has the shape dimensions. {} and zeros clear it, literals and tensors are
+// copied, operations computed in place and products by the corelib.
+void llvm_store_tensor(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info, Expression *expression, LLVMValueRef *dimensions)
+{
+    LLVMValueRef data = llvm_load_tensor_field(llvm, header, type_info, 0, "data");
+    Node *node = expression != NULL ? expression->node : NULL;
+    if (expression != NULL && node == NULL)
+    {
+        llvm_build_elementwise(llvm, expression, data, dimensions);
+        return;
+    }
+    if (node != NULL && node->node_type == N_CALL && strcmp(((Call *)node->data)->name, MATMUL) == 0)
+    {
+        llvm_build_matmul(llvm, node->data, data);
+        return;
+    }
+    LLVMTypeRef element_type = llvm_scalar_type(llvm, type_info->type);
+    unsigned alignment = llvm_array_alignment(type_info->type);
+    LLVMValueRef count = llvm_tensor_count(llvm, dimensions, count_dimensions(type_info->array_info));
+    LLVMValueRef size = LLVMBuildNUWMul(llvm->builder, count, LLVMSizeOf(element_type), "size");
+    if (node == NULL || node->node_type == N_CALL || (node->node_type == N_ARRAY && node->data == NULL))
+    {
+        LLVMBuildMemSet(llvm->builder, data, LLVMConstNull(LLVMInt8TypeInContext(llvm->context)), size, alignment);
+    }
+    else if (node->node_type == N_ARRAY)
+    {
+        LLVMTypeRef array_type = get_llvm_type(llvm, expression->type_info);
+        LLVMValueRef elements = LLVMBuildBitCast(llvm->builder, data, LLVMPointerType(array_type, 0), "elements");
+        llvm_store_array(llvm, elements, array_type, type_info->type, expression);
+    }
+    else
+    {
+        LLVMValueRef source = llvm_array_address(llvm, expression);
+        if (source != header)
+        {
+            LLVMValueRef source_data = llvm_load_tensor_field(llvm, source, expression->type_info, 0, "data");
+            LLVMBuildMemMove(llvm->builder, data, alignment, source_data, alignment, size);
+        }
+    }
+}
+
+// Header of a tensor operand or argument: the one of a variable or
+// parameter, or a temporary holding the result of an operation
+LLVMValueRef llvm_tensor_operand(Llvm *llvm, Expression *expression)
+{
+    if (expression->node != NULL && expression->node->node_type == N_NAME)
+    {
+        return llvm_array_address(llvm, expression);
+    }
+    TypeInfo *type_info = expression->type_info;
+    LLVMValueRef *dimensions = malloc(count_dimensions(type_info->array_info) * sizeof(LLVMValueRef));
+    llvm_tensor_shape(llvm, expression, dimensions);
+    LLVMValueRef header = llvm_build_entry_header(llvm, get_llvm_type(llvm, type_info), type_info->type, "temporary");
+    llvm_alloc_tensor(llvm, header, type_info, dimensions);
+    llvm_store_tensor(llvm, header, type_info, expression, dimensions);
+    free(dimensions);
+    return header;
+}
+
+// Declares a tensor. The dimensions its type gives are checked against the
+// initializer, which gives the others. One without an initializer is
+// cleared.
+void llvm_init_tensor(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info, Expression *expression)
+{
+    int rank = count_dimensions(type_info->array_info);
+    LLVMValueRef *dimensions = malloc(rank * sizeof(LLVMValueRef));
+    if (expression == NULL || (llvm_is_array_literal(expression) && expression->node->data == NULL))
+    {
+        llvm_tensor_dimensions(llvm, header, type_info, dimensions);
+    }
+    else
+    {
+        LLVMValueRef *declared = malloc(rank * sizeof(LLVMValueRef));
+        llvm_tensor_shape(llvm, expression, dimensions);
+        LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+        int i = 0;
+        for (ArrayInfo *array_info = type_info->array_info; array_info != NULL; array_info = array_info->next, i++)
+        {
+            declared[i] = array_info->size >= 0 ? LLVMConstInt(i64_type, array_info->size, 0) : dimensions[i];
+        }
+        llvm_check_shape(llvm, expression->line, expression->col, declared, dimensions, rank);
+        free(declared);
+    }
+    llvm_alloc_tensor(llvm, header, type_info, dimensions);
+    llvm_store_tensor(llvm, header, type_info, expression, dimensions);
+    free(dimensions);
+}
+
+// Assigns to a tensor, which keeps its shape. Operations check the shape of
+// their operands against it, other expressions are checked here.
+void llvm_assign_tensor(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info, Expression *expression)
+{
+    int rank = count_dimensions(type_info->array_info);
+    LLVMValueRef *dimensions = malloc(rank * sizeof(LLVMValueRef));
+    llvm_tensor_dimensions(llvm, header, type_info, dimensions);
+    if (expression->node != NULL && !(llvm_is_array_literal(expression) && expression->node->data == NULL))
+    {
+        LLVMValueRef *actual = malloc(rank * sizeof(LLVMValueRef));
+        llvm_tensor_shape(llvm, expression, actual);
+        llvm_check_shape(llvm, expression->line, expression->col, dimensions, actual, rank);
+        free(actual);
+    }
+    llvm_store_tensor(llvm, header, type_info, expression, dimensions);
+    free(dimensions);
+}
+
+// Tensor parameters take the shape of their argument, the dimensions the
+// parameter declares are checked on entry
+void llvm_check_tensor_param(Llvm *llvm, LLVMValueRef header, TypeInfo *type_info)
+{
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    int i = 0;
+    for (ArrayInfo *array_info = type_info->array_info; array_info != NULL; array_info = array_info->next, i++)
     {
-    case TYPE_INT:
-        var_type = LLVMInt32TypeInContext(llvm->context);
-        break;
-    case TYPE_FLOAT:
-        var_type = LLVMFloatTypeInContext(llvm->context);
-        break;
-    default:
-        fprintf(stderr, "Unsupported type for variable: %d\n", type_info->type);
-        exit(1);
+        if (array_info->size < 0)
+        {
+            continue;
+        }
+        LLVMValueRef expected = LLVMConstInt(i64_type, array_info->size, 0);
+        LLVMValueRef actual = LLVMBuildLoad2(llvm->builder, i64_type, llvm_tensor_dimension_pointer(llvm, header, type_info, i), "dimension");
+        llvm_set_tbaa(llvm, actual, "tensor header");
+        LLVMValueRef ok = LLVMBuildICmp(llvm->builder, LLVMIntEQ, expected, actual, "same_dimension");
+        llvm_build_shape_check(llvm, ok, llvm->line, llvm->col, i, expected, actual);
     }
-    return var_type;
 }
 
-LLVMValueRef llvm_visit_integer(Llvm *llvm, Integer *integer)
+// Address of the first element of a sequence and the number of its
+// elements, arrays and tensors of any rank being taken as a whole. A tensor
+// operation is computed into a temporary.
+void llvm_sequence_elements(Llvm *llvm, Expression *expression, LLVMValueRef *data, LLVMValueRef *length)
 {
-    return LLVMConstInt(LLVMInt32TypeInContext(llvm->context), integer->value, 0);
+    TypeInfo *type_info = expression->type_info;
+    if (type_info->tensor)
+    {
+        LLVMValueRef header = llvm_tensor_operand(llvm, expression);
+        *data = llvm_load_tensor_field(llvm, header, type_info, 0, "data");
+        *length = llvm_load_tensor_field(llvm, header, type_info, 1, "length");
+    }
+    else if (expression->node != NULL && expression->node->node_type == N_SLICE)
+    {
+        llvm_build_view(llvm, expression, data, length);
+    }
+    else if (type_info->slice)
+    {
+        LLVMValueRef header = llvm_slice_header(llvm, expression);
+        *data = llvm_load_slice_field(llvm, header, type_info->type, 0, "data");
+        *length = llvm_load_slice_field(llvm, header, type_info->type, 1, "length");
+    }
+    else
+    {
+        LLVMTypeRef element_type = llvm_scalar_type(llvm, type_info->type);
+        *data = LLVMBuildBitCast(llvm->builder, llvm_array_address(llvm, expression), LLVMPointerType(element_type, 0), "data");
+        *length = LLVMConstInt(LLVMInt64TypeInContext(llvm->context), count_elements(type_info->array_info), 0);
+    }
 }
 
-LLVMValueRef llvm_visit_float(Llvm *llvm, Float *floating_point)
+// Corelib kernel tron_<operation>_<type> of a reduction, declared on first
+// use. Kernels take f16 elements by their bits and give f16 and bf16
+// results as a float, argmax gives an i64.
+LLVMValueRef llvm_reduction_function(Llvm *llvm, char *operation, Type type)
 {
-    return LLVMConstReal(LLVMFloatTypeInContext(llvm->context), floating_point->value);
+    char name[64];
+    snprintf(name, sizeof(name), "tron_%s_%s", operation, type_name(type));
+    LLVMValueRef function = LLVMGetNamedFunction(llvm->module, name);
+    if (function != NULL)
+    {
+        return function;
+    }
+    LLVMTypeRef element_type = type == TYPE_F16 ? LLVMInt16TypeInContext(llvm->context) : llvm_scalar_type(llvm, type);
+    LLVMTypeRef return_type = llvm_scalar_type(llvm, type);
+    if (strcmp(operation, ARGMAX) == 0)
+    {
+        return_type = LLVMInt64TypeInContext(llvm->context);
+    }
+    else if (type == TYPE_F16 || type == TYPE_BF16)
+    {
+        return_type = LLVMFloatTypeInContext(llvm->context);
+    }
+    LLVMTypeRef params[3] = {LLVMPointerType(element_type, 0), LLVMPointerType(element_type, 0), LLVMInt64TypeInContext(llvm->context)};
+    bool is_dot = strcmp(operation, DOT) == 0;
+    if (!is_dot)
+    {
+        params[1] = params[2];
+    }
+    function = LLVMAddFunction(llvm->module, name, LLVMFunctionType(return_type, params, is_dot ? 3 : 2, 0));
+    llvm_add_function_attribute(llvm, function, "readonly");
+    llvm_add_function_attribute(llvm, function, "nounwind");
+    llvm_add_function_attribute(llvm, function, "willreturn");
+    return function;
 }
 
-LLVMValueRef llvm_visit_call(Llvm *llvm, Call *call)
+// sum, min, max, dot and argmax call the corelib kernel for the element
+// type of their sequences. min and max of an empty sequence are an index
+// out of bounds, argmax gives -1 for it. The sequences of dot must have the
+// same shape, which is checked like the operands of a tensor operation.
+LLVMValueRef llvm_visit_reduction(Llvm *llvm, Call *call)
 {
-    Symbol *symbol = lookup_symbol(llvm->scope, call->name);
-    if (symbol == NULL)
+    int line = llvm->line;
+    int col = llvm->col;
+    Expression *first = call->expression;
+    Expression *second = first->next;
+    Type type = first->type_info->type;
+    if (second != NULL && first->type_info->tensor)
     {
-        fatal("Symbol not found: %s\n", call->name);
+        int rank = count_dimensions(first->type_info->array_info);
+        LLVMValueRef *expected = malloc(rank * sizeof(LLVMValueRef));
+        LLVMValueRef *actual = malloc(rank * sizeof(LLVMValueRef));
+        llvm_tensor_shape(llvm, first, expected);
+        llvm_tensor_shape(llvm, second, actual);
+        llvm_check_shape(llvm, second->line, second->col, expected, actual, rank);
+        free(expected);
+        free(actual);
     }
 
+    LLVMValueRef args[3];
     int num_args = 0;
-    Expression *arg = call->expression;
-    while (arg != NULL)
+    LLVMValueRef length;
+    for (Expression *arg = first; arg != NULL; arg = arg->next)
     {
-        num_args++;
-        arg = arg->next;
+        LLVMValueRef arg_length;
+        llvm_sequence_elements(llvm, arg, &args[num_args++], &arg_length);
+        if (arg != first && !first->type_info->tensor)
+        {
+            llvm_check_shape(llvm, arg->line, arg->col, &length, &arg_length, 1);
+        }
+        length = arg_length;
     }
-    LLVMValueRef *args = calloc(num_args, sizeof(LLVMValueRef));
-    int i = 0;
-    arg = call->expression;
-    while (arg != NULL)
+    args[num_args++] = length;
+    if ((strcmp(call->name, MIN) == 0 || strcmp(call->name, MAX) == 0) &&
+        (!LLVMIsAConstantInt(length) || LLVMConstIntGetZExtValue(length) == 0))
     {
-        args[i++] = llvm_visit_expression(llvm, arg);
-        arg = arg->next;
+        llvm_check_index(llvm, first, LLVMConstNull(LLVMTypeOf(length)), length, false);
     }
+    llvm_set_location(llvm, line, col);
 
-    LlvmSymbolInfo *llvm_symbol_info = (LlvmSymbolInfo *)symbol->info;
-    LLVMValueRef llvm_call = LLVMBuildCall2(llvm->builder, llvm_symbol_info->type, llvm_symbol_info->value, args, num_args, call->name);
-    free(args);
+    LLVMValueRef function = llvm_reduction_function(llvm, call->name, type);
+    LLVMTypeRef function_type = LLVMGlobalGetValueType(function);
+    LLVMTypeRef data_type = LLVMTypeOf(LLVMGetParam(function, 0));
+    for (int i = 0; i < num_args - 1; i++)
+    {
+        args[i] = LLVMBuildBitCast(llvm->builder, args[i], data_type, "elements");
+    }
+    LLVMValueRef value = LLVMBuildCall2(llvm->builder, function_type, function, args, num_args, call->name);
+    if (strcmp(call->name, ARGMAX) == 0)
+    {
+        return LLVMBuildTrunc(llvm->builder, value, LLVMInt32TypeInContext(llvm->context), "argmax");
+    }
+    return llvm_build_conversion(llvm, value, LLVMTypeOf(value) == llvm_scalar_type(llvm, type) ? type : TYPE_FLOAT, type, call->name);
+}
 
-    return llvm_call;
+// Counts the operators of expression against budget, false once it runs
+// out or on anything that must not run unless the left operand allows it:
+// calls may have effects, divisions trap on a zero divisor and so does
+// checked arithmetic on overflow, and an index may be out of bounds
+bool llvm_is_branchless(Llvm *llvm, Expression *expression, int *budget)
+{
+    if (expression == NULL)
+    {
+        return true;
+    }
+    if (expression->node != NULL)
+    {
+        if (expression->node->node_type == N_CALL)
+        {
+            Call *call = expression->node->data;
+            return is_cast(call->name) && --*budget >= 0 && llvm_is_branchless(llvm, call->expression, budget);
+        }
+        return expression->node->node_type != N_ARRAY && expression->node->node_type != N_SLICE;
+    }
+    Expression *operand = expression->left != NULL ? expression->left : expression->right;
+    if (expression->token->token_type == T_DIV || expression->token->token_type == T_REM || expression->token->token_type == T_LBRACKET ||
+        llvm_checks_overflow(llvm, expression->token->token_type, operand->type_info->type))
+    {
+        return false;
+    }
+    return --*budget >= 0 && llvm_is_branchless(llvm, expression->left, budget) && llvm_is_branchless(llvm, expression->right, budget);
 }
 
-LLVMValueRef llvm_visit_name(Llvm *llvm, Name *name)
+LLVMValueRef llvm_to_bool(Llvm *llvm, LLVMValueRef value)
 {
-    Symbol *symbol = lookup_symbol(llvm->scope, name->value);
-    if (symbol == NULL)
+    LLVMTypeRef type = LLVMTypeOf(value);
+    if (llvm_is_float_type(type))
     {
-        fatal("Symbol not found: %s\n", name->value);
+        return LLVMBuildFCmp(llvm->builder, LLVMRealUNE, value, LLVMConstNull(type), "tobool");
+    }
+    if (LLVMGetIntTypeWidth(type) == 1)
+    {
+        return value;
     }
+    return LLVMBuildICmp(llvm->builder, LLVMIntNE, value, LLVMConstNull(type), "tobool");
+}
 
-    LlvmSymbolInfo *llvm_symbol_info = symbol->info;
-    if (symbol->type == SYMBOL_ARG)
+// Only evaluates the right operand of && and || when the left one does not
+// decide the result. Cheap right operands are evaluated anyway and picked
+// with a select, a branch on data dependent conditions costs more in
+// mispredictions than it saves.
+LLVMValueRef llvm_visit_logical(Llvm *llvm, Expression *expression)
+{
+    bool is_and = expression->token->token_type == T_LOGICAL_AND;
+    LLVMTypeRef bool_type = LLVMInt1TypeInContext(llvm->context);
+    LLVMValueRef left = llvm_to_bool(llvm, llvm_visit_expression(llvm, expression->left));
+
+    int budget = LLVM_BRANCHLESS_COST;
+    if (llvm_is_branchless(llvm, expression->right, &budget))
     {
-        return llvm_symbol_info->value;
+        LLVMValueRef right = llvm_to_bool(llvm, llvm_visit_expression(llvm, expression->right));
+        llvm_set_location(llvm, expression->line, expression->col);
+        if (is_and)
+        {
+            return LLVMBuildSelect(llvm->builder, left, right, LLVMConstInt(bool_type, 0, 0), "logical_and");
+        }
+        return LLVMBuildSelect(llvm->builder, left, LLVMConstInt(bool_type, 1, 0), right, "logical_or");
     }
-    else if (symbol->type == SYMBOL_VARIABLE)
+
+    LLVMBasicBlockRef left_block = LLVMGetInsertBlock(llvm->builder);
+    LLVMValueRef function_ref = LLVMGetBasicBlockParent(left_block);
+    LLVMBasicBlockRef next_block = LLVMGetNextBasicBlock(left_block);
+    LLVMBasicBlockRef exit_block;
+    if (next_block != NULL)
     {
-        return LLVMBuildLoad2(llvm->builder, llvm_symbol_info->type, llvm_symbol_info->value, name->value);
+        exit_block = LLVMInsertBasicBlockInContext(llvm->context, next_block, is_and ? "and_exit" : "or_exit");
     }
     else
     {
-        fatal("Invalid symbol type");
+        exit_block = LLVMAppendBasicBlockInContext(llvm->context, function_ref, is_and ? "and_exit" : "or_exit");
+    }
+    LLVMBasicBlockRef right_block = LLVMInsertBasicBlockInContext(llvm->context, exit_block, is_and ? "and_rhs" : "or_rhs");
+
+    llvm_set_location(llvm, expression->line, expression->col);
+    if (is_and)
+    {
+        LLVMBuildCondBr(llvm->builder, left, right_block, exit_block);
+    }
+    else
+    {
+        LLVMBuildCondBr(llvm->builder, left, exit_block, right_block);
     }
+
+    LLVMPositionBuilderAtEnd(llvm->builder, right_block);
+    LLVMValueRef right = llvm_to_bool(llvm, llvm_visit_expression(llvm, expression->right));
+    // The right operand may have branched itself
+    right_block = LLVMGetInsertBlock(llvm->builder);
+    LLVMBuildBr(llvm->builder, exit_block);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, exit_block);
+    LLVMValueRef phi = LLVMBuildPhi(llvm->builder, bool_type, is_and ? "logical_and" : "logical_or");
+    LLVMValueRef values[2] = {LLVMConstInt(bool_type, is_and ? 0 : 1, 0), right};
+    LLVMBasicBlockRef blocks[2] = {left_block, right_block};
+    LLVMAddIncoming(phi, values, blocks, 2);
+    return phi;
 }
 
 LLVMValueRef llvm_visit_expression(Llvm *llvm, Expression *expression)
@@ -137,36 +2246,88 @@ LLVMValueRef llvm_visit_expression(Llvm *llvm, Expression *expression)
         return NULL;
     }
 
+    if (expression->left != NULL && expression->right != NULL &&
+        (expression->token->token_type == T_LOGICAL_AND || expression->token->token_type == T_LOGICAL_OR))
+    {
+        return llvm_visit_logical(llvm, expression);
+    }
+    if (expression->token != NULL && expression->token->token_type == T_LBRACKET)
+    {
+        return llvm_visit_element(llvm, expression);
+    }
+    if (expression->type_info != NULL && expression->type_info->tensor)
+    {
+        fatal("Tensor at %d:%d can only be indexed, assigned or passed", expression->line, expression->col);
+    }
+
     LLVMValueRef left = llvm_visit_expression(llvm, expression->left);
     LLVMValueRef right = llvm_visit_expression(llvm, expression->right);
+    llvm_set_location(llvm, expression->line, expression->col);
 
     LLVMValueRef result;
 
+    bool left_float = left != NULL && llvm_is_float_type(LLVMTypeOf(left));
+    bool right_float = right != NULL && llvm_is_float_type(LLVMTypeOf(right));
+    bool is_float = left_float || right_float;
+
     if (left != NULL && right != NULL)
     {
-        // Both left and right set so this is a binary expression
+        if (left_float != right_float)
+        {
+            fatal("Operands of %s at %d:%d mix int and float, convert one with %s or %s", expression->token->buffer,
+                  expression->line, expression->col, AS_FLOAT, AS_INT);
+        }
+        // Types of the same width share their LLVM type but not their
+        // operations
+        Type left_type = expression->left->type_info->type;
+        Type right_type = expression->right->type_info->type;
+        if (LLVMTypeOf(left) != LLVMTypeOf(right) || (left_type != right_type && left_type != TYPE_INFER && right_type != TYPE_INFER))
+        {
+            fatal("Operands of %s at %d:%d have different types %s and %s, convert one with %s<type>", expression->token->buffer,
+                  expression->line, expression->col, type_name(left_type), type_name(right_type), CAST_PREFIX);
+        }
+    }
+
+    if (left != NULL && right != NULL && expression->left->type_info->type == TYPE_BF16)
+    {
+        result = llvm_visit_float_binary(llvm, expression, llvm_bf16_to_float(llvm, left), llvm_bf16_to_float(llvm, right));
+        if (!is_boolean_operator(expression->token->token_type))
+        {
+            result = llvm_float_to_bf16(llvm, result);
+        }
+    }
+    else if (left != NULL && right != NULL && is_float)
+    {
+        result = llvm_visit_float_binary(llvm, expression, left, right);
+    }
+    else if (left != NULL && right != NULL)
+    {
+        // Both left and right set so this is a binary expression, the
+        // signedness of the operands picks division, shift and comparison
+        Type type = expression->left->type_info->type;
+        bool is_signed = llvm_is_signed(type);
         switch (expression->token->token_type)
         {
         case T_ADD:
-            result = LLVMBuildAdd(llvm->builder, left, right, "add");
+            result = llvm_build_arithmetic(llvm, expression, T_ADD, type, left, right, "add");
             break;
         case T_SUB:
-            result = LLVMBuildSub(llvm->builder, left, right, "sub");
+            result = llvm_build_arithmetic(llvm, expression, T_SUB, type, left, right, "sub");
             break;
         case T_MUL:
-            result = LLVMBuildMul(llvm->builder, left, right, "mul");
+            result = llvm_build_arithmetic(llvm, expression, T_MUL, type, left, right, "mul");
             break;
         case T_DIV:
-            result = LLVMBuildSDiv(llvm->builder, left, right, "sdiv");
+            result = is_signed ? LLVMBuildSDiv(llvm->builder, left, right, "sdiv") : LLVMBuildUDiv(llvm->builder, left, right, "udiv");
             break;
         case T_REM:
-            result = LLVMBuildSRem(llvm->builder, left, right, "srem");
+            result = is_signed ? LLVMBuildSRem(llvm->builder, left, right, "srem") : LLVMBuildURem(llvm->builder, left, right, "urem");
             break;
         case T_SHL:
             result = LLVMBuildShl(llvm->builder, left, right, "shl");
             break;
         case T_SHR:
-            result = LLVMBuildLShr(llvm->builder, left, right, "lshr");
+            result = is_signed ? LLVMBuildAShr(llvm->builder, left, right, "ashr") : LLVMBuildLShr(llvm->builder, left, right, "lshr");
             break;
         case T_AND:
             result = LLVMBuildAnd(llvm->builder, left, right, "and");
@@ -187,22 +2348,16 @@ LLVMValueRef llvm_visit_expression(Llvm *llvm, Expression *expression)
             result = LLVMBuildICmp(llvm->builder, LLVMIntNE, left, right, "neq");
             break;
         case T_LT:
-            result = LLVMBuildICmp(llvm->builder, LLVMIntSLT, left, right, "lt");
+            result = LLVMBuildICmp(llvm->builder, is_signed ? LLVMIntSLT : LLVMIntULT, left, right, "lt");
             break;
         case T_LTE:
-            result = LLVMBuildICmp(llvm->builder, LLVMIntSLE, left, right, "lte");
+            result = LLVMBuildICmp(llvm->builder, is_signed ? LLVMIntSLE : LLVMIntULE, left, right, "lte");
             break;
         case T_GT:
-            result = LLVMBuildICmp(llvm->builder, LLVMIntSGT, left, right, "gt");
+            result = LLVMBuildICmp(llvm->builder, is_signed ? LLVMIntSGT : LLVMIntUGT, left, right, "gt");
             break;
         case T_GTE:
-            result = LLVMBuildICmp(llvm->builder, LLVMIntSGE, left, right, "gte");
-            break;
-        case T_LOGICAL_AND:
-            result = LLVMBuildAnd(llvm->builder, left, right, "logical_and");
-            break;
-        case T_LOGICAL_OR:
-            result = LLVMBuildOr(llvm->builder, left, right, "logical_or");
+            result = LLVMBuildICmp(llvm->builder, is_signed ? LLVMIntSGE : LLVMIntUGE, left, right, "gte");
             break;
         default:
             fprintf(stderr, "Invalid expression\n");
@@ -212,16 +2367,51 @@ LLVMValueRef llvm_visit_expression(Llvm *llvm, Expression *expression)
     }
     else
     {
+        if (left != NULL && expression->left->type_info->type == TYPE_BF16)
+        {
+            // Negation only flips the sign bit, anything else is computed
+            // on the float value
+            if (expression->token->token_type == T_SUB)
+            {
+                return LLVMBuildXor(llvm->builder, left, LLVMConstInt(LLVMTypeOf(left), 0x8000, 0), "fneg");
+            }
+            left = llvm_bf16_to_float(llvm, left);
+            is_float = true;
+        }
         if (left != NULL)
         {
             // Only left expression set so this is left to right unary expression
             switch (expression->token->token_type)
             {
             case T_INC:
-                result = LLVMBuildAdd(llvm->builder, left, LLVMConstInt(LLVMInt32Type(), 1, 0), "inc");
+                result = llvm_build_arithmetic(llvm, expression, T_ADD, expression->left->type_info->type, left,
+                                               LLVMConstInt(LLVMTypeOf(left), 1, 0), "inc");
                 break;
             case T_DEC:
-                result = LLVMBuildSub(llvm->builder, left, LLVMConstInt(LLVMInt32Type(), 1, 0), "dec");
+                result = llvm_build_arithmetic(llvm, expression, T_SUB, expression->left->type_info->type, left,
+                                               LLVMConstInt(LLVMTypeOf(left), 1, 0), "dec");
+                break;
+            case T_SUB:
+                result = is_float ? llvm_build_fneg(llvm, left)
+                                  : llvm_build_arithmetic(llvm, expression, T_SUB, expression->left->type_info->type,
+                                                          LLVMConstNull(LLVMTypeOf(left)), left, "neg");
+                break;
+            case T_XOR:
+                if (is_float)
+                {
+                    fatal("Operator %s at %d:%d does not apply to float operands", expression->token->buffer, expression->line, expression->col);
+                }
+                result = LLVMBuildNot(llvm->builder, left, "not");
+                break;
+            case T_LOGICAL_NOT:
+                if (is_float)
+                {
+                    result = llvm_build_fcmp(llvm, LLVMRealOEQ, left, LLVMConstNull(LLVMTypeOf(left)), "logical_not");
+                }
+                else
+                {
+                    result = LLVMBuildICmp(llvm->builder, LLVMIntEQ, left, LLVMConstNull(LLVMTypeOf(left)), "logical_not");
+                }
                 break;
             default:
                 fprintf(stderr, "Invalid left unary expression\n");
@@ -235,7 +2425,9 @@ LLVMValueRef llvm_visit_expression(Llvm *llvm, Expression *expression)
             switch (expression->token->token_type)
             {
             case T_SUB:
-                result = LLVMBuildNeg(llvm->builder, right, "neg");
+                result = is_float ? llvm_build_fneg(llvm, right)
+                                  : llvm_build_arithmetic(llvm, expression, T_SUB, expression->right->type_info->type,
+                                                          LLVMConstNull(LLVMTypeOf(right)), right, "neg");
                 break;
             default:
                 fprintf(stderr, "Invalid right unary expression\n");
@@ -254,19 +2446,27 @@ LLVMValueRef llvm_visit_expression(Llvm *llvm, Expression *expression)
             switch (node->node_type)
             {
             case N_INTEGER:
-                result = llvm_visit_integer(llvm, (Integer *)node->data);
+                result = llvm_visit_integer(llvm, (Integer *)node->data, expression->type_info);
                 break;
             case N_FLOAT:
-                result = llvm_visit_float(llvm, (Float *)node->data);
+                result = llvm_visit_float(llvm, (Float *)node->data, expression->type_info);
                 break;
             case N_CALL:
                 result = llvm_visit_call(llvm, (Call *)node->data);
                 break;
             case N_NAME:
+                if (expression->type_info->array_info != NULL)
+                {
+                    fatal("Array %s at %d:%d can only be indexed or assigned", ((Name *)node->data)->value, expression->line, expression->col);
+                }
+                if (expression->type_info->slice)
+                {
+                    fatal("Slice %s at %d:%d can only be indexed, sliced or passed", ((Name *)node->data)->value, expression->line, expression->col);
+                }
                 result = llvm_visit_name(llvm, (Name *)node->data);
                 break;
-            case N_ARRAY:
-                result = llvm_visit_expression(llvm, (Expression *)node->data);
+            case N_SLICE:
+                fatal("Slice at %d:%d can only be indexed, sliced or passed", expression->line, expression->col);
                 break;
             default:
                 fprintf(stderr, "Unsupported node type in this context\n");
@@ -276,88 +2476,714 @@ LLVMValueRef llvm_visit_expression(Llvm *llvm, Expression *expression)
         }
     }
 
-    return result;
+    return result;
+}
+
+bool is_exported(char *name, bool exported)
+{
+    return exported || strcmp(name, "main") == 0;
+}
+
+// Symbols that are not exported are only reachable from this module, which
+// lets LLVM change their signature, propagate constants into them and drop
+// them once unused
+void llvm_set_visibility(LLVMValueRef value, bool exported)
+{
+    LLVMSetLinkage(value, exported ? LLVMExternalLinkage : LLVMInternalLinkage);
+    if (!exported)
+    {
+        LLVMSetUnnamedAddress(value, LLVMGlobalUnnamedAddr);
+        if (LLVMIsAFunction(value))
+        {
+            LLVMSetFunctionCallConv(value, LLVMFastCallConv);
+        }
+    }
+}
+
+int is_global_variable(LLVMValueRef value)
+{
+    return LLVMIsAGlobalValue(value) && LLVMGetGlobalParent(value);
+}
+
+void llvm_visit_assignment(Llvm *llvm, Assignment *assignment)
+{
+    Symbol *symbol = lookup_symbol(llvm->scope, assignment->name);
+    if (symbol == NULL)
+    {
+        fatal("Symbol not found");
+    }
+
+    LlvmSymbolInfo *llvm_symbol_info = symbol->info;
+
+    // Assignments at root level initialize globals and are evaluated at
+    // compile time, inside functions they are plain stores
+    if (is_global_variable(llvm_symbol_info->value) && find_enclosing_scope_info(llvm->scope, SCOPE_FUNCTION) == NULL)
+    {
+        if (LLVMGetTypeKind(llvm_symbol_info->type) == LLVMArrayTypeKind)
+        {
+            LLVMSetInitializer(llvm_symbol_info->value, llvm_const_array_literal(llvm, assignment->name, llvm_symbol_info->type, assignment->expression));
+            return;
+        }
+        if (LLVMGetTypeKind(llvm_symbol_info->type) == LLVMStructTypeKind)
+        {
+            LLVMSetInitializer(llvm_symbol_info->value, llvm_const_slice(llvm, assignment->name, assignment->type_info->type, assignment->expression));
+            return;
+        }
+        LLVMValueRef initializer = llvm_eval_constant(llvm, assignment->expression, llvm_symbol_info->type);
+        if (initializer == NULL)
+        {
+            // Half precision literals are built as LLVM constants directly
+            initializer = llvm_visit_expression(llvm, assignment->expression);
+        }
+        if (LLVMIsAConstant(initializer))
+        {
+            LLVMSetInitializer(llvm_symbol_info->value, initializer);
+        }
+        else
+        {
+            fatal("Global variable %s can not be initialized at compile time: %s", assignment->name,
+                  llvm->eval != NULL ? llvm->eval->error : "not a constant expression");
+        }
+    }
+    else
+    {
+        LLVMValueRef address = llvm_symbol_info->value;
+        LLVMTypeRef type = llvm_symbol_info->type;
+        char *element_tag = NULL;
+        if (llvm_symbol_info->type_info != NULL)
+        {
+            // Tensors are assigned as a whole or one element at a time
+            if (assignment->index == NULL)
+            {
+                llvm_assign_tensor(llvm, address, llvm_symbol_info->type_info, assignment->expression);
+                return;
+            }
+            Expression **indexes = malloc(count_dimensions(llvm_symbol_info->type_info->array_info) * sizeof(Expression *));
+            int rank = 0;
+            for (Expression *index = assignment->index; index != NULL; index = index->next)
+            {
+                indexes[rank++] = index;
+            }
+            address = llvm_build_tensor_element_pointer(llvm, address, llvm_symbol_info->type_info, indexes);
+            free(indexes);
+            type = llvm_scalar_type(llvm, assignment->type_info->type);
+            element_tag = "tensor element";
+        }
+        else
+        {
+            for (Expression *index = assignment->index; index != NULL; index = index->next)
+            {
+                if (LLVMGetTypeKind(type) == LLVMStructTypeKind)
+                {
+                    address = llvm_build_slice_element_pointer(llvm, address, assignment->type_info->type, index);
+                    type = llvm_scalar_type(llvm, assignment->type_info->type);
+                    element_tag = "slice element";
+                    continue;
+                }
+                address = llvm_build_element_pointer(llvm, address, type, index);
+                type = LLVMGetElementType(type);
+            }
+        }
+        if (LLVMGetTypeKind(type) == LLVMArrayTypeKind)
+        {
+            llvm_store_array(llvm, address, type, assignment->type_info->type, assignment->expression);
+            return;
+        }
+        if (LLVMGetTypeKind(type) == LLVMStructTypeKind)
+        {
+            llvm_init_slice(llvm, address, assignment->type_info->type, assignment->expression);
+            return;
+        }
+        LLVMValueRef expr_value = llvm_visit_expression(llvm, assignment->expression);
+        LLVMValueRef store = LLVMBuildStore(llvm->builder, expr_value, address);
+        if (element_tag != NULL)
+        {
+            llvm_set_tbaa(llvm, store, element_tag);
+        }
+    }
+}
+
+LLVMValueRef llvm_add_global(Llvm *llvm, Variable *variable, LLVMTypeRef type)
+{
+    LLVMValueRef value = LLVMAddGlobal(llvm->module, type, variable->name);
+    llvm_set_visibility(value, is_exported(variable->name, variable->exported));
+    if (llvm->di_builder != NULL && llvm->options->debug_info == DEBUG_INFO_FULL)
+    {
+        LLVMMetadataRef di_global = LLVMDIBuilderCreateGlobalVariableExpression(llvm->di_builder, llvm->di_compile_unit,
+                                                                                variable->name, strlen(variable->name),
+                                                                                variable->name, strlen(variable->name),
+                                                                                llvm->di_file, llvm->line,
+                                                                                get_llvm_debug_type(llvm, variable->type_info),
+                                                                                !is_exported(variable->name, variable->exported),
+                                                                                LLVMDIBuilderCreateExpression(llvm->di_builder, NULL, 0),
+                                                                                NULL, 0);
+        LLVMGlobalSetMetadata(value, LLVMGetMDKindIDInContext(llvm->context, "dbg", 3), di_global);
+    }
+    return value;
+}
+
+// Constants are evaluated once at compile time and used as immediates.
+// Root level ones are also emitted as read only globals for other modules.
+void llvm_visit_constant(Llvm *llvm, Variable *variable)
+{
+    LLVMTypeRef type = get_llvm_type(llvm, variable->type_info);
+    if (variable->type_info->array_info != NULL)
+    {
+        // Constant arrays are read through their global
+        LLVMValueRef initializer = llvm_const_array_literal(llvm, variable->name, type, variable->assignment->expression);
+        unsigned alignment = llvm_array_alignment(variable->type_info->type);
+        LLVMValueRef global;
+        if (find_enclosing_scope_info(llvm->scope, SCOPE_FUNCTION) == NULL)
+        {
+            global = llvm_add_global(llvm, variable, type);
+            LLVMSetInitializer(global, initializer);
+            LLVMSetGlobalConstant(global, 1);
+            LLVMSetAlignment(global, alignment);
+        }
+        else
+        {
+            global = llvm_pool_constant(llvm, initializer, alignment);
+        }
+        LlvmSymbolInfo *llvm_symbol_info = new_llvm_symbol_info(type, global);
+        llvm_symbol_info->value_type = variable->type_info->type;
+        insert_symbol(llvm->scope, SYMBOL_CONSTANT, variable->name, llvm_symbol_info);
+        return;
+    }
+    LLVMValueRef value = llvm_eval_constant(llvm, variable->assignment->expression, type);
+    if (value == NULL)
+    {
+        fatal("Constant %s can not be evaluated at compile time: %s", variable->name,
+              llvm->eval != NULL ? llvm->eval->error : "no analysis was run");
+    }
+    if (find_enclosing_scope_info(llvm->scope, SCOPE_FUNCTION) == NULL)
+    {
+        LLVMValueRef global = llvm_add_global(llvm, variable, type);
+        LLVMSetInitializer(global, value);
+        LLVMSetGlobalConstant(global, 1);
+    }
+    LlvmSymbolInfo *llvm_symbol_info = new_llvm_symbol_info(type, value);
+    llvm_symbol_info->value_type = variable->type_info->type;
+    insert_symbol(llvm->scope, SYMBOL_CONSTANT, variable->name, llvm_symbol_info);
+}
+
+void llvm_visit_variable(Llvm *llvm, Variable *variable)
+{
+    if (variable->constant)
+    {
+        llvm_visit_constant(llvm, variable);
+        return;
+    }
+
+    LLVMValueRef function_ref = find_enclosing_scope_info(llvm->scope, SCOPE_FUNCTION);
+    LLVMTypeRef type = get_llvm_type(llvm, variable->type_info);
+    LLVMValueRef value;
+
+    if (function_ref != NULL)
+    {
+        // Arrays go to the entry block so that one declared in a loop does
+        // not grow the stack on every iteration
+        if (variable->type_info->slice || variable->type_info->tensor)
+        {
+            value = llvm_build_entry_header(llvm, type, variable->type_info->type, variable->name);
+        }
+        else if (variable->type_info->array_info != NULL)
+        {
+            value = llvm_build_entry_alloca(llvm, type, variable->name);
+            LLVMSetAlignment(value, llvm_array_alignment(variable->type_info->type));
+        }
+        else
+        {
+            value = LLVMBuildAlloca(llvm->builder, type, variable->name);
+        }
+        if (llvm_has_debug_variables(llvm))
+        {
+            LLVMMetadataRef di_variable = LLVMDIBuilderCreateAutoVariable(llvm->di_builder, llvm->di_scope,
+                                                                          variable->name, strlen(variable->name),
+                                                                          llvm->di_file, llvm->line,
+                                                                          get_llvm_debug_type(llvm, variable->type_info),
+                                                                          true, LLVMDIFlagZero, 0);
+            LLVMDIBuilderInsertDeclareAtEnd(llvm->di_builder, value, di_variable,
+                                            LLVMDIBuilderCreateExpression(llvm->di_builder, NULL, 0),
+                                            llvm_debug_location(llvm), LLVMGetInsertBlock(llvm->builder));
+        }
+    }
+    else
+    {
+        value = llvm_add_global(llvm, variable, type);
+        if (variable->type_info->array_info != NULL)
+        {
+            LLVMSetAlignment(value, llvm_array_alignment(variable->type_info->type));
+        }
+        if (variable->assignment == NULL)
+        {
+            LLVMSetInitializer(value, LLVMConstNull(type));
+        }
+    }
+    LlvmSymbolInfo *llvm_symbol_info = new_llvm_symbol_info(type, value);
+    insert_symbol(llvm->scope, SYMBOL_VARIABLE, variable->name, llvm_symbol_info);
+    if (variable->type_info->tensor)
+    {
+        llvm_symbol_info->type_info = variable->type_info;
+        llvm_init_tensor(llvm, value, variable->type_info, variable->assignment != NULL ? variable->assignment->expression : NULL);
+    }
+    else if (variable->assignment)
+    {
+        llvm_visit_assignment(llvm, variable->assignment);
+    }
+    else if (variable->type_info->slice && function_ref != NULL)
+    {
+        llvm_init_slice(llvm, value, variable->type_info->type, NULL);
+    }
+}
+
+LLVMBasicBlockRef llvm_visit_block(Llvm *llvm, ScopeType scope_type, Block *block, LLVMBasicBlockRef llvm_block, LLVMBasicBlockRef llvm_exit_block, LlvmScopeInfo *llvm_scope_info)
+{
+    if (block->statements != NULL)
+    {
+        // Nested blocks get their own lexical scope so that shadowed
+        // variables resolve correctly in the debugger
+        LLVMMetadataRef di_scope = llvm->di_scope;
+        if (scope_type != SCOPE_FUNCTION && llvm_has_debug_variables(llvm))
+        {
+            llvm->di_scope = LLVMDIBuilderCreateLexicalBlock(llvm->di_builder, di_scope, llvm->di_file, llvm->line, llvm->col);
+        }
+
+        // The scope of a function body is pushed with its parameters
+        if (scope_type != SCOPE_FUNCTION)
+        {
+            llvm->scope = push_scope(llvm->scope, scope_type, llvm_scope_info, NULL, NULL);
+        }
+        llvm_visit(llvm, block->statements);
+        if (!llvm_scope_info->has_returned)
+        {
+            if (llvm_scope_info->jump_to != NULL)
+            {
+                LLVMBuildBr(llvm->builder, llvm_scope_info->jump_to);
+            }
+            else if (llvm_exit_block != NULL)
+            {
+                LLVMBuildBr(llvm->builder, llvm_exit_block);
+            }
+        }
+        if (scope_type != SCOPE_FUNCTION)
+        {
+            llvm->scope = pop_scope(llvm->scope);
+        }
+
+        llvm->di_scope = di_scope;
+    }
+    return llvm_block;
+}
+
+LLVMValueRef llvm_memo_global(Llvm *llvm, LLVMTypeRef type, char *function, char *suffix)
+{
+    char name[MAX_BUFFER_SIZE];
+    snprintf(name, sizeof(name), "%s.%s", function, suffix);
+    LLVMValueRef global = LLVMAddGlobal(llvm->module, type, name);
+    LLVMSetInitializer(global, LLVMConstNull(type));
+    LLVMSetLinkage(global, LLVMInternalLinkage);
+    if (llvm->options->memo_thread_local)
+    {
+        LLVMSetThreadLocal(global, 1);
+    }
+    return global;
 }
 
-int is_global_variable(LLVMValueRef value)
+// Keys and results are cached as their 32 bit patterns
+bool llvm_memo_supports(LLVMTypeRef type)
 {
-    return LLVMIsAGlobalValue(value) && LLVMGetGlobalParent(value);
+    return LLVMGetTypeKind(type) == LLVMFloatTypeKind ||
+           (LLVMGetTypeKind(type) == LLVMIntegerTypeKind && LLVMGetIntTypeWidth(type) == 32);
 }
 
-void llvm_visit_assignment(Llvm *llvm, Assignment *assignment)
+LLVMValueRef llvm_memo_bits(Llvm *llvm, LLVMValueRef value)
 {
-    Symbol *symbol = lookup_symbol(llvm->scope, assignment->name);
-    if (symbol == NULL)
+    if (LLVMGetTypeKind(LLVMTypeOf(value)) == LLVMFloatTypeKind)
     {
-        fatal("Symbol not found");
+        return LLVMBuildBitCast(llvm->builder, value, LLVMInt32TypeInContext(llvm->context), "memo_bits");
     }
+    return value;
+}
 
-    LlvmSymbolInfo *llvm_symbol_info = symbol->info;
-    LLVMValueRef expr_value = llvm_visit_expression(llvm, assignment->expression);
+LLVMValueRef llvm_memo_element(Llvm *llvm, LLVMValueRef array, LLVMTypeRef array_type, LLVMValueRef index)
+{
+    LLVMValueRef indices[2] = {LLVMConstInt(LLVMInt64TypeInContext(llvm->context), 0, 0),
+                               LLVMBuildZExt(llvm->builder, index, LLVMInt64TypeInContext(llvm->context), "memo_index")};
+    return LLVMBuildGEP2(llvm->builder, array_type, array, indices, 2, "memo_element");
+}
 
-    if (is_global_variable(llvm_symbol_info->value))
+// Emits the cache lookup at the top of a memoized function and leaves the
+// builder where the body starts. A single parameter below MEMO_DENSE_SIZE
+// indexes a flat table directly, every other key goes through the corelib
+// open addressing table. Returns of the body are routed to llvm_memo_exit.
+void llvm_memo_enter(Llvm *llvm, Function *function, LLVMValueRef function_ref, LLVMTypeRef return_type)
+{
+    LLVMTypeRef i8_type = LLVMInt8TypeInContext(llvm->context);
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMTypeRef handle_type = LLVMPointerType(i8_type, 0);
+    if (LLVMGetNamedFunction(llvm->module, "tron_memo_lookup") == NULL)
     {
-        if (LLVMIsAConstant(expr_value))
-        {
-            LLVMSetInitializer(llvm_symbol_info->value, expr_value);
-        }
-        else
+        LLVMTypeRef params[4] = {LLVMPointerType(handle_type, 0), i32_type, LLVMPointerType(i32_type, 0), LLVMPointerType(i32_type, 0)};
+        LLVMAddFunction(llvm->module, "tron_memo_lookup", LLVMFunctionType(i32_type, params, 4, 0));
+        params[3] = i32_type;
+        LLVMAddFunction(llvm->module, "tron_memo_store", LLVMFunctionType(LLVMVoidTypeInContext(llvm->context), params, 4, 0));
+    }
+
+    LlvmMemo *memo = malloc(sizeof(LlvmMemo));
+    memo->num_keys = 0;
+    for (Variable *param = function->params; param != NULL; param = param->next)
+    {
+        if (!llvm_memo_supports(LLVMTypeOf(LLVMGetParam(function_ref, memo->num_keys))))
         {
-            fatal("Global variables must be initialized with a constant expression");
+            fatal("Memoized function %s can only take 32 bit parameters", function->name);
         }
+        memo->num_keys++;
+    }
+    if (!llvm_memo_supports(return_type))
+    {
+        fatal("Memoized function %s can only return a 32 bit value", function->name);
+    }
+
+    LLVMTypeRef keys_type = LLVMArrayType(i32_type, memo->num_keys);
+    memo->keys = LLVMBuildAlloca(llvm->builder, keys_type, "memo_keys");
+    memo->result = LLVMBuildAlloca(llvm->builder, return_type, "memo_result");
+    LLVMValueRef bits = LLVMBuildAlloca(llvm->builder, i32_type, "memo_bits");
+    for (int i = 0; i < memo->num_keys; i++)
+    {
+        LLVMValueRef key = llvm_memo_bits(llvm, LLVMGetParam(function_ref, i));
+        LLVMBuildStore(llvm->builder, key, llvm_memo_element(llvm, memo->keys, keys_type, LLVMConstInt(i32_type, i, 0)));
+    }
+    memo->table = llvm_memo_global(llvm, handle_type, function->name, "memo_table");
+    memo->values = NULL;
+    memo->filled = NULL;
+
+    LLVMBasicBlockRef lookup = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "memo_lookup");
+    LLVMBasicBlockRef hit = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "memo_hit");
+    LLVMBasicBlockRef body = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "memo_body");
+    memo->exit = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "memo_exit");
+    memo->ret = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "memo_return");
+
+    if (memo->num_keys == 1)
+    {
+        LLVMTypeRef values_type = LLVMArrayType(i32_type, MEMO_DENSE_SIZE);
+        LLVMTypeRef filled_type = LLVMArrayType(i8_type, MEMO_DENSE_SIZE);
+        memo->values = llvm_memo_global(llvm, values_type, function->name, "memo_values");
+        memo->filled = llvm_memo_global(llvm, filled_type, function->name, "memo_filled");
+
+        LLVMBasicBlockRef dense = LLVMInsertBasicBlockInContext(llvm->context, lookup, "memo_dense");
+        LLVMBasicBlockRef dense_hit = LLVMInsertBasicBlockInContext(llvm->context, lookup, "memo_dense_hit");
+        LLVMValueRef key = llvm_memo_bits(llvm, LLVMGetParam(function_ref, 0));
+        LLVMValueRef in_range = LLVMBuildICmp(llvm->builder, LLVMIntULT, key, LLVMConstInt(i32_type, MEMO_DENSE_SIZE, 0), "memo_in_range");
+        LLVMBuildCondBr(llvm->builder, in_range, dense, lookup);
+
+        LLVMPositionBuilderAtEnd(llvm->builder, dense);
+        LLVMValueRef filled = LLVMBuildLoad2(llvm->builder, i8_type, llvm_memo_element(llvm, memo->filled, filled_type, key), "memo_filled");
+        LLVMBuildCondBr(llvm->builder, LLVMBuildICmp(llvm->builder, LLVMIntNE, filled, LLVMConstInt(i8_type, 0, 0), "memo_found"), dense_hit, body);
+
+        LLVMPositionBuilderAtEnd(llvm->builder, dense_hit);
+        LLVMValueRef value = LLVMBuildLoad2(llvm->builder, i32_type, llvm_memo_element(llvm, memo->values, values_type, key), "memo_value");
+        LLVMBuildStore(llvm->builder, value, bits);
+        LLVMBuildBr(llvm->builder, hit);
     }
     else
     {
-        LLVMBuildStore(llvm->builder, expr_value, llvm_symbol_info->value);
+        LLVMBuildBr(llvm->builder, lookup);
     }
+
+    LLVMPositionBuilderAtEnd(llvm->builder, lookup);
+    LLVMValueRef args[4] = {memo->table, LLVMConstInt(i32_type, memo->num_keys, 0),
+                            llvm_memo_element(llvm, memo->keys, keys_type, LLVMConstInt(i32_type, 0, 0)), bits};
+    LLVMValueRef found = llvm_call_runtime(llvm, "tron_memo_lookup", args, 4);
+    LLVMBuildCondBr(llvm->builder, LLVMBuildICmp(llvm->builder, LLVMIntNE, found, LLVMConstInt(i32_type, 0, 0), "memo_found"), hit, body);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, hit);
+    LLVMValueRef cached = LLVMBuildLoad2(llvm->builder, i32_type, bits, "memo_cached");
+    LLVMBuildStore(llvm->builder, LLVMBuildBitCast(llvm->builder, cached, return_type, "memo_cached"), memo->result);
+    LLVMBuildBr(llvm->builder, memo->ret);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, body);
+    llvm->memo = memo;
 }
 
-void llvm_visit_variable(Llvm *llvm, Variable *variable)
+void llvm_memo_exit(Llvm *llvm, LLVMTypeRef return_type)
 {
-    LLVMValueRef function_ref = find_enclosing_scope_info(llvm->scope, SCOPE_FUNCTION);
-    LLVMTypeRef type = get_llvm_type(llvm, variable->type_info);
-    LLVMValueRef value;
+    LlvmMemo *memo = llvm->memo;
+    LLVMTypeRef i8_type = LLVMInt8TypeInContext(llvm->context);
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMTypeRef keys_type = LLVMArrayType(i32_type, memo->num_keys);
+    LLVMPositionBuilderAtEnd(llvm->builder, memo->exit);
+    LLVMValueRef result = LLVMBuildLoad2(llvm->builder, return_type, memo->result, "memo_result");
+    LLVMValueRef bits = llvm_memo_bits(llvm, result);
+    LLVMValueRef first_key = llvm_memo_element(llvm, memo->keys, keys_type, LLVMConstInt(i32_type, 0, 0));
 
-    if (function_ref != NULL)
+    LLVMBasicBlockRef store = LLVMInsertBasicBlockInContext(llvm->context, memo->ret, "memo_store");
+    if (memo->num_keys == 1)
     {
-        value = LLVMBuildAlloca(llvm->builder, type, variable->name);
+        LLVMBasicBlockRef dense_store = LLVMInsertBasicBlockInContext(llvm->context, store, "memo_dense_store");
+        LLVMValueRef key = LLVMBuildLoad2(llvm->builder, i32_type, first_key, "memo_key");
+        LLVMValueRef in_range = LLVMBuildICmp(llvm->builder, LLVMIntULT, key, LLVMConstInt(i32_type, MEMO_DENSE_SIZE, 0), "memo_in_range");
+        LLVMBuildCondBr(llvm->builder, in_range, dense_store, store);
+
+        LLVMPositionBuilderAtEnd(llvm->builder, dense_store);
+        LLVMBuildStore(llvm->builder, bits, llvm_memo_element(llvm, memo->values, LLVMArrayType(i32_type, MEMO_DENSE_SIZE), key));
+        LLVMBuildStore(llvm->builder, LLVMConstInt(i8_type, 1, 0), llvm_memo_element(llvm, memo->filled, LLVMArrayType(i8_type, MEMO_DENSE_SIZE), key));
+        LLVMBuildBr(llvm->builder, memo->ret);
     }
     else
     {
-        value = LLVMAddGlobal(llvm->module, type, variable->name);
-        LLVMSetLinkage(value, LLVMExternalLinkage);
+        LLVMBuildBr(llvm->builder, store);
     }
-    insert_symbol(llvm->scope, SYMBOL_VARIABLE, variable->name, new_llvm_symbol_info(type, value));
-    if (variable->assignment)
+
+    LLVMPositionBuilderAtEnd(llvm->builder, store);
+    LLVMValueRef args[4] = {memo->table, LLVMConstInt(i32_type, memo->num_keys, 0), first_key, bits};
+    llvm_call_runtime(llvm, "tron_memo_store", args, 4);
+    LLVMBuildBr(llvm->builder, memo->ret);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, memo->ret);
+    if (llvm->options->instrument)
     {
-        llvm_visit_assignment(llvm, variable->assignment);
+        llvm_call_runtime(llvm, "tron_profile_exit", NULL, 0);
     }
+    LLVMBuildRet(llvm->builder, LLVMBuildLoad2(llvm->builder, return_type, memo->result, "memo_result"));
+
+    free(memo);
+    llvm->memo = NULL;
 }
 
-LLVMBasicBlockRef llvm_visit_block(Llvm *llvm, ScopeType scope_type, Block *block, LLVMBasicBlockRef llvm_block, LLVMBasicBlockRef llvm_exit_block, LlvmScopeInfo *llvm_scope_info)
+bool llvm_has_calls(Expression *expression)
 {
-    if (block->statements != NULL)
+    if (expression == NULL)
     {
-        llvm->scope = push_scope(llvm->scope, scope_type, llvm_scope_info, NULL, NULL);
-        llvm_visit(llvm, block->statements);
-        if (!llvm_scope_info->has_returned)
+        return false;
+    }
+    if (expression->node != NULL && expression->node->node_type == N_CALL)
+    {
+        return true;
+    }
+    return llvm_has_calls(expression->left) || llvm_has_calls(expression->right);
+}
+
+bool llvm_is_call_to(Expression *expression, char *name)
+{
+    return expression != NULL && expression->left == NULL && expression->right == NULL &&
+           expression->node != NULL && expression->node->node_type == N_CALL &&
+           strcmp(((Call *)expression->node->data)->name, name) == 0;
+}
+
+// Returns the call to `name` when expression is `name(...)`, or one of
+// `name(...) op x` and `x op name(...)` for op in + and * with no calls in
+// x, which then is stored in operand
+Call *llvm_find_tail_call(Expression *expression, char *name, Expression **operand)
+{
+    *operand = NULL;
+    if (llvm_is_call_to(expression, name))
+    {
+        return expression->node->data;
+    }
+    if (expression == NULL || expression->left == NULL || expression->right == NULL ||
+        (expression->token->token_type != T_ADD && expression->token->token_type != T_MUL))
+    {
+        return NULL;
+    }
+    if (llvm_is_call_to(expression->left, name) && !llvm_has_calls(expression->right))
+    {
+        *operand = expression->right;
+        return expression->left->node->data;
+    }
+    if (llvm_is_call_to(expression->right, name) && !llvm_has_calls(expression->left))
+    {
+        *operand = expression->left;
+        return expression->right->node->data;
+    }
+    return NULL;
+}
+
+// Counts the self tail calls among the returns of statements. accumulate
+// ends up as the operator of the accumulated ones, or T_EOF when there are
+// none or they mix operators.
+int llvm_scan_tail_calls(Node *statements, char *name, TokenType *accumulate, bool *mixed)
+{
+    int num_calls = 0;
+    for (Node *node = statements; node != NULL; node = node->next)
+    {
+        switch (node->node_type)
         {
-            if (llvm_scope_info->jump_to != NULL)
+        case N_RETURN:
+        {
+            Expression *expression = ((Return *)node->data)->expression;
+            Expression *operand;
+            if (llvm_find_tail_call(expression, name, &operand) == NULL)
             {
-                LLVMBuildBr(llvm->builder, llvm_scope_info->jump_to);
+                break;
             }
-            else if (llvm_exit_block != NULL)
+            num_calls++;
+            if (operand != NULL)
             {
-                LLVMBuildBr(llvm->builder, llvm_exit_block);
+                *mixed = *mixed || (*accumulate != T_EOF && *accumulate != expression->token->token_type);
+                *accumulate = expression->token->token_type;
+            }
+            break;
+        }
+        case N_IF:
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                num_calls += llvm_scan_tail_calls(if_->body->statements, name, accumulate, mixed);
             }
+            break;
+        case N_WHILE:
+            num_calls += llvm_scan_tail_calls(((While *)node->data)->body->statements, name, accumulate, mixed);
+            break;
+        case N_BLOCK:
+            num_calls += llvm_scan_tail_calls(((Block *)node->data)->statements, name, accumulate, mixed);
+            break;
+        default:
+            break;
         }
-        llvm->scope = pop_scope(llvm->scope);
     }
-    return llvm_block;
+    return num_calls;
+}
+
+// Moves the parameters of a self tail recursive function into stack slots
+// and opens the loop header the tail calls jump back to. mem2reg turns the
+// slots back into phis, so the recursion runs as a loop in constant stack
+// even at -O0 where LLVM's own tail call elimination does not run.
+void llvm_tail_enter(Llvm *llvm, Function *function, LLVMValueRef function_ref, LLVMTypeRef return_type)
+{
+    // Only a function calling itself has anything to turn into a loop
+    FunctionEffects *effects = llvm->effects != NULL ? find_function_effects(llvm->effects, function->name) : NULL;
+    if (effects != NULL && effects->self_calls == 0)
+    {
+        return;
+    }
+
+    TokenType accumulate = T_EOF;
+    bool mixed = false;
+    if (llvm_scan_tail_calls(function->body->statements, function->name, &accumulate, &mixed) == 0)
+    {
+        return;
+    }
+    // A slice or tensor argument may point at a header of the frame being
+    // replaced
+    for (Variable *param = function->params; param != NULL; param = param->next)
+    {
+        if (param->type_info->slice || param->type_info->tensor)
+        {
+            return;
+        }
+    }
+    // Reassociating float math would change results
+    if (mixed || LLVMGetTypeKind(return_type) != LLVMIntegerTypeKind)
+    {
+        accumulate = T_EOF;
+    }
+
+    LlvmTail *tail = malloc(sizeof(LlvmTail));
+    tail->name = function->name;
+    tail->num_params = LLVMCountParams(function_ref);
+    tail->params = calloc(tail->num_params, sizeof(LLVMValueRef));
+    tail->accumulate = accumulate;
+    tail->accumulator = NULL;
+
+    Variable *param = function->params;
+    for (int i = 0; i < tail->num_params; i++)
+    {
+        Symbol *symbol = lookup_symbol(llvm->scope, param->name);
+        LlvmSymbolInfo *llvm_symbol_info = symbol->info;
+        tail->params[i] = LLVMBuildAlloca(llvm->builder, llvm_symbol_info->type, param->name);
+        LLVMBuildStore(llvm->builder, llvm_symbol_info->value, tail->params[i]);
+        symbol->type = SYMBOL_VARIABLE;
+        llvm_symbol_info->value = tail->params[i];
+        param = param->next;
+    }
+    if (accumulate != T_EOF)
+    {
+        tail->accumulator = LLVMBuildAlloca(llvm->builder, return_type, "accumulator");
+        LLVMBuildStore(llvm->builder, LLVMConstInt(return_type, accumulate == T_MUL ? 1 : 0, 0), tail->accumulator);
+    }
+
+    tail->header = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "tail_recurse");
+    LLVMBuildBr(llvm->builder, tail->header);
+    LLVMPositionBuilderAtEnd(llvm->builder, tail->header);
+    llvm->tail = tail;
+}
+
+void llvm_tail_exit(Llvm *llvm)
+{
+    free(llvm->tail->params);
+    free(llvm->tail);
+    llvm->tail = NULL;
+}
+
+// A returned call can be marked `tail` unless an argument points into the
+// caller's frame
+bool llvm_is_tail_call(LLVMValueRef value)
+{
+    if (value == NULL || LLVMIsACallInst(value) == NULL)
+    {
+        return false;
+    }
+    for (int i = 0; i < LLVMGetNumArgOperands(value); i++)
+    {
+        if (LLVMGetTypeKind(LLVMTypeOf(LLVMGetOperand(value, i))) == LLVMPointerTypeKind)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+LLVMValueRef llvm_accumulate(Llvm *llvm, LLVMValueRef value)
+{
+    LlvmTail *tail = llvm->tail;
+    LLVMValueRef accumulator = LLVMBuildLoad2(llvm->builder, LLVMTypeOf(value), tail->accumulator, "accumulator");
+    if (tail->accumulate == T_MUL)
+    {
+        return LLVMBuildMul(llvm->builder, accumulator, value, "accumulate");
+    }
+    return LLVMBuildAdd(llvm->builder, accumulator, value, "accumulate");
+}
+
+// Emits `return name(...)` and its accumulated forms as a jump back to the
+// header, returns false for any other return
+bool llvm_visit_tail_call(Llvm *llvm, Expression *expression)
+{
+    LlvmTail *tail = llvm->tail;
+    Expression *operand;
+    Call *call = llvm_find_tail_call(expression, tail->name, &operand);
+    if (call == NULL || (operand != NULL && expression->token->token_type != tail->accumulate))
+    {
+        return false;
+    }
+
+    // All arguments are evaluated before any parameter is overwritten
+    LLVMValueRef *args = calloc(tail->num_params, sizeof(LLVMValueRef));
+    Expression *arg = call->expression;
+    for (int i = 0; i < tail->num_params; i++)
+    {
+        args[i] = llvm_visit_expression(llvm, arg);
+        arg = arg->next;
+    }
+    if (operand != NULL)
+    {
+        LLVMBuildStore(llvm->builder, llvm_accumulate(llvm, llvm_visit_expression(llvm, operand)), tail->accumulator);
+    }
+    for (int i = 0; i < tail->num_params; i++)
+    {
+        LLVMBuildStore(llvm->builder, args[i], tail->params[i]);
+    }
+    free(args);
+    LLVMBuildBr(llvm->builder, tail->header);
+    return true;
 }
 
 void llvm_visit_function(Llvm *llvm, Function *function)
 {
+    // Analyzed right before it is compiled, its body is still in the cache
+    // then and whatever it calls has been analyzed already
+    if (llvm->effects != NULL)
+    {
+        analyze_function_effects(llvm->effects, function);
+    }
 
     int num_args = 0;
     Variable *param = function->params;
@@ -371,33 +3197,149 @@ void llvm_visit_function(Llvm *llvm, Function *function)
     param = function->params;
     for (int i = 0; i < num_args; ++i)
     {
-        param_types[i] = get_llvm_type(llvm, param->type_info);
-        insert_symbol(llvm->scope, SYMBOL_ARG, param->name, new_llvm_symbol_info(param_types[i], NULL));
+        param_types[i] = llvm_param_type(llvm, param->type_info);
         param = param->next;
     }
 
     LLVMTypeRef type = LLVMFunctionType(get_llvm_type(llvm, function->type_info), param_types, num_args, 0);
     LLVMValueRef value = LLVMAddFunction(llvm->module, function->name, type);
+    llvm_set_visibility(value, is_exported(function->name, function->exported));
+    llvm_add_effect_attributes(llvm, value, function->name);
     free(param_types);
 
     insert_symbol(llvm->scope, SYMBOL_FUNCTION, function->name, new_llvm_symbol_info(type, value));
 
+    if (llvm->di_builder != NULL)
+    {
+        // Line tables only need the subprogram itself, full debug info
+        // also describes the signature as return type followed by params
+        int num_di_types = 0;
+        LLVMMetadataRef *di_types = calloc(num_args + 1, sizeof(LLVMMetadataRef));
+        if (llvm->options->debug_info == DEBUG_INFO_FULL)
+        {
+            di_types[num_di_types++] = get_llvm_debug_type(llvm, function->type_info);
+            for (param = function->params; param != NULL; param = param->next)
+            {
+                di_types[num_di_types++] = llvm_debug_param_type(llvm, param->type_info);
+            }
+        }
+        LLVMMetadataRef subroutine_type = LLVMDIBuilderCreateSubroutineType(llvm->di_builder, llvm->di_file, di_types, num_di_types, LLVMDIFlagZero);
+        free(di_types);
+        llvm->di_scope = LLVMDIBuilderCreateFunction(llvm->di_builder, llvm->di_file,
+                                                     function->name, strlen(function->name),
+                                                     function->name, strlen(function->name),
+                                                     llvm->di_file, llvm->line, subroutine_type,
+                                                     !is_exported(function->name, function->exported), true, llvm->line, LLVMDIFlagZero,
+                                                     llvm->options->opt_level > 0);
+        LLVMSetSubprogram(value, llvm->di_scope);
+        llvm_set_location(llvm, llvm->line, llvm->col);
+    }
+
     LLVMBasicBlockRef entry_block = LLVMAppendBasicBlockInContext(llvm->context, value, "entry");
     LLVMPositionBuilderAtEnd(llvm->builder, entry_block);
     LlvmScopeInfo *llvm_scope_info = new_llvm_scope_info(value, NULL, NULL);
 
-    // Update the values in the LlvmSymbolInfo for each parameter
+    if (llvm->options->instrument)
+    {
+        LLVMValueRef name = LLVMBuildGlobalStringPtr(llvm->builder, function->name, "profile_name");
+        llvm_call_runtime(llvm, "tron_profile_enter", &name, 1);
+    }
+
+    if (llvm->profile != NULL)
+    {
+        profile_begin_function(llvm->profile, function->name);
+    }
+    uint64_t entry_count;
+    if (llvm_profile_site(llvm, "entry", NULL, &entry_count))
+    {
+        LLVMValueRef count = LLVMConstInt(LLVMInt64TypeInContext(llvm->context), entry_count, 0);
+        LLVMGlobalSetMetadata(value, LLVMGetMDKindIDInContext(llvm->context, "prof", 4),
+                              llvm_profile_node(llvm, "function_entry_count", &count, 1));
+        if (entry_count == 0)
+        {
+            // Never reached in the training run, optimize for size and keep
+            // it out of the hot text
+            LLVMAddAttributeAtIndex(value, LLVMAttributeFunctionIndex,
+                                    LLVMCreateEnumAttribute(llvm->context, LLVMGetEnumAttributeKindForName("cold", 4), 0));
+        }
+    }
+
+    // Parameters live in the scope of the body, as they do in the parser,
+    // so that they neither leak into the globals nor clash with the
+    // parameters of other functions
+    llvm->scope = push_scope(llvm->scope, SCOPE_FUNCTION, llvm_scope_info, NULL, NULL);
     param = function->params;
     for (int i = 0; i < num_args; ++i)
     {
         LLVMValueRef arg_value = LLVMGetParam(value, i);
-        Symbol *symbol = lookup_symbol(llvm->scope, param->name);
-        LlvmSymbolInfo *llvm_symbol_info = symbol->info;
-        llvm_symbol_info->value = arg_value;
+        if (param->type_info->slice || param->type_info->tensor)
+        {
+            // Slice and tensor parameters are used like the headers of
+            // local ones
+            llvm_add_param_attribute(llvm, value, i, "nocapture");
+            llvm_add_param_attribute(llvm, value, i, "nonnull");
+            LlvmSymbolInfo *llvm_symbol_info = new_llvm_symbol_info(get_llvm_type(llvm, param->type_info), arg_value);
+            insert_symbol(llvm->scope, SYMBOL_ARG, param->name, llvm_symbol_info);
+            if (param->type_info->tensor)
+            {
+                llvm_symbol_info->type_info = param->type_info;
+            }
+        }
+        else
+        {
+            insert_symbol(llvm->scope, SYMBOL_ARG, param->name, new_llvm_symbol_info(LLVMTypeOf(arg_value), arg_value));
+        }
+        if (llvm_has_debug_variables(llvm))
+        {
+            LLVMMetadataRef di_variable = LLVMDIBuilderCreateParameterVariable(llvm->di_builder, llvm->di_scope,
+                                                                               param->name, strlen(param->name), i + 1,
+                                                                               llvm->di_file, llvm->line,
+                                                                               llvm_debug_param_type(llvm, param->type_info),
+                                                                               true, LLVMDIFlagZero);
+            LLVMDIBuilderInsertDbgValueAtEnd(llvm->di_builder, arg_value, di_variable,
+                                             LLVMDIBuilderCreateExpression(llvm->di_builder, NULL, 0),
+                                             llvm_debug_location(llvm), entry_block);
+        }
         param = param->next;
     }
+    // Once the parameters are declared, checking them branches away from
+    // the entry block
+    param = function->params;
+    for (int i = 0; i < num_args; ++i, param = param->next)
+    {
+        if (param->type_info->tensor)
+        {
+            llvm_check_tensor_param(llvm, LLVMGetParam(value, i), param->type_info);
+        }
+    }
+
+    FunctionEffects *effects = llvm->effects != NULL ? find_function_effects(llvm->effects, function->name) : NULL;
+    bool memoized = effects != NULL && effects->memoized;
+    // Every call of a memoized function has to go through its cache
+    if (memoized)
+    {
+        llvm_memo_enter(llvm, function, value, get_llvm_type(llvm, function->type_info));
+    }
+    else
+    {
+        llvm_tail_enter(llvm, function, value, get_llvm_type(llvm, function->type_info));
+    }
 
     llvm_visit_block(llvm, SCOPE_FUNCTION, function->body, entry_block, NULL, llvm_scope_info);
+    llvm_release_local_slices(llvm, value);
+
+    if (memoized)
+    {
+        llvm_memo_exit(llvm, get_llvm_type(llvm, function->type_info));
+    }
+    if (llvm->tail != NULL)
+    {
+        llvm_tail_exit(llvm);
+    }
+    llvm->scope = pop_scope(llvm->scope);
+
+    llvm->di_scope = NULL;
+    LLVMSetCurrentDebugLocation2(llvm->builder, NULL);
 }
 
 void llvm_visit_if(Llvm *llvm, If *if_)
@@ -416,6 +3358,11 @@ void llvm_visit_if(Llvm *llvm, If *if_)
         if_exit = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "if_exit");
     }
 
+    // Executions of the chain not yet claimed by a previous arm, the weights
+    // of each condition split what is left between its arm and the rest
+    uint64_t remaining;
+    bool has_profile = llvm_profile_site(llvm, "if", if_->condition, &remaining);
+
     LLVMBasicBlockRef if_check = LLVMInsertBasicBlockInContext(llvm->context, if_exit, "if_check");
     LLVMBuildBr(llvm->builder, if_check);
 
@@ -425,17 +3372,18 @@ void llvm_visit_if(Llvm *llvm, If *if_)
 
         LLVMBasicBlockRef if_body = LLVMInsertBasicBlockInContext(llvm->context, if_exit, "if_body");
 
+        LLVMValueRef branch = NULL;
         if (if_->condition)
         {
             LLVMValueRef cond_value = llvm_visit_expression(llvm, if_->condition);
             if (if_->next)
             {
                 if_check = LLVMInsertBasicBlockInContext(llvm->context, if_exit, "if_check");
-                LLVMBuildCondBr(llvm->builder, cond_value, if_body, if_check);
+                branch = LLVMBuildCondBr(llvm->builder, cond_value, if_body, if_check);
             }
             else
             {
-                LLVMBuildCondBr(llvm->builder, cond_value, if_body, if_exit);
+                branch = LLVMBuildCondBr(llvm->builder, cond_value, if_body, if_exit);
             }
         }
         else
@@ -445,6 +3393,14 @@ void llvm_visit_if(Llvm *llvm, If *if_)
 
         LLVMPositionBuilderAtEnd(llvm->builder, if_body);
 
+        uint64_t taken;
+        if (llvm_profile_site(llvm, branch != NULL ? "arm" : "else", if_->condition, &taken) && has_profile && branch != NULL)
+        {
+            taken = taken < remaining ? taken : remaining;
+            llvm_set_branch_weights(llvm, branch, taken, remaining - taken);
+            remaining -= taken;
+        }
+
         LlvmScopeInfo *llvm_scope_info = new_llvm_scope_info(NULL, NULL, NULL);
         llvm_visit_block(llvm, SCOPE_IF, if_->body, if_body, if_exit, llvm_scope_info);
 
@@ -468,48 +3424,195 @@ void llvm_visit_continue(Llvm *llvm, Continue *continue_)
     llvm_scope_info->jump_to = enclosing_llvm_scope_info->continue_block;
 }
 
-void llvm_visit_while(Llvm *llvm, While *while_)
+void llvm_build_while(Llvm *llvm, While *while_)
 {
     LLVMBasicBlockRef current_block = LLVMGetInsertBlock(llvm->builder);
     LLVMValueRef function_ref = LLVMGetBasicBlockParent(current_block);
     LLVMBasicBlockRef next_block = LLVMGetNextBasicBlock(current_block);
 
-    LLVMBasicBlockRef while_exit;
-    if (next_block != NULL)
+    LLVMBasicBlockRef while_exit;
+    if (next_block != NULL)
+    {
+        while_exit = LLVMInsertBasicBlockInContext(llvm->context, next_block, "while_exit");
+    }
+    else
+    {
+        while_exit = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "while_exit");
+    }
+
+    LLVMBasicBlockRef while_check = LLVMInsertBasicBlockInContext(llvm->context, while_exit, "while_check");
+    LLVMBasicBlockRef while_body = LLVMInsertBasicBlockInContext(llvm->context, while_exit, "while_body");
+
+    LLVMPositionBuilderAtEnd(llvm->builder, current_block);
+
+    // Trip counter for --instrument, reported when the loop is left
+    // normally or through break
+    LLVMTypeRef trips_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMValueRef trips = NULL;
+    char site[MAX_BUFFER_SIZE];
+    if (llvm->options->instrument)
+    {
+        snprintf(site, sizeof(site), "%s:%d", LLVMGetValueName(function_ref), llvm->line);
+        trips = llvm_build_entry_alloca(llvm, trips_type, "trips");
+        LLVMBuildStore(llvm->builder, LLVMConstInt(trips_type, 0, 0), trips);
+    }
+
+    uint64_t entries;
+    bool has_profile = llvm_profile_site(llvm, "loop", while_->condition, &entries);
+
+    LLVMBuildBr(llvm->builder, while_check);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, while_check);
+    LLVMValueRef cond_value = llvm_visit_expression(llvm, while_->condition);
+    LLVMValueRef branch = LLVMBuildCondBr(llvm->builder, cond_value, while_body, while_exit);
+
+    LLVMPositionBuilderAtEnd(llvm->builder, while_body);
+
+    // Each entry into the loop leaves through the condition at most once
+    uint64_t iterations;
+    if (llvm_profile_site(llvm, "body", while_->condition, &iterations) && has_profile)
+    {
+        llvm_set_branch_weights(llvm, branch, iterations, entries);
+    }
+    if (trips != NULL)
+    {
+        LLVMValueRef count = LLVMBuildLoad2(llvm->builder, trips_type, trips, "trips");
+        LLVMBuildStore(llvm->builder, LLVMBuildAdd(llvm->builder, count, LLVMConstInt(trips_type, 1, 0), "trips"), trips);
+    }
+    LlvmScopeInfo *llvm_scope_info = new_llvm_scope_info(NULL, while_exit, while_check);
+    llvm_visit_block(llvm, SCOPE_WHILE, while_->body, while_body, while_check, llvm_scope_info);
+    LLVMPositionBuilderAtEnd(llvm->builder, while_exit);
+
+    if (trips != NULL)
+    {
+        LLVMValueRef args[2];
+        args[0] = LLVMBuildGlobalStringPtr(llvm->builder, site, "profile_site");
+        args[1] = LLVMBuildLoad2(llvm->builder, trips_type, trips, "trips");
+        llvm_call_runtime(llvm, "tron_profile_loop", args, 2);
+    }
+}
+
+// Tests the facts of a loop on entry, true when every index they cover is
+// in bounds for the whole loop
+LLVMValueRef llvm_build_bounds_facts(Llvm *llvm, BoundsLoop *loop)
+{
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMValueRef start = loop->induction != NULL ? llvm_visit_index(llvm, loop->induction) : NULL;
+    LLVMValueRef limit = loop->limit != NULL ? llvm_visit_index(llvm, loop->limit) : NULL;
+    LLVMValueRef holds = LLVMConstInt(LLVMInt1TypeInContext(llvm->context), 1, 0);
+    for (BoundsFact *fact = loop->facts; fact != NULL; fact = fact->next)
+    {
+        LLVMValueRef length = LLVMConstInt(i64_type, fact->size, 0);
+        if (fact->array != NULL)
+        {
+            LlvmSymbolInfo *llvm_symbol_info = lookup_symbol(llvm->scope, fact->array)->info;
+            LLVMValueRef field = LLVMBuildStructGEP2(llvm->builder, llvm_symbol_info->type, llvm_symbol_info->value, 1, "");
+            length = LLVMBuildLoad2(llvm->builder, i64_type, field, "length");
+            llvm_set_tbaa(llvm, length, "slice header");
+        }
+        LLVMValueRef fact_holds;
+        switch (fact->kind)
+        {
+        case BOUNDS_LOW:
+            fact_holds = LLVMBuildICmp(llvm->builder, LLVMIntSGE, start, LLVMConstInt(i64_type, -fact->offset, 1), "low");
+            break;
+        case BOUNDS_HIGH:
+            length = LLVMBuildNSWSub(llvm->builder, length, LLVMConstInt(i64_type, fact->offset, 1), "");
+            fact_holds = LLVMBuildICmp(llvm->builder, LLVMIntSLE, limit, length, "high");
+            break;
+        default:
+            fact_holds = LLVMBuildICmp(llvm->builder, LLVMIntULT, llvm_visit_index(llvm, fact->index), length, "index");
+            break;
+        }
+        holds = LLVMBuildAnd(llvm->builder, holds, fact_holds, "in_bounds");
+    }
+    return holds;
+}
+
+// Innermost loops whose indexes are proven in bounds are compiled without
+// their checks. When that takes tests on entry, the loop is compiled twice
+// and the tests pick the copy to run, the checked one only runs when an
+// index may really be out of bounds.
+void llvm_visit_while(Llvm *llvm, While *while_)
+{
+    BoundsLoop *loop = find_bounds_loop(llvm->bounds, while_);
+    // Profile counters are registered once per site
+    if (loop == NULL || (loop->facts != NULL && llvm->options->profile_generate))
     {
-        while_exit = LLVMInsertBasicBlockInContext(llvm->context, next_block, "while_exit");
+        llvm_build_while(llvm, while_);
+        return;
     }
-    else
+    if (loop->facts == NULL)
     {
-        while_exit = LLVMAppendBasicBlockInContext(llvm->context, function_ref, "while_exit");
+        llvm->unchecked_loop = loop;
+        llvm_build_while(llvm, while_);
+        llvm->unchecked_loop = NULL;
+        return;
     }
 
-    LLVMBasicBlockRef while_check = LLVMInsertBasicBlockInContext(llvm->context, while_exit, "while_check");
-    LLVMBasicBlockRef while_body = LLVMInsertBasicBlockInContext(llvm->context, while_exit, "while_body");
+    LLVMBasicBlockRef current_block = LLVMGetInsertBlock(llvm->builder);
+    LLVMValueRef function_ref = LLVMGetBasicBlockParent(current_block);
+    LLVMBasicBlockRef next_block = LLVMGetNextBasicBlock(current_block);
+    LLVMBasicBlockRef join_block = next_block != NULL ? LLVMInsertBasicBlockInContext(llvm->context, next_block, "bounds_join")
+                                                      : LLVMAppendBasicBlockInContext(llvm->context, function_ref, "bounds_join");
+    LLVMBasicBlockRef unchecked_block = LLVMInsertBasicBlockInContext(llvm->context, join_block, "unchecked");
+    LLVMBasicBlockRef checked_block = LLVMInsertBasicBlockInContext(llvm->context, join_block, "checked");
+    LLVMValueRef holds = llvm_build_bounds_facts(llvm, loop);
+    llvm_set_branch_weights(llvm, LLVMBuildCondBr(llvm->builder, holds, unchecked_block, checked_block), 1000, 1);
 
-    LLVMPositionBuilderAtEnd(llvm->builder, current_block);
-    LLVMBuildBr(llvm->builder, while_check);
+    LLVMPositionBuilderAtEnd(llvm->builder, unchecked_block);
+    llvm->unchecked_loop = loop;
+    llvm_build_while(llvm, while_);
+    llvm->unchecked_loop = NULL;
+    LLVMBuildBr(llvm->builder, join_block);
 
-    LLVMPositionBuilderAtEnd(llvm->builder, while_check);
-    LLVMValueRef cond_value = llvm_visit_expression(llvm, while_->condition);
-    LLVMBuildCondBr(llvm->builder, cond_value, while_body, while_exit);
+    LLVMPositionBuilderAtEnd(llvm->builder, checked_block);
+    llvm_build_while(llvm, while_);
+    LLVMBuildBr(llvm->builder, join_block);
 
-    LLVMPositionBuilderAtEnd(llvm->builder, while_body);
-    LlvmScopeInfo *llvm_scope_info = new_llvm_scope_info(NULL, while_exit, while_check);
-    llvm_visit_block(llvm, SCOPE_WHILE, while_->body, while_body, while_check, llvm_scope_info);
-    LLVMPositionBuilderAtEnd(llvm->builder, while_exit);
+    LLVMPositionBuilderAtEnd(llvm->builder, join_block);
 }
 
 void llvm_visit_return(Llvm *llvm, Return *return_)
 {
-    LLVMValueRef ret_value = llvm_visit_expression(llvm, return_->expression);
-    LLVMBuildRet(llvm->builder, ret_value);
     LlvmScopeInfo *llvm_scope_info = llvm->scope->info;
     llvm_scope_info->has_returned = true;
+    if (llvm->tail != NULL && llvm_visit_tail_call(llvm, return_->expression))
+    {
+        return;
+    }
+
+    LLVMValueRef ret_value = llvm_visit_expression(llvm, return_->expression);
+    if (llvm->tail != NULL && llvm->tail->accumulator != NULL)
+    {
+        ret_value = llvm_accumulate(llvm, ret_value);
+    }
+    else if (llvm->memo == NULL && llvm_is_tail_call(ret_value))
+    {
+        // Calls to other functions in tail position, mutual recursion
+        // included, reuse the caller's frame when the backend can
+        LLVMSetTailCall(ret_value, 1);
+    }
+
+    if (llvm->memo != NULL)
+    {
+        // Memoized functions return through the cache store
+        LLVMBuildStore(llvm->builder, ret_value, llvm->memo->result);
+        LLVMBuildBr(llvm->builder, llvm->memo->exit);
+    }
+    else
+    {
+        if (llvm->options->instrument)
+        {
+            llvm_call_runtime(llvm, "tron_profile_exit", NULL, 0);
+        }
+        LLVMBuildRet(llvm->builder, ret_value);
+    }
 }
 
 void llvm_visit_statement(Llvm *llvm, Node *node)
 {
+    llvm_set_location(llvm, node->line, node->col);
     switch (node->node_type)
     {
     case N_VARIABLE:
@@ -546,6 +3649,17 @@ void llvm_visit_statement(Llvm *llvm, Node *node)
     }
 }
 
+void llvm_analyze(Llvm *llvm, Node *ast)
+{
+    llvm->effects = new_effects(ast, llvm->options);
+    if (!llvm->options->unchecked)
+    {
+        llvm->bounds = analyze_bounds(ast, llvm->options->overflow == OVERFLOW_TRAP);
+    }
+    llvm->eval = new_eval(ast, llvm->options->const_eval_steps, llvm_eval_lookup, llvm);
+    llvm->eval->wrap = llvm->options->overflow == OVERFLOW_WRAP;
+}
+
 void llvm_visit(Llvm *llvm, Node *node)
 {
     Node *current = node;
@@ -560,25 +3674,223 @@ void llvm_visit(Llvm *llvm, Node *node)
     }
 }
 
-Llvm *new_llvm()
+void llvm_init_debug_info(Llvm *llvm, LLVMDWARFEmissionKind emission_kind)
+{
+    char *path = llvm->options->input != NULL ? llvm->options->input : "<stdin>";
+    char directory[PATH_MAX];
+    if (getcwd(directory, sizeof(directory)) == NULL)
+    {
+        strcpy(directory, ".");
+    }
+
+    llvm->di_builder = LLVMCreateDIBuilder(llvm->module);
+    llvm->di_file = LLVMDIBuilderCreateFile(llvm->di_builder, path, strlen(path), directory, strlen(directory));
+    llvm->di_compile_unit = LLVMDIBuilderCreateCompileUnit(llvm->di_builder, LLVMDWARFSourceLanguageC, llvm->di_file,
+                                                           "tron", 4, llvm->options->opt_level > 0, "", 0, 0, "", 0,
+                                                           emission_kind, 0, false, false, "", 0, "", 0);
+
+    LLVMTypeRef int_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMAddModuleFlag(llvm->module, LLVMModuleFlagBehaviorWarning, "Debug Info Version", 18,
+                      LLVMValueAsMetadata(LLVMConstInt(int_type, LLVMDebugMetadataVersion(), 0)));
+    LLVMAddModuleFlag(llvm->module, LLVMModuleFlagBehaviorWarning, "Dwarf Version", 13,
+                      LLVMValueAsMetadata(LLVMConstInt(int_type, 4, 0)));
+}
+
+void llvm_declare_builtin(Llvm *llvm, char *name, LLVMTypeRef return_type, LLVMTypeRef *param_types, int num_params)
+{
+    LLVMTypeRef type = LLVMFunctionType(return_type, param_types, num_params, 0);
+    LLVMValueRef value = LLVMAddFunction(llvm->module, name, type);
+    insert_symbol(llvm->scope, SYMBOL_FUNCTION, name, new_llvm_symbol_info(type, value));
+}
+
+// Attaches the profile summary that lets hot/cold decisions (inlining
+// thresholds, block placement, .text.hot/.text.unlikely sections) use the
+// counts
+void llvm_add_profile_summary(Llvm *llvm)
+{
+    Profile *profile = llvm->profile;
+    int cutoffs[] = {10000, 100000, 200000, 300000, 400000, 500000, 600000, 700000, 800000,
+                     900000, 950000, 990000, 999000, 999900, 999990, 999999};
+    int num_cutoffs = sizeof(cutoffs) / sizeof(cutoffs[0]);
+
+    LLVMTypeRef i32_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMMetadataRef *detailed = malloc(num_cutoffs * sizeof(LLVMMetadataRef));
+    for (int i = 0; i < num_cutoffs; i++)
+    {
+        uint64_t min_count;
+        int num_counts;
+        profile_cutoff(profile, cutoffs[i], &min_count, &num_counts);
+        LLVMMetadataRef entry[3] = {LLVMValueAsMetadata(LLVMConstInt(i32_type, cutoffs[i], 0)),
+                                    LLVMValueAsMetadata(LLVMConstInt(i64_type, min_count, 0)),
+                                    LLVMValueAsMetadata(LLVMConstInt(i32_type, num_counts, 0))};
+        detailed[i] = LLVMMDNodeInContext2(llvm->context, entry, 3);
+    }
+
+    LLVMValueRef values[6] = {LLVMConstInt(i64_type, profile_total_count(profile), 0),
+                              LLVMConstInt(i64_type, profile->max_function_count > profile->max_internal_count ? profile->max_function_count : profile->max_internal_count, 0),
+                              LLVMConstInt(i64_type, profile->max_internal_count, 0),
+                              LLVMConstInt(i64_type, profile->max_function_count, 0),
+                              LLVMConstInt(i64_type, profile->num_counts, 0),
+                              LLVMConstInt(i64_type, profile->num_functions, 0)};
+    char *names[6] = {"TotalCount", "MaxCount", "MaxInternalCount", "MaxFunctionCount", "NumCounts", "NumFunctions"};
+
+    LLVMMetadataRef fields[8];
+    LLVMMetadataRef format[2] = {LLVMMDStringInContext2(llvm->context, "ProfileFormat", 13),
+                                 LLVMMDStringInContext2(llvm->context, "InstrProf", 9)};
+    fields[0] = LLVMMDNodeInContext2(llvm->context, format, 2);
+    for (int i = 0; i < 6; i++)
+    {
+        fields[i + 1] = llvm_profile_node(llvm, names[i], &values[i], 1);
+    }
+    LLVMMetadataRef summary[2] = {LLVMMDStringInContext2(llvm->context, "DetailedSummary", 15),
+                                  LLVMMDNodeInContext2(llvm->context, detailed, num_cutoffs)};
+    fields[7] = LLVMMDNodeInContext2(llvm->context, summary, 2);
+    free(detailed);
+
+    LLVMAddModuleFlag(llvm->module, LLVMModuleFlagBehaviorError, "ProfileSummary", 14,
+                      LLVMMDNodeInContext2(llvm->context, fields, 8));
+}
+
+Llvm *new_llvm(Options *options)
 {
     Llvm *llvm = malloc(sizeof(Llvm));
+    llvm->options = options;
+    llvm->target_machine = NULL;
+    llvm->di_builder = NULL;
+    llvm->di_file = NULL;
+    llvm->di_compile_unit = NULL;
+    llvm->di_scope = NULL;
+    llvm->remarks_out = NULL;
+    llvm->remarks = NULL;
+    llvm->profile = NULL;
+    llvm->profile_init = NULL;
+    llvm->effects = NULL;
+    llvm->bounds = NULL;
+    llvm->unchecked_loop = NULL;
+    llvm->eval = NULL;
+    llvm->memo = NULL;
+    llvm->tail = NULL;
+    llvm->local_slices = NULL;
+    llvm->line = 0;
+    llvm->col = 0;
     llvm->context = LLVMContextCreate();
     // LLVMContextSetOpaquePointers(llvm->context, 0);
+    // Names of instructions and blocks only help whoever reads the IR or
+    // the remarks, an object file has no use for them. Textual IR given to
+    // --lto can not be parsed into a context that discards them, and
+    // discarding them once values are named corrupts the symbol tables.
+    LLVMContextSetDiscardValueNames(llvm->context, strcmp(options->emit, "obj") == 0 && options->remarks == NULL &&
+                                                       options->lto == NULL);
     llvm->module = LLVMModuleCreateWithNameInContext("default", llvm->context);
     llvm->builder = LLVMCreateBuilderInContext(llvm->context);
 
+    if (options->debug_info == DEBUG_INFO_FULL)
+    {
+        llvm_init_debug_info(llvm, LLVMDWARFEmissionFull);
+    }
+    else if (options->debug_info == DEBUG_INFO_LINE_TABLES)
+    {
+        llvm_init_debug_info(llvm, LLVMDWARFEmissionLineTablesOnly);
+    }
+    else if (options->remarks != NULL)
+    {
+        // Remarks are mapped back to source through debug locations, track
+        // them without emitting any debug info into the object file.
+        llvm_init_debug_info(llvm, LLVMDWARFEmissionNone);
+    }
+
     LlvmScopeInfo *llvm_scope_info = new_llvm_scope_info(NULL, NULL, NULL);
     llvm->scope = push_scope(NULL, SCOPE_ROOT, llvm_scope_info, (void (*)(void *))dispose_llvm_scope_info, (void (*)(void *))dispose_llvm_symbol_info);
 
-    LLVMTypeRef param_types[] = {LLVMInt32TypeInContext(llvm->context)};
-    LLVMTypeRef type = LLVMFunctionType(LLVMInt32TypeInContext(llvm->context), param_types, 1, 0);
-    LLVMValueRef value = LLVMAddFunction(llvm->module, "print_int", type);
-    insert_symbol(llvm->scope, SYMBOL_FUNCTION, "print_int", new_llvm_symbol_info(type, value));
+    // Builtins match their corelib definitions so that they can be linked
+    // in as bitcode with --lto
+    LLVMTypeRef void_type = LLVMVoidTypeInContext(llvm->context);
+    LLVMTypeRef int_type = LLVMInt32TypeInContext(llvm->context);
+    LLVMTypeRef float_type = LLVMFloatTypeInContext(llvm->context);
+    llvm_declare_builtin(llvm, "print_int", void_type, &int_type, 1);
+    llvm_declare_builtin(llvm, "print_float", void_type, &float_type, 1);
+
+    if (options->overflow == OVERFLOW_TRAP)
+    {
+        LLVMTypeRef location_params[2] = {int_type, int_type};
+        LLVMValueRef overflow = LLVMAddFunction(llvm->module, "tron_overflow", LLVMFunctionType(void_type, location_params, 2, 0));
+        llvm_add_function_attribute(llvm, overflow, "noreturn");
+        llvm_add_function_attribute(llvm, overflow, "cold");
+        llvm_add_function_attribute(llvm, overflow, "nounwind");
+    }
+    if (!options->unchecked)
+    {
+        LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+        LLVMTypeRef bounds_params[4] = {int_type, int_type, i64_type, i64_type};
+        LLVMValueRef bounds = LLVMAddFunction(llvm->module, "tron_bounds", LLVMFunctionType(void_type, bounds_params, 4, 0));
+        llvm_add_function_attribute(llvm, bounds, "noreturn");
+        llvm_add_function_attribute(llvm, bounds, "cold");
+        llvm_add_function_attribute(llvm, bounds, "nounwind");
+    }
+    LLVMTypeRef i64_type = LLVMInt64TypeInContext(llvm->context);
+    LLVMTypeRef shape_params[5] = {int_type, int_type, int_type, i64_type, i64_type};
+    LLVMValueRef shape = LLVMAddFunction(llvm->module, "tron_shape", LLVMFunctionType(void_type, shape_params, 5, 0));
+    llvm_add_function_attribute(llvm, shape, "noreturn");
+    llvm_add_function_attribute(llvm, shape, "cold");
+    llvm_add_function_attribute(llvm, shape, "nounwind");
+
+    if (options->profile_generate)
+    {
+        LLVMTypeRef void_type = LLVMVoidTypeInContext(llvm->context);
+        LLVMTypeRef string_type = LLVMPointerType(LLVMInt8TypeInContext(llvm->context), 0);
+        LLVMTypeRef register_params[3] = {string_type, string_type, LLVMPointerType(LLVMInt64TypeInContext(llvm->context), 0)};
+        LLVMAddFunction(llvm->module, "tron_pgo_register", LLVMFunctionType(void_type, register_params, 3, 0));
+
+        // Counters are registered from a constructor completed in llvm_finalize
+        llvm->profile_init = LLVMAddFunction(llvm->module, "tron_pgo_init", LLVMFunctionType(void_type, NULL, 0, 0));
+        LLVMSetLinkage(llvm->profile_init, LLVMInternalLinkage);
+        LLVMAppendBasicBlockInContext(llvm->context, llvm->profile_init, "entry");
+    }
+    else if (options->profile_use != NULL)
+    {
+        llvm->profile = load_profile(options->profile_use);
+        llvm_add_profile_summary(llvm);
+    }
+
+    if (options->instrument)
+    {
+        // Runtime hooks live in corelib and are not visible to Tron code
+        LLVMTypeRef void_type = LLVMVoidTypeInContext(llvm->context);
+        LLVMTypeRef loop_params[2] = {LLVMPointerType(LLVMInt8TypeInContext(llvm->context), 0), LLVMInt64TypeInContext(llvm->context)};
+        LLVMAddFunction(llvm->module, "tron_profile_enter", LLVMFunctionType(void_type, loop_params, 1, 0));
+        LLVMAddFunction(llvm->module, "tron_profile_exit", LLVMFunctionType(void_type, NULL, 0, 0));
+        LLVMAddFunction(llvm->module, "tron_profile_loop", LLVMFunctionType(void_type, loop_params, 2, 0));
+    }
 
     return llvm;
 }
 
+void llvm_finalize(Llvm *llvm)
+{
+    if (llvm->profile_init != NULL)
+    {
+        LLVMPositionBuilderAtEnd(llvm->builder, LLVMGetEntryBasicBlock(llvm->profile_init));
+        LLVMBuildRetVoid(llvm->builder);
+
+        // @llvm.global_ctors = appending global [1 x { i32, void ()*, i8* }]
+        LLVMTypeRef fields[3] = {LLVMInt32TypeInContext(llvm->context),
+                                 LLVMPointerType(LLVMGlobalGetValueType(llvm->profile_init), 0),
+                                 LLVMPointerType(LLVMInt8TypeInContext(llvm->context), 0)};
+        LLVMTypeRef ctor_type = LLVMStructTypeInContext(llvm->context, fields, 3, 0);
+        LLVMValueRef values[3] = {LLVMConstInt(fields[0], 65535, 0), llvm->profile_init, LLVMConstNull(fields[2])};
+        LLVMValueRef ctor = LLVMConstNamedStruct(ctor_type, values, 3);
+        LLVMValueRef ctors = LLVMAddGlobal(llvm->module, LLVMArrayType(ctor_type, 1), "llvm.global_ctors");
+        LLVMSetInitializer(ctors, LLVMConstArray(ctor_type, &ctor, 1));
+        LLVMSetLinkage(ctors, LLVMAppendingLinkage);
+    }
+
+    if (llvm->di_builder != NULL)
+    {
+        LLVMDIBuilderFinalize(llvm->di_builder);
+    }
+}
+
 void llvm_dump(Llvm *llvm, FILE *out)
 {
     LLVMDumpModule(llvm->module);
@@ -586,6 +3898,31 @@ void llvm_dump(Llvm *llvm, FILE *out)
 
 void dispose_llvm(Llvm *llvm)
 {
+    if (llvm->target_machine != NULL)
+    {
+        LLVMDisposeTargetMachine(llvm->target_machine);
+    }
+    if (llvm->di_builder != NULL)
+    {
+        LLVMDisposeDIBuilder(llvm->di_builder);
+    }
+    if (llvm->profile != NULL)
+    {
+        dispose_profile(llvm->profile);
+    }
+    if (llvm->effects != NULL)
+    {
+        dispose_effects(llvm->effects);
+    }
+    dispose_bounds(llvm->bounds);
+    if (llvm->eval != NULL)
+    {
+        dispose_eval(llvm->eval);
+    }
+    if (llvm->remarks_out != NULL && llvm->remarks_out != stderr)
+    {
+        fclose(llvm->remarks_out);
+    }
     LLVMDisposeBuilder(llvm->builder);
     LLVMDisposeModule(llvm->module);
     LLVMContextDispose(llvm->context);
@@ -593,8 +3930,13 @@ void dispose_llvm(Llvm *llvm)
     free(llvm);
 }
 
-void llvm_compile(Llvm *llvm, char *output)
+LLVMTargetMachineRef llvm_target_machine(Llvm *llvm)
 {
+    if (llvm->target_machine != NULL)
+    {
+        return llvm->target_machine;
+    }
+
     LLVMInitializeAllTargetInfos();
     LLVMInitializeAllTargets();
     LLVMInitializeAllTargetMCs();
@@ -602,26 +3944,399 @@ void llvm_compile(Llvm *llvm, char *output)
 
     char *err;
     LLVMTargetRef target;
-    LLVMTargetMachineRef target_machine;
+    char *triple = LLVMGetDefaultTargetTriple();
 
-    if (LLVMGetTargetFromTriple(LLVMGetDefaultTargetTriple(), &target, &err) != 0)
+    if (LLVMGetTargetFromTriple(triple, &target, &err) != 0)
     {
         fatal("Could not get target information");
     }
 
-    target_machine = LLVMCreateTargetMachine(target, LLVMGetDefaultTargetTriple(),
-                                             "", "", LLVMCodeGenLevelDefault,
-                                             LLVMRelocDefault, LLVMCodeModelDefault);
-    if (!target_machine)
+    // FMA and wider vectors are only used when the CPU is named, the
+    // default generic CPU runs anywhere
+    char *cpu = "";
+    char *features = "";
+    bool native = llvm->options->cpu != NULL && strcmp(llvm->options->cpu, "native") == 0;
+    if (native)
+    {
+        cpu = LLVMGetHostCPUName();
+        features = LLVMGetHostCPUFeatures();
+    }
+    else if (llvm->options->cpu != NULL)
+    {
+        cpu = llvm->options->cpu;
+    }
+
+    LLVMCodeGenOptLevel codegen_levels[] = {LLVMCodeGenLevelNone, LLVMCodeGenLevelLess, LLVMCodeGenLevelDefault, LLVMCodeGenLevelAggressive};
+    // Objects are linked by the system cc which produces PIE by default
+    llvm->target_machine = LLVMCreateTargetMachine(target, triple,
+                                                   cpu, features, codegen_levels[llvm->options->opt_level],
+                                                   LLVMRelocPIC, LLVMCodeModelDefault);
+    if (!llvm->target_machine)
     {
         fatal("Could not create target machine");
     }
+    if (native)
+    {
+        LLVMDisposeMessage(cpu);
+        LLVMDisposeMessage(features);
+    }
+
+    LLVMSetTarget(llvm->module, triple);
+    LLVMTargetDataRef data_layout = LLVMCreateTargetDataLayout(llvm->target_machine);
+    LLVMSetModuleDataLayout(llvm->module, data_layout);
+    LLVMDisposeTargetData(data_layout);
+    LLVMDisposeMessage(triple);
+
+    return llvm->target_machine;
+}
+
+// The YAML remark parser of LLVM 14 gives scalars as they are written
+// apart from the quotes around single quoted ones, so the doubled quotes of
+// those are collapsed here and double quoted ones, such as the line breaks
+// of asm-printer remarks, unescaped. quoted writes the string as a YAML
+// scalar again.
+void print_remark_string(FILE *out, LLVMRemarkStringRef str, bool quoted)
+{
+    const char *data = LLVMRemarkStringGetData(str);
+    uint32_t length = LLVMRemarkStringGetLen(str);
+    if (length >= 2 && data[0] == '"' && data[length - 1] == '"')
+    {
+        if (quoted)
+        {
+            fprintf(out, "%.*s", length, data);
+            return;
+        }
+        for (uint32_t i = 1; i < length - 1; i++)
+        {
+            if (data[i] == '\\' && i + 1 < length - 1)
+            {
+                i++;
+                fputc(data[i] == 'n' ? '\n' : data[i] == 't' ? '\t' : data[i], out);
+                continue;
+            }
+            fputc(data[i], out);
+        }
+        return;
+    }
+    if (quoted)
+    {
+        fputc('\'', out);
+    }
+    for (uint32_t i = 0; i < length; i++)
+    {
+        if (data[i] == '\'' && i + 1 < length && data[i + 1] == '\'')
+        {
+            i++;
+        }
+        if (quoted && data[i] == '\'')
+        {
+            fputc('\'', out);
+        }
+        fputc(data[i], out);
+    }
+    if (quoted)
+    {
+        fputc('\'', out);
+    }
+}
+
+void print_remark_location(FILE *out, LLVMRemarkDebugLocRef location)
+{
+    fprintf(out, "{ File: ");
+    print_remark_string(out, LLVMRemarkDebugLocGetSourceFilePath(location), true);
+    fprintf(out, ", Line: %u, Column: %u }\n", LLVMRemarkDebugLocGetSourceLine(location),
+            LLVMRemarkDebugLocGetSourceColumn(location));
+}
+
+// Tag of a remark in LLVM's YAML and the --remarks kind it belongs to,
+// failures to apply a transformation being missed remarks
+char *remark_tag(enum LLVMRemarkType type, char **kind)
+{
+    switch (type)
+    {
+    case LLVMRemarkTypePassed:
+        *kind = "passed";
+        return "Passed";
+    case LLVMRemarkTypeMissed:
+        *kind = "missed";
+        return "Missed";
+    case LLVMRemarkTypeFailure:
+        *kind = "missed";
+        return "Failure";
+    case LLVMRemarkTypeAnalysisFPCommute:
+        *kind = "analysis";
+        return "AnalysisFPCommute";
+    case LLVMRemarkTypeAnalysisAliasing:
+        *kind = "analysis";
+        return "AnalysisAliasing";
+    default:
+        *kind = "analysis";
+        return "Analysis";
+    }
+}
+
+// Writes a remark as a YAML document in the layout of LLVM's own
+// -pass-remarks-output, or as a file:line:col text line with its kind, pass
+// and name. The message is the concatenation of its arguments.
+void llvm_print_remark(Llvm *llvm, LLVMRemarkEntryRef remark, char *tag, char *kind)
+{
+    FILE *out = llvm->remarks_out;
+    LLVMRemarkDebugLocRef location = LLVMRemarkEntryGetDebugLoc(remark);
+    LLVMRemarkStringRef pass = LLVMRemarkEntryGetPassName(remark);
+    LLVMRemarkStringRef name = LLVMRemarkEntryGetRemarkName(remark);
+    if (strcmp(llvm->options->remarks_format, "yaml") == 0)
+    {
+        fprintf(out, "--- !%s\nPass:            ", tag);
+        print_remark_string(out, pass, true);
+        fprintf(out, "\nName:            ");
+        print_remark_string(out, name, true);
+        if (location != NULL)
+        {
+            fprintf(out, "\nDebugLoc:        ");
+            print_remark_location(out, location);
+        }
+        else
+        {
+            fprintf(out, "\n");
+        }
+        fprintf(out, "Function:        ");
+        print_remark_string(out, LLVMRemarkEntryGetFunctionName(remark), true);
+        fprintf(out, "\nArgs:\n");
+        for (LLVMRemarkArgRef arg = LLVMRemarkEntryGetFirstArg(remark); arg != NULL;
+             arg = LLVMRemarkEntryGetNextArg(arg, remark))
+        {
+            LLVMRemarkStringRef key = LLVMRemarkArgGetKey(arg);
+            fprintf(out, "  - %.*s: ", LLVMRemarkStringGetLen(key), LLVMRemarkStringGetData(key));
+            print_remark_string(out, LLVMRemarkArgGetValue(arg), true);
+            fprintf(out, "\n");
+            if (LLVMRemarkArgGetDebugLoc(arg) != NULL)
+            {
+                fprintf(out, "    DebugLoc:        ");
+                print_remark_location(out, LLVMRemarkArgGetDebugLoc(arg));
+            }
+        }
+        fprintf(out, "...\n");
+        return;
+    }
+    if (location != NULL)
+    {
+        print_remark_string(out, LLVMRemarkDebugLocGetSourceFilePath(location), false);
+        fprintf(out, ":%u:%u: ", LLVMRemarkDebugLocGetSourceLine(location), LLVMRemarkDebugLocGetSourceColumn(location));
+    }
+    fprintf(out, "remark: ");
+    for (LLVMRemarkArgRef arg = LLVMRemarkEntryGetFirstArg(remark); arg != NULL; arg = LLVMRemarkEntryGetNextArg(arg, remark))
+    {
+        print_remark_string(out, LLVMRemarkArgGetValue(arg), false);
+    }
+    fprintf(out, " [%s ", kind);
+    print_remark_string(out, pass, false);
+    fputc('/', out);
+    print_remark_string(out, name, false);
+    fprintf(out, "]\n");
+}
+
+// Reads back the remarks LLVM streamed while passes and codegen ran and
+// reports those of the kind --remarks asked for
+void llvm_report_remarks(Llvm *llvm)
+{
+    if (llvm->remarks == NULL)
+    {
+        return;
+    }
+    size_t length;
+    char *yaml = llvm_close_remarks(llvm->context, llvm->remarks, &length);
+    llvm->remarks = NULL;
+    char *colon = strchr(llvm->options->remarks, ':');
+    int kind_length = colon != NULL ? colon - llvm->options->remarks : 0;
+
+    LLVMRemarkParserRef parser = LLVMRemarkParserCreateYAML(yaml, length);
+    LLVMRemarkEntryRef remark;
+    while (length > 0 && (remark = LLVMRemarkParserGetNext(parser)) != NULL)
+    {
+        char *kind;
+        char *tag = remark_tag(LLVMRemarkEntryGetType(remark), &kind);
+        if (colon == NULL || strncmp(llvm->options->remarks, "all", kind_length) == 0 ||
+            (strlen(kind) == kind_length && strncmp(llvm->options->remarks, kind, kind_length) == 0))
+        {
+            llvm_print_remark(llvm, remark, tag, kind);
+        }
+        LLVMRemarkEntryDispose(remark);
+    }
+    if (LLVMRemarkParserHasError(parser))
+    {
+        fatal("Could not read optimization remarks: %s", LLVMRemarkParserGetErrorMessage(parser));
+    }
+    LLVMRemarkParserDispose(parser);
+    free(yaml);
+    fflush(llvm->remarks_out);
+}
+
+void llvm_link_bitcode(Llvm *llvm, char *path)
+{
+    LLVMMemoryBufferRef buffer;
+    LLVMModuleRef module;
+    char *message;
+    if (LLVMCreateMemoryBufferWithContentsOfFile(path, &buffer, &message) != 0)
+    {
+        fatal("Could not read %s: %s", path, message);
+    }
+    // Accepts both bitcode and textual IR, takes ownership of the buffer
+    if (LLVMParseIRInContext(llvm->context, buffer, &module, &message) != 0)
+    {
+        fatal("Could not parse %s: %s", path, message);
+    }
+    if (LLVMLinkModules2(llvm->module, module) != 0)
+    {
+        fatal("Could not link %s", path);
+    }
+}
+
+bool llvm_is_external_definition(LLVMValueRef value)
+{
+    return !LLVMIsDeclaration(value) && LLVMGetLinkage(value) != LLVMInternalLinkage &&
+           LLVMGetLinkage(value) != LLVMPrivateLinkage && strncmp(LLVMGetValueName(value), "llvm.", 5) != 0;
+}
+
+// With the whole program in one module only the symbols the Tron module
+// exports can be referenced from outside, internal linkage lets the optimizer
+// inline, specialize and drop everything else
+void llvm_internalize(Llvm *llvm, HashTable *exported)
+{
+    for (LLVMValueRef function = LLVMGetFirstFunction(llvm->module); function != NULL; function = LLVMGetNextFunction(function))
+    {
+        if (llvm_is_external_definition(function) && lookup_value(exported, (char *)LLVMGetValueName(function)) == NULL)
+        {
+            LLVMSetLinkage(function, LLVMInternalLinkage);
+        }
+    }
+    for (LLVMValueRef global = LLVMGetFirstGlobal(llvm->module); global != NULL; global = LLVMGetNextGlobal(global))
+    {
+        if (llvm_is_external_definition(global) && lookup_value(exported, (char *)LLVMGetValueName(global)) == NULL)
+        {
+            LLVMSetLinkage(global, LLVMInternalLinkage);
+        }
+    }
+}
+
+void llvm_link(Llvm *llvm)
+{
+    if (llvm->options->lto == NULL)
+    {
+        return;
+    }
+
+    // Sets the module triple and data layout the linked modules must agree on
+    llvm_target_machine(llvm);
+
+    HashTable *exported = new_hash_table(SYMBOL_TABLE_SIZE);
+    for (LLVMValueRef function = LLVMGetFirstFunction(llvm->module); function != NULL; function = LLVMGetNextFunction(function))
+    {
+        if (llvm_is_external_definition(function))
+        {
+            insert_value(exported, (char *)LLVMGetValueName(function), NULL);
+        }
+    }
+    for (LLVMValueRef global = LLVMGetFirstGlobal(llvm->module); global != NULL; global = LLVMGetNextGlobal(global))
+    {
+        if (llvm_is_external_definition(global))
+        {
+            insert_value(exported, (char *)LLVMGetValueName(global), NULL);
+        }
+    }
+
+    char *paths = strdup(llvm->options->lto);
+    for (char *path = strtok(paths, ","); path != NULL; path = strtok(NULL, ","))
+    {
+        llvm_link_bitcode(llvm, path);
+    }
+    free(paths);
+
+    llvm_internalize(llvm, exported);
+    dispose_hash_table(exported, NULL);
+}
+
+// Streams the remarks of the passes matching the --remarks regex from here
+// on, whatever their kind, which is filtered when they are reported
+void llvm_enable_remarks(Llvm *llvm)
+{
+    char *filter = llvm->options->remarks;
+    char *colon = strchr(filter, ':');
+    if (colon != NULL)
+    {
+        char *kind = strndup(filter, colon - filter);
+        if (strcmp(kind, "all") != 0 && strcmp(kind, "passed") != 0 && strcmp(kind, "missed") != 0 &&
+            strcmp(kind, "analysis") != 0)
+        {
+            fatal("Unknown remark kind: %s", kind);
+        }
+        free(kind);
+        filter = colon + 1;
+    }
+
+    char *error = NULL;
+    llvm->remarks = llvm_open_remarks(llvm->context, filter, &error);
+    if (llvm->remarks == NULL)
+    {
+        fatal("Invalid remarks regex: %s", error);
+    }
+
+    llvm->remarks_out = stderr;
+    if (llvm->options->remarks_output != NULL)
+    {
+        llvm->remarks_out = fopen(llvm->options->remarks_output, "w");
+        if (llvm->remarks_out == NULL)
+        {
+            fatal("Could not open remarks output: %s", llvm->options->remarks_output);
+        }
+    }
+}
+
+void llvm_optimize(Llvm *llvm)
+{
+    if (llvm->options->remarks != NULL)
+    {
+        llvm_enable_remarks(llvm);
+    }
 
-    if (LLVMTargetMachineEmitToFile(target_machine, llvm->module, output,
-                                    LLVMObjectFile, &err) != 0)
+    // The optimizing pipelines end with globaldce, at -O0 it is still run to
+    // strip internal functions and globals nothing refers to
+    char pipeline[32];
+    snprintf(pipeline, sizeof(pipeline), "default<O%d>%s", llvm->options->opt_level,
+             llvm->options->opt_level == 0 ? ",globaldce" : "");
+
+    LLVMPassBuilderOptionsRef pass_options = LLVMCreatePassBuilderOptions();
+    LLVMErrorRef err = LLVMRunPasses(llvm->module, pipeline, llvm_target_machine(llvm), pass_options);
+    LLVMDisposePassBuilderOptions(pass_options);
+
+    if (err != NULL)
+    {
+        char *msg = LLVMGetErrorMessage(err);
+        fatal("Optimization failed: %s", msg);
+    }
+}
+
+void llvm_compile(Llvm *llvm, char *output)
+{
+    char *err;
+    LLVMBool failed;
+    if (strcmp(llvm->options->emit, "bc") == 0)
+    {
+        failed = LLVMWriteBitcodeToFile(llvm->module, output);
+    }
+    else if (strcmp(llvm->options->emit, "ll") == 0)
+    {
+        failed = LLVMPrintModuleToFile(llvm->module, output, &err);
+    }
+    else
+    {
+        LLVMCodeGenFileType file_type = strcmp(llvm->options->emit, "asm") == 0 ? LLVMAssemblyFile : LLVMObjectFile;
+        failed = LLVMTargetMachineEmitToFile(llvm_target_machine(llvm), llvm->module, output, file_type, &err);
+    }
+    if (failed)
     {
-        fatal("Could not compile for the target machine");
+        fatal("Could not write %s", output);
     }
+    llvm_report_remarks(llvm);
 }
 
 void llvm_validate(Llvm *llvm)
@@ -25,14 +25,31 @@
 #include <llvm-c/Transforms/Scalar.h>
 #include <llvm-c/Transforms/Vectorize.h>
 #include <llvm-c/BitWriter.h>
+#include <llvm-c/IRReader.h>
+#include <llvm-c/Linker.h>
+#include <llvm-c/DebugInfo.h>
+#include <llvm-c/Remarks.h>
+#include <llvm-c/Support.h>
+#include <llvm-c/Transforms/PassBuilder.h>
 
 #include "scope.h"
 #include "node.h"
+#include "options.h"
+#include "remarks.h"
+#include "profile.h"
+#include "bounds.h"
+#include "effects.h"
+#include "eval.h"
 
+// value_type is only set for constants, the compile time interpreter needs
+// the signedness LLVM types do not carry
 typedef struct LlvmSymbolInfo
 {
     LLVMTypeRef type;
     LLVMValueRef value;
+    Type value_type;
+    // Shape of a tensor, NULL for other symbols
+    TypeInfo *type_info;
 } LlvmSymbolInfo;
 
 typedef struct LlvmScopeInfo
@@ -44,20 +61,99 @@ typedef struct LlvmScopeInfo
     bool has_returned;
 } LlvmScopeInfo;
 
+// Size of the direct-indexed cache of memoized functions taking a single
+// parameter, other keys go to an open addressing table in corelib
+#define MEMO_DENSE_SIZE 4096
+
+typedef struct LlvmMemo
+{
+    LLVMValueRef values;
+    LLVMValueRef filled;
+    LLVMValueRef table;
+    LLVMValueRef keys;
+    LLVMValueRef result;
+    LLVMBasicBlockRef exit;
+    LLVMBasicBlockRef ret;
+    int num_keys;
+} LlvmMemo;
+
+// Self tail calls are turned into jumps back to the header after storing
+// the new arguments into the parameter slots. Calls accumulated with
+// `return f(...) op x` fold x into the accumulator, which is applied to
+// every other return value.
+typedef struct LlvmTail
+{
+    char *name;
+    LLVMValueRef *params;
+    int num_params;
+    LLVMValueRef accumulator;
+    TokenType accumulate;
+    LLVMBasicBlockRef header;
+} LlvmTail;
+
+// Slice and tensor variables of the function being visited, and the
+// temporaries of tensor operations, their buffers are released before
+// every return
+typedef struct LlvmLocalSlice
+{
+    LLVMValueRef header;
+    Type type;
+    struct LlvmLocalSlice *next;
+} LlvmLocalSlice;
+
+// A leaf of a fused tensor expression, evaluated once before its loop.
+// value is the data pointer of a tensor when indexed, the value of a scalar
+// otherwise.
+typedef struct LlvmFusedLeaf
+{
+    Expression *expression;
+    LLVMValueRef value;
+    bool indexed;
+    struct LlvmFusedLeaf *next;
+} LlvmFusedLeaf;
+
+// Right operands of && and || with at most this many operators, and none
+// that can trap or call, are evaluated unconditionally and combined with a
+// select instead of being branched around
+#define LLVM_BRANCHLESS_COST 4
+
 typedef struct Llvm
 {
     LLVMContextRef context;
     LLVMModuleRef module;
     LLVMBuilderRef builder;
+    LLVMTargetMachineRef target_machine;
+    LLVMDIBuilderRef di_builder;
+    LLVMMetadataRef di_file;
+    LLVMMetadataRef di_compile_unit;
+    LLVMMetadataRef di_scope;
+    FILE *remarks_out;
+    LlvmRemarkStream *remarks;
+    Profile *profile;
+    Effects *effects;
+    BoundsLoop *bounds;
+    BoundsLoop *unchecked_loop;
+    Eval *eval;
+    LlvmMemo *memo;
+    LlvmTail *tail;
+    LlvmLocalSlice *local_slices;
+    LLVMValueRef profile_init;
     Scope *scope;
+    Options *options;
+    int line;
+    int col;
 } Llvm;
 
-Llvm *new_llvm();
+Llvm *new_llvm(Options *options);
 LlvmSymbolInfo *new_llvm_symbol_info(LLVMTypeRef type, LLVMValueRef value);
 LlvmScopeInfo *new_llvm_scope_info(LLVMValueRef function_ref, LLVMBasicBlockRef break_block, LLVMBasicBlockRef continue_block);
+void llvm_analyze(Llvm *llvm, Node *ast);
 void llvm_visit(Llvm *llvm, Node *node);
 LLVMValueRef llvm_visit_expression(Llvm *llvm, Expression *expression);
+void llvm_finalize(Llvm *llvm);
 void llvm_dump(Llvm *llvm, FILE *out);
+void llvm_link(Llvm *llvm);
+void llvm_optimize(Llvm *llvm);
 void llvm_compile(Llvm *llvm, char *output);
 void llvm_validate(Llvm *llvm);
 void dispose_llvm(Llvm *llvm);
@@ -15,31 +15,41 @@
  ******************************************************************************/
 
 #include "parser.h"
+#include "simplify.h"
+#include "specialize.h"
 #include "llvm.h"
 
 int main(int argc, char **argv)
 {
-  if (argc != 3)
+  Options *options = parse_options(argc, argv);
+
+  FILE *file = fopen(options->input, "r");
+  if (file == NULL)
   {
-    fprintf(stderr, "Usage: tron <input_file> <output_file>\n");
+    fprintf(stderr, "Could not open input file: %s\n", options->input);
     exit(EXIT_FAILURE);
   }
 
-  FILE *file = fopen(argv[1], "r");
-
   Parser *p = new_parser(file);
   Node *ast = parse(p);
+  simplify(ast);
+  specialize(ast, options->opt_level > 0);
 
-  Llvm *llvm = new_llvm();
+  Llvm *llvm = new_llvm(options);
 
+  llvm_analyze(llvm, ast);
   llvm_visit(llvm, ast);
+  llvm_finalize(llvm);
   llvm_validate(llvm);
   llvm_dump(llvm, stdout);
-  llvm_compile(llvm, argv[2]);
+  llvm_link(llvm);
+  llvm_optimize(llvm);
+  llvm_compile(llvm, options->output);
 
   dispose_llvm(llvm);
 
   dispose_node(ast);
   dispose_parser(p);
   fclose(file);
+  dispose_options(options);
 }
@@ -17,12 +17,38 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "constants.h"
 #include "node.h"
 
+// as_float, as_int and the other as_<type> builtins look like calls but
+// convert their argument in place. Returns the type converted to, TYPE_INFER
+// for anything else.
+Type cast_type(char *name)
+{
+    if (strncmp(name, CAST_PREFIX, strlen(CAST_PREFIX)) != 0)
+    {
+        return TYPE_INFER;
+    }
+    return lookup_type(name + strlen(CAST_PREFIX));
+}
+
+bool is_cast(char *name)
+{
+    return cast_type(name) != TYPE_INFER;
+}
+
+// sum, min, max, dot and argmax only read the sequences they are given
+bool is_reduction(char *name)
+{
+    return strcmp(name, SUM) == 0 || strcmp(name, MIN) == 0 || strcmp(name, MAX) == 0 || strcmp(name, DOT) == 0 ||
+           strcmp(name, ARGMAX) == 0;
+}
+
 ArrayInfo *new_array_info(int size)
 {
     ArrayInfo *array_info = malloc(sizeof(ArrayInfo));
     array_info->size = size;
+    array_info->next = NULL;
     return array_info;
 }
 
@@ -46,16 +72,277 @@ TypeInfo *dup_type_info(TypeInfo *type_info)
         return NULL;
     }
     TypeInfo *dup = memdup(type_info, sizeof(TypeInfo));
+    dup->array_info = dup_array_info(type_info->array_info);
     dup->next = dup_type_info(type_info->next);
     return dup;
 }
 
+ArrayInfo *dup_array_info(ArrayInfo *array_info)
+{
+    if (array_info == NULL)
+    {
+        return NULL;
+    }
+    ArrayInfo *dup = new_array_info(array_info->size);
+    dup->next = dup_array_info(array_info->next);
+    return dup;
+}
+
+// Type of the elements of an array type, the outermost dimension dropped,
+// or of a slice. Indexing a tensor in all its dimensions gives a scalar.
+TypeInfo *element_type_info(TypeInfo *type_info)
+{
+    TypeInfo *element = new_type_info(type_info->type);
+    if (!type_info->slice)
+    {
+        element->array_info = dup_array_info(type_info->array_info->next);
+        element->tensor = type_info->tensor && element->array_info != NULL;
+    }
+    return element;
+}
+
+int count_dimensions(ArrayInfo *array_info)
+{
+    int count = 0;
+    for (; array_info != NULL; array_info = array_info->next)
+    {
+        count++;
+    }
+    return count;
+}
+
+// Number of scalars in an array of the sizes given
+int64_t count_elements(ArrayInfo *array_info)
+{
+    int64_t count = 1;
+    for (; array_info != NULL; array_info = array_info->next)
+    {
+        count *= array_info->size;
+    }
+    return count;
+}
+
+// Tables keyed by function name are sized by this, a slot per function
+// keeps their chains short on large programs
+size_t count_functions(Node *ast)
+{
+    size_t count = 0;
+    for (Node *node = ast; node != NULL; node = node->next)
+    {
+        count += node->node_type == N_FUNCTION;
+    }
+    return count;
+}
+
+// Tables keyed by variable name are sized by this, it counts the
+// declarations in statements and the blocks nested in them, but not in
+// functions, so on the root it counts the globals
+size_t count_variables(Node *statements)
+{
+    size_t count = 0;
+    for (Node *node = statements; node != NULL; node = node->next)
+    {
+        if (node->node_type == N_VARIABLE)
+        {
+            count++;
+        }
+        else if (node->node_type == N_IF)
+        {
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                count += count_variables(if_->body->statements);
+            }
+        }
+        else if (node->node_type == N_WHILE)
+        {
+            count += count_variables(((While *)node->data)->body->statements);
+        }
+    }
+    return count;
+}
+
+bool type_info_equals(TypeInfo *left, TypeInfo *right)
+{
+    if (left->type != right->type || left->slice != right->slice || left->tensor != right->tensor)
+    {
+        return false;
+    }
+    ArrayInfo *left_array = left->array_info;
+    ArrayInfo *right_array = right->array_info;
+    for (; left_array != NULL && right_array != NULL; left_array = left_array->next, right_array = right_array->next)
+    {
+        if (left_array->size != right_array->size)
+        {
+            return false;
+        }
+    }
+    return left_array == NULL && right_array == NULL;
+}
+
+// Memo caches keep keys and results as 32 bit patterns, so a memoized
+// function may only take and return 32 bit numbers
+bool is_memo_type(TypeInfo *type_info)
+{
+    return type_info->type != TYPE_INFER && type_info->array_info == NULL && !type_info->slice && !type_info->tensor &&
+           type_bits(type_info->type) == 32;
+}
+
+bool has_memo_signature(Function *function)
+{
+    for (Variable *param = function->params; param != NULL; param = param->next)
+    {
+        if (!is_memo_type(param->type_info))
+        {
+            return false;
+        }
+    }
+    return is_memo_type(function->type_info);
+}
+
+// The dup_* functions deep copy a subtree, including the rest of the
+// chain behind it, so that the copy can be changed and disposed on its own
+Expression *dup_expression(Expression *expression)
+{
+    if (expression == NULL)
+    {
+        return NULL;
+    }
+    Expression *dup = new_expression(dup_token(expression->token), dup_expression(expression->left),
+                                     dup_expression(expression->right), dup_node(expression->node),
+                                     dup_type_info(expression->type_info));
+    dup->line = expression->line;
+    dup->col = expression->col;
+    dup->next = dup_expression(expression->next);
+    return dup;
+}
+
+Assignment *dup_assignment(Assignment *assignment)
+{
+    if (assignment == NULL)
+    {
+        return NULL;
+    }
+    Assignment *dup = new_assignment(assignment->name, dup_type_info(assignment->type_info), dup_expression(assignment->expression));
+    dup->index = dup_expression(assignment->index);
+    return dup;
+}
+
+Variable *dup_variable(Variable *variable)
+{
+    if (variable == NULL)
+    {
+        return NULL;
+    }
+    Variable *dup = new_variable(variable->name, dup_type_info(variable->type_info), dup_assignment(variable->assignment));
+    dup->exported = variable->exported;
+    dup->constant = variable->constant;
+    dup->next = dup_variable(variable->next);
+    return dup;
+}
+
+Call *dup_call(Call *call)
+{
+    return new_call(call->name, dup_type_info(call->type_info), dup_expression(call->expression));
+}
+
+Slice *dup_slice(Slice *slice)
+{
+    return new_slice(dup_expression(slice->array), dup_expression(slice->low), dup_expression(slice->high));
+}
+
+Block *dup_block(Block *block)
+{
+    if (block == NULL)
+    {
+        return NULL;
+    }
+    return new_block(dup_node(block->statements));
+}
+
+If *dup_if(If *if_)
+{
+    if (if_ == NULL)
+    {
+        return NULL;
+    }
+    If *dup = new_if(dup_expression(if_->condition), dup_block(if_->body));
+    dup->next = dup_if(if_->next);
+    return dup;
+}
+
+Function *dup_function(Function *function)
+{
+    Function *dup = new_function(function->name, dup_type_info(function->type_info), dup_variable(function->params),
+                                 dup_block(function->body));
+    dup->exported = function->exported;
+    dup->memo = function->memo;
+    dup->specialize = function->specialize;
+    dup->constant = function->constant;
+    dup->calls = function->calls;
+    return dup;
+}
+
+void *dup_data(Node *node)
+{
+    switch (node->node_type)
+    {
+    case N_INTEGER:
+        return new_integer(((Integer *)node->data)->value);
+    case N_FLOAT:
+        return new_float(((Float *)node->data)->value);
+    case N_NAME:
+        return new_name(((Name *)node->data)->value);
+    case N_EXPRESSION:
+    case N_ARRAY:
+        return dup_expression(node->data);
+    case N_VARIABLE:
+        return dup_variable(node->data);
+    case N_ASSIGNMENT:
+        return dup_assignment(node->data);
+    case N_CALL:
+        return dup_call(node->data);
+    case N_SLICE:
+        return dup_slice(node->data);
+    case N_FUNCTION:
+        return dup_function(node->data);
+    case N_RETURN:
+        return new_return(dup_expression(((Return *)node->data)->expression));
+    case N_BLOCK:
+        return dup_block(node->data);
+    case N_IF:
+        return dup_if(node->data);
+    case N_WHILE:
+        return new_while(dup_expression(((While *)node->data)->condition), dup_block(((While *)node->data)->body));
+    case N_BREAK:
+        return new_break();
+    case N_CONTINUE:
+        return new_continue();
+    }
+    fprintf(stderr, "Unexpected node type");
+    exit(EXIT_FAILURE);
+}
+
+Node *dup_node(Node *node)
+{
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    Node *dup = new_node(node->node_type, dup_data(node));
+    dup->line = node->line;
+    dup->col = node->col;
+    dup->next = dup_node(node->next);
+    return dup;
+}
+
 Node *new_node(NodeType nodeType, void *data)
 {
     Node *node = malloc(sizeof(Node));
     node->node_type = nodeType;
     node->data = data;
     node->next = NULL;
+    node->line = 0;
+    node->col = 0;
     return node;
 }
 
@@ -66,6 +353,8 @@ Variable *new_variable(char *name, TypeInfo *type_info, Assignment *assignment)
     variable->assignment = assignment;
     variable->type_info = type_info;
     variable->next = NULL;
+    variable->exported = false;
+    variable->constant = false;
     return variable;
 }
 
@@ -75,9 +364,19 @@ Assignment *new_assignment(char *name, TypeInfo *type_info, Expression *expressi
     assignment->name = strdup(name);
     assignment->type_info = type_info;
     assignment->expression = expression;
+    assignment->index = NULL;
     return assignment;
 }
 
+Slice *new_slice(Expression *array, Expression *low, Expression *high)
+{
+    Slice *slice = malloc(sizeof(Slice));
+    slice->array = array;
+    slice->low = low;
+    slice->high = high;
+    return slice;
+}
+
 Call *new_call(char *name, TypeInfo *type_info, Expression *expression)
 {
     Call *call = malloc(sizeof(Call));
@@ -96,6 +395,18 @@ Expression *new_expression(Token *token, Expression *left, Expression *right, No
     expression->node = node;
     expression->type_info = type_info;
     expression->next = NULL;
+    expression->line = 0;
+    expression->col = 0;
+    if (token != NULL)
+    {
+        expression->line = token->line;
+        expression->col = token->col;
+    }
+    else if (left != NULL)
+    {
+        expression->line = left->line;
+        expression->col = left->col;
+    }
     return expression;
 }
 
@@ -118,14 +429,14 @@ Return *new_return(Expression *expression)
     return return_;
 }
 
-Integer *new_integer(int value)
+Integer *new_integer(int64_t value)
 {
     Integer *integer = malloc(sizeof(Integer));
     integer->value = value;
     return integer;
 }
 
-Float *new_float(float value)
+Float *new_float(double value)
 {
     Float *float_ = malloc(sizeof(Float));
     float_->value = value;
@@ -136,6 +447,9 @@ TypeInfo *new_type_info(Type type)
 {
     TypeInfo *type_info = malloc(sizeof(TypeInfo));
     type_info->type = type;
+    type_info->array_info = NULL;
+    type_info->slice = false;
+    type_info->tensor = false;
     type_info->next = NULL;
     return type_info;
 }
@@ -154,6 +468,11 @@ Function *new_function(char *name, TypeInfo *type_info, Variable *params, Block
     function->type_info = type_info;
     function->params = params;
     function->body = body;
+    function->exported = false;
+    function->memo = false;
+    function->specialize = false;
+    function->constant = false;
+    function->calls = false;
     return function;
 }
 
@@ -208,6 +527,7 @@ void dispose_type_info(TypeInfo *type_info)
         return;
     }
     dispose_type_info(type_info->next);
+    dispose_array_info(type_info->array_info);
     free(type_info);
 }
 
@@ -235,6 +555,7 @@ void dispose_expression(Expression *expression)
     dispose_expression(expression->right);
     dispose_node(expression->node);
     dispose_token(expression->token);
+    dispose_type_info(expression->type_info);
     free(expression);
 }
 
@@ -264,6 +585,7 @@ void dispose_assignment(Assignment *assignment)
     }
     dispose_type_info(assignment->type_info);
     dispose_expression(assignment->expression);
+    dispose_expression(assignment->index);
     free(assignment->name);
     free(assignment);
 }
@@ -280,6 +602,18 @@ void dispose_call(Call *call)
     free(call);
 }
 
+void dispose_slice(Slice *slice)
+{
+    if (slice == NULL)
+    {
+        return;
+    }
+    dispose_expression(slice->array);
+    dispose_expression(slice->low);
+    dispose_expression(slice->high);
+    free(slice);
+}
+
 void dispose_function(Function *function)
 {
     if (function == NULL)
@@ -346,6 +680,7 @@ void dispose_one(Node *node)
         dispose_variable((Variable *)node->data);
         break;
     case N_EXPRESSION:
+    case N_ARRAY:
         dispose_expression((Expression *)node->data);
         break;
     case N_INTEGER:
@@ -360,6 +695,9 @@ void dispose_one(Node *node)
     case N_CALL:
         dispose_call((Call *)node->data);
         break;
+    case N_SLICE:
+        dispose_slice((Slice *)node->data);
+        break;
     case N_FUNCTION:
         dispose_function((Function *)node->data);
         break;
@@ -18,22 +18,30 @@
 #define MNODE_H_
 
 #include "stdbool.h"
+#include "stdint.h"
 
 #include "assert.h"
 #include "token.h"
 #include "type.h"
 #include "utils.h"
 
+// Dimensions of an array type from the outermost one in, a size of -1 is
+// taken from the initializer
 typedef struct ArrayInfo
 {
     int size;
     struct ArrayInfo *next;
 } ArrayInfo;
 
+// A slice is a growable sequence of type living on the heap, it has no
+// array_info. A tensor lives on the heap too, its array_info holds at least
+// one dimension and a size of -1 is only known at runtime.
 typedef struct TypeInfo
 {
     Type type;
     ArrayInfo *array_info;
+    bool slice;
+    bool tensor;
     struct TypeInfo *next;
 } TypeInfo;
 
@@ -53,7 +61,8 @@ typedef enum NodeType
     N_FLOAT,
     N_CONTINUE,
     N_BREAK,
-    N_ARRAY
+    N_ARRAY,
+    N_SLICE
 } NodeType;
 
 typedef struct Node
@@ -61,6 +70,8 @@ typedef struct Node
     NodeType node_type;
     void *data;
     struct Node *next;
+    int line;
+    int col;
 } Node;
 
 typedef struct Block
@@ -68,14 +79,16 @@ typedef struct Block
     Node *statements;
 } Block;
 
+// Literals keep the widest value of their kind, the expression they belong
+// to says which type they have
 typedef struct Integer
 {
-    int value;
+    int64_t value;
 } Integer;
 
 typedef struct Float
 {
-    float value;
+    double value;
 } Float;
 
 typedef struct Name
@@ -91,6 +104,8 @@ typedef struct Expression
     struct Expression *right;
     TypeInfo *type_info;
     Node *node;
+    int line;
+    int col;
 } Expression;
 
 typedef struct If
@@ -106,11 +121,14 @@ typedef struct While
     Block *body;
 } While;
 
+// Assigning an array element chains one index expression per dimension
+// through next, type_info is then the type of the element
 typedef struct Assignment
 {
     char *name;
     TypeInfo *type_info;
     Expression *expression;
+    Expression *index;
 } Assignment;
 
 typedef struct Variable
@@ -119,6 +137,8 @@ typedef struct Variable
     TypeInfo *type_info;
     Assignment *assignment;
     struct Variable *next;
+    bool exported;
+    bool constant;
 } Variable;
 
 typedef struct Call
@@ -128,6 +148,15 @@ typedef struct Call
     Expression *expression;
 } Call;
 
+// array[low:high] views the elements of a slice or array from low up to
+// high without copying them, low and high default to its bounds
+typedef struct Slice
+{
+    Expression *array;
+    Expression *low;
+    Expression *high;
+} Slice;
+
 typedef struct Return
 {
     Expression *expression;
@@ -147,6 +176,13 @@ typedef struct Function
     TypeInfo *type_info;
     Variable *params;
     Block *body;
+    bool exported;
+    bool memo;
+    bool specialize;
+    bool constant;
+    // Whether the body makes any call, casts and builtins included, so that
+    // passes looking for call sites can skip the bodies without
+    bool calls;
 } Function;
 
 typedef struct ScopeInfo
@@ -156,12 +192,15 @@ typedef struct ScopeInfo
 } ScopeInfo;
 
 Node *new_node(NodeType nodeType, void *data);
+Type cast_type(char *name);
+bool is_cast(char *name);
+bool is_reduction(char *name);
 Variable *new_variable(char *name, TypeInfo *type_info, Assignment *assignment);
 Assignment *new_assignment(char *name, TypeInfo *type_info, Expression *expression);
 Call *new_call(char *name, TypeInfo *type_info, Expression *expression);
 Expression *new_expression(Token *token, Expression *left, Expression *right, Node *node, TypeInfo *type_info);
-Integer *new_integer(int value);
-Float *new_float(float value);
+Integer *new_integer(int64_t value);
+Float *new_float(double value);
 Name *new_name(char *value);
 Break *new_break();
 Continue *new_continue();
@@ -173,6 +212,7 @@ If *new_if(Expression *condition, Block *body);
 While *new_while(Expression *condition, Block *body);
 ScopeInfo *new_scope_info(Function *function, bool is_loop);
 ArrayInfo *new_array_info(int size);
+Slice *new_slice(Expression *array, Expression *low, Expression *high);
 
 void dispose_scope_info(ScopeInfo *scope_info);
 void dispose_node(Node *node);
@@ -192,7 +232,25 @@ void dispose_type_info(TypeInfo *type_info);
 void dispose_if(If *if_);
 void dispose_while(While *while_);
 void dispose_array_info(ArrayInfo *array_info);
+void dispose_slice(Slice *slice);
 
 TypeInfo *dup_type_info(TypeInfo *type_info);
+ArrayInfo *dup_array_info(ArrayInfo *array_info);
+TypeInfo *element_type_info(TypeInfo *type_info);
+int count_dimensions(ArrayInfo *array_info);
+int64_t count_elements(ArrayInfo *array_info);
+size_t count_functions(Node *ast);
+size_t count_variables(Node *statements);
+bool type_info_equals(TypeInfo *left, TypeInfo *right);
+bool has_memo_signature(Function *function);
+Node *dup_node(Node *node);
+Expression *dup_expression(Expression *expression);
+Variable *dup_variable(Variable *variable);
+Assignment *dup_assignment(Assignment *assignment);
+Call *dup_call(Call *call);
+Slice *dup_slice(Slice *slice);
+Block *dup_block(Block *block);
+If *dup_if(If *if_);
+Function *dup_function(Function *function);
 
 #endif
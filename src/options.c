@@ -0,0 +1,225 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+
+void print_usage()
+{
+    fprintf(stderr, "Usage: tron [options] <input_file> <output_file>\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -O<level>                    Optimization level 0-3 (default 0)\n");
+    fprintf(stderr, "  -g                           Emit full DWARF debug info (lines, functions, variables)\n");
+    fprintf(stderr, "  -gline-tables-only           Emit DWARF line tables only\n");
+    fprintf(stderr, "  -march=native|<cpu>          Generate code for the host or the given CPU (default generic)\n");
+    fprintf(stderr, "  -ffast-math                  Let float math reassociate and assume no NaNs, infinities\n");
+    fprintf(stderr, "                               or signed zeros, implies -ffp-contract=fast\n");
+    fprintf(stderr, "  -ffp-contract=fast|off       Fuse float multiplies and adds into FMA (default off)\n");
+    fprintf(stderr, "  --wrap                       Let signed integer overflow wrap around instead of\n");
+    fprintf(stderr, "                               assuming it never happens\n");
+    fprintf(stderr, "  --trap-on-overflow           Abort with the source location on signed integer overflow\n");
+    fprintf(stderr, "  --unchecked                  Leave array, slice and tensor indexes unchecked\n");
+    fprintf(stderr, "  --instrument                 Record call counts, cycle times and loop trip counts,\n");
+    fprintf(stderr, "                               written as collapsed stacks at exit\n");
+    fprintf(stderr, "  --profile-generate           Count branches and calls, written to tron.profile at exit\n");
+    fprintf(stderr, "  --profile-use=<file>         Optimize with branch weights and entry counts from a profile\n");
+    fprintf(stderr, "  --auto-memo                  Memoize pure recursive functions without @memo\n");
+    fprintf(stderr, "  --memo-thread-local          Give each thread its own memoization caches\n");
+    fprintf(stderr, "  --const-eval-steps=<n>       Step budget of every compile time evaluation (default 1000000)\n");
+    fprintf(stderr, "  --lto=<file>[,<file>...]     Link bitcode or IR (e.g. obj/corelib.bc) into the module\n");
+    fprintf(stderr, "                               and optimize the whole program with only main exported\n");
+    fprintf(stderr, "  --emit=obj|asm|bc|ll         Output format (default obj)\n");
+    fprintf(stderr, "  --remarks=[kind:]<regex>     Report optimization remarks of passes matching regex,\n");
+    fprintf(stderr, "                               kind is one of passed, missed, analysis or all (default)\n");
+    fprintf(stderr, "  --remarks-format=text|yaml   Remark output format (default text)\n");
+    fprintf(stderr, "  --remarks-output=<file>      Write remarks to file instead of stderr\n");
+    exit(EXIT_FAILURE);
+}
+
+Options *new_options()
+{
+    Options *options = malloc(sizeof(Options));
+    options->input = NULL;
+    options->output = NULL;
+    options->opt_level = 0;
+    options->debug_info = DEBUG_INFO_NONE;
+    options->instrument = 0;
+    options->profile_generate = 0;
+    options->profile_use = NULL;
+    options->lto = NULL;
+    options->auto_memo = 0;
+    options->memo_thread_local = 0;
+    options->const_eval_steps = 1000000;
+    options->fast_math = 0;
+    options->fp_contract = 0;
+    options->overflow = OVERFLOW_UNDEFINED;
+    options->unchecked = 0;
+    options->cpu = NULL;
+    options->emit = "obj";
+    options->remarks = NULL;
+    options->remarks_format = "text";
+    options->remarks_output = NULL;
+    return options;
+}
+
+Options *parse_options(int argc, char **argv)
+{
+    Options *options = new_options();
+
+    for (int i = 1; i < argc; i++)
+    {
+        char *arg = argv[i];
+        if (strncmp(arg, "-O", 2) == 0)
+        {
+            if (strlen(arg) != 3 || arg[2] < '0' || arg[2] > '3')
+            {
+                print_usage();
+            }
+            options->opt_level = arg[2] - '0';
+        }
+        else if (strcmp(arg, "-g") == 0)
+        {
+            options->debug_info = DEBUG_INFO_FULL;
+        }
+        else if (strcmp(arg, "-gline-tables-only") == 0)
+        {
+            options->debug_info = DEBUG_INFO_LINE_TABLES;
+        }
+        else if (strncmp(arg, "-march=", 7) == 0)
+        {
+            options->cpu = arg + 7;
+        }
+        else if (strcmp(arg, "-ffast-math") == 0)
+        {
+            options->fast_math = 1;
+            options->fp_contract = 1;
+        }
+        else if (strncmp(arg, "-ffp-contract=", 14) == 0)
+        {
+            if (strcmp(arg + 14, "fast") != 0 && strcmp(arg + 14, "off") != 0)
+            {
+                print_usage();
+            }
+            options->fp_contract = strcmp(arg + 14, "fast") == 0;
+        }
+        else if (strcmp(arg, "--wrap") == 0)
+        {
+            options->overflow = OVERFLOW_WRAP;
+        }
+        else if (strcmp(arg, "--trap-on-overflow") == 0)
+        {
+            options->overflow = OVERFLOW_TRAP;
+        }
+        else if (strcmp(arg, "--unchecked") == 0)
+        {
+            options->unchecked = 1;
+        }
+        else if (strcmp(arg, "--instrument") == 0)
+        {
+            options->instrument = 1;
+        }
+        else if (strcmp(arg, "--profile-generate") == 0)
+        {
+            options->profile_generate = 1;
+        }
+        else if (strncmp(arg, "--profile-use=", 14) == 0)
+        {
+            options->profile_use = arg + 14;
+        }
+        else if (strcmp(arg, "--auto-memo") == 0)
+        {
+            options->auto_memo = 1;
+        }
+        else if (strcmp(arg, "--memo-thread-local") == 0)
+        {
+            options->memo_thread_local = 1;
+        }
+        else if (strncmp(arg, "--const-eval-steps=", 19) == 0)
+        {
+            char *end;
+            options->const_eval_steps = strtol(arg + 19, &end, 10);
+            if (*end != '\0' || options->const_eval_steps <= 0)
+            {
+                print_usage();
+            }
+        }
+        else if (strncmp(arg, "--lto=", 6) == 0)
+        {
+            options->lto = arg + 6;
+        }
+        else if (strncmp(arg, "--emit=", 7) == 0)
+        {
+            options->emit = arg + 7;
+            if (strcmp(options->emit, "obj") != 0 && strcmp(options->emit, "asm") != 0 &&
+                strcmp(options->emit, "bc") != 0 && strcmp(options->emit, "ll") != 0)
+            {
+                print_usage();
+            }
+        }
+        else if (strncmp(arg, "--remarks=", 10) == 0)
+        {
+            options->remarks = arg + 10;
+        }
+        else if (strncmp(arg, "--remarks-format=", 17) == 0)
+        {
+            options->remarks_format = arg + 17;
+            if (strcmp(options->remarks_format, "text") != 0 && strcmp(options->remarks_format, "yaml") != 0)
+            {
+                print_usage();
+            }
+        }
+        else if (strncmp(arg, "--remarks-output=", 17) == 0)
+        {
+            options->remarks_output = arg + 17;
+        }
+        else if (arg[0] == '-')
+        {
+            print_usage();
+        }
+        else if (options->input == NULL)
+        {
+            options->input = arg;
+        }
+        else if (options->output == NULL)
+        {
+            options->output = arg;
+        }
+        else
+        {
+            print_usage();
+        }
+    }
+
+    if (options->input == NULL || options->output == NULL)
+    {
+        print_usage();
+    }
+    if (options->profile_generate && options->profile_use != NULL)
+    {
+        fprintf(stderr, "--profile-generate and --profile-use are mutually exclusive\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return options;
+}
+
+void dispose_options(Options *options)
+{
+    free(options);
+}
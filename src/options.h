@@ -0,0 +1,64 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#ifndef MOPTIONS_H_
+#define MOPTIONS_H_
+
+typedef enum DebugInfoLevel
+{
+    DEBUG_INFO_NONE = 0,
+    DEBUG_INFO_LINE_TABLES = 1,
+    DEBUG_INFO_FULL = 2,
+} DebugInfoLevel;
+
+// What signed integer arithmetic does when its result does not fit its type,
+// unsigned arithmetic always wraps
+typedef enum OverflowMode
+{
+    OVERFLOW_UNDEFINED = 0,
+    OVERFLOW_WRAP = 1,
+    OVERFLOW_TRAP = 2,
+} OverflowMode;
+
+typedef struct Options
+{
+    char *input;
+    char *output;
+    int opt_level;
+    DebugInfoLevel debug_info;
+    int instrument;
+    int profile_generate;
+    char *profile_use;
+    char *lto;
+    int auto_memo;
+    int memo_thread_local;
+    long const_eval_steps;
+    int fast_math;
+    int fp_contract;
+    OverflowMode overflow;
+    int unchecked;
+    char *cpu;
+    char *emit;
+    char *remarks;
+    char *remarks_format;
+    char *remarks_output;
+} Options;
+
+Options *new_options();
+Options *parse_options(int argc, char **argv);
+void dispose_options(Options *options);
+
+#endif
@@ -40,11 +40,30 @@ Parser *new_parser(FILE *file)
     p->depth = 0;
 
     // Global builtins
-    // Types
-    insert_symbol(p->scope, SYMBOL_TYPE, "int", new_type_info(TYPE_INT));
-    insert_symbol(p->scope, SYMBOL_TYPE, "float", new_type_info(TYPE_FLOAT));
+    // Types and their as_<type> conversions
+    for (Type type = TYPE_FIRST; type <= TYPE_LAST; type++)
+    {
+        char cast[32];
+        snprintf(cast, sizeof(cast), "%s%s", CAST_PREFIX, type_name(type));
+        insert_symbol(p->scope, SYMBOL_TYPE, type_name(type), new_type_info(type));
+        insert_symbol(p->scope, SYMBOL_FUNCTION, cast, new_type_info(type));
+    }
+    insert_symbol(p->scope, SYMBOL_TYPE, "i32", new_type_info(TYPE_INT));
+    insert_symbol(p->scope, SYMBOL_TYPE, "f32", new_type_info(TYPE_FLOAT));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, CAST_PREFIX "i32", new_type_info(TYPE_INT));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, CAST_PREFIX "f32", new_type_info(TYPE_FLOAT));
     // Functions
     insert_symbol(p->scope, SYMBOL_FUNCTION, "print_int", new_type_info(TYPE_INT));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, "print_float", new_type_info(TYPE_FLOAT));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, LEN, new_type_info(TYPE_INT));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, PUSH, new_type_info(TYPE_INT));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, ZEROS, new_type_info(TYPE_INFER));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, SUM, new_type_info(TYPE_INFER));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, MIN, new_type_info(TYPE_INFER));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, MAX, new_type_info(TYPE_INFER));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, DOT, new_type_info(TYPE_INFER));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, ARGMAX, new_type_info(TYPE_INT));
+    insert_symbol(p->scope, SYMBOL_FUNCTION, MATMUL, new_type_info(TYPE_INFER));
 
     next_token(p);
     return p;
@@ -52,6 +71,7 @@ Parser *new_parser(FILE *file)
 
 void dispose_parser(Parser *p)
 {
+    dispose_token(p->token);
     dispose_lexer(p->l);
     pop_scope(p->scope);
     free(p);
@@ -66,6 +86,16 @@ void parse_error(Parser *p, char *msg)
     exit(EXIT_FAILURE);
 }
 
+// For errors found once the parser has moved past the token at fault
+void parse_error_at(Token *token, char *msg)
+{
+    fprintf(stderr, "Syntax Error <%d:%d> %s\n",
+            token->line,
+            token->col,
+            msg);
+    exit(EXIT_FAILURE);
+}
+
 Token *accept_token(Parser *p, int num_types, ...)
 {
     Token *token = NULL;
@@ -94,7 +124,7 @@ Token *expect_token(Parser *p, int count, ...)
     for (int i = 0; i < count; i++)
     {
         TokenType tokenType = va_arg(args, TokenType);
-        if ((token = accept_token(p, tokenType)) != NULL)
+        if ((token = accept_token(p, 1, tokenType)) != NULL)
         {
             va_end(args);
             return token;
@@ -125,7 +155,7 @@ Symbol *accept_type(Parser *p)
         if (symbol != NULL && symbol->type == SYMBOL_TYPE)
         {
 
-            accept_token(p, 1, T_NAME);
+            dispose_token(accept_token(p, 1, T_NAME));
             return symbol;
         }
     }
@@ -144,8 +174,291 @@ void exit_scope(Parser *p)
     p->depth--;
 }
 
+// Expressions built from literals alone, such as 1 or -(2 << 4), have no type
+// of their own yet and take the one of the context they are used in
+bool is_untyped_literal(Expression *expression)
+{
+    if (expression == NULL)
+    {
+        return true;
+    }
+    if (expression->node != NULL)
+    {
+        // true and false are bool from the start
+        return expression->type_info->type != TYPE_BOOL &&
+               (expression->node->node_type == N_INTEGER || expression->node->node_type == N_FLOAT);
+    }
+    return expression->type_info->type != TYPE_BOOL &&
+           is_untyped_literal(expression->left) && is_untyped_literal(expression->right);
+}
+
+// Literals are read unsigned, a leading minus is an operator of its own.
+// Negated, a literal may also be the magnitude of the minimum of a signed
+// type, such as 128 in -128 for an i8.
+bool literal_fits(uint64_t value, Type type, bool negated)
+{
+    int bits = type_bits(type);
+    if (is_signed_type(type))
+    {
+        uint64_t limit = (uint64_t)1 << (bits - 1);
+        return negated ? value <= limit : value < limit;
+    }
+    return bits == 64 || value < (uint64_t)1 << bits;
+}
+
+bool is_negated_literal(Expression *expression)
+{
+    return expression->node == NULL && expression->token->token_type == T_SUB && expression->right == NULL &&
+           expression->left != NULL && expression->left->node != NULL && expression->left->node->node_type == N_INTEGER;
+}
+
+// Gives the literals of expression the given type when they are of the same
+// kind, integer literals for integer types and float literals for float
+// types. Anything else is left for the type checks to report.
+void coerce_literal(Parser *p, Expression *expression, Type type)
+{
+    if (expression != NULL && expression->node != NULL && expression->node->node_type == N_ARRAY)
+    {
+        // Elements share one type, parse_array made sure of it
+        for (Expression *element = expression->node->data; element != NULL; element = element->next)
+        {
+            coerce_literal(p, element, type);
+        }
+        Expression *first = expression->node->data;
+        if (first != NULL)
+        {
+            expression->type_info->type = first->type_info->type;
+        }
+        return;
+    }
+    if (expression == NULL || !is_untyped_literal(expression) || expression->type_info->type == type)
+    {
+        return;
+    }
+    if (!(is_integer_type(type) && is_integer_type(expression->type_info->type)) &&
+        !(is_float_type(type) && is_float_type(expression->type_info->type)))
+    {
+        return;
+    }
+    Expression *literal = is_negated_literal(expression) ? expression->left : expression;
+    if (literal->node != NULL && literal->node->node_type == N_INTEGER &&
+        !literal_fits(((Integer *)literal->node->data)->value, type, literal != expression))
+    {
+        parse_error_at(literal->token, "Integer literal does not fit its type");
+    }
+    if (literal != expression)
+    {
+        // Folded into one literal, negating the magnitude of a minimum in
+        // its own type would overflow
+        Integer *integer = literal->node->data;
+        integer->value = (int64_t)(0 - (uint64_t)integer->value);
+        Token *minus_token = expression->token;
+        expression->token = literal->token;
+        expression->node = literal->node;
+        literal->token = minus_token;
+        literal->node = NULL;
+        dispose_expression(literal);
+        expression->left = NULL;
+    }
+    else
+    {
+        coerce_literal(p, expression->left, type);
+        coerce_literal(p, expression->right, type);
+    }
+    expression->type_info->type = type;
+}
+
+// Integer literals are ints unless they need more bits
+Type literal_type(uint64_t value)
+{
+    if (literal_fits(value, TYPE_INT, false))
+    {
+        return TYPE_INT;
+    }
+    return literal_fits(value, TYPE_I64, false) ? TYPE_I64 : TYPE_U64;
+}
+
+// Arrays and slices are only worked on through their elements
+bool is_sequence(TypeInfo *type_info)
+{
+    return type_info->array_info != NULL || type_info->slice;
+}
+
+Expression *parse_bound(Parser *p)
+{
+    Expression *index = parse_expression(p);
+    if (index == NULL)
+    {
+        parse_error(p, "Index is missing");
+    }
+    if (!is_integer_type(index->type_info->type))
+    {
+        parse_error(p, "Array index must be an integer");
+    }
+    return index;
+}
+
+// Parses the index between brackets, the opening one already accepted, into
+// an array or slice of the given type
+Expression *parse_index(Parser *p, TypeInfo *type_info)
+{
+    if (!is_sequence(type_info))
+    {
+        parse_error(p, "Only arrays can be indexed");
+    }
+    Expression *index = parse_bound(p);
+    dispose_token(expect_token(p, 1, T_RBRACKET));
+    return index;
+}
+
+// Parses array[low:high] from the colon on, either bound can be left out
+Expression *parse_slice(Parser *p, Expression *array, Expression *low, Token *colon_token)
+{
+    if (array->type_info->tensor ||
+        (!array->type_info->slice && (array->type_info->array_info == NULL || array->type_info->array_info->next != NULL)))
+    {
+        parse_error(p, "Only slices and one dimensional arrays can be sliced");
+    }
+    Expression *high = p->token->token_type == T_RBRACKET ? NULL : parse_bound(p);
+    dispose_token(expect_token(p, 1, T_RBRACKET));
+
+    TypeInfo *type_info = new_type_info(array->type_info->type);
+    type_info->slice = true;
+    return new_expression(colon_token, NULL, NULL, new_node(N_SLICE, new_slice(array, low, high)), type_info);
+}
+
+// a[i][j] indexes a with i and the resulting row with j, every index drops
+// the outermost dimension of the type. a[i:j] views a part of a. Tensors
+// have no rows, they take an index for every dimension.
+Expression *parse_element(Parser *p, Expression *array)
+{
+    Expression *sequence = array;
+    Token *lbracket_token;
+    while ((lbracket_token = accept_token(p, 1, T_LBRACKET)) != NULL)
+    {
+        if (!is_sequence(array->type_info))
+        {
+            parse_error(p, "Only arrays can be indexed");
+        }
+        Expression *index = p->token->token_type == T_COLON ? NULL : parse_bound(p);
+        Token *colon_token;
+        if ((colon_token = accept_token(p, 1, T_COLON)) != NULL)
+        {
+            array = parse_slice(p, array, index, colon_token);
+            dispose_token(lbracket_token);
+            continue;
+        }
+        dispose_token(expect_token(p, 1, T_RBRACKET));
+        array = new_expression(lbracket_token, array, index, NULL, element_type_info(array->type_info));
+    }
+    if (array != sequence && array->type_info->tensor)
+    {
+        parse_error(p, "Tensors are indexed with one index per dimension");
+    }
+    return array;
+}
+
+bool is_empty_array(Expression *expression)
+{
+    return expression->node != NULL && expression->node->node_type == N_ARRAY && expression->node->data == NULL;
+}
+
+bool has_unknown_size(TypeInfo *type_info)
+{
+    for (ArrayInfo *array_info = type_info->array_info; array_info != NULL; array_info = array_info->next)
+    {
+        if (array_info->size < 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tensors are assigned tensors of the same shape, array literals of it and
+// zeros. Dimensions that either side only knows at runtime are checked
+// when the assignment runs, the declared ones never change.
+void check_tensor_shape(Parser *p, TypeInfo *type_info, Expression *expression)
+{
+    TypeInfo *source = expression->type_info;
+    if (is_empty_array(expression))
+    {
+        return;
+    }
+    if (!source->tensor && (expression->node == NULL || expression->node->node_type != N_ARRAY))
+    {
+        parse_error(p, "Tensors can only be assigned tensors, array literals and zeros");
+    }
+    if (source->type != TYPE_INFER && source->type != type_info->type)
+    {
+        parse_error(p, "Tensor element types do not match");
+    }
+    if (count_dimensions(source->array_info) != count_dimensions(type_info->array_info))
+    {
+        parse_error(p, "Tensor ranks do not match");
+    }
+    ArrayInfo *target = type_info->array_info;
+    for (ArrayInfo *dimension = source->array_info; dimension != NULL; dimension = dimension->next, target = target->next)
+    {
+        if (dimension->size >= 0 && target->size >= 0 && dimension->size != target->size)
+        {
+            parse_error(p, "Tensor shapes do not match");
+        }
+    }
+}
+
+// Gives a target of inferred type the type of the assigned expression and
+// checks it otherwise. Array sizes left out of a declaration are taken from
+// the expression and {} zero fills any array.
+void resolve_assigned_type(Parser *p, TypeInfo *type_info, Expression *expression)
+{
+    if (type_info->type == TYPE_INFER)
+    {
+        type_info->type = expression->type_info->type;
+        type_info->array_info = dup_array_info(expression->type_info->array_info);
+        type_info->slice = expression->type_info->slice;
+        type_info->tensor = expression->type_info->tensor;
+        return;
+    }
+    coerce_literal(p, expression, type_info->type);
+    if (type_info->tensor)
+    {
+        check_tensor_shape(p, type_info, expression);
+        return;
+    }
+    if (type_info->slice && expression->node != NULL && expression->node->node_type == N_ARRAY)
+    {
+        // Slices are filled from a literal of their elements
+        if (!is_empty_array(expression) &&
+            (expression->type_info->type != type_info->type || expression->type_info->array_info->next != NULL))
+        {
+            parse_error(p, "Variable type does not match with expression type");
+        }
+        return;
+    }
+    if (type_info->array_info != NULL && is_empty_array(expression))
+    {
+        return;
+    }
+    ArrayInfo *target = type_info->array_info;
+    ArrayInfo *source = expression->type_info->array_info;
+    for (; target != NULL && source != NULL; target = target->next, source = source->next)
+    {
+        if (target->size < 0)
+        {
+            target->size = source->size;
+        }
+    }
+    if (!type_info_equals(type_info, expression->type_info))
+    {
+        parse_error(p, "Variable type does not match with expression type");
+    }
+}
+
 Expression *parse_array(Parser *p)
 {
+    int line = p->token->line;
+    int col = p->token->col;
     dispose_token(expect_token(p, 1, T_LBRACE));
 
     Expression *elements = parse_expressions(p);
@@ -155,16 +468,37 @@ Expression *parse_array(Parser *p)
     TypeInfo *type_info;
     if (elements != NULL)
     {
-        type_info = dup_type_info(elements->type_info);
+        // Untyped literals take the type of the first typed element
+        Expression *typed = elements;
+        for (Expression *element = elements; element != NULL; element = element->next)
+        {
+            if (!is_untyped_literal(element))
+            {
+                typed = element;
+                break;
+            }
+        }
 
-        Expression *current = elements;
         int size = 0;
-        while (current != NULL)
+        for (Expression *element = elements; element != NULL; element = element->next)
         {
+            coerce_literal(p, element, typed->type_info->type);
+            if (is_sequence(element->type_info) && (element->node == NULL || element->node->node_type != N_ARRAY))
+            {
+                parse_error(p, "Array elements can only be nested array literals");
+            }
+            if (!type_info_equals(element->type_info, typed->type_info))
+            {
+                parse_error(p, "Array elements must have the same type");
+            }
             size++;
-            current = current->next;
         }
-        type_info->array_info = new_array_info(size);
+
+        // The elements of a nested literal add the inner dimensions
+        type_info = dup_type_info(typed->type_info);
+        ArrayInfo *array_info = new_array_info(size);
+        array_info->next = type_info->array_info;
+        type_info->array_info = array_info;
     }
     else
     {
@@ -172,12 +506,49 @@ Expression *parse_array(Parser *p)
         type_info->array_info = new_array_info(-1);
     }
 
-    return new_expression(
+    Expression *expression = new_expression(
         NULL,
         NULL,
         NULL,
         new_node(N_ARRAY, elements),
         type_info);
+    expression->line = line;
+    expression->col = col;
+    return expression;
+}
+
+// [2][3] after a type, an empty [] leaves the size to the initializer of an
+// array or to runtime for a tensor
+void parse_dimensions(Parser *p, TypeInfo *type_info)
+{
+    ArrayInfo *current = NULL;
+    Token *lbracket_token;
+    while ((lbracket_token = accept_token(p, 1, T_LBRACKET)))
+    {
+        if (current == NULL)
+        {
+            current = new_array_info(-1);
+            type_info->array_info = current;
+        }
+        else
+        {
+            current->next = new_array_info(-1);
+            current = current->next;
+        }
+
+        Token *integer_token;
+        if ((integer_token = accept_token(p, 1, T_INTEGER)))
+        {
+            current->size = atoi(integer_token->buffer);
+            if (current->size <= 0)
+            {
+                parse_error(p, "Array size must be positive");
+            }
+            dispose_token(integer_token);
+        }
+        dispose_token(expect_token(p, 1, T_RBRACKET));
+        dispose_token(lbracket_token);
+    }
 }
 
 TypeInfo *parse_type_info(Parser *p)
@@ -185,33 +556,45 @@ TypeInfo *parse_type_info(Parser *p)
     TypeInfo *type_info = NULL;
 
     Symbol *symbol;
-    if ((symbol = accept_type(p)) != NULL)
+    Token *slice_token;
+    Token *tensor_token;
+    if ((slice_token = accept_keyword(p, SLICE)) != NULL)
     {
+        dispose_token(expect_token(p, 1, T_LT));
+        if ((symbol = accept_type(p)) == NULL)
+        {
+            parse_error(p, "Slice element type is missing");
+        }
         type_info = dup_type_info(symbol->info);
-
-        ArrayInfo *current;
-        Token *lbracket_token;
-        while ((lbracket_token = accept_token(p, 1, T_LBRACKET)))
+        type_info->slice = true;
+        dispose_token(expect_token(p, 1, T_GT));
+        dispose_token(slice_token);
+    }
+    else if ((tensor_token = accept_keyword(p, TENSOR)) != NULL)
+    {
+        dispose_token(expect_token(p, 1, T_LT));
+        if ((symbol = accept_type(p)) == NULL)
         {
-            if (current == NULL)
-            {
-                current = new_array_info(-1);
-                type_info->array_info = current;
-            }
-            else
-            {
-                current->next = new_array_info(-1);
-                current = current->next;
-            }
-
-            Token *integer_token;
-            if ((integer_token = accept_token(p, 1, T_INTEGER)))
-            {
-                current->size = atoi(integer_token->buffer);
-            }
-            dispose_token(expect_token(p, 1, T_RBRACKET));
-            dispose_token(lbracket_token);
+            parse_error(p, "Tensor element type is missing");
+        }
+        type_info = dup_type_info(symbol->info);
+        type_info->tensor = true;
+        if (type_info->type == TYPE_BOOL)
+        {
+            parse_error(p, "Tensor elements must be numbers");
+        }
+        dispose_token(expect_token(p, 1, T_GT));
+        parse_dimensions(p, type_info);
+        if (type_info->array_info == NULL)
+        {
+            parse_error(p, "Tensor dimensions are missing");
         }
+        dispose_token(tensor_token);
+    }
+    else if ((symbol = accept_type(p)) != NULL)
+    {
+        type_info = dup_type_info(symbol->info);
+        parse_dimensions(p, type_info);
     }
     return type_info;
 }
@@ -254,6 +637,172 @@ TypeInfo *parse_type_infos(Parser *p)
     return type_info;
 }
 
+// push(slice, value) appends to a slice variable, len(sequence) gives the
+// number of elements of a slice or array and len(tensor, d) the size of a
+// dimension of a tensor, the outermost one by default. zeros(n, m, ...) is
+// a tensor of that shape filled with zeros, its element type is the one of
+// the tensor it initializes. The backend expands all of them in place.
+// Reductions take any sequence of numbers and give a value of its element
+// type, argmax an int. matmul(a, b) is the [m][n] product of [m][k] and
+// [k][n] tensors, or the [b][m][n] products of the matrices of [b][m][k]
+// and [b][k][n] ones.
+void check_sequence_builtin(Parser *p, Call *call)
+{
+    Expression *first = call->expression;
+    if (strcmp(call->name, LEN) == 0)
+    {
+        if (first == NULL || !is_sequence(first->type_info))
+        {
+            parse_error(p, "len takes a slice or an array");
+        }
+        Expression *dimension = first->next;
+        if (dimension != NULL &&
+            (!first->type_info->tensor || dimension->next != NULL || dimension->node == NULL ||
+             dimension->node->node_type != N_INTEGER ||
+             ((Integer *)dimension->node->data)->value >= count_dimensions(first->type_info->array_info)))
+        {
+            parse_error(p, "The dimension of len must be a literal below the rank of the tensor");
+        }
+    }
+    else if (strcmp(call->name, ZEROS) == 0)
+    {
+        if (first == NULL)
+        {
+            parse_error(p, "zeros takes the size of every dimension");
+        }
+        ArrayInfo **link = &call->type_info->array_info;
+        for (Expression *size = first; size != NULL; size = size->next)
+        {
+            if (!is_integer_type(size->type_info->type) || is_sequence(size->type_info))
+            {
+                parse_error(p, "Tensor dimensions must be integers");
+            }
+            *link = new_array_info(-1);
+            if (size->node != NULL && size->node->node_type == N_INTEGER)
+            {
+                int64_t value = ((Integer *)size->node->data)->value;
+                if (value <= 0 || value > INT32_MAX)
+                {
+                    parse_error(p, "Tensor dimensions must be positive");
+                }
+                (*link)->size = (int)value;
+            }
+            link = &(*link)->next;
+        }
+        call->type_info->tensor = true;
+    }
+    else if (strcmp(call->name, PUSH) == 0)
+    {
+        if (first == NULL || first->next == NULL || first->next->next != NULL || !first->type_info->slice ||
+            first->node == NULL || first->node->node_type != N_NAME)
+        {
+            parse_error(p, "push takes a slice variable and a value");
+        }
+        coerce_literal(p, first->next, first->type_info->type);
+        if (first->next->type_info->type != first->type_info->type || is_sequence(first->next->type_info))
+        {
+            parse_error(p, "Pushed value must have the element type of the slice");
+        }
+    }
+    else if (is_reduction(call->name))
+    {
+        bool is_dot = strcmp(call->name, DOT) == 0;
+        if (first == NULL || (is_dot ? first->next == NULL || first->next->next != NULL : first->next != NULL))
+        {
+            parse_error(p, is_dot ? "dot takes two sequences" : "Reductions take one sequence");
+        }
+        for (Expression *arg = first; arg != NULL; arg = arg->next)
+        {
+            if (!is_sequence(arg->type_info) || (!is_integer_type(arg->type_info->type) && !is_float_type(arg->type_info->type)))
+            {
+                parse_error(p, "Reductions take arrays, slices and tensors of numbers");
+            }
+            if (arg->node != NULL && arg->node->node_type == N_ARRAY)
+            {
+                parse_error(p, "Reductions do not take array literals");
+            }
+        }
+        Expression *second = first->next;
+        if (is_dot && (first->type_info->tensor || second->type_info->tensor))
+        {
+            if (!first->type_info->tensor || !second->type_info->tensor)
+            {
+                parse_error(p, "dot takes two tensors or two arrays or slices");
+            }
+            check_tensor_shape(p, first->type_info, second);
+        }
+        else if (is_dot)
+        {
+            if (first->type_info->type != second->type_info->type)
+            {
+                parse_error(p, "dot takes sequences of the same element type");
+            }
+            if (!first->type_info->slice && !second->type_info->slice &&
+                count_elements(first->type_info->array_info) != count_elements(second->type_info->array_info))
+            {
+                parse_error(p, "dot takes sequences of the same length");
+            }
+        }
+        if (strcmp(call->name, ARGMAX) != 0)
+        {
+            call->type_info->type = first->type_info->type;
+        }
+    }
+    else if (strcmp(call->name, MATMUL) == 0)
+    {
+        if (first == NULL || first->next == NULL || first->next->next != NULL)
+        {
+            parse_error(p, "matmul takes two tensors");
+        }
+        Expression *second = first->next;
+        TypeInfo *left = first->type_info;
+        TypeInfo *right = second->type_info;
+        Type type = left->type;
+        if (!left->tensor || !right->tensor ||
+            (type != TYPE_INT && type != TYPE_I64 && type != TYPE_FLOAT && type != TYPE_F64))
+        {
+            parse_error(p, "matmul takes tensors of int, i64, float or f64");
+        }
+        if (right->type != type)
+        {
+            parse_error(p, "matmul takes tensors of the same element type");
+        }
+        int rank = count_dimensions(left->array_info);
+        if ((rank != 2 && rank != 3) || count_dimensions(right->array_info) != rank)
+        {
+            parse_error(p, "matmul takes two matrices or two batches of them");
+        }
+        ArrayInfo *rows = left->array_info;
+        ArrayInfo *inner = right->array_info;
+        if (rank == 3)
+        {
+            if (rows->size >= 0 && inner->size >= 0 && rows->size != inner->size)
+            {
+                parse_error(p, "matmul takes batches of the same size");
+            }
+            call->type_info->array_info = new_array_info(rows->size >= 0 ? rows->size : inner->size);
+            rows = rows->next;
+            inner = inner->next;
+        }
+        if (rows->next->size >= 0 && inner->size >= 0 && rows->next->size != inner->size)
+        {
+            parse_error(p, "matmul takes a [m][k] and a [k][n] matrix");
+        }
+        ArrayInfo *dimensions = new_array_info(rows->size);
+        dimensions->next = new_array_info(inner->next->size);
+        if (call->type_info->array_info != NULL)
+        {
+            call->type_info->array_info->next = dimensions;
+        }
+        else
+        {
+            call->type_info->array_info = dimensions;
+        }
+        call->type_info->type = type;
+        call->type_info->tensor = true;
+    }
+}
+
 Call *parse_call(Parser *p, Symbol *symbol)
 {
     Call *call = NULL;
@@ -277,8 +826,27 @@ Call *parse_call(Parser *p, Symbol *symbol)
             dispose_token(commaToken);
         }
 
+        for (Expression *arg = expression; arg != NULL; arg = arg->next)
+        {
+            if (arg->type_info->array_info != NULL && !arg->type_info->tensor && strcmp(symbol->name, LEN) != 0 &&
+                !is_reduction(symbol->name))
+            {
+                parse_error(p, "Arrays can not be passed to functions, pass a slice of them");
+            }
+            if (arg->type_info->tensor && arg->type_info->type == TYPE_INFER)
+            {
+                parse_error(p, "zeros can only be assigned to a tensor");
+            }
+        }
+
         TypeInfo *call_type_info = dup_type_info(symbol->info);
         call = new_call(symbol->name, call_type_info, expression);
+        check_sequence_builtin(p, call);
+        ScopeInfo *scope_info = find_enclosing_scope_info(p->scope, SCOPE_FUNCTION);
+        if (scope_info != NULL)
+        {
+            scope_info->function->calls = true;
+        }
         dispose_token(expect_token(p, 1, T_RPAREN));
         dispose_token(lparen_token);
     }
@@ -295,7 +863,15 @@ Expression *parse_unary_expression(Parser *p)
         {
             parse_error(p, "Operand is missing");
         }
-        TypeInfo *type_info = dup_type_info(operand->type_info);
+        if (operand->type_info->tensor)
+        {
+            parse_error(p, "Only + - * / apply to tensors");
+        }
+        if (is_sequence(operand->type_info))
+        {
+            parse_error(p, "Operators do not apply to arrays and slices");
+        }
+        TypeInfo *type_info = opToken->token_type == T_LOGICAL_NOT ? new_type_info(TYPE_BOOL) : dup_type_info(operand->type_info);
         Expression *expression = new_expression(
             opToken,
             operand,
@@ -313,6 +889,57 @@ Expression *parse_expression(Parser *p)
     return parse_binary_expression(p, 0);
 }
 
+// Element-wise + - * / of two tensors of the same shape, or of a tensor and
+// a scalar applied to every element. The result knows every dimension
+// either operand knows at compile time, those that neither does are checked
+// when the operation runs.
+Expression *parse_tensor_operation(Parser *p, Token *op_token, Expression *left, Expression *right)
+{
+    TokenType op = op_token->token_type;
+    if (op != T_ADD && op != T_SUB && op != T_MUL && op != T_DIV)
+    {
+        parse_error(p, "Only + - * / apply to tensors");
+    }
+    Expression *tensor = left->type_info->tensor ? left : right;
+    Expression *other = tensor == left ? right : left;
+    if (tensor->type_info->type == TYPE_INFER || (other->type_info->tensor && other->type_info->type == TYPE_INFER))
+    {
+        parse_error(p, "zeros can only be assigned to a tensor");
+    }
+    if (!other->type_info->tensor && is_sequence(other->type_info))
+    {
+        parse_error(p, "Operators do not apply to arrays and slices");
+    }
+    coerce_literal(p, other, tensor->type_info->type);
+    if (other->type_info->type != tensor->type_info->type)
+    {
+        parse_error(p, "Tensor operands must have the same element type");
+    }
+
+    TypeInfo *type_info = dup_type_info(tensor->type_info);
+    if (other->type_info->tensor)
+    {
+        if (count_dimensions(other->type_info->array_info) != count_dimensions(type_info->array_info))
+        {
+            parse_error(p, "Tensor ranks do not match");
+        }
+        ArrayInfo *dimension = type_info->array_info;
+        for (ArrayInfo *other_dimension = other->type_info->array_info; other_dimension != NULL;
+             other_dimension = other_dimension->next, dimension = dimension->next)
+        {
+            if (dimension->size >= 0 && other_dimension->size >= 0 && dimension->size != other_dimension->size)
+            {
+                parse_error(p, "Tensor shapes do not match");
+            }
+            if (dimension->size < 0)
+            {
+                dimension->size = other_dimension->size;
+            }
+        }
+    }
+    return new_expression(op_token, left, right, NULL, type_info);
+}
+
 Expression *parse_binary_expression(Parser *p, int min_precedence)
 {
     Expression *left = parse_unary_expression(p);
@@ -354,7 +981,27 @@ Expression *parse_binary_expression(Parser *p, int min_precedence)
         {
             parse_error(p, "Expected expression after binary operator");
         }
-        TypeInfo *type_info = dup_type_info(left->type_info);
+        if (left->type_info->tensor || right->type_info->tensor)
+        {
+            left = parse_tensor_operation(p, op_token, left, right);
+            continue;
+        }
+        if (is_sequence(left->type_info) || is_sequence(right->type_info))
+        {
+            parse_error(p, "Operators do not apply to arrays and slices");
+        }
+        if (left->type_info->type != right->type_info->type)
+        {
+            if (is_untyped_literal(right))
+            {
+                coerce_literal(p, right, left->type_info->type);
+            }
+            else
+            {
+                coerce_literal(p, left, right->type_info->type);
+            }
+        }
+        TypeInfo *type_info = is_boolean_operator(op_token->token_type) ? new_type_info(TYPE_BOOL) : dup_type_info(left->type_info);
         left = new_expression(op_token, left, right, NULL, type_info);
     }
 
@@ -410,8 +1057,8 @@ Expression *parse_factor(Parser *p)
                     leaf_token,
                     NULL,
                     NULL,
-                    new_node(N_INTEGER, new_integer(atoi(leaf_token->buffer))),
-                    new_type_info(TYPE_INT));
+                    new_node(N_INTEGER, new_integer((int64_t)strtoull(leaf_token->buffer, NULL, 10))),
+                    new_type_info(literal_type(strtoull(leaf_token->buffer, NULL, 10))));
             }
             else if (leaf_token->token_type == T_FLOAT)
             {
@@ -422,12 +1069,21 @@ Expression *parse_factor(Parser *p)
                     new_node(N_FLOAT, new_float(atof(leaf_token->buffer))),
                     new_type_info(TYPE_FLOAT));
             }
+            else if (strcmp(leaf_token->buffer, TRUE) == 0 || strcmp(leaf_token->buffer, FALSE) == 0)
+            {
+                expression = new_expression(
+                    leaf_token,
+                    NULL,
+                    NULL,
+                    new_node(N_INTEGER, new_integer(strcmp(leaf_token->buffer, TRUE) == 0)),
+                    new_type_info(TYPE_BOOL));
+            }
             else if (leaf_token->token_type == T_NAME)
             {
                 Symbol *symbol = lookup_symbol(p->scope, leaf_token->buffer);
-                TypeInfo *expression_type_info = dup_type_info(symbol->info);
                 if (symbol != NULL)
                 {
+                    TypeInfo *expression_type_info = dup_type_info(symbol->info);
                     if (symbol->type == SYMBOL_FUNCTION)
                     {
                         Call *call = parse_call(p, symbol);
@@ -435,6 +1091,9 @@ Expression *parse_factor(Parser *p)
                         {
                             parse_error(p, "Function call missing");
                         }
+                        // Builtins such as zeros are typed by their arguments
+                        dispose_type_info(expression_type_info);
+                        expression_type_info = dup_type_info(call->type_info);
 
                         expression = new_expression(
                             leaf_token,
@@ -443,7 +1102,7 @@ Expression *parse_factor(Parser *p)
                             new_node(N_CALL, call),
                             expression_type_info);
                     }
-                    else if (symbol->type == SYMBOL_VARIABLE || symbol->type == SYMBOL_ARG)
+                    else if (symbol->type == SYMBOL_VARIABLE || symbol->type == SYMBOL_ARG || symbol->type == SYMBOL_CONSTANT)
                     {
 
                         expression = new_expression(
@@ -452,6 +1111,7 @@ Expression *parse_factor(Parser *p)
                             NULL,
                             new_node(N_NAME, new_name(leaf_token->buffer)),
                             expression_type_info);
+                        expression = parse_element(p, expression);
                     }
                     else
                     {
@@ -481,18 +1141,7 @@ Assignment *parse_assignment(Parser *p, Symbol *symbol)
         }
 
         TypeInfo *type_info = (TypeInfo *)symbol->info;
-
-        if (type_info->type == TYPE_INFER)
-        {
-            type_info->type = expression->type_info->type;
-        }
-        else
-        {
-            if (type_info->type != expression->type_info->type)
-            {
-                parse_error(p, "Variable type does not match with expression type");
-            }
-        }
+        resolve_assigned_type(p, type_info, expression);
         TypeInfo *assignment_type_info = dup_type_info(type_info);
         assignment = new_assignment(symbol->name, assignment_type_info, expression);
         dispose_token(assign_token);
@@ -500,6 +1149,40 @@ Assignment *parse_assignment(Parser *p, Symbol *symbol)
     return assignment;
 }
 
+// a[i][j] = expression; stores into a single element or row of an array
+Assignment *parse_element_assignment(Parser *p, Symbol *symbol)
+{
+    TypeInfo *type_info = dup_type_info(symbol->info);
+    Expression *index = NULL;
+    Expression **link = &index;
+    Token *lbracket_token;
+    while ((lbracket_token = accept_token(p, 1, T_LBRACKET)) != NULL)
+    {
+        *link = parse_index(p, type_info);
+        link = &(*link)->next;
+        TypeInfo *element = element_type_info(type_info);
+        dispose_type_info(type_info);
+        type_info = element;
+        dispose_token(lbracket_token);
+    }
+    if (type_info->tensor)
+    {
+        parse_error(p, "Tensors are indexed with one index per dimension");
+    }
+
+    dispose_token(expect_token(p, 1, T_ASSIGN));
+    Expression *expression = parse_expression(p);
+    if (expression == NULL)
+    {
+        parse_error(p, "Expression required");
+    }
+    resolve_assigned_type(p, type_info, expression);
+
+    Assignment *assignment = new_assignment(symbol->name, type_info, expression);
+    assignment->index = index;
+    return assignment;
+}
+
 Variable *parse_param(Parser *p, SymbolType symbol_type)
 {
     Variable *param = NULL;
@@ -531,11 +1214,35 @@ Variable *parse_param(Parser *p, SymbolType symbol_type)
             parse_error(p, "Symbol already exists");
         }
 
+        if (symbol_type == SYMBOL_ARG && type_info->array_info != NULL && !type_info->tensor)
+        {
+            parse_error(p, "Arrays can not be passed to functions, pass a slice of them");
+        }
+        if (symbol_type == SYMBOL_CONSTANT && type_info->slice)
+        {
+            parse_error(p, "Slices can not be constants");
+        }
+        if (type_info->tensor && (symbol_type == SYMBOL_CONSTANT || p->scope->parent == NULL))
+        {
+            parse_error(p, "Tensors can only be declared inside functions");
+        }
+
         Assignment *assignment = parse_assignment(p, symbol);
-        if (type_info->type == TYPE_INFER && assignment == NULL)
+        if (type_info->type == TYPE_INFER)
         {
             parse_error(p, "Variable type can not be resolved");
         }
+        // Tensor parameters take the shape of the argument, tensor
+        // variables the one of their initializer
+        if (type_info->tensor && has_unknown_size(type_info) &&
+            symbol_type != SYMBOL_ARG && (assignment == NULL || is_empty_array(assignment->expression)))
+        {
+            parse_error(p, "Tensor shape can not be resolved, initialize it with zeros");
+        }
+        if (!type_info->tensor && has_unknown_size(type_info))
+        {
+            parse_error(p, "Array size can not be resolved");
+        }
 
         TypeInfo *variable_type_info = dup_type_info(type_info);
         param = new_variable(name_token->buffer, variable_type_info, assignment);
@@ -556,6 +1263,7 @@ Variable *parse_variable(Parser *p)
             parse_error(p, "Variable not initialized");
         }
         dispose_token(expect_token(p, 1, T_SEMICOLON));
+        dispose_token(var_token);
     }
     return param;
 }
@@ -609,6 +1317,10 @@ Return *parse_return(Parser *p)
         }
 
         return_ = new_return(parse_expression(p));
+        if (return_->expression != NULL && is_sequence(return_->expression->type_info))
+        {
+            parse_error(p, "Functions can not return arrays, slices and tensors");
+        }
 
         if (scope_info->function->type_info->type == TYPE_INFER)
         {
@@ -625,6 +1337,7 @@ Return *parse_return(Parser *p)
         }
         else
         {
+            coerce_literal(p, return_->expression, scope_info->function->type_info->type);
             if (return_->expression->type_info->type != scope_info->function->type_info->type)
             {
                 parse_error(p, "Returned type should match the enclosing function type");
@@ -652,6 +1365,7 @@ Variable *parse_params(Parser *p, SymbolType symbol_type)
     Token *comma_token = accept_token(p, 1, T_COMMA);
     while (comma_token != NULL)
     {
+        dispose_token(comma_token);
         current->next = parse_param(p, symbol_type);
         current = current->next;
         comma_token = accept_token(p, 1, T_COMMA);
@@ -659,12 +1373,46 @@ Variable *parse_params(Parser *p, SymbolType symbol_type)
     return param;
 }
 
+bool parse_annotations(Parser *p, bool *memo, bool *specialize)
+{
+    bool annotated = false;
+    Token *at_token;
+    while ((at_token = accept_token(p, 1, T_AT)) != NULL)
+    {
+        Token *name_token = expect_token(p, 1, T_NAME);
+        if (strcmp(name_token->buffer, MEMO) == 0)
+        {
+            *memo = true;
+        }
+        else if (strcmp(name_token->buffer, SPECIALIZE) == 0)
+        {
+            *specialize = true;
+        }
+        else
+        {
+            parse_error(p, "Unknown annotation");
+        }
+        annotated = true;
+        dispose_token(name_token);
+        dispose_token(at_token);
+    }
+    return annotated;
+}
+
 Function *parse_function(Parser *p)
 {
     Function *function = NULL;
     Token *def_token;
 
-    if ((def_token = accept_keyword(p, FUNCTION)) != NULL)
+    bool memo = false;
+    bool specialize = false;
+    bool annotated = parse_annotations(p, &memo, &specialize);
+
+    if ((def_token = accept_keyword(p, FUNCTION)) == NULL && annotated)
+    {
+        parse_error(p, "Annotations must precede a function");
+    }
+    if (def_token != NULL)
     {
         if (p->scope->parent != NULL)
         {
@@ -674,6 +1422,8 @@ Function *parse_function(Parser *p)
         Token *name_token = expect_token(p, 1, T_NAME);
 
         function = new_function(name_token->buffer, NULL, NULL, NULL);
+        function->memo = memo;
+        function->specialize = specialize;
         enter_scope(p, SCOPE_FUNCTION, new_scope_info(function, false));
 
         dispose_token(expect_token(p, 1, T_LPAREN));
@@ -689,6 +1439,10 @@ Function *parse_function(Parser *p)
             {
                 parse_error(p, "Type info is missing");
             }
+            if (is_sequence(function->type_info))
+            {
+                parse_error(p, "Functions can not return arrays, slices and tensors");
+            }
             dispose_token(colon_token);
         }
 
@@ -705,11 +1459,18 @@ Function *parse_function(Parser *p)
 
         function->body = parse_block(p);
         exit_scope(p);
+        // Calls after the function see the return type inferred from its body
+        symbol_type_info->type = function->type_info->type;
 
         if (function->body == NULL)
         {
             parse_error(p, "Function body is missing");
         }
+        // Checked once the return type is inferred from the body
+        if (function->memo && !has_memo_signature(function))
+        {
+            parse_error_at(name_token, "@memo functions can only take and return 32 bit numbers");
+        }
 
         dispose_token(name_token);
         dispose_token(def_token);
@@ -767,6 +1528,7 @@ If *parse_if(Parser *p)
         Token *else_token;
         while ((else_token = accept_keyword(p, ELSE)) != NULL)
         {
+            dispose_token(else_token);
 
             If *next = parse_single_if(p);
 
@@ -840,8 +1602,18 @@ Node *parse_namebiguity(Parser *p)
 
         if (symbol != NULL)
         {
-            if (symbol->type == SYMBOL_VARIABLE || symbol->type == SYMBOL_ARG)
+            if ((symbol->type == SYMBOL_VARIABLE || symbol->type == SYMBOL_ARG) && p->token->token_type == T_LBRACKET)
+            {
+                Assignment *assignment = parse_element_assignment(p, symbol);
+                dispose_token(expect_token(p, 1, T_SEMICOLON));
+                node = new_node(N_ASSIGNMENT, assignment);
+            }
+            else if (symbol->type == SYMBOL_VARIABLE || symbol->type == SYMBOL_ARG)
             {
+                if (((TypeInfo *)symbol->info)->slice)
+                {
+                    parse_error(p, "Slices can only be assigned where they are declared");
+                }
                 Assignment *assignment = parse_assignment(p, symbol);
                 if (assignment == NULL)
                 {
@@ -850,6 +1622,10 @@ Node *parse_namebiguity(Parser *p)
                 dispose_token(expect_token(p, 1, T_SEMICOLON));
                 node = new_node(N_ASSIGNMENT, assignment);
             }
+            else if (symbol->type == SYMBOL_CONSTANT)
+            {
+                parse_error(p, "Constants can not be assigned");
+            }
             else if (symbol->type == SYMBOL_FUNCTION)
             {
                 Call *call = parse_call(p, symbol);
@@ -875,8 +1651,95 @@ Node *parse_namebiguity(Parser *p)
     return node;
 }
 
+// `const name = expression;` declares a value computed at compile time and
+// `const func` a function that can be evaluated at compile time
+Node *parse_const(Parser *p)
+{
+    Node *node = NULL;
+    Token *const_token;
+    if ((const_token = accept_keyword(p, CONST)) != NULL)
+    {
+        Function *function = parse_function(p);
+        if (function != NULL)
+        {
+            function->constant = true;
+            node = new_node(N_FUNCTION, function);
+        }
+        else
+        {
+            Variable *constant = parse_param(p, SYMBOL_CONSTANT);
+            if (constant == NULL || constant->assignment == NULL)
+            {
+                parse_error(p, "Constants must be initialized");
+            }
+            constant->constant = true;
+            dispose_token(expect_token(p, 1, T_SEMICOLON));
+            node = new_node(N_VARIABLE, constant);
+        }
+        dispose_token(const_token);
+    }
+    return node;
+}
+
+Node *parse_export(Parser *p)
+{
+    Node *node = NULL;
+    Token *export_token;
+    if ((export_token = accept_keyword(p, EXPORT)) != NULL)
+    {
+        if (p->scope->parent != NULL)
+        {
+            parse_error(p, "Only root level symbols can be exported");
+        }
+
+        Node *constant = parse_const(p);
+        Function *function = constant == NULL ? parse_function(p) : NULL;
+        Variable *variable = constant == NULL && function == NULL ? parse_variable(p) : NULL;
+        if (constant != NULL)
+        {
+            node = constant;
+            if (node->node_type == N_FUNCTION)
+            {
+                ((Function *)node->data)->exported = true;
+            }
+            else
+            {
+                ((Variable *)node->data)->exported = true;
+            }
+        }
+        else if (function != NULL)
+        {
+            function->exported = true;
+            node = new_node(N_FUNCTION, function);
+        }
+        else if (variable != NULL)
+        {
+            variable->exported = true;
+            node = new_node(N_VARIABLE, variable);
+        }
+        else
+        {
+            parse_error(p, "Only functions and variables can be exported");
+        }
+        dispose_token(export_token);
+    }
+    return node;
+}
+
 Node *parse_statement(Parser *p)
 {
+    Node *exported = parse_export(p);
+    if (exported != NULL)
+    {
+        return exported;
+    }
+
+    Node *constant = parse_const(p);
+    if (constant != NULL)
+    {
+        return constant;
+    }
+
     Function *function = parse_function(p);
     if (function != NULL)
     {
@@ -928,13 +1791,26 @@ Node *parse_statement(Parser *p)
     return NULL;
 }
 
-Node *parse(Parser *p)
+Node *parse_located_statement(Parser *p)
 {
+    int line = p->token->line;
+    int col = p->token->col;
     Node *node = parse_statement(p);
+    if (node != NULL)
+    {
+        node->line = line;
+        node->col = col;
+    }
+    return node;
+}
+
+Node *parse(Parser *p)
+{
+    Node *node = parse_located_statement(p);
     Node *current = node;
     while (current)
     {
-        current->next = parse_statement(p);
+        current->next = parse_located_statement(p);
         current = current->next;
     }
     return node;
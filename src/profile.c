@@ -0,0 +1,263 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assert.h"
+#include "constants.h"
+#include "profile.h"
+
+Profile *new_profile()
+{
+    Profile *profile = malloc(sizeof(Profile));
+    profile->counts = new_hash_table(PROFILE_TABLE_SIZE);
+    profile->occurrences = NULL;
+    profile->function = NULL;
+    profile->all_counts = NULL;
+    profile->num_counts = 0;
+    profile->num_functions = 0;
+    profile->max_function_count = 0;
+    profile->max_internal_count = 0;
+    return profile;
+}
+
+unsigned int hash_bytes(unsigned int hash, void *data, size_t size)
+{
+    // FNV-1a
+    unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+unsigned int hash_expression(unsigned int hash, Expression *expression)
+{
+    if (expression == NULL)
+    {
+        return hash_bytes(hash, "$", 1);
+    }
+
+    if (expression->token != NULL)
+    {
+        hash = hash_bytes(hash, &expression->token->token_type, sizeof(TokenType));
+    }
+    hash = hash_expression(hash, expression->left);
+    hash = hash_expression(hash, expression->right);
+
+    Node *node = expression->node;
+    if (node == NULL)
+    {
+        return hash;
+    }
+    switch (node->node_type)
+    {
+    case N_INTEGER:
+        return hash_bytes(hash, &((Integer *)node->data)->value, sizeof(int64_t));
+    case N_FLOAT:
+        return hash_bytes(hash, &((Float *)node->data)->value, sizeof(double));
+    case N_NAME:
+        return hash_bytes(hash, ((Name *)node->data)->value, strlen(((Name *)node->data)->value));
+    case N_CALL:
+    {
+        Call *call = node->data;
+        hash = hash_bytes(hash, call->name, strlen(call->name));
+        for (Expression *arg = call->expression; arg != NULL; arg = arg->next)
+        {
+            hash = hash_expression(hash, arg);
+        }
+        return hash;
+    }
+    default:
+        return hash;
+    }
+}
+
+void profile_site_signature(char *buffer, char *kind, Expression *expression)
+{
+    if (expression == NULL)
+    {
+        snprintf(buffer, PROFILE_SIGNATURE_SIZE, "%s", kind);
+    }
+    else
+    {
+        snprintf(buffer, PROFILE_SIGNATURE_SIZE, "%s:%08x", kind, hash_expression(2166136261u, expression));
+    }
+}
+
+void profile_begin_function(Profile *profile, char *function)
+{
+    if (profile->occurrences != NULL)
+    {
+        dispose_hash_table(profile->occurrences, free);
+    }
+    profile->occurrences = new_hash_table(PROFILE_TABLE_SIZE);
+    profile->function = function;
+}
+
+int profile_next_occurrence(HashTable *occurrences, char *signature)
+{
+    Bucket *bucket = lookup_value(occurrences, signature);
+    if (bucket == NULL)
+    {
+        bucket = insert_value(occurrences, signature, calloc(1, sizeof(int)));
+    }
+    return (*(int *)bucket->value)++;
+}
+
+void profile_site_key(char *buffer, char *function, char *signature, int occurrence)
+{
+    snprintf(buffer, MAX_BUFFER_SIZE, "%s %s %d", function, signature, occurrence);
+}
+
+Profile *load_profile(char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fatal("Could not open profile: %s\n", path);
+    }
+
+    Profile *profile = new_profile();
+    int capacity = 256;
+    profile->all_counts = malloc(capacity * sizeof(uint64_t));
+
+    char line[MAX_BUFFER_SIZE];
+    char function[MAX_BUFFER_SIZE] = "";
+    char key[MAX_BUFFER_SIZE];
+    char signature[MAX_BUFFER_SIZE];
+    unsigned long long count;
+    HashTable *occurrences = NULL;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+        if (sscanf(line, "function %s", function) == 1)
+        {
+            if (occurrences != NULL)
+            {
+                dispose_hash_table(occurrences, free);
+            }
+            occurrences = new_hash_table(PROFILE_TABLE_SIZE);
+            profile->num_functions++;
+            continue;
+        }
+        if (occurrences == NULL || sscanf(line, "%s %llu", signature, &count) != 2)
+        {
+            fatal("Malformed profile line in %s: %s", path, line);
+        }
+
+        profile_site_key(key, function, signature, profile_next_occurrence(occurrences, signature));
+        uint64_t *value = malloc(sizeof(uint64_t));
+        *value = count;
+        if (insert_value(profile->counts, key, value) == NULL)
+        {
+            free(value);
+            continue;
+        }
+
+        if (profile->num_counts == capacity)
+        {
+            capacity *= 2;
+            profile->all_counts = realloc(profile->all_counts, capacity * sizeof(uint64_t));
+        }
+        profile->all_counts[profile->num_counts++] = count;
+        if (strcmp(signature, "entry") == 0)
+        {
+            profile->max_function_count = count > profile->max_function_count ? count : profile->max_function_count;
+        }
+        else
+        {
+            profile->max_internal_count = count > profile->max_internal_count ? count : profile->max_internal_count;
+        }
+    }
+    if (occurrences != NULL)
+    {
+        dispose_hash_table(occurrences, free);
+    }
+    fclose(file);
+
+    return profile;
+}
+
+bool profile_lookup(Profile *profile, char *signature, uint64_t *count)
+{
+    char key[MAX_BUFFER_SIZE];
+    profile_site_key(key, profile->function, signature, profile_next_occurrence(profile->occurrences, signature));
+    Bucket *bucket = lookup_value(profile->counts, key);
+    if (bucket == NULL)
+    {
+        return false;
+    }
+    *count = *(uint64_t *)bucket->value;
+    return true;
+}
+
+uint64_t profile_total_count(Profile *profile)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < profile->num_counts; i++)
+    {
+        total += profile->all_counts[i];
+    }
+    return total;
+}
+
+int compare_counts_descending(const void *a, const void *b)
+{
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+    return left < right ? 1 : (left > right ? -1 : 0);
+}
+
+// Smallest count among the hottest counts that together make up cutoff
+// (per million) of the total, as expected by the detailed profile summary
+void profile_cutoff(Profile *profile, int cutoff, uint64_t *min_count, int *num_counts)
+{
+    qsort(profile->all_counts, profile->num_counts, sizeof(uint64_t), compare_counts_descending);
+
+    uint64_t total = profile_total_count(profile);
+    long double target = (long double)total * cutoff / 1000000;
+    uint64_t accumulated = 0;
+    *min_count = 0;
+    *num_counts = 0;
+    for (int i = 0; i < profile->num_counts; i++)
+    {
+        accumulated += profile->all_counts[i];
+        *min_count = profile->all_counts[i];
+        *num_counts = i + 1;
+        if (accumulated >= target)
+        {
+            break;
+        }
+    }
+}
+
+void dispose_profile(Profile *profile)
+{
+    dispose_hash_table(profile->counts, free);
+    if (profile->occurrences != NULL)
+    {
+        dispose_hash_table(profile->occurrences, free);
+    }
+    free(profile->all_counts);
+    free(profile);
+}
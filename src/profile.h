@@ -0,0 +1,54 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#ifndef MPROFILE_H_
+#define MPROFILE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hashtable.h"
+#include "node.h"
+
+#define PROFILE_TABLE_SIZE 4096
+#define PROFILE_SIGNATURE_SIZE 64
+
+// Counts read back from a --profile-generate run. Sites are keyed by their
+// function name, a signature built from the site kind and the shape of its
+// condition, and the occurrence of that signature within the function, so
+// edits elsewhere in the source leave the remaining sites matched.
+typedef struct Profile
+{
+    HashTable *counts;
+    HashTable *occurrences;
+    char *function;
+    uint64_t *all_counts;
+    int num_counts;
+    int num_functions;
+    uint64_t max_function_count;
+    uint64_t max_internal_count;
+} Profile;
+
+Profile *new_profile();
+Profile *load_profile(char *path);
+void profile_site_signature(char *buffer, char *kind, Expression *expression);
+void profile_begin_function(Profile *profile, char *function);
+bool profile_lookup(Profile *profile, char *signature, uint64_t *count);
+uint64_t profile_total_count(Profile *profile);
+void profile_cutoff(Profile *profile, int cutoff, uint64_t *min_count, int *num_counts);
+void dispose_profile(Profile *profile);
+
+#endif
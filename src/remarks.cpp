@@ -0,0 +1,91 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"},;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LLVMRemarkStreamer.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Remarks/RemarkStreamer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "remarks.h"
+
+struct LlvmRemarkStream
+{
+    std::string yaml;
+    llvm::raw_string_ostream out;
+
+    LlvmRemarkStream() : out(yaml)
+    {
+    }
+};
+
+// The context stops streaming before the buffer goes away
+void llvm_stop_remarks(llvm::LLVMContext &context)
+{
+    context.setLLVMRemarkStreamer(nullptr);
+    context.setMainRemarkStreamer(nullptr);
+}
+
+// NULL with a message in error when passes is not a valid regex
+LlvmRemarkStream *llvm_open_remarks(LLVMContextRef context, const char *passes, char **error)
+{
+    LlvmRemarkStream *stream = new LlvmRemarkStream();
+    llvm::Error err = llvm::setupLLVMOptimizationRemarks(*llvm::unwrap(context), stream->out, passes, "yaml", false);
+    if (err)
+    {
+        *error = strdup(llvm::toString(std::move(err)).c_str());
+        llvm_stop_remarks(*llvm::unwrap(context));
+        delete stream;
+        return NULL;
+    }
+    return stream;
+}
+
+// The YAML documents of the remarks streamed so far, to be freed by the
+// caller
+char *llvm_close_remarks(LLVMContextRef context, LlvmRemarkStream *stream, size_t *length)
+{
+    llvm_stop_remarks(*llvm::unwrap(context));
+    stream->out.flush();
+    *length = stream->yaml.size();
+    char *yaml = (char *)malloc(*length + 1);
+    memcpy(yaml, stream->yaml.c_str(), *length + 1);
+    delete stream;
+    return yaml;
+}
+
+// Constants folded by the builder have no flags to set
+void llvm_set_fast_math_flags(LLVMValueRef value, bool fast, bool contract)
+{
+    llvm::Instruction *instruction = llvm::dyn_cast<llvm::Instruction>(llvm::unwrap(value));
+    if (instruction == nullptr || !llvm::isa<llvm::FPMathOperator>(instruction))
+    {
+        return;
+    }
+    if (fast)
+    {
+        instruction->setFast(true);
+    }
+    if (contract)
+    {
+        instruction->setHasAllowContract(true);
+    }
+}
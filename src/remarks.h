@@ -0,0 +1,47 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"},;
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#ifndef MREMARKS_H_
+#define MREMARKS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <llvm-c/Core.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// LLVM serializes optimization remarks with their kind, pass and name only
+// through its C++ API, remarks.cpp is the bridge to it. The remarks of the
+// passes matching a regex are streamed as YAML into memory while the
+// context optimizes and generates code, then read back with the remark
+// parser of the C API.
+typedef struct LlvmRemarkStream LlvmRemarkStream;
+
+LlvmRemarkStream *llvm_open_remarks(LLVMContextRef context, const char *passes, char **error);
+char *llvm_close_remarks(LLVMContextRef context, LlvmRemarkStream *stream, size_t *length);
+
+// The C API can not set fast-math flags on an instruction either. fast sets
+// all of them, contract only allows fusing into an FMA.
+void llvm_set_fast_math_flags(LLVMValueRef value, bool fast, bool contract);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
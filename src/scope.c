@@ -26,7 +26,7 @@ Scope *push_scope(Scope *parent, ScopeType type, void *info, void (*dispose_info
     scope->parent = parent;
     scope->info = info;
     scope->type = type;
-    scope->symbol_table = new_hash_table(SYMBOL_TABLE_SIZE);
+    scope->symbol_table = new_hash_table(parent == NULL ? SYMBOL_TABLE_SIZE : LOCAL_SYMBOL_TABLE_SIZE);
     if (dispose_info == NULL)
     {
         assert(scope->parent != NULL);
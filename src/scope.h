@@ -23,6 +23,8 @@
 #include "stdbool.h"
 
 #define SYMBOL_TABLE_SIZE 1024
+// Functions and blocks only hold their own locals
+#define LOCAL_SYMBOL_TABLE_SIZE 64
 
 typedef enum SymbolType
 {
@@ -30,6 +32,7 @@ typedef enum SymbolType
     SYMBOL_FUNCTION = 1,
     SYMBOL_TYPE = 2,
     SYMBOL_ARG = 3,
+    SYMBOL_CONSTANT = 4,
 } SymbolType;
 
 typedef enum ScopeType
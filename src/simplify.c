@@ -0,0 +1,445 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eval.h"
+#include "hashtable.h"
+#include "simplify.h"
+
+bool is_literal(Expression *expression)
+{
+    return expression != NULL && expression->left == NULL && expression->right == NULL &&
+           (expression->node->node_type == N_INTEGER || expression->node->node_type == N_FLOAT);
+}
+
+void replace_with_literal(Expression *expression, EvalValue value)
+{
+    dispose_expression(expression->left);
+    dispose_expression(expression->right);
+    dispose_node(expression->node);
+    expression->left = NULL;
+    expression->right = NULL;
+    if (is_float_type(value.type))
+    {
+        expression->node = new_node(N_FLOAT, new_float(value.float_value));
+    }
+    else
+    {
+        expression->node = new_node(N_INTEGER, new_integer(value.int_value));
+    }
+}
+
+// Folds the constant parts of expression in place. Returns whether
+// expression only combines literals, possibly through casts, so each node is
+// judged from its children without walking them again.
+bool simplify_expression(Eval *eval, Expression *expression)
+{
+    if (expression == NULL || is_literal(expression))
+    {
+        return true;
+    }
+    bool constant = simplify_expression(eval, expression->left);
+    constant = simplify_expression(eval, expression->right) && constant;
+    if (expression->node != NULL && expression->node->node_type == N_CALL)
+    {
+        // A cast of a constant is constant, its operand is the first argument
+        Call *call = expression->node->data;
+        constant = is_cast(call->name);
+        for (Expression *arg = call->expression; arg != NULL; arg = arg->next)
+        {
+            bool constant_arg = simplify_expression(eval, arg);
+            constant = constant && (arg != call->expression || constant_arg);
+        }
+    }
+    else if (expression->node != NULL && expression->node->node_type == N_ARRAY)
+    {
+        for (Expression *element = expression->node->data; element != NULL; element = element->next)
+        {
+            simplify_expression(eval, element);
+        }
+        return false;
+    }
+    else if (expression->node != NULL && expression->node->node_type == N_SLICE)
+    {
+        Slice *slice = expression->node->data;
+        simplify_expression(eval, slice->array);
+        simplify_expression(eval, slice->low);
+        simplify_expression(eval, slice->high);
+        return false;
+    }
+    else if (expression->node != NULL)
+    {
+        constant = false;
+    }
+
+    // Constant comparisons fold into true or false, the literal keeps the
+    // bool type of the expression. Anything the interpreter rejects, such as
+    // a division by zero, is left for runtime.
+    EvalValue value;
+    if (constant && eval_expression(eval, expression, &value))
+    {
+        replace_with_literal(expression, value);
+    }
+    return constant;
+}
+
+// Only called with a condition simplify_expression found constant
+bool constant_condition(Eval *eval, Expression *condition, bool *taken)
+{
+    EvalValue value;
+    if (!eval_expression(eval, condition, &value))
+    {
+        return false;
+    }
+    *taken = is_float_type(value.type) ? value.float_value != 0 : value.int_value != 0;
+    return true;
+}
+
+// How a name is used in a function body, the flags of every use are
+// combined in a single table
+typedef enum LocalUse
+{
+    USE_DECLARED = 1,
+    USE_READ = 2,
+    USE_KEPT = 4
+} LocalUse;
+
+// unused counts the names only declared so far, nothing is removed when it
+// ends up zero
+typedef struct LocalUses
+{
+    HashTable *names;
+    int unused;
+} LocalUses;
+
+void mark_use(LocalUses *uses, char *name, LocalUse use)
+{
+    Bucket *bucket = lookup_value(uses->names, name);
+    if (bucket == NULL)
+    {
+        bucket = insert_value(uses->names, name, NULL);
+    }
+    intptr_t before = (intptr_t)bucket->value;
+    bucket->value = (void *)(before | use);
+    uses->unused += ((before | use) == USE_DECLARED) - (before == USE_DECLARED);
+}
+
+// Marks the names read in expression and returns whether computing it has an
+// effect: a call, casts aside, or a check that may abort, an index or a slice
+// out of bounds or a tensor of the wrong shape
+bool collect_reads(LocalUses *uses, Expression *expression)
+{
+    bool effects = false;
+    for (; expression != NULL; expression = expression->next)
+    {
+        effects |= collect_reads(uses, expression->left);
+        effects |= collect_reads(uses, expression->right);
+        effects |= expression->type_info != NULL && expression->type_info->tensor;
+        if (expression->node == NULL)
+        {
+            effects |= expression->token->token_type == T_LBRACKET;
+            continue;
+        }
+        if (expression->node->node_type == N_NAME)
+        {
+            mark_use(uses, ((Name *)expression->node->data)->value, USE_READ);
+        }
+        else if (expression->node->node_type == N_CALL)
+        {
+            Call *call = expression->node->data;
+            effects |= collect_reads(uses, call->expression) || !is_cast(call->name);
+        }
+        else if (expression->node->node_type == N_ARRAY)
+        {
+            effects |= collect_reads(uses, expression->node->data);
+        }
+        else if (expression->node->node_type == N_SLICE)
+        {
+            Slice *slice = expression->node->data;
+            collect_reads(uses, slice->array);
+            collect_reads(uses, slice->low);
+            collect_reads(uses, slice->high);
+            effects = true;
+        }
+    }
+    return effects;
+}
+
+// Records the locals a statement declares, the names it reads and the
+// locals that must be kept because computing their value has an effect.
+// Slices are always kept, writing through one may change what a view of it
+// or the slice it views reads. Statements are recorded once simplified, so
+// nothing in an arm or after a jump that was dropped counts.
+void collect_statement(LocalUses *uses, Node *node)
+{
+    switch (node->node_type)
+    {
+    case N_VARIABLE:
+    {
+        Variable *variable = node->data;
+        mark_use(uses, variable->name, USE_DECLARED);
+        if (variable->type_info->slice)
+        {
+            mark_use(uses, variable->name, USE_KEPT);
+        }
+        if (variable->assignment != NULL && collect_reads(uses, variable->assignment->expression))
+        {
+            mark_use(uses, variable->name, USE_KEPT);
+        }
+        break;
+    }
+    case N_ASSIGNMENT:
+    {
+        Assignment *assignment = node->data;
+        // Storing through an index checks it too
+        bool effects = collect_reads(uses, assignment->expression);
+        if (collect_reads(uses, assignment->index) || effects || assignment->index != NULL)
+        {
+            mark_use(uses, assignment->name, USE_KEPT);
+        }
+        break;
+    }
+    case N_CALL:
+        collect_reads(uses, ((Call *)node->data)->expression);
+        break;
+    case N_RETURN:
+        collect_reads(uses, ((Return *)node->data)->expression);
+        break;
+    default:
+        break;
+    }
+}
+
+Node *simplify_statements(Eval *eval, Node *statements, LocalUses *uses);
+
+// Drops the arms that can never run and turns the first arm that always
+// runs into the final else. Returns NULL when no arm is left.
+If *simplify_if(Eval *eval, If *if_, LocalUses *uses)
+{
+    If **link = &if_;
+    while (*link != NULL)
+    {
+        If *arm = *link;
+        bool constant = simplify_expression(eval, arm->condition);
+        bool taken;
+        if (arm->condition != NULL && constant && constant_condition(eval, arm->condition, &taken))
+        {
+            if (!taken)
+            {
+                *link = arm->next;
+                arm->next = NULL;
+                dispose_if(arm);
+                continue;
+            }
+            dispose_expression(arm->condition);
+            arm->condition = NULL;
+            dispose_if(arm->next);
+            arm->next = NULL;
+        }
+        collect_reads(uses, arm->condition);
+        arm->body->statements = simplify_statements(eval, arm->body->statements, uses);
+        link = &arm->next;
+    }
+    return if_;
+}
+
+Node *simplify_statements(Eval *eval, Node *statements, LocalUses *uses)
+{
+    Node head;
+    head.next = statements;
+    Node *previous = &head;
+    for (Node *node = statements; node != NULL; node = previous->next)
+    {
+        bool removed = false;
+        switch (node->node_type)
+        {
+        case N_VARIABLE:
+        {
+            Variable *variable = node->data;
+            if (variable->assignment != NULL)
+            {
+                simplify_expression(eval, variable->assignment->expression);
+            }
+            break;
+        }
+        case N_ASSIGNMENT:
+            simplify_expression(eval, ((Assignment *)node->data)->expression);
+            for (Expression *index = ((Assignment *)node->data)->index; index != NULL; index = index->next)
+            {
+                simplify_expression(eval, index);
+            }
+            break;
+        case N_CALL:
+            for (Expression *arg = ((Call *)node->data)->expression; arg != NULL; arg = arg->next)
+            {
+                simplify_expression(eval, arg);
+            }
+            break;
+        case N_RETURN:
+            simplify_expression(eval, ((Return *)node->data)->expression);
+            break;
+        case N_IF:
+            node->data = simplify_if(eval, node->data, uses);
+            removed = node->data == NULL;
+            break;
+        case N_WHILE:
+        {
+            While *while_ = node->data;
+            bool constant = simplify_expression(eval, while_->condition);
+            bool taken;
+            if (constant && constant_condition(eval, while_->condition, &taken) && !taken)
+            {
+                removed = true;
+                break;
+            }
+            collect_reads(uses, while_->condition);
+            while_->body->statements = simplify_statements(eval, while_->body->statements, uses);
+            break;
+        }
+        default:
+            break;
+        }
+
+        if (removed)
+        {
+            previous->next = node->next;
+            node->next = NULL;
+            dispose_node(node);
+            continue;
+        }
+        collect_statement(uses, node);
+
+        // Nothing after a jump out of the block can run
+        if (node->node_type == N_RETURN || node->node_type == N_BREAK || node->node_type == N_CONTINUE)
+        {
+            dispose_node(node->next);
+            node->next = NULL;
+        }
+        previous = node;
+    }
+    return head.next;
+}
+
+// The globals declared before the function being simplified. A local may
+// share the name of one it assigns in another scope. Names are only
+// gathered once a local looks unused.
+typedef struct GlobalNames
+{
+    HashTable *names;
+    Node *scanned;
+    Node *until;
+} GlobalNames;
+
+bool is_global(GlobalNames *globals, char *name)
+{
+    for (; globals->scanned != globals->until; globals->scanned = globals->scanned->next)
+    {
+        if (globals->scanned->node_type == N_VARIABLE)
+        {
+            insert_value(globals->names, ((Variable *)globals->scanned->data)->name, NULL);
+        }
+    }
+    return lookup_value(globals->names, name) != NULL;
+}
+
+bool is_unused(char *name, LocalUses *uses, GlobalNames *globals)
+{
+    Bucket *bucket = lookup_value(uses->names, name);
+    return bucket != NULL && (intptr_t)bucket->value == USE_DECLARED && !is_global(globals, name);
+}
+
+Node *remove_unused_locals(Node *statements, LocalUses *uses, GlobalNames *globals)
+{
+    Node head;
+    head.next = statements;
+    Node *previous = &head;
+    for (Node *node = statements; node != NULL; node = previous->next)
+    {
+        bool removed = false;
+        switch (node->node_type)
+        {
+        case N_VARIABLE:
+            removed = !((Variable *)node->data)->constant && is_unused(((Variable *)node->data)->name, uses, globals);
+            break;
+        case N_ASSIGNMENT:
+            removed = is_unused(((Assignment *)node->data)->name, uses, globals);
+            break;
+        case N_IF:
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                if_->body->statements = remove_unused_locals(if_->body->statements, uses, globals);
+            }
+            break;
+        case N_WHILE:
+            ((While *)node->data)->body->statements = remove_unused_locals(((While *)node->data)->body->statements, uses, globals);
+            break;
+        default:
+            break;
+        }
+
+        if (removed)
+        {
+            previous->next = node->next;
+            node->next = NULL;
+            dispose_node(node);
+            continue;
+        }
+        previous = node;
+    }
+    return head.next;
+}
+
+void simplify(Node *ast)
+{
+    // Only literals and casts are ever evaluated here, a small budget is
+    // plenty
+    Eval *eval = new_eval(NULL, 1024, NULL, NULL);
+    size_t global_count = count_variables(ast);
+    GlobalNames globals = {new_hash_table(global_count > SIMPLIFY_TABLE_SIZE ? global_count : SIMPLIFY_TABLE_SIZE), ast,
+                           NULL};
+    for (Node *node = ast; node != NULL; node = node->next)
+    {
+        if (node->node_type == N_VARIABLE)
+        {
+            Variable *variable = node->data;
+            if (variable->assignment != NULL)
+            {
+                simplify_expression(eval, variable->assignment->expression);
+            }
+        }
+        else if (node->node_type == N_FUNCTION)
+        {
+            Function *function = node->data;
+            // Every local is looked up on each use, a table too small for
+            // them would make simplifying a long body quadratic
+            size_t local_count = count_variables(function->body->statements);
+            LocalUses uses = {
+                new_hash_table(local_count > SIMPLIFY_LOCALS_TABLE_SIZE ? local_count : SIMPLIFY_LOCALS_TABLE_SIZE), 0};
+            function->body->statements = simplify_statements(eval, function->body->statements, &uses);
+            if (uses.unused > 0)
+            {
+                globals.until = node;
+                function->body->statements = remove_unused_locals(function->body->statements, &uses, &globals);
+            }
+            dispose_hash_table(uses.names, NULL);
+        }
+    }
+    dispose_hash_table(globals.names, NULL);
+    dispose_eval(eval);
+}
@@ -0,0 +1,32 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#ifndef MSIMPLIFY_H_
+#define MSIMPLIFY_H_
+
+#include "node.h"
+
+#define SIMPLIFY_TABLE_SIZE 256
+#define SIMPLIFY_LOCALS_TABLE_SIZE 32
+
+// Front end clean up run between parse() and code generation: folds
+// constant subexpressions, prunes constant if arms and while loops, drops
+// statements after return, break and continue, and removes locals that are
+// never read.
+bool is_literal(Expression *expression);
+void simplify(Node *ast);
+
+#endif
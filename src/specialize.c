@@ -0,0 +1,591 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simplify.h"
+#include "specialize.h"
+
+typedef void (*SpecializeCallVisitor)(Specializer *specializer, Call *call);
+typedef void (*SpecializeExpressionVisitor)(Specializer *specializer, Expression *expression);
+
+void specialize_walk_expression(Specializer *specializer, Expression *expression, SpecializeCallVisitor visit_call,
+                                SpecializeExpressionVisitor visit_expression)
+{
+    for (; expression != NULL; expression = expression->next)
+    {
+        specialize_walk_expression(specializer, expression->left, visit_call, visit_expression);
+        specialize_walk_expression(specializer, expression->right, visit_call, visit_expression);
+        if (expression->node != NULL && expression->node->node_type == N_CALL)
+        {
+            Call *call = expression->node->data;
+            specialize_walk_expression(specializer, call->expression, visit_call, visit_expression);
+            if (visit_call != NULL)
+            {
+                visit_call(specializer, call);
+            }
+        }
+        else if (expression->node != NULL && expression->node->node_type == N_ARRAY)
+        {
+            specialize_walk_expression(specializer, expression->node->data, visit_call, visit_expression);
+        }
+        else if (expression->node != NULL && expression->node->node_type == N_SLICE)
+        {
+            Slice *slice = expression->node->data;
+            specialize_walk_expression(specializer, slice->array, visit_call, visit_expression);
+            specialize_walk_expression(specializer, slice->low, visit_call, visit_expression);
+            specialize_walk_expression(specializer, slice->high, visit_call, visit_expression);
+        }
+        if (visit_expression != NULL)
+        {
+            visit_expression(specializer, expression);
+        }
+    }
+}
+
+void specialize_walk_statements(Specializer *specializer, Node *statements, SpecializeCallVisitor visit_call,
+                                SpecializeExpressionVisitor visit_expression)
+{
+    for (Node *node = statements; node != NULL; node = node->next)
+    {
+        switch (node->node_type)
+        {
+        case N_VARIABLE:
+            if (((Variable *)node->data)->assignment != NULL)
+            {
+                specialize_walk_expression(specializer, ((Variable *)node->data)->assignment->expression, visit_call, visit_expression);
+            }
+            break;
+        case N_ASSIGNMENT:
+            specialize_walk_expression(specializer, ((Assignment *)node->data)->expression, visit_call, visit_expression);
+            specialize_walk_expression(specializer, ((Assignment *)node->data)->index, visit_call, visit_expression);
+            break;
+        case N_CALL:
+            specialize_walk_expression(specializer, ((Call *)node->data)->expression, visit_call, visit_expression);
+            if (visit_call != NULL)
+            {
+                visit_call(specializer, node->data);
+            }
+            break;
+        case N_RETURN:
+            specialize_walk_expression(specializer, ((Return *)node->data)->expression, visit_call, visit_expression);
+            break;
+        case N_IF:
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                specialize_walk_expression(specializer, if_->condition, visit_call, visit_expression);
+                specialize_walk_statements(specializer, if_->body->statements, visit_call, visit_expression);
+            }
+            break;
+        case N_WHILE:
+            specialize_walk_expression(specializer, ((While *)node->data)->condition, visit_call, visit_expression);
+            specialize_walk_statements(specializer, ((While *)node->data)->body->statements, visit_call, visit_expression);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+int specialize_param_index(Function *function, char *name)
+{
+    int i = 0;
+    for (Variable *param = function->params; param != NULL; param = param->next, i++)
+    {
+        if (strcmp(param->name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Parameters the body assigns or shadows keep their value out of reach
+void specialize_exclude_assigned(SpecializeCandidate *candidate, Node *statements)
+{
+    for (Node *node = statements; node != NULL; node = node->next)
+    {
+        switch (node->node_type)
+        {
+        case N_VARIABLE:
+        case N_ASSIGNMENT:
+        {
+            char *name = node->node_type == N_VARIABLE ? ((Variable *)node->data)->name : ((Assignment *)node->data)->name;
+            int i = specialize_param_index(candidate->function, name);
+            if (i >= 0)
+            {
+                candidate->eligible[i] = false;
+            }
+            break;
+        }
+        case N_IF:
+            for (If *if_ = node->data; if_ != NULL; if_ = if_->next)
+            {
+                specialize_exclude_assigned(candidate, if_->body->statements);
+            }
+            break;
+        case N_WHILE:
+            specialize_exclude_assigned(candidate, ((While *)node->data)->body->statements);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void specialize_count_size(Specializer *specializer, Expression *expression)
+{
+    specializer->size++;
+}
+
+// Scalar parameters are eligible until the body turns out to assign them.
+// Returns NULL when the function can not be cloned at all.
+SpecializeCandidate *new_specialize_candidate(Node *node, bool automatic)
+{
+    Function *function = node->data;
+    if (function->constant || function->params == NULL || (!automatic && !function->specialize))
+    {
+        return NULL;
+    }
+    SpecializeCandidate *candidate = malloc(sizeof(SpecializeCandidate));
+    candidate->function = function;
+    candidate->node = node;
+    candidate->num_params = 0;
+    for (Variable *param = function->params; param != NULL; param = param->next)
+    {
+        candidate->num_params++;
+    }
+    candidate->eligible = calloc(candidate->num_params, sizeof(bool));
+    int i = 0;
+    for (Variable *param = function->params; param != NULL; param = param->next, i++)
+    {
+        candidate->eligible[i] = param->type_info != NULL && param->type_info->array_info == NULL &&
+                                 (is_integer_type(param->type_info->type) || is_float_type(param->type_info->type));
+    }
+    candidate->num_clones = 0;
+    candidate->recurring = false;
+    candidate->specializations = NULL;
+    // Each function only sees a few distinct literals
+    candidate->values = new_hash_table(SPECIALIZE_CANDIDATE_TABLE_SIZE);
+    // Only functions with a recurring literal get clones to look up
+    candidate->keys = NULL;
+    return candidate;
+}
+
+// Only looked at once a literal recurs or the function asks to be cloned,
+// walking every body up front costs more than the few clones it decides.
+// Returns whether a parameter is still eligible.
+bool specialize_worth_cloning(Specializer *specializer, SpecializeCandidate *candidate)
+{
+    Function *function = candidate->function;
+    // Small functions are left to the inliner, large ones would grow the
+    // code too much with every clone
+    specializer->size = 0;
+    specialize_walk_statements(specializer, function->body->statements, NULL, specialize_count_size);
+    if (!function->specialize && (specializer->size < SPECIALIZE_MIN_SIZE || specializer->size > SPECIALIZE_MAX_SIZE))
+    {
+        return false;
+    }
+
+    specialize_exclude_assigned(candidate, function->body->statements);
+    for (int i = 0; i < candidate->num_params; i++)
+    {
+        if (candidate->eligible[i])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The literal passed for a parameter when it can take its place
+Node *specialize_argument(Variable *param, Expression *arg)
+{
+    if (arg == NULL || !is_literal(arg))
+    {
+        return NULL;
+    }
+    // Integer literals wrap to the parameter type like the converted
+    // argument does, float literals are only exact in their own type
+    if ((is_integer_type(param->type_info->type) && arg->node->node_type == N_INTEGER) ||
+        (param->type_info->type == arg->type_info->type && arg->node->node_type == N_FLOAT))
+    {
+        return arg->node;
+    }
+    return NULL;
+}
+
+// Names a parameter and the literal passed for it, such as "1:3" or
+// "0:0x1p+1"
+void specialize_value_key(char *key, int i, Node *value)
+{
+    if (value->node_type == N_INTEGER)
+    {
+        sprintf(key, "%d:%lld", i, (long long)((Integer *)value->data)->value);
+    }
+    else
+    {
+        sprintf(key, "%d:%a", i, ((Float *)value->data)->value);
+    }
+}
+
+// Counts how often each parameter is passed each literal
+void specialize_count_values(Specializer *specializer, Call *call)
+{
+    Bucket *bucket = lookup_value(specializer->candidates, call->name);
+    if (bucket == NULL)
+    {
+        return;
+    }
+    SpecializeCandidate *candidate = bucket->value;
+    Expression *arg = call->expression;
+    int i = 0;
+    for (Variable *param = candidate->function->params; param != NULL; param = param->next, i++)
+    {
+        Node *value = candidate->eligible[i] ? specialize_argument(param, arg) : NULL;
+        if (value != NULL)
+        {
+            char key[SPECIALIZE_VALUE_KEY_SIZE];
+            specialize_value_key(key, i, value);
+            Bucket *seen = lookup_value(candidate->values, key);
+            if (seen == NULL)
+            {
+                seen = insert_value(candidate->values, key, calloc(1, sizeof(int)));
+            }
+            (*(int *)seen->value)++;
+            candidate->recurring = candidate->recurring || *(int *)seen->value >= SPECIALIZE_MIN_CALLS;
+        }
+        arg = arg != NULL ? arg->next : NULL;
+    }
+}
+
+// A literal argument is worth a clone when the same parameter gets it at
+// several call sites, or always when the function asks for it
+Node *specialize_recurring(SpecializeCandidate *candidate, int i, Node *value)
+{
+    if (value == NULL || candidate->function->specialize)
+    {
+        return value;
+    }
+    char key[SPECIALIZE_VALUE_KEY_SIZE];
+    specialize_value_key(key, i, value);
+    Bucket *seen = lookup_value(candidate->values, key);
+    return seen != NULL && *(int *)seen->value >= SPECIALIZE_MIN_CALLS ? value : NULL;
+}
+
+// Builds a key from the recurring literal arguments of call, such as
+// "_,3,0x1p+1", fills values when given. Returns NULL when there are none.
+char *specialize_key(SpecializeCandidate *candidate, Call *call, Node **values)
+{
+    char *key = malloc(candidate->num_params * 32 + 1);
+    int length = 0;
+    bool any = false;
+    Expression *arg = call->expression;
+    int i = 0;
+    for (Variable *param = candidate->function->params; param != NULL; param = param->next, i++)
+    {
+        Node *value = candidate->eligible[i] ? specialize_recurring(candidate, i, specialize_argument(param, arg)) : NULL;
+        if (value == NULL)
+        {
+            length += sprintf(key + length, i == 0 ? "_" : ",_");
+        }
+        else if (value->node_type == N_INTEGER)
+        {
+            length += sprintf(key + length, i == 0 ? "%lld" : ",%lld", (long long)((Integer *)value->data)->value);
+        }
+        else
+        {
+            length += sprintf(key + length, i == 0 ? "%a" : ",%a", ((Float *)value->data)->value);
+        }
+        if (values != NULL)
+        {
+            values[i] = dup_node(value);
+        }
+        any = any || value != NULL;
+        arg = arg != NULL ? arg->next : NULL;
+    }
+    if (!any)
+    {
+        free(key);
+        return NULL;
+    }
+    return key;
+}
+
+void specialize_count(Specializer *specializer, Call *call)
+{
+    Bucket *bucket = lookup_value(specializer->candidates, call->name);
+    if (bucket == NULL)
+    {
+        return;
+    }
+    SpecializeCandidate *candidate = bucket->value;
+    if (!candidate->recurring && !candidate->function->specialize)
+    {
+        return;
+    }
+    char *key = specialize_key(candidate, call, NULL);
+    if (key == NULL)
+    {
+        return;
+    }
+
+    if (candidate->keys == NULL)
+    {
+        candidate->keys = new_hash_table(SPECIALIZE_CANDIDATE_TABLE_SIZE);
+    }
+    if (lookup_value(candidate->keys, key) != NULL)
+    {
+        free(key);
+        return;
+    }
+
+    // Kept in the order they are first seen so that clones are numbered
+    // the same way on every run
+    Specialization *specialization = malloc(sizeof(Specialization));
+    specialization->values = calloc(candidate->num_params, sizeof(Node *));
+    specialization->key = specialize_key(candidate, call, specialization->values);
+    specialization->name = NULL;
+    specialization->next = NULL;
+    Specialization **link = &candidate->specializations;
+    while (*link != NULL)
+    {
+        link = &(*link)->next;
+    }
+    *link = specialization;
+    insert_value(candidate->keys, key, specialization);
+    free(key);
+}
+
+void specialize_substitute(Specializer *specializer, Expression *expression)
+{
+    if (expression->node == NULL || expression->node->node_type != N_NAME)
+    {
+        return;
+    }
+    int i = specialize_param_index(specializer->candidate->function, ((Name *)expression->node->data)->value);
+    if (i < 0 || specializer->specialization->values[i] == NULL)
+    {
+        return;
+    }
+    dispose_node(expression->node);
+    expression->node = dup_node(specializer->specialization->values[i]);
+}
+
+// Copies the function with the constant parameters dropped and their uses
+// replaced by the literals, the clone is placed right after the original
+Node *clone_specialization(Specializer *specializer, SpecializeCandidate *candidate, Specialization *specialization,
+                           Node *after)
+{
+    Function *clone = dup_function(candidate->function);
+    specialization->name = malloc(strlen(clone->name) + 32);
+    sprintf(specialization->name, "%s.specialized.%d", clone->name, ++candidate->num_clones);
+    free(clone->name);
+    clone->name = strdup(specialization->name);
+    clone->exported = false;
+    clone->specialize = false;
+
+    specializer->candidate = candidate;
+    specializer->specialization = specialization;
+    specialize_walk_statements(specializer, clone->body->statements, NULL, specialize_substitute);
+
+    Variable **link = &clone->params;
+    for (int i = 0; i < candidate->num_params; i++)
+    {
+        Variable *param = *link;
+        if (specialization->values[i] == NULL)
+        {
+            link = &param->next;
+            continue;
+        }
+        *link = param->next;
+        param->next = NULL;
+        dispose_variable(param);
+    }
+    // A cache keyed by nothing would hold a single value, the clone is
+    // cheap to recompute only when it still has parameters to key on
+    clone->memo = clone->memo && clone->params != NULL;
+
+    Node *node = new_node(N_FUNCTION, clone);
+    node->line = candidate->node->line;
+    node->col = candidate->node->col;
+    node->next = after->next;
+    after->next = node;
+    return node;
+}
+
+void specialize_rewrite(Specializer *specializer, Call *call)
+{
+    Bucket *bucket = lookup_value(specializer->candidates, call->name);
+    if (bucket == NULL)
+    {
+        return;
+    }
+    SpecializeCandidate *candidate = bucket->value;
+    char *key = candidate->keys != NULL ? specialize_key(candidate, call, NULL) : NULL;
+    if (key == NULL)
+    {
+        return;
+    }
+    Bucket *seen = lookup_value(candidate->keys, key);
+    free(key);
+    // Functions can only call what is defined before them
+    if (seen == NULL || ((Specialization *)seen->value)->name == NULL ||
+        lookup_value(specializer->defined, ((Specialization *)seen->value)->name) == NULL)
+    {
+        return;
+    }
+
+    Specialization *specialization = seen->value;
+    Expression **link = &call->expression;
+    for (int i = 0; i < candidate->num_params; i++)
+    {
+        Expression *arg = *link;
+        if (specialization->values[i] == NULL)
+        {
+            link = &arg->next;
+            continue;
+        }
+        *link = arg->next;
+        arg->next = NULL;
+        dispose_expression(arg);
+    }
+    free(call->name);
+    call->name = strdup(specialization->name);
+}
+
+void dispose_specialize_candidate(SpecializeCandidate *candidate)
+{
+    Specialization *specialization = candidate->specializations;
+    while (specialization != NULL)
+    {
+        Specialization *next = specialization->next;
+        for (int i = 0; i < candidate->num_params; i++)
+        {
+            dispose_node(specialization->values[i]);
+        }
+        free(specialization->values);
+        free(specialization->key);
+        free(specialization->name);
+        free(specialization);
+        specialization = next;
+    }
+    dispose_hash_table(candidate->values, free);
+    if (candidate->keys != NULL)
+    {
+        dispose_hash_table(candidate->keys, NULL);
+    }
+    free(candidate->eligible);
+    free(candidate);
+}
+
+void specialize(Node *ast, bool automatic)
+{
+    Specializer specializer;
+    size_t functions = count_functions(ast);
+    specializer.candidates = new_hash_table(functions > SPECIALIZE_TABLE_SIZE ? functions : SPECIALIZE_TABLE_SIZE);
+    specializer.defined = new_hash_table(functions > SPECIALIZE_TABLE_SIZE ? functions : SPECIALIZE_TABLE_SIZE);
+    specializer.specialization = NULL;
+    specializer.candidate = NULL;
+    specializer.recurring = false;
+
+    for (Node *node = ast; node != NULL; node = node->next)
+    {
+        SpecializeCandidate *candidate = node->node_type == N_FUNCTION ? new_specialize_candidate(node, automatic) : NULL;
+        if (candidate != NULL)
+        {
+            insert_value(specializer.candidates, candidate->function->name, candidate);
+        }
+    }
+
+    // Global initializers are evaluated at compile time and keep calling
+    // the original functions. Bodies without calls have no call site to
+    // count or rewrite.
+    for (Node *node = ast; node != NULL; node = node->next)
+    {
+        if (node->node_type == N_FUNCTION && ((Function *)node->data)->calls)
+        {
+            specialize_walk_statements(&specializer, ((Function *)node->data)->body->statements, specialize_count_values, NULL);
+        }
+    }
+    for (Node *node = ast; node != NULL; node = node->next)
+    {
+        Bucket *bucket = node->node_type == N_FUNCTION ? lookup_value(specializer.candidates, ((Function *)node->data)->name) : NULL;
+        if (bucket == NULL || ((SpecializeCandidate *)bucket->value)->node != node)
+        {
+            continue;
+        }
+        SpecializeCandidate *candidate = bucket->value;
+        if ((candidate->recurring || candidate->function->specialize) && !specialize_worth_cloning(&specializer, candidate))
+        {
+            candidate->recurring = false;
+            memset(candidate->eligible, 0, candidate->num_params * sizeof(bool));
+        }
+        specializer.recurring = specializer.recurring || candidate->recurring || candidate->function->specialize;
+    }
+    // Nothing is cloned when no literal recurs and no function asks for it
+    for (Node *node = ast; node != NULL && specializer.recurring; node = node->next)
+    {
+        if (node->node_type == N_FUNCTION && ((Function *)node->data)->calls)
+        {
+            specialize_walk_statements(&specializer, ((Function *)node->data)->body->statements, specialize_count, NULL);
+        }
+    }
+
+    bool cloned = false;
+    for (Node *node = ast; node != NULL; node = node->next)
+    {
+        Bucket *bucket = node->node_type == N_FUNCTION ? lookup_value(specializer.candidates, ((Function *)node->data)->name) : NULL;
+        if (bucket == NULL || ((SpecializeCandidate *)bucket->value)->node != node)
+        {
+            continue;
+        }
+        SpecializeCandidate *candidate = bucket->value;
+        for (Specialization *specialization = candidate->specializations; specialization != NULL; specialization = specialization->next)
+        {
+            if (candidate->num_clones < SPECIALIZE_MAX_CLONES)
+            {
+                node = clone_specialization(&specializer, candidate, specialization, node);
+                cloned = true;
+            }
+        }
+    }
+
+    if (cloned)
+    {
+        // Fold the branches and loops the constants decide
+        simplify(ast);
+
+        for (Node *node = ast; node != NULL; node = node->next)
+        {
+            if (node->node_type != N_FUNCTION)
+            {
+                continue;
+            }
+            Function *function = node->data;
+            insert_value(specializer.defined, function->name, NULL);
+            if (function->calls)
+            {
+                specialize_walk_statements(&specializer, function->body->statements, specialize_rewrite, NULL);
+            }
+        }
+    }
+
+    dispose_hash_table(specializer.defined, NULL);
+    dispose_hash_table(specializer.candidates, (void (*)(void *))dispose_specialize_candidate);
+}
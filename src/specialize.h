@@ -0,0 +1,72 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#ifndef MSPECIALIZE_H_
+#define MSPECIALIZE_H_
+
+#include <stdbool.h>
+
+#include "hashtable.h"
+#include "node.h"
+
+#define SPECIALIZE_TABLE_SIZE 256
+#define SPECIALIZE_CANDIDATE_TABLE_SIZE 16
+#define SPECIALIZE_VALUE_KEY_SIZE 48
+#define SPECIALIZE_MIN_CALLS 2
+#define SPECIALIZE_MIN_SIZE 8
+#define SPECIALIZE_MAX_SIZE 256
+#define SPECIALIZE_MAX_CLONES 4
+
+// One set of recurring constant arguments seen at the call sites of a
+// function. values holds a literal node per parameter, NULL where the
+// argument varies.
+typedef struct Specialization
+{
+    char *key;
+    Node **values;
+    char *name;
+    struct Specialization *next;
+} Specialization;
+
+typedef struct SpecializeCandidate
+{
+    Function *function;
+    Node *node;
+    int num_params;
+    bool *eligible;
+    int num_clones;
+    bool recurring;
+    Specialization *specializations;
+    HashTable *values;
+    HashTable *keys;
+} SpecializeCandidate;
+
+typedef struct Specializer
+{
+    HashTable *candidates;
+    HashTable *defined;
+    Specialization *specialization;
+    SpecializeCandidate *candidate;
+    bool recurring;
+    int size;
+} Specializer;
+
+// Clones functions for the constant arguments they are called with and
+// redirects those calls to the clones. Without automatic only functions
+// annotated with @specialize are cloned.
+void specialize(Node *ast, bool automatic);
+
+#endif
@@ -26,11 +26,49 @@ Token *new_token(TokenType token_type, char *buf, int len)
     token->token_type = token_type;
     token->buffer = strndup(buf, len);
     token->length = len;
+    token->line = 0;
+    token->col = 0;
     return token;
 }
 
+Token *dup_token(Token *token)
+{
+    if (token == NULL)
+    {
+        return NULL;
+    }
+    Token *dup = new_token(token->token_type, token->buffer, token->length);
+    dup->type = token->type;
+    dup->line = token->line;
+    dup->col = token->col;
+    return dup;
+}
+
+// Comparisons and logical operators produce a bool whatever their operands
+bool is_boolean_operator(TokenType token_type)
+{
+    switch (token_type)
+    {
+    case T_EQ:
+    case T_NEQ:
+    case T_LT:
+    case T_LTE:
+    case T_GT:
+    case T_GTE:
+    case T_LOGICAL_AND:
+    case T_LOGICAL_OR:
+        return true;
+    default:
+        return false;
+    }
+}
+
 void dispose_token(Token *token)
 {
+    if (token == NULL)
+    {
+        return;
+    }
     free(token->buffer);
     free(token);
 }
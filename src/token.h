@@ -132,6 +132,7 @@ typedef enum TokenType
   T_COMMA,     // ,
   T_COLON,     // :
   T_SEMICOLON, // ;
+  T_AT,        // @
 
   // Non-terminal tokens
   T_COMMENT,
@@ -156,9 +157,13 @@ typedef struct Token
   Type type;
   char *buffer;
   int length;
+  int line;
+  int col;
 } Token;
 
 Token *new_token(TokenType type, char *buf, int len);
+Token *dup_token(Token *token);
+bool is_boolean_operator(TokenType token_type);
 void dispose_token(Token *token);
 
 #endif
@@ -0,0 +1,128 @@
+/******************************************************************************
+ * Copyright [2023] [Kadir PEKEL]
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * 	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "type.h"
+
+bool is_integer_type(Type type)
+{
+    switch (type)
+    {
+    case TYPE_INT:
+    case TYPE_I8:
+    case TYPE_I16:
+    case TYPE_I64:
+    case TYPE_U8:
+    case TYPE_U16:
+    case TYPE_U32:
+    case TYPE_U64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_float_type(Type type)
+{
+    return type == TYPE_FLOAT || type == TYPE_F16 || type == TYPE_BF16 || type == TYPE_F64;
+}
+
+// Decides between the signed and unsigned forms of division, remainder,
+// right shifts, comparisons and conversions
+bool is_signed_type(Type type)
+{
+    return type == TYPE_INT || type == TYPE_I8 || type == TYPE_I16 || type == TYPE_I64;
+}
+
+int type_bits(Type type)
+{
+    switch (type)
+    {
+    case TYPE_BOOL:
+        return 1;
+    case TYPE_I8:
+    case TYPE_U8:
+        return 8;
+    case TYPE_I16:
+    case TYPE_U16:
+    case TYPE_F16:
+    case TYPE_BF16:
+        return 16;
+    case TYPE_I64:
+    case TYPE_U64:
+    case TYPE_F64:
+        return 64;
+    default:
+        return 32;
+    }
+}
+
+char *type_name(Type type)
+{
+    switch (type)
+    {
+    case TYPE_BOOL:
+        return "bool";
+    case TYPE_INT:
+        return "int";
+    case TYPE_FLOAT:
+        return "float";
+    case TYPE_I8:
+        return "i8";
+    case TYPE_I16:
+        return "i16";
+    case TYPE_I64:
+        return "i64";
+    case TYPE_U8:
+        return "u8";
+    case TYPE_U16:
+        return "u16";
+    case TYPE_U32:
+        return "u32";
+    case TYPE_U64:
+        return "u64";
+    case TYPE_F16:
+        return "f16";
+    case TYPE_BF16:
+        return "bf16";
+    case TYPE_F64:
+        return "f64";
+    default:
+        return "infer";
+    }
+}
+
+// TYPE_INFER when name is not a builtin type
+Type lookup_type(char *name)
+{
+    if (strcmp(name, "i32") == 0)
+    {
+        return TYPE_INT;
+    }
+    if (strcmp(name, "f32") == 0)
+    {
+        return TYPE_FLOAT;
+    }
+    for (Type type = TYPE_FIRST; type <= TYPE_LAST; type++)
+    {
+        if (strcmp(type_name(type), name) == 0)
+        {
+            return type;
+        }
+    }
+    return TYPE_INFER;
+}
@@ -17,12 +17,35 @@
 #ifndef MTYPE_H_
 #define MTYPE_H_
 
+#include <stdbool.h>
+
+// int and float are the 32 bit types, i32 and f32 are accepted as aliases
 typedef enum Type
 {
     TYPE_INFER,
     TYPE_BOOL,
     TYPE_INT,
-    TYPE_FLOAT
+    TYPE_FLOAT,
+    TYPE_I8,
+    TYPE_I16,
+    TYPE_I64,
+    TYPE_U8,
+    TYPE_U16,
+    TYPE_U32,
+    TYPE_U64,
+    TYPE_F16,
+    TYPE_BF16,
+    TYPE_F64
 } Type;
 
-#endif
\ No newline at end of file
+#define TYPE_FIRST TYPE_BOOL
+#define TYPE_LAST TYPE_F64
+
+bool is_integer_type(Type type);
+bool is_float_type(Type type);
+bool is_signed_type(Type type);
+int type_bits(Type type);
+char *type_name(Type type);
+Type lookup_type(char *name);
+
+#endif